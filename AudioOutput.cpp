@@ -0,0 +1,284 @@
+/**
+ * Plays audio samples on a dedicated thread.
+ *
+ * The QAudioOutput is created on (and owned by) the audio thread and runs in
+ * pull mode: whenever its buffer has room, it reads from the Stream device,
+ * which copies samples straight out of the ring buffer. The emulation thread
+ * never talks to the audio device directly, so a slow frame can't stall the
+ * audio device and a slow audio device can't stall the emulator.
+ *
+ * Nothing gets allocated once the thread is running.
+ *
+ * To keep latency low without running dry, samples are resampled on the way
+ * into the ring. The ratio is proportional to how far the (smoothed) fill
+ * level is from the target and never moves more than MAX_RATE_ADJUST from
+ * 1.0, so clock drift is absorbed without any audible pitch change or pops.
+ */
+#include "AudioOutput.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <QAudioOutput>
+
+/**
+ * Constructor. Starts the audio thread.
+ *
+ * @param sample_rate The sample rate to play at.
+ * @param target_latency How much audio to keep buffered (in ms).
+ */
+AudioOutput::AudioOutput(int sample_rate, uint32_t target_latency) :
+    QThread(),
+    _sample_rate(sample_rate),
+    _format(),
+    _ring(),
+    _target_fill(0),
+    _average_fill(0.0),
+    _resampler(),
+    _resampled(),
+    _rate_adjust(0),
+    _underruns(0),
+    _overruns(0),
+    _stream(_ring, _target_fill, _underruns)
+{
+    const uint32_t target_fill = (sample_rate * target_latency) / 1000;
+    _target_fill = std::max<uint32_t>(
+            1, std::min<uint32_t>(target_fill,
+                                  RING_CAPACITY / (MAX_FILL_FACTOR + 1)));
+    _average_fill = _target_fill;
+
+    _format.setSampleRate(sample_rate);
+    _format.setChannelCount(1);
+    _format.setSampleSize(16);
+    _format.setCodec("audio/pcm");
+    _format.setByteOrder(QAudioFormat::LittleEndian);
+    _format.setSampleType(QAudioFormat::SignedInt);
+
+    start();
+}
+
+/**
+ * Queue up samples to be played.
+ *
+ * @note This should only ever be called from the emulation thread.
+ *
+ * @param samples The samples to play.
+ * @param count Number of samples.
+ *
+ * @return The number of samples queued (after resampling). Anything that
+ *         didn't fit in the ring buffer is dropped (and counted as an overrun).
+ */
+size_t AudioOutput::Write(const int16_t *samples, size_t count)
+{
+    const uint32_t target = _target_fill;
+    const size_t fill = _ring.GetSize();
+
+    /**
+     * Way too much audio is queued up; drop this block rather than let the
+     * latency grow.
+     */
+    if(fill > target * MAX_FILL_FACTOR)
+    {
+        _overruns += static_cast<uint32_t>(count);
+        return 0;
+    }
+
+    /**
+     * Speed up or slow down slightly depending on how far the buffer is from
+     * its target fill level.
+     */
+    _average_fill += (fill - _average_fill) / 16.0;
+
+    const double error = std::max(-1.0, std::min(
+            (_average_fill - target) / target, 1.0));
+    const double ratio = 1.0 - (error * MAX_RATE_ADJUST);
+
+    _resampler.SetRatio(ratio);
+    _rate_adjust = static_cast<int32_t>(std::lround((ratio - 1.0) * 1000000));
+
+    size_t total = 0;
+
+    for(size_t first = 0; first < count; first += RESAMPLE_CHUNK)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(count - first,
+                                                            RESAMPLE_CHUNK));
+        const int resampled = _resampler.Process(samples + first,
+                                                 chunk,
+                                                 _resampled,
+                                                 RESAMPLE_CHUNK * 2);
+
+        const size_t written = _ring.Push(_resampled, resampled);
+
+        if(written < static_cast<size_t>(resampled))
+            _overruns += static_cast<uint32_t>(resampled - written);
+
+        total += written;
+    }
+
+    return total;
+}
+
+/**
+ * Get the sample rate being played at.
+ *
+ * @return The sample rate in Hz.
+ */
+int AudioOutput::GetSampleRate() const
+{
+    return _sample_rate;
+}
+
+/**
+ * Get the amount of audio being kept buffered.
+ *
+ * @return The target latency in milliseconds.
+ */
+uint32_t AudioOutput::GetTargetLatency() const
+{
+    return (_target_fill * 1000) / _sample_rate;
+}
+
+/**
+ * Get how much the sample rate is currently being adjusted to hold the buffer
+ * at the target latency.
+ *
+ * @return The adjustment in parts per million (positive when more samples are
+ *         being generated to fill the buffer back up).
+ */
+int32_t AudioOutput::GetRateAdjust() const
+{
+    return _rate_adjust;
+}
+
+/**
+ * Get how much audio is queued up waiting to be played.
+ *
+ * @return The number of samples in the ring buffer.
+ */
+uint32_t AudioOutput::GetBufferFill() const
+{
+    return static_cast<uint32_t>(_ring.GetSize());
+}
+
+/**
+ * Get the number of times the audio device ran out of samples to play.
+ *
+ * @return The number of underruns.
+ */
+uint32_t AudioOutput::GetUnderruns() const
+{
+    return _underruns;
+}
+
+/**
+ * Get the number of samples that were dropped because the ring buffer was full.
+ *
+ * @return The number of dropped samples.
+ */
+uint32_t AudioOutput::GetOverruns() const
+{
+    return _overruns;
+}
+
+/**
+ * Main loop of the audio thread.
+ */
+void AudioOutput::run()
+{
+    QAudioOutput output(_format);
+
+    const int bytes_per_ms = (_sample_rate * sizeof(int16_t)) / 1000;
+    output.setBufferSize(bytes_per_ms * DEVICE_BUFFER_MS);
+
+    _stream.open(QIODevice::ReadOnly);
+    output.start(&_stream);
+
+    exec();
+
+    output.stop();
+    _stream.close();
+}
+
+/**
+ * Destructor. Stops the audio thread.
+ */
+AudioOutput::~AudioOutput()
+{
+    quit();
+    wait();
+}
+
+/**
+ * Constructor.
+ *
+ * @param ring Where samples get pulled from.
+ * @param target_fill How full the ring should be before playback resumes
+ *                    after running dry.
+ * @param underruns Incremented every time the ring runs dry.
+ */
+AudioOutput::Stream::Stream(SampleRing &ring,
+                            const std::atomic<uint32_t> &target_fill,
+                            std::atomic<uint32_t> &underruns) :
+    QIODevice(),
+    _ring(ring),
+    _target_fill(target_fill),
+    _underruns(underruns),
+    _starved(true)
+{ }
+
+/**
+ * The stream can't be seeked.
+ *
+ * @return Always returns true.
+ */
+bool AudioOutput::Stream::isSequential() const
+{
+    return true;
+}
+
+/**
+ * Called by the audio device whenever it needs more samples.
+ *
+ * The full request is always satisfied: if the ring doesn't have enough
+ * samples, the rest is filled with silence so the device keeps running. Once
+ * the ring has run dry, playback waits for it to be refilled to the target
+ * level so that it doesn't immediately run dry again.
+ *
+ * @param data Where to copy the samples.
+ * @param max_len The number of bytes requested.
+ *
+ * @return The number of bytes copied.
+ */
+qint64 AudioOutput::Stream::readData(char *data, qint64 max_len)
+{
+    const size_t wanted = static_cast<size_t>(max_len) / sizeof(int16_t);
+    int16_t *samples = reinterpret_cast<int16_t*>(data);
+
+    if(_starved && _ring.GetSize() >= _target_fill)
+        _starved = false;
+
+    const size_t count = (_starved) ? 0 : _ring.Pop(samples, wanted);
+
+    if(count < wanted)
+    {
+        std::memset(samples + count, 0, (wanted - count) * sizeof(int16_t));
+
+        if(!_starved)
+            _underruns++;
+
+        _starved = true;
+    }
+
+    return static_cast<qint64>(wanted * sizeof(int16_t));
+}
+
+/**
+ * The stream is read-only.
+ *
+ * @return Always returns -1.
+ */
+qint64 AudioOutput::Stream::writeData(const char*, qint64)
+{
+    return -1;
+}
@@ -0,0 +1,193 @@
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include "Resampler.h"
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include <QAudioFormat>
+#include <QIODevice>
+#include <QThread>
+
+/**
+ * Plays 16-bit mono samples on a dedicated audio thread.
+ *
+ * The emulation thread pushes samples into a lock-free ring buffer with
+ * Write(), and the audio device pulls them out on its own thread whenever it
+ * needs more. If the ring runs dry, silence is played instead and an underrun
+ * is counted.
+ *
+ * The emulated CPU clock and the host's audio clock never run at exactly the
+ * same speed, so the samples are resampled on their way into the ring. The
+ * ratio is nudged (by at most MAX_RATE_ADJUST) to hold the ring at the target
+ * latency.
+ */
+class AudioOutput : public QThread
+{
+public:
+    /**
+     * The highest sample rate and target latency (in ms) that can be asked
+     * for. The ring buffer is sized to hold this much audio.
+     */
+    static constexpr int MAX_SAMPLE_RATE = 96000;
+    static constexpr uint32_t MAX_TARGET_LATENCY = 150;
+
+public:
+    AudioOutput(int sample_rate, uint32_t target_latency);
+
+    AudioOutput(const AudioOutput &copy) = delete;
+    AudioOutput& operator=(const AudioOutput &rhs) = delete;
+
+    size_t Write(const int16_t *samples, size_t count);
+
+    int GetSampleRate() const;
+    uint32_t GetTargetLatency() const;
+    int32_t GetRateAdjust() const;
+    uint32_t GetBufferFill() const;
+    uint32_t GetUnderruns() const;
+    uint32_t GetOverruns() const;
+
+    ~AudioOutput();
+
+private:
+    void run() override;
+
+private:
+    /**
+     * Number of samples the ring buffer between the emulation thread and the
+     * audio thread can hold. The target fill is kept under a quarter of this
+     * (see MAX_FILL_FACTOR), which leaves room for the largest target.
+     */
+    static constexpr size_t RING_CAPACITY = 65536;
+
+    /**
+     * Size of the audio device's own buffer (in ms). The device pulls from the
+     * ring buffer whenever there's room in this buffer.
+     */
+    static constexpr int DEVICE_BUFFER_MS = 20;
+
+    /**
+     * Maximum amount the resampling ratio is adjusted by to correct the buffer
+     * fill level (0.5%, which isn't audible as a change in pitch).
+     */
+    static constexpr double MAX_RATE_ADJUST = 0.005;
+
+    /**
+     * If the buffer gets this many times fuller than the target, samples are
+     * dropped instead of waiting for the resampler to catch up (this happens
+     * if the emulator runs in bursts, e.g., after a hitch).
+     */
+    static constexpr uint32_t MAX_FILL_FACTOR = 3;
+
+    static_assert((MAX_SAMPLE_RATE / 1000) * MAX_TARGET_LATENCY <=
+                  RING_CAPACITY / (MAX_FILL_FACTOR + 1),
+                  "RING_CAPACITY can't hold the largest target latency");
+
+    /**
+     * Number of input samples resampled at a time.
+     */
+    static constexpr int RESAMPLE_CHUNK = 512;
+
+    /**
+     * Samples waiting to be played.
+     */
+    typedef RingBuffer<int16_t, RING_CAPACITY> SampleRing;
+
+    /**
+     * The I/O device that the audio device pulls samples from. This is only
+     * ever read from the audio thread.
+     */
+    class Stream : public QIODevice
+    {
+    public:
+        Stream(SampleRing &ring,
+               const std::atomic<uint32_t> &target_fill,
+               std::atomic<uint32_t> &underruns);
+
+        bool isSequential() const override;
+
+    protected:
+        qint64 readData(char *data, qint64 max_len) override;
+        qint64 writeData(const char *data, qint64 len) override;
+
+    private:
+        /**
+         * Where samples get pulled from.
+         */
+        SampleRing &_ring;
+
+        /**
+         * After the ring runs dry, playback only resumes once the ring has
+         * been refilled to this many samples.
+         */
+        const std::atomic<uint32_t> &_target_fill;
+
+        /**
+         * Incremented every time the ring runs dry.
+         */
+        std::atomic<uint32_t> &_underruns;
+
+        /**
+         * True if the ring ran dry and is being refilled. Only the first short
+         * read in a row counts as an underrun.
+         */
+        bool _starved;
+    };
+
+    /**
+     * The sample rate being played at.
+     */
+    int _sample_rate;
+
+    /**
+     * Format of the samples (16-bit signed mono).
+     */
+    QAudioFormat _format;
+
+    /**
+     * Samples pushed by the emulation thread, waiting to be played.
+     */
+    SampleRing _ring;
+
+    /**
+     * The number of samples the ring should hold (the target latency).
+     */
+    std::atomic<uint32_t> _target_fill;
+
+    /**
+     * Smoothed ring fill level used to adjust the resampling ratio (only
+     * touched by the emulation thread).
+     */
+    double _average_fill;
+
+    /**
+     * Adjusts the sample rate to hold the ring at the target fill level, and
+     * the buffer it writes into (only touched by the emulation thread).
+     */
+    Resampler _resampler;
+    int16_t _resampled[RESAMPLE_CHUNK * 2];
+
+    /**
+     * The current resampling adjustment in parts per million.
+     */
+    std::atomic<int32_t> _rate_adjust;
+
+    /**
+     * Number of times the ring buffer ran out of samples.
+     */
+    std::atomic<uint32_t> _underruns;
+
+    /**
+     * Number of samples dropped because the ring buffer was full.
+     */
+    std::atomic<uint32_t> _overruns;
+
+    /**
+     * Device that the audio output pulls from.
+     */
+    Stream _stream;
+};
+
+#endif // AUDIOOUTPUT_H
@@ -0,0 +1,466 @@
+/**
+ * Emulates the AY-3-8910 sound chip.
+ *
+ * Each tone channel flips its output every 8 * period clocks, the noise
+ * generator shifts a 17-bit LFSR every 16 * period clocks and the envelope
+ * steps through its 16 volume levels every 16 * period clocks. A channel's
+ * output is high while both its tone and noise are high (or disabled in the
+ * mixer), and a high output plays at the channel's volume.
+ *
+ * The chip is never stepped one clock at a time. RunUntil() jumps straight to
+ * the next cycle where an audible generator changes, recomputes the summed
+ * output level, and adds the change to a BlipBuffer as a band-limited step.
+ * Generators that can't be heard are advanced arithmetically so that they
+ * stay in phase.
+ */
+#include "Ay38910.h"
+
+#include <algorithm>
+
+/**
+ * Bits that are actually implemented in each register (unimplemented bits
+ * read back as zero).
+ */
+const uint8_t Ay38910::REGISTER_MASKS[Ay38910::NUM_REGISTERS] = {
+    0xFF, 0x0F, 0xFF, 0x0F, 0xFF, 0x0F, 0x1F, 0xFF,
+    0x1F, 0x1F, 0x1F, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF
+};
+
+/**
+ * Amplitude of one channel at each volume setting (measured from a real chip
+ * and scaled so that all six channels of a Mockingboard fit in 16 bits).
+ */
+const int Ay38910::VOLUME_LEVELS[16] = {
+    0, 30, 45, 64, 93, 136, 186, 301, 372, 582, 776, 990, 1255, 1512, 1866, 2200
+};
+
+/**
+ * Constructor.
+ */
+Ay38910::Ay38910() :
+    _regs(),
+    _address(0),
+    _tone_remaining(),
+    _tone_output(),
+    _noise_remaining(0),
+    _noise_shift(1),
+    _env_remaining(0),
+    _env_counter(0),
+    _env_invert(0),
+    _env_holding(true),
+    _time(0),
+    _level(0)
+{
+    Reset();
+}
+
+/**
+ * Reset every register to zero (which is what happens when the chip's /RESET
+ * line is pulled low). This doesn't affect any sound already synthesized.
+ */
+void Ay38910::Reset()
+{
+    std::fill(_regs, _regs + NUM_REGISTERS, 0);
+    _address = 0;
+
+    for(int i = 0; i < NUM_CHANNELS; ++i)
+    {
+        _tone_remaining[i] = get_tone_period(i);
+        _tone_output[i] = false;
+    }
+
+    _noise_remaining = get_noise_period();
+    _noise_shift = 1;
+
+    restart_envelope();
+}
+
+/**
+ * Forget about any synthesized sound. This should be called whenever the
+ * BlipBuffer being synthesized into is cleared.
+ */
+void Ay38910::ClearAudio()
+{
+    _time = 0;
+    _level = 0;
+}
+
+/**
+ * Select the register that the next read or write accesses.
+ *
+ * @param addr The register number. Anything above 15 deselects the chip.
+ */
+void Ay38910::LatchAddress(uint8_t addr)
+{
+    _address = addr;
+}
+
+/**
+ * Write the currently selected register.
+ *
+ * @note The chip should be run up to the time of the write beforehand, so that
+ *       the change takes effect at the right cycle.
+ *
+ * @param data The value to write.
+ */
+void Ay38910::Write(uint8_t data)
+{
+    if(_address >= NUM_REGISTERS)
+        return;
+
+    _regs[_address] = data & REGISTER_MASKS[_address];
+
+    /**
+     * A shorter period takes effect right away instead of waiting for the
+     * longer one to run out.
+     */
+    switch(_address)
+    {
+    case REG_TONE_A_FINE:
+    case REG_TONE_A_COARSE:
+    case REG_TONE_B_FINE:
+    case REG_TONE_B_COARSE:
+    case REG_TONE_C_FINE:
+    case REG_TONE_C_COARSE:
+    {
+        const int channel = _address / 2;
+        _tone_remaining[channel] = std::min(_tone_remaining[channel],
+                                            get_tone_period(channel));
+        break;
+    }
+
+    case REG_NOISE_PERIOD:
+        _noise_remaining = std::min(_noise_remaining, get_noise_period());
+        break;
+
+    case REG_ENV_FINE:
+    case REG_ENV_COARSE:
+        _env_remaining = std::min(_env_remaining, get_envelope_period());
+        break;
+
+    case REG_ENV_SHAPE:
+        restart_envelope();
+        break;
+    }
+}
+
+/**
+ * Read the currently selected register.
+ *
+ * @return The register's value (0xFF if no register is selected, since
+ *         nothing is driving the bus).
+ */
+uint8_t Ay38910::Read() const
+{
+    if(_address >= NUM_REGISTERS)
+        return 0xFF;
+
+    return _regs[_address];
+}
+
+/**
+ * Synthesize the output up to the given time.
+ *
+ * @param time Frame-relative clock cycle to synthesize up to.
+ * @param blip Where the output is synthesized into.
+ */
+void Ay38910::RunUntil(uint32_t time, BlipBuffer &blip)
+{
+    /**
+     * Pick up any change caused by a register write.
+     */
+    update_level(blip);
+
+    while(_time < time)
+    {
+        /**
+         * Jump to the next cycle where something audible changes.
+         */
+        uint32_t step = time - _time;
+        bool noise_audible = false;
+        bool env_audible = false;
+
+        for(int i = 0; i < NUM_CHANNELS; ++i)
+        {
+            if(!is_channel_audible(i))
+                continue;
+
+            if(!(_regs[REG_MIXER] & (MIXER_TONE_OFF << i)))
+                step = std::min(step, _tone_remaining[i]);
+
+            if(!(_regs[REG_MIXER] & (MIXER_NOISE_OFF << i)))
+                noise_audible = true;
+
+            if(_regs[REG_AMPLITUDE_A + i] & AMPLITUDE_USE_ENVELOPE)
+                env_audible = true;
+        }
+
+        if(noise_audible)
+            step = std::min(step, _noise_remaining);
+
+        if(env_audible && !_env_holding)
+            step = std::min(step, _env_remaining);
+
+        advance(step);
+        _time += step;
+
+        update_level(blip);
+    }
+}
+
+/**
+ * Synthesize the rest of the frame and start a new one.
+ *
+ * @param num_cycles Length of the frame in clock cycles.
+ * @param blip Where the output is synthesized into.
+ */
+void Ay38910::EndFrame(uint32_t num_cycles, BlipBuffer &blip)
+{
+    RunUntil(num_cycles, blip);
+    _time = 0;
+}
+
+/**
+ * Get the number of cycles between each flip of a tone channel's output.
+ *
+ * @param channel The tone channel (0 to 2).
+ *
+ * @return Half of the tone's period in clock cycles.
+ */
+uint32_t Ay38910::get_tone_period(int channel) const
+{
+    const uint32_t period = _regs[REG_TONE_A_FINE + (channel * 2)] |
+                            (_regs[REG_TONE_A_COARSE + (channel * 2)] << 8);
+
+    return std::max<uint32_t>(period, 1) * 8;
+}
+
+/**
+ * Get the number of cycles between each shift of the noise generator.
+ *
+ * @return The noise period in clock cycles.
+ */
+uint32_t Ay38910::get_noise_period() const
+{
+    return std::max<uint32_t>(_regs[REG_NOISE_PERIOD], 1) * 16;
+}
+
+/**
+ * Get the number of cycles between each step of the envelope.
+ *
+ * @return The envelope step period in clock cycles.
+ */
+uint32_t Ay38910::get_envelope_period() const
+{
+    const uint32_t period = _regs[REG_ENV_FINE] | (_regs[REG_ENV_COARSE] << 8);
+
+    return std::max<uint32_t>(period, 1) * 16;
+}
+
+/**
+ * Check whether a channel can currently be heard at all.
+ *
+ * @param channel The channel (0 to 2).
+ *
+ * @return True if the channel has a non-zero volume (or follows the envelope).
+ */
+bool Ay38910::is_channel_audible(int channel) const
+{
+    return _regs[REG_AMPLITUDE_A + channel] != 0;
+}
+
+/**
+ * Advance every generator by a number of cycles.
+ *
+ * @param cycles The number of cycles to advance by.
+ */
+void Ay38910::advance(uint32_t cycles)
+{
+    for(int i = 0; i < NUM_CHANNELS; ++i)
+    {
+        if(cycles < _tone_remaining[i])
+        {
+            _tone_remaining[i] -= cycles;
+        }
+        else
+        {
+            const uint32_t period = get_tone_period(i);
+            const uint32_t past = cycles - _tone_remaining[i];
+
+            if(((past / period) & 1) == 0)
+                _tone_output[i] = !_tone_output[i];
+
+            _tone_remaining[i] = period - (past % period);
+        }
+    }
+
+    if(cycles < _noise_remaining)
+    {
+        _noise_remaining -= cycles;
+    }
+    else
+    {
+        const uint32_t period = get_noise_period();
+        const uint32_t past = cycles - _noise_remaining;
+
+        for(uint32_t i = (past / period) + 1; i > 0; --i)
+        {
+            const uint32_t bit = (_noise_shift ^ (_noise_shift >> 3)) & 1;
+            _noise_shift = (_noise_shift >> 1) | (bit << 16);
+        }
+
+        _noise_remaining = period - (past % period);
+    }
+
+    if(_env_holding)
+        return;
+
+    if(cycles < _env_remaining)
+    {
+        _env_remaining -= cycles;
+    }
+    else
+    {
+        const uint32_t period = get_envelope_period();
+        const uint32_t past = cycles - _env_remaining;
+
+        for(uint32_t i = (past / period) + 1; i > 0 && !_env_holding; --i)
+            step_envelope();
+
+        _env_remaining = period - (past % period);
+    }
+}
+
+/**
+ * Move the envelope on to its next step, handling the end of each ramp
+ * according to the envelope shape.
+ */
+void Ay38910::step_envelope()
+{
+    if(_env_counter > 0)
+    {
+        _env_counter--;
+        return;
+    }
+
+    const uint8_t shape = _regs[REG_ENV_SHAPE];
+
+    if(!(shape & ENV_CONTINUE))
+    {
+        /**
+         * Every non-continuing shape ends at zero.
+         */
+        _env_invert = 0;
+        _env_holding = true;
+    }
+    else if(shape & ENV_HOLD)
+    {
+        if(shape & ENV_ALTERNATE)
+            _env_invert ^= 0xF;
+
+        _env_holding = true;
+    }
+    else
+    {
+        if(shape & ENV_ALTERNATE)
+            _env_invert ^= 0xF;
+
+        _env_counter = 15;
+    }
+}
+
+/**
+ * Start the envelope from the beginning of its shape.
+ */
+void Ay38910::restart_envelope()
+{
+    _env_remaining = get_envelope_period();
+    _env_counter = 15;
+    _env_invert = (_regs[REG_ENV_SHAPE] & ENV_ATTACK) ? 0xF : 0;
+    _env_holding = false;
+}
+
+/**
+ * Recompute the summed output of the three channels, and add any change to the
+ * BlipBuffer at the current time.
+ *
+ * @param blip Where the output is synthesized into.
+ */
+void Ay38910::update_level(BlipBuffer &blip)
+{
+    const uint8_t mixer = _regs[REG_MIXER];
+    const bool noise = (_noise_shift & 1) != 0;
+    const int env_volume = _env_counter ^ _env_invert;
+
+    int level = 0;
+
+    for(int i = 0; i < NUM_CHANNELS; ++i)
+    {
+        const bool tone_high = _tone_output[i] || (mixer & (MIXER_TONE_OFF << i));
+        const bool noise_high = noise || (mixer & (MIXER_NOISE_OFF << i));
+
+        if(tone_high && noise_high)
+        {
+            const uint8_t amplitude = _regs[REG_AMPLITUDE_A + i];
+            const int volume = (amplitude & AMPLITUDE_USE_ENVELOPE) ?
+                               env_volume : (amplitude & 0xF);
+
+            level += VOLUME_LEVELS[volume];
+        }
+    }
+
+    if(level != _level)
+    {
+        blip.AddDelta(_time, level - _level);
+        _level = level;
+    }
+}
+
+/**
+ * Save the chip state.
+ *
+ * @param output Where to write the state.
+ */
+void Ay38910::SaveState(StateWriter &output)
+{
+    output.Write(_regs, sizeof(_regs));
+    output.Write(&_address, sizeof(_address));
+    output.Write(_tone_remaining, sizeof(_tone_remaining));
+    output.Write(_tone_output, sizeof(_tone_output));
+    output.Write(&_noise_remaining, sizeof(_noise_remaining));
+    output.Write(&_noise_shift, sizeof(_noise_shift));
+    output.Write(&_env_remaining, sizeof(_env_remaining));
+    output.Write(&_env_counter, sizeof(_env_counter));
+    output.Write(&_env_invert, sizeof(_env_invert));
+    output.Write(&_env_holding, sizeof(_env_holding));
+}
+
+/**
+ * Load the chip state.
+ *
+ * @param input Where to read the state from.
+ */
+void Ay38910::LoadState(StateReader &input)
+{
+    input.Read(_regs, sizeof(_regs));
+    input.Read(&_address, sizeof(_address));
+    input.Read(_tone_remaining, sizeof(_tone_remaining));
+    input.Read(_tone_output, sizeof(_tone_output));
+    input.Read(&_noise_remaining, sizeof(_noise_remaining));
+    input.Read(&_noise_shift, sizeof(_noise_shift));
+    input.Read(&_env_remaining, sizeof(_env_remaining));
+    input.Read(&_env_counter, sizeof(_env_counter));
+    input.Read(&_env_invert, sizeof(_env_invert));
+    input.Read(&_env_holding, sizeof(_env_holding));
+
+    /**
+     * Keep a damaged state from indexing past the volume table: registers only
+     * hold the bits the chip implements, and the envelope steps through 16
+     * levels.
+     */
+    for(int i = 0; i < NUM_REGISTERS; ++i)
+        _regs[i] &= REGISTER_MASKS[i];
+
+    _env_counter &= 0xF;
+    _env_invert &= 0xF;
+}
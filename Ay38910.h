@@ -0,0 +1,149 @@
+#ifndef AY38910_H
+#define AY38910_H
+
+#include "BlipBuffer.h"
+#include "IState.h"
+
+#include <cstdint>
+
+/**
+ * General Instrument AY-3-8910 Programmable Sound Generator.
+ *
+ * Three square wave tone channels, a noise generator and an envelope
+ * generator. The output is synthesized into a BlipBuffer by only visiting the
+ * cycles where one of the audible generators changes state, so the cost is
+ * proportional to the number of edges and not the number of cycles or samples.
+ */
+class Ay38910 : public IState
+{
+public:
+    /**
+     * Register numbers.
+     */
+    enum Register {
+        REG_TONE_A_FINE = 0,
+        REG_TONE_A_COARSE = 1,
+        REG_TONE_B_FINE = 2,
+        REG_TONE_B_COARSE = 3,
+        REG_TONE_C_FINE = 4,
+        REG_TONE_C_COARSE = 5,
+        REG_NOISE_PERIOD = 6,
+        REG_MIXER = 7,
+        REG_AMPLITUDE_A = 8,
+        REG_AMPLITUDE_B = 9,
+        REG_AMPLITUDE_C = 10,
+        REG_ENV_FINE = 11,
+        REG_ENV_COARSE = 12,
+        REG_ENV_SHAPE = 13,
+        REG_PORT_A = 14,
+        REG_PORT_B = 15,
+        NUM_REGISTERS = 16
+    };
+
+public:
+    Ay38910();
+
+    void Reset();
+    void ClearAudio();
+
+    void LatchAddress(uint8_t addr);
+    void Write(uint8_t data);
+    uint8_t Read() const;
+
+    void RunUntil(uint32_t time, BlipBuffer &blip);
+    void EndFrame(uint32_t num_cycles, BlipBuffer &blip);
+
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
+
+private:
+    uint32_t get_tone_period(int channel) const;
+    uint32_t get_noise_period() const;
+    uint32_t get_envelope_period() const;
+
+    bool is_channel_audible(int channel) const;
+
+    void advance(uint32_t cycles);
+    void step_envelope();
+    void restart_envelope();
+
+    void update_level(BlipBuffer &blip);
+
+private:
+    /**
+     * Number of tone channels.
+     */
+    static constexpr int NUM_CHANNELS = 3;
+
+    /**
+     * Mixer bits that disable the tone and noise of channel A (shifted left by
+     * the channel number for the other channels).
+     */
+    static constexpr uint8_t MIXER_TONE_OFF = 0x01;
+    static constexpr uint8_t MIXER_NOISE_OFF = 0x08;
+
+    /**
+     * Amplitude register bit that makes the channel follow the envelope.
+     */
+    static constexpr uint8_t AMPLITUDE_USE_ENVELOPE = 0x10;
+
+    /**
+     * Envelope shape bits.
+     */
+    static constexpr uint8_t ENV_HOLD = 0x1;
+    static constexpr uint8_t ENV_ALTERNATE = 0x2;
+    static constexpr uint8_t ENV_ATTACK = 0x4;
+    static constexpr uint8_t ENV_CONTINUE = 0x8;
+
+    /**
+     * Bits that are actually implemented in each register.
+     */
+    static const uint8_t REGISTER_MASKS[NUM_REGISTERS];
+
+    /**
+     * Output amplitude of one channel at each of the 16 volume levels. The
+     * steps are roughly logarithmic, as on the real chip.
+     */
+    static const int VOLUME_LEVELS[16];
+
+    /**
+     * The register file, and the register selected by the last address latch.
+     */
+    uint8_t _regs[NUM_REGISTERS];
+    uint8_t _address;
+
+    /**
+     * Cycles until each tone channel flips, and each channel's current output.
+     */
+    uint32_t _tone_remaining[NUM_CHANNELS];
+    bool _tone_output[NUM_CHANNELS];
+
+    /**
+     * Cycles until the noise shift register next shifts, and the 17-bit shift
+     * register itself (bit 0 is the output).
+     */
+    uint32_t _noise_remaining;
+    uint32_t _noise_shift;
+
+    /**
+     * Cycles until the envelope steps, the step counter (counts down from 15),
+     * the value XORed with the counter to produce the envelope's volume, and
+     * whether the envelope has stopped.
+     */
+    uint32_t _env_remaining;
+    uint8_t _env_counter;
+    uint8_t _env_invert;
+    bool _env_holding;
+
+    /**
+     * The frame-relative cycle the output has been synthesized up to.
+     */
+    uint32_t _time;
+
+    /**
+     * The output level last added to the BlipBuffer.
+     */
+    int _level;
+};
+
+#endif // AY38910_H
@@ -0,0 +1,201 @@
+/**
+ * Band-limited step synthesis.
+ *
+ * A square wave is just a series of steps. Rather than point-sampling the
+ * wave (which aliases every edge that doesn't land exactly on a sample), each
+ * step is added as a short windowed-sinc impulse at its exact sub-sample
+ * position. At read time the impulses are integrated back into steps and run
+ * through a DC blocking filter, which centers the waveform around zero and
+ * lets it settle back to silence when the speaker stops moving.
+ */
+#include "BlipBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+constexpr int BlipBuffer::MAX_SAMPLES;
+
+/**
+ * Constructor. Precomputes the impulse kernel.
+ */
+BlipBuffer::BlipBuffer() :
+    _kernel(),
+    _factor(0),
+    _offset(0),
+    _buffer(),
+    _integrator(0.0f),
+    _dc_prev_input(0.0f),
+    _dc_prev_output(0.0f),
+    _dc_coefficient(0.0f)
+{
+    const double pi = std::acos(-1.0);
+
+    /**
+     * Cut off slightly below the Nyquist frequency so the window's transition
+     * band doesn't fold back.
+     */
+    constexpr double cutoff = 0.45;
+    constexpr double half_width = KERNEL_WIDTH / 2;
+
+    for(int phase = 0; phase < NUM_PHASES; ++phase)
+    {
+        const double frac = static_cast<double>(phase) / NUM_PHASES;
+        double sum = 0.0;
+        double taps[KERNEL_WIDTH];
+
+        for(int i = 0; i < KERNEL_WIDTH; ++i)
+        {
+            /**
+             * Distance (in samples) between this tap and the step, given the
+             * output is delayed by half the kernel width.
+             */
+            const double x = i - half_width - frac + 1.0;
+            const double arg = 2.0 * cutoff * x;
+            const double sinc = (x == 0.0) ? 1.0 : std::sin(pi * arg) / (pi * arg);
+            const double window = 0.42 +
+                                  (0.5 * std::cos(pi * x / half_width)) +
+                                  (0.08 * std::cos(2.0 * pi * x / half_width));
+
+            taps[i] = (std::fabs(x) < half_width) ? sinc * window : 0.0;
+            sum += taps[i];
+        }
+
+        for(int i = 0; i < KERNEL_WIDTH; ++i)
+            _kernel[phase][i] = static_cast<float>(taps[i] / sum);
+    }
+}
+
+/**
+ * Set the rate of the clock that deltas are timed with and the rate samples
+ * are generated at.
+ *
+ * @param clock_rate Clock cycles per second.
+ * @param sample_rate Output samples per second.
+ */
+void BlipBuffer::SetRates(double clock_rate, int sample_rate)
+{
+    const double pi = std::acos(-1.0);
+
+    _factor = static_cast<uint64_t>(std::llround(
+            (sample_rate / clock_rate) * std::ldexp(1.0, FRAC_BITS)));
+
+    _dc_coefficient = static_cast<float>(
+            std::exp(-2.0 * pi * DC_CUTOFF / sample_rate));
+}
+
+/**
+ * Get the longest frame that can be generated before samples have to be read
+ * out.
+ *
+ * @return The maximum frame duration in clock cycles.
+ */
+uint32_t BlipBuffer::GetMaxFrameCycles() const
+{
+    const uint64_t max_time = static_cast<uint64_t>(MAX_SAMPLES) << FRAC_BITS;
+    return static_cast<uint32_t>(std::min<uint64_t>(max_time / _factor,
+                                                    UINT32_MAX));
+}
+
+/**
+ * Throw away any generated sound and return to silence.
+ */
+void BlipBuffer::Clear()
+{
+    _offset = 0;
+    _integrator = 0.0f;
+    _dc_prev_input = 0.0f;
+    _dc_prev_output = 0.0f;
+
+    std::memset(_buffer, 0, sizeof(_buffer));
+}
+
+/**
+ * Add a change in amplitude.
+ *
+ * @param clock_time When the change happens, in clock cycles relative to the
+ *                   start of the current frame.
+ * @param delta The change in amplitude.
+ */
+void BlipBuffer::AddDelta(uint32_t clock_time, int delta)
+{
+    const uint64_t time = _offset + (clock_time * _factor);
+    const int pos = std::min(static_cast<int>(time >> FRAC_BITS), MAX_SAMPLES);
+    const int phase = static_cast<int>(time >> (FRAC_BITS - PHASE_BITS)) &
+                      (NUM_PHASES - 1);
+
+    const float *kernel = _kernel[phase];
+    float *out = _buffer + pos;
+    const float amount = static_cast<float>(delta);
+
+    for(int i = 0; i < KERNEL_WIDTH; ++i)
+        out[i] += kernel[i] * amount;
+}
+
+/**
+ * Finish the current frame. The samples it covers become available to read.
+ *
+ * @param clock_duration Length of the frame in clock cycles (no more than
+ *                       GetMaxFrameCycles() minus whatever is still unread).
+ */
+void BlipBuffer::EndFrame(uint32_t clock_duration)
+{
+    _offset += clock_duration * _factor;
+}
+
+/**
+ * Get the number of samples that can be read.
+ *
+ * @return The number of samples available.
+ */
+int BlipBuffer::GetSamplesAvailable() const
+{
+    return std::min(static_cast<int>(_offset >> FRAC_BITS), MAX_SAMPLES);
+}
+
+/**
+ * Read out finished samples.
+ *
+ * @param samples Where to write the samples.
+ * @param count Maximum number of samples to read.
+ *
+ * @return The number of samples actually read.
+ */
+int BlipBuffer::ReadSamples(int16_t *samples, int count)
+{
+    count = std::min(count, GetSamplesAvailable());
+
+    float integrator = _integrator;
+    float prev_input = _dc_prev_input;
+    float prev_output = _dc_prev_output;
+    const float coefficient = _dc_coefficient;
+
+    for(int i = 0; i < count; ++i)
+    {
+        integrator += _buffer[i];
+
+        const float output = integrator - prev_input +
+                             (coefficient * prev_output);
+        prev_input = integrator;
+        prev_output = output;
+
+        const float clamped = std::max(-32768.0f, std::min(output, 32767.0f));
+        samples[i] = static_cast<int16_t>(std::lrint(clamped));
+    }
+
+    _integrator = integrator;
+    _dc_prev_input = prev_input;
+    _dc_prev_output = prev_output;
+
+    /**
+     * Shift whatever hasn't been read (including the tails of the impulses)
+     * down to the start of the buffer.
+     */
+    const int remaining = GetSamplesAvailable() - count + KERNEL_WIDTH;
+    std::memmove(_buffer, _buffer + count, remaining * sizeof(float));
+    std::memset(_buffer + remaining, 0, count * sizeof(float));
+
+    _offset -= static_cast<uint64_t>(count) << FRAC_BITS;
+
+    return count;
+}
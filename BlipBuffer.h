@@ -0,0 +1,102 @@
+#ifndef BLIPBUFFER_H
+#define BLIPBUFFER_H
+
+#include <cstdint>
+
+/**
+ * Band-limited sound synthesis buffer.
+ *
+ * Instead of sampling a waveform once per output sample, changes in the
+ * waveform's amplitude ("deltas") are added at the exact clock cycle they
+ * happen at. Each delta is inserted as a band-limited step, so the square edges
+ * produced by the speaker don't alias. The cost of adding sound is proportional
+ * to the number of deltas, not the number of samples.
+ */
+class BlipBuffer
+{
+public:
+    /**
+     * Maximum number of samples that can be generated before they have to be
+     * read out with ReadSamples().
+     */
+    static constexpr int MAX_SAMPLES = 8192;
+
+public:
+    BlipBuffer();
+
+    BlipBuffer(const BlipBuffer &copy) = delete;
+    BlipBuffer& operator=(const BlipBuffer &rhs) = delete;
+
+    void SetRates(double clock_rate, int sample_rate);
+    uint32_t GetMaxFrameCycles() const;
+
+    void Clear();
+
+    void AddDelta(uint32_t clock_time, int delta);
+    void EndFrame(uint32_t clock_duration);
+
+    int GetSamplesAvailable() const;
+    int ReadSamples(int16_t *samples, int count);
+
+private:
+    /**
+     * Number of samples each step is spread across (the output is delayed by
+     * half of this).
+     */
+    static constexpr int KERNEL_WIDTH = 16;
+
+    /**
+     * Number of sub-sample positions a step can be placed at.
+     */
+    static constexpr int PHASE_BITS = 6;
+    static constexpr int NUM_PHASES = 1 << PHASE_BITS;
+
+    /**
+     * Times are kept in fixed point, with this many bits after the point
+     * (in units of output samples).
+     */
+    static constexpr int FRAC_BITS = 32;
+
+    /**
+     * Cutoff frequency of the DC blocking filter (in Hz).
+     */
+    static constexpr double DC_CUTOFF = 16.0;
+
+    /**
+     * The band-limited impulse for every sub-sample phase. Each row sums to
+     * one, so adding a row scaled by a delta and then integrating produces a
+     * band-limited step of that size.
+     */
+    float _kernel[NUM_PHASES][KERNEL_WIDTH];
+
+    /**
+     * Output samples per clock cycle, in fixed point.
+     */
+    uint64_t _factor;
+
+    /**
+     * Time (in fixed point samples) of the start of the current frame,
+     * relative to the first sample that hasn't been read yet. The fractional
+     * part carries over between frames, so no error builds up.
+     */
+    uint64_t _offset;
+
+    /**
+     * The impulses added so far. Integrating this produces the waveform.
+     */
+    float _buffer[MAX_SAMPLES + KERNEL_WIDTH];
+
+    /**
+     * Running sum of the impulses (the current amplitude).
+     */
+    float _integrator;
+
+    /**
+     * DC blocking filter state and coefficient.
+     */
+    float _dc_prev_input;
+    float _dc_prev_output;
+    float _dc_coefficient;
+};
+
+#endif // BLIPBUFFER_H
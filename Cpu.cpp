@@ -68,6 +68,16 @@ uint32_t Cpu::Execute(uint32_t num_cycles)
  */
 void Cpu::SingleStep()
 {
+    /**
+     * The IRQ line is checked between instructions. Taking the interrupt
+     * counts as a step of its own.
+     */
+    if(_irq_sources != 0 && !get_flag(FLAG_IRQ))
+    {
+        service_irq();
+        return;
+    }
+
     bool crossed_page_boundary = false;
     _cur_opcode = _bus.Read(_context.pc++);
 
@@ -80,6 +90,12 @@ void Cpu::SingleStep()
     CALL_MEMBER_FN(_opcodes[_cur_opcode].instr)();
 
     _num_instr++;
+
+    if(_num_scheduled > 0 &&
+       static_cast<int32_t>(_total_cycles - _next_event) >= 0)
+    {
+        run_scheduled();
+    }
 }
 
 /**
@@ -92,6 +108,80 @@ uint32_t Cpu::GetTotalCycles() const
     return _total_cycles;
 }
 
+/**
+ * Let time pass without running any instructions, as if the current
+ * instruction took longer. This is used by devices that skip over time the
+ * CPU would otherwise spend waiting on them.
+ *
+ * @param num_cycles The number of cycles to let pass.
+ */
+void Cpu::AddCycles(uint32_t num_cycles)
+{
+    _total_cycles += num_cycles;
+}
+
+/**
+ * Assert or release the IRQ line on behalf of a device. The line stays
+ * asserted as long as at least one device is asserting it.
+ *
+ * @param source A bit unique to the device (see IrqSource).
+ * @param asserted True to assert the line, false to release it.
+ */
+void Cpu::SetIrq(uint32_t source, bool asserted)
+{
+    if(asserted)
+        _irq_sources |= source;
+    else
+        _irq_sources &= ~source;
+}
+
+/**
+ * Ask to be called back once the CPU reaches a specific cycle. This replaces
+ * any callback the device had already scheduled.
+ *
+ * @param device The device to call back.
+ * @param cycle The cycle to call the device back at (this must be after the
+ *              current cycle).
+ */
+void Cpu::Schedule(IScheduled *device, uint32_t cycle)
+{
+    int index = 0;
+    while(index < _num_scheduled && _scheduled[index].device != device)
+        index++;
+
+    if(index == _num_scheduled)
+    {
+        if(_num_scheduled == MAX_SCHEDULED)
+            return;
+
+        _num_scheduled++;
+    }
+
+    _scheduled[index].device = device;
+    _scheduled[index].cycle = cycle;
+
+    update_next_event();
+}
+
+/**
+ * Cancel a device's scheduled callback (if it has one).
+ *
+ * @param device The device to cancel the callback for.
+ */
+void Cpu::Unschedule(IScheduled *device)
+{
+    for(int i = 0; i < _num_scheduled; ++i)
+    {
+        if(_scheduled[i].device == device)
+        {
+            _scheduled[i] = _scheduled[--_num_scheduled];
+            break;
+        }
+    }
+
+    update_next_event();
+}
+
 /**
  * Getter for the CPU registers.
  *
@@ -144,35 +234,104 @@ void Cpu::SetBpEnabled(bool enabled)
 }
 
 /**
- * Save the CPU state out to a file.
+ * Save the CPU state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void Cpu::SaveState(std::ofstream &output)
+void Cpu::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(&_cur_opcode), sizeof(_cur_opcode));
-    output.write(reinterpret_cast<char*>(&_num_instr), sizeof(_num_instr));
-    output.write(reinterpret_cast<char*>(&_total_cycles),
-                 sizeof(_total_cycles));
-    output.write(reinterpret_cast<char*>(&_effective_addr),
-                 sizeof(_effective_addr));
-    output.write(reinterpret_cast<char*>(&_context), sizeof(_context));
+    output.Write(&_cur_opcode, sizeof(_cur_opcode));
+    output.Write(&_num_instr, sizeof(_num_instr));
+    output.Write(&_total_cycles, sizeof(_total_cycles));
+    output.Write(&_effective_addr, sizeof(_effective_addr));
+    output.Write(&_context.pc, sizeof(_context.pc));
+    output.Write(&_context.acc, sizeof(_context.acc));
+    output.Write(&_context.x, sizeof(_context.x));
+    output.Write(&_context.y, sizeof(_context.y));
+    output.Write(&_context.sp, sizeof(_context.sp));
+    output.Write(&_context.sr, sizeof(_context.sr));
 }
 
 /**
- * Load the CPU state out of a file.
+ * Load the CPU state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
+ */
+void Cpu::LoadState(StateReader &input)
+{
+    input.Read(&_cur_opcode, sizeof(_cur_opcode));
+    input.Read(&_num_instr, sizeof(_num_instr));
+    input.Read(&_total_cycles, sizeof(_total_cycles));
+    input.Read(&_effective_addr, sizeof(_effective_addr));
+    input.Read(&_context.pc, sizeof(_context.pc));
+    input.Read(&_context.acc, sizeof(_context.acc));
+    input.Read(&_context.x, sizeof(_context.x));
+    input.Read(&_context.y, sizeof(_context.y));
+    input.Read(&_context.sp, sizeof(_context.sp));
+    input.Read(&_context.sr, sizeof(_context.sr));
+}
+
+/**
+ * Jump to the IRQ handler. This is the same as a BRK except that the B flag
+ * isn't set in the pushed status register.
  */
-void Cpu::LoadState(std::ifstream &input)
+void Cpu::service_irq()
 {
-    input.read(reinterpret_cast<char*>(&_cur_opcode), sizeof(_cur_opcode));
-    input.read(reinterpret_cast<char*>(&_num_instr), sizeof(_num_instr));
-    input.read(reinterpret_cast<char*>(&_total_cycles),
-                 sizeof(_total_cycles));
-    input.read(reinterpret_cast<char*>(&_effective_addr),
-                 sizeof(_effective_addr));
-    input.read(reinterpret_cast<char*>(&_context), sizeof(_context));
+    push16(_context.pc);
+    push8((_context.sr & ~FLAG_BRK) | FLAG_UNUSED);
+
+    set_flag(FLAG_IRQ, 1);
+
+    _context.pc = bus_read16(0xFFFE);
+    _total_cycles += 7;
+}
+
+/**
+ * Call back every device whose scheduled cycle has been reached. Each device
+ * is removed from the schedule before being called, so it can reschedule
+ * itself.
+ */
+void Cpu::run_scheduled()
+{
+    int i = 0;
+    while(i < _num_scheduled)
+    {
+        if(static_cast<int32_t>(_total_cycles - _scheduled[i].cycle) >= 0)
+        {
+            IScheduled *device = _scheduled[i].device;
+            _scheduled[i] = _scheduled[--_num_scheduled];
+
+            device->OnScheduled(_total_cycles);
+
+            /**
+             * The schedule may have changed; start over.
+             */
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    update_next_event();
+}
+
+/**
+ * Recalculate the earliest scheduled cycle.
+ */
+void Cpu::update_next_event()
+{
+    if(_num_scheduled == 0)
+        return;
+
+    _next_event = _scheduled[0].cycle;
+
+    for(int i = 1; i < _num_scheduled; ++i)
+    {
+        if(static_cast<int32_t>(_scheduled[i].cycle - _next_event) < 0)
+            _next_event = _scheduled[i].cycle;
+    }
 }
 
 /**
@@ -1,11 +1,11 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include "IScheduled.h"
 #include "IState.h"
 #include "SystemBus.h"
 
 #include <cstdint>
-#include <fstream>
 #include <string>
 #include <vector>
 
@@ -101,6 +101,13 @@ enum CpuFlag {
     FLAG_NEGATIVE = 0x80
 };
 
+/**
+ * Bit mask values for the devices that can assert the IRQ line.
+ */
+enum IrqSource {
+    IRQ_MOCKINGBOARD = 0x1
+};
+
 /**
  * 6502 CPU Core.
  */
@@ -119,6 +126,12 @@ public:
     void SingleStep();
 
     uint32_t GetTotalCycles() const;
+    void AddCycles(uint32_t num_cycles);
+
+    void SetIrq(uint32_t source, bool asserted);
+
+    void Schedule(IScheduled *device, uint32_t cycle);
+    void Unschedule(IScheduled *device);
 
     CpuContext GetContext() const;
 
@@ -128,12 +141,16 @@ public:
     bool GetBpEnabled() const;
     void SetBpEnabled(bool enabled);
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
 private:
     uint16_t bus_read16(uint16_t addr) const;
 
+    void service_irq();
+    void run_scheduled();
+    void update_next_event();
+
     void save_result(uint16_t result);
 
     void do_branch(CpuFlag flag, uint8_t value);
@@ -230,6 +247,36 @@ private:
      */
     static constexpr uint16_t _stack_base = 0x100;
 
+    /**
+     * Maximum number of devices that can be scheduled at the same time.
+     */
+    static constexpr int MAX_SCHEDULED = 8;
+
+    /**
+     * A device waiting to be called back at a specific cycle.
+     */
+    struct ScheduledEvent {
+        IScheduled *device;
+        uint32_t cycle;
+    };
+
+    /**
+     * Devices waiting to be called back.
+     */
+    ScheduledEvent _scheduled[MAX_SCHEDULED] = {};
+    int _num_scheduled = 0;
+
+    /**
+     * The earliest cycle any device is scheduled for.
+     */
+    uint32_t _next_event = 0;
+
+    /**
+     * One bit for every device currently asserting the IRQ line. The line is
+     * asserted as long as any bit is set.
+     */
+    uint32_t _irq_sources = 0;
+
     /**
      * Currently executing opcode.
      */
@@ -5,11 +5,20 @@
  * tracks), and motor position (used to figure out which bit to read/write on
  * the current track).
  *
+ * Reading and writing is done by emulating the card's logic state sequencer:
+ * a 16-state machine, clocked at 2MHz, whose next state and action on the data
+ * register are looked up in the P6 PROM. It's run in batches to catch up with
+ * the CPU whenever the CPU accesses the card, and whole bit cells of reading
+ * are looked up in a table built out of the PROM instead of running every
+ * clock. See "Understanding the Apple II" by Jim Sather (chapter 9) for how
+ * the sequencer works.
+ *
  * This class also encapsulates the disk controller ROM which is executed on
  * start-up to bootstrap DOS into memory.
  */
 #include "DiskController.h"
 
+#include <algorithm>
 #include <cstdlib>
 
 /**
@@ -52,27 +61,163 @@ static constexpr uint8_t disk_rom[256] = {
     0x4c, 0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
+/**
+ * The P6 PROM (341-0028) that drives the logic state sequencer. Each entry
+ * holds the next state in the upper nibble, and the action to take on the data
+ * register in the lower nibble:
+ *
+ * 0x0-0x7 = Clear the data register.
+ * 0x8, 0xC = Do nothing.
+ * 0x9 = Shift left, bringing in a '0'.
+ * 0xA, 0xE = Shift right, bringing in the write protect switch.
+ * 0xB, 0xF = Load the data register from the data bus.
+ * 0xD = Shift left, bringing in a '1'.
+ *
+ * The table is indexed by the current state (upper nibble), Q7 (read/write),
+ * Q6 (shift/load), the data register's MSB, and the drive's read pulse (which
+ * is active low).
+ */
+static constexpr uint8_t p6_rom[256] = {
+    0x18, 0x18, 0x18, 0x18, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18,
+    0x2d, 0x2d, 0x38, 0x38, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+    0xd8, 0x38, 0x08, 0x28, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x39, 0x39, 0x39, 0x39, 0x3b, 0x3b, 0x3b, 0x3b,
+    0xd8, 0x48, 0x48, 0x48, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x48, 0x48, 0x48, 0x48, 0x48, 0x48, 0x48, 0x48,
+    0xd8, 0x58, 0xd8, 0x58, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58, 0x58,
+    0xd8, 0x68, 0xd8, 0x68, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x68, 0x68, 0x68, 0x68, 0x68, 0x68, 0x68, 0x68,
+    0xd8, 0x78, 0xd8, 0x78, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78,
+    0xd8, 0x88, 0xd8, 0x88, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x08, 0x08, 0x88, 0x88, 0x08, 0x08, 0x88, 0x88,
+    0xd8, 0x98, 0xd8, 0x98, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98, 0x98,
+    0xd8, 0x29, 0xd8, 0xa8, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xa8, 0xa8, 0xa8, 0xa8, 0xa8, 0xa8, 0xa8, 0xa8,
+    0xcd, 0xbd, 0xd8, 0xb8, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xb9, 0xb9, 0xb9, 0xb9, 0xbb, 0xbb, 0xbb, 0xbb,
+    0xd9, 0x59, 0xd8, 0xc8, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xc8, 0xc8, 0xc8, 0xc8, 0xc8, 0xc8, 0xc8, 0xc8,
+    0xd9, 0xd9, 0xd8, 0xa0, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xd8, 0xd8, 0xd8, 0xd8, 0xd8, 0xd8, 0xd8, 0xd8,
+    0xd8, 0x08, 0xe8, 0xe8, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xe8, 0xe8, 0xe8, 0xe8, 0xe8, 0xe8, 0xe8, 0xe8,
+    0xfd, 0xfd, 0xf8, 0xf8, 0x0a, 0x0a, 0x0a, 0x0a,
+    0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf8,
+    0xdd, 0x4d, 0xe0, 0xe0, 0x0a, 0x0a, 0x0a, 0x0a,
+    0x88, 0x88, 0x08, 0x08, 0x88, 0x88, 0x08, 0x08
+};
+
+/**
+ * Find the entry in the P6 PROM for the current inputs to the sequencer.
+ *
+ * @param state The current state.
+ * @param read_write Q7 (true when writing).
+ * @param shift_load Q6 (true when loading).
+ * @param data_reg The data register.
+ * @param pulse True if the drive is sending a read pulse.
+ *
+ * @return The PROM entry.
+ */
+static inline uint8_t sequencer_entry(uint8_t state,
+                                      bool read_write,
+                                      bool shift_load,
+                                      uint8_t data_reg,
+                                      bool pulse)
+{
+    return p6_rom[(state << 4) |
+                  (read_write << 3) |
+                  (shift_load << 2) |
+                  ((data_reg >> 7) << 1) |
+                  (pulse ? 0 : 1)];
+}
+
+/**
+ * Perform a sequencer action on the data register.
+ *
+ * @param action The action (lower nibble of a P6 PROM entry).
+ * @param data_reg The data register.
+ * @param data_bus The value on the data bus.
+ * @param write_protect True if the disk is write protected.
+ *
+ * @return The new value of the data register.
+ */
+static inline uint8_t sequencer_action(uint8_t action,
+                                       uint8_t data_reg,
+                                       uint8_t data_bus,
+                                       bool write_protect)
+{
+    switch(action)
+    {
+    case 0x8:
+    case 0xC:
+        return data_reg;
+
+    case 0x9:
+        return data_reg << 1;
+
+    case 0xA:
+    case 0xE:
+        return (data_reg >> 1) | ((write_protect) ? 0x80 : 0x00);
+
+    case 0xB:
+    case 0xF:
+        return data_bus;
+
+    case 0xD:
+        return (data_reg << 1) | 1;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Where the turned on phases pull the drive head to, in quarter tracks (from
+ * the last multiple of eight), indexed by which phases are on. Each phase
+ * pulls the head to a half track, and two neighbouring phases pull it halfway
+ * between them. A value of -1 means the head doesn't move (no phases are on,
+ * or opposite phases cancel each other out).
+ */
+static constexpr int8_t phase_positions[16] = {
+    -1, 0, 2, 1, 4, -1, 3, 2, 6, 7, -1, 0, 5, 6, 4, -1
+};
+
 /**
  * Constructor.
  *
  * @param cpu Reference to the CPU so cycle counts can be detected.
+ * @param bus Reference to the system bus so the code reading the disk can be
+ *            inspected.
  */
-DiskController::DiskController(Cpu &cpu) :
+DiskController::DiskController(Cpu &cpu, SystemBus &bus) :
     IMemoryMapped(DISK_START_ADDR, DISK_END_ADDR),
     _cpu(cpu),
+    _bus(bus),
     _data_reg(0),
+    _data_bus(0),
+    _lss_state(0),
+    _cell_clocks(0),
+    _flux_changed(false),
+    _read_steps(),
     _shift_load(false),
     _read_write(false),
     _motor_on(false),
     _drive_0_enabled(true),
-    _cur_phase(PHASE_0),
+    _phases(0),
     _cur_track(0),
-    _leftover_cycles(CYCLES_PER_BIT),
     _last_cycle_count(0),
     _disk_busy(false),
+    _telemetry(),
     _drive0(),
     _drive1()
-{ }
+{
+    build_read_steps();
+}
 
 /**
  * Reset the disk controller to it's default state without removing any disk
@@ -81,16 +226,21 @@ DiskController::DiskController(Cpu &cpu) :
 void DiskController::Reset()
 {
     _data_reg = 0;
+    _data_bus = 0;
+    _lss_state = 0;
+    _cell_clocks = 0;
+    _flux_changed = false;
     _shift_load = false;
     _read_write = false;
     _motor_on = false;
     _drive_0_enabled = true;
-    _cur_phase = PHASE_0;
+    _phases = 0;
     _cur_track = 0;
-    _leftover_cycles = CYCLES_PER_BIT;
     _last_cycle_count = 0;
     _drive0.Reset();
     _drive1.Reset();
+
+    _telemetry.RecordMotor(_cpu.GetTotalCycles(), DRIVE_0, false);
 }
 
 /**
@@ -98,22 +248,26 @@ void DiskController::Reset()
  *
  * @param filename The full path to the disk image.
  * @param drive The drive to load a disk into.
- * @param data The disk image data.
+ *
+ * @return True if the disk was loaded, false if the image couldn't be opened
+ *         or isn't valid (the drive is left empty).
  */
-void DiskController::LoadDisk(std::string filename,
-                              DriveId drive,
-                              uint8_t data[DiskDrive::DISK_SIZE])
+bool DiskController::LoadDisk(std::string filename, DriveId drive)
 {
+    bool loaded = false;
+
     switch(drive)
     {
     case DRIVE_0:
-        _drive0.LoadDisk(filename, data);
+        loaded = _drive0.LoadDisk(filename);
         break;
 
     case DRIVE_1:
-        _drive1.LoadDisk(filename, data);
+        loaded = _drive1.LoadDisk(filename);
         break;
     }
+
+    return loaded;
 }
 
 /**
@@ -135,6 +289,32 @@ void DiskController::UnloadDisk(DriveId drive)
     }
 }
 
+/**
+ * Write any changes made to the inserted disks back to their image files.
+ *
+ * @return True if both image files are up to date, false otherwise.
+ */
+bool DiskController::FlushDisks()
+{
+    const bool drive0_flushed = _drive0.FlushWrites();
+    const bool drive1_flushed = _drive1.FlushWrites();
+
+    return drive0_flushed && drive1_flushed;
+}
+
+/**
+ * Reload any inserted disks whose image files were changed by another program.
+ *
+ * @return True if either disk was reloaded, false otherwise.
+ */
+bool DiskController::ReloadDisks()
+{
+    const bool drive0_reloaded = _drive0.ReloadIfChanged();
+    const bool drive1_reloaded = _drive1.ReloadIfChanged();
+
+    return drive0_reloaded || drive1_reloaded;
+}
+
 /**
  * Read data from the disk or toggle a switch.
  *
@@ -150,7 +330,17 @@ uint8_t DiskController::Read(uint16_t addr, bool no_side_fx)
         return disk_rom[addr & 0xFF];
 
     if(!no_side_fx)
-        perform_read_write(addr, 0);
+    {
+        perform_read_write(addr);
+
+        if(addr == 0xC0EC && _motor_on && !_read_write)
+        {
+            _telemetry.RecordRead(_cpu.GetTotalCycles(),
+                                  (_drive_0_enabled) ? DRIVE_0 : DRIVE_1,
+                                  _cur_track,
+                                  _data_reg);
+        }
+    }
 
     /**
      * A read to any even address will dump the data register onto the data bus.
@@ -166,57 +356,81 @@ uint8_t DiskController::Read(uint16_t addr, bool no_side_fx)
  */
 void DiskController::Write(uint16_t addr, uint8_t data)
 {
-    perform_read_write(addr, data);
+    perform_read_write(addr);
+    _data_bus = data;
+
+    /**
+     * Writes that load the data register while writing hand the controller
+     * the next disk byte.
+     */
+    if((addr == 0xC0ED || addr == 0xC0EF) && _motor_on && _read_write)
+    {
+        _telemetry.RecordWrite(_cpu.GetTotalCycles(),
+                               (_drive_0_enabled) ? DRIVE_0 : DRIVE_1,
+                               _cur_track);
+    }
 }
 
 /**
- * Save the Disk controller state out to a file.
+ * Save the Disk controller state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void DiskController::SaveState(std::ofstream &output)
+void DiskController::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(&_data_reg), sizeof(_data_reg));
-    output.write(reinterpret_cast<char*>(&_shift_load), sizeof(_shift_load));
-    output.write(reinterpret_cast<char*>(&_read_write), sizeof(_read_write));
-    output.write(reinterpret_cast<char*>(&_motor_on), sizeof(_motor_on));
-    output.write(reinterpret_cast<char*>(&_drive_0_enabled),
-                 sizeof(_drive_0_enabled));
-    output.write(reinterpret_cast<char*>(&_cur_phase), sizeof(_cur_phase));
-    output.write(reinterpret_cast<char*>(&_cur_track), sizeof(_cur_track));
-    output.write(reinterpret_cast<char*>(&_leftover_cycles),
-                 sizeof(_leftover_cycles));
-    output.write(reinterpret_cast<char*>(&_last_cycle_count),
-                 sizeof(_last_cycle_count));
-    output.write(reinterpret_cast<char*>(&_disk_busy), sizeof(_disk_busy));
+    output.Write(&_data_reg, sizeof(_data_reg));
+    output.Write(&_data_bus, sizeof(_data_bus));
+    output.Write(&_lss_state, sizeof(_lss_state));
+    output.Write(&_cell_clocks, sizeof(_cell_clocks));
+    output.Write(&_flux_changed, sizeof(_flux_changed));
+    output.Write(&_shift_load, sizeof(_shift_load));
+    output.Write(&_read_write, sizeof(_read_write));
+    output.Write(&_motor_on, sizeof(_motor_on));
+    output.Write(&_drive_0_enabled, sizeof(_drive_0_enabled));
+    output.Write(&_phases, sizeof(_phases));
+    output.Write(&_cur_track, sizeof(_cur_track));
+    output.Write(&_last_cycle_count, sizeof(_last_cycle_count));
+    output.Write(&_disk_busy, sizeof(_disk_busy));
 
     _drive0.SaveState(output);
     _drive1.SaveState(output);
 }
 
 /**
- * Load the Disk controller state out of a file.
+ * Load the Disk controller state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void DiskController::LoadState(std::ifstream &input)
+void DiskController::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(&_data_reg), sizeof(_data_reg));
-    input.read(reinterpret_cast<char*>(&_shift_load), sizeof(_shift_load));
-    input.read(reinterpret_cast<char*>(&_read_write), sizeof(_read_write));
-    input.read(reinterpret_cast<char*>(&_motor_on), sizeof(_motor_on));
-    input.read(reinterpret_cast<char*>(&_drive_0_enabled),
-               sizeof(_drive_0_enabled));
-    input.read(reinterpret_cast<char*>(&_cur_phase), sizeof(_cur_phase));
-    input.read(reinterpret_cast<char*>(&_cur_track), sizeof(_cur_track));
-    input.read(reinterpret_cast<char*>(&_leftover_cycles),
-               sizeof(_leftover_cycles));
-    input.read(reinterpret_cast<char*>(&_last_cycle_count),
-               sizeof(_last_cycle_count));
-    input.read(reinterpret_cast<char*>(&_disk_busy), sizeof(_disk_busy));
+    input.Read(&_data_reg, sizeof(_data_reg));
+    input.Read(&_data_bus, sizeof(_data_bus));
+    input.Read(&_lss_state, sizeof(_lss_state));
+    input.Read(&_cell_clocks, sizeof(_cell_clocks));
+    input.Read(&_flux_changed, sizeof(_flux_changed));
+    input.Read(&_shift_load, sizeof(_shift_load));
+    input.Read(&_read_write, sizeof(_read_write));
+    input.Read(&_motor_on, sizeof(_motor_on));
+    input.Read(&_drive_0_enabled, sizeof(_drive_0_enabled));
+    input.Read(&_phases, sizeof(_phases));
+    input.Read(&_cur_track, sizeof(_cur_track));
+    input.Read(&_last_cycle_count, sizeof(_last_cycle_count));
+    input.Read(&_disk_busy, sizeof(_disk_busy));
+
+    /**
+     * Reject a damaged state before either drive gets a chance to swap disks
+     * (the previous state gets restored when loading fails).
+     */
+    if(_lss_state > 15 || _phases > 15 || _cell_clocks >= CLOCKS_PER_BIT ||
+       _cur_track < 0 || _cur_track >= DiskDrive::NUM_QUARTER_TRACKS)
+        input.SetFailed();
 
     _drive0.LoadState(input);
     _drive1.LoadState(input);
+
+    _telemetry.RecordMotor(_cpu.GetTotalCycles(),
+                           (_drive_0_enabled) ? DRIVE_0 : DRIVE_1,
+                           _motor_on);
 }
 
 /**
@@ -264,6 +478,91 @@ bool DiskController::GetDiskBusy()
     }
 }
 
+/**
+ * Check whether the selected drive's motor is spinning.
+ *
+ * @return True if the motor is on, false otherwise.
+ */
+bool DiskController::GetMotorOn() const
+{
+    return _motor_on;
+}
+
+/**
+ * Allow (or stop) reads from the disk in a drive being sped up. This is reset
+ * whenever a new disk is inserted.
+ *
+ * @param drive The drive containing the disk.
+ * @param accelerated True to speed up reads, false otherwise.
+ */
+void DiskController::SetDiskAccelerated(DriveId drive, bool accelerated)
+{
+    switch(drive)
+    {
+    case DRIVE_0:
+        _drive0.SetAccelerated(accelerated);
+        break;
+
+    case DRIVE_1:
+        _drive1.SetAccelerated(accelerated);
+        break;
+    }
+}
+
+/**
+ * Check whether reads from the disk in a drive are being sped up.
+ *
+ * @param drive The drive containing the disk.
+ *
+ * @return True if reads are sped up, false otherwise (or if the drive is
+ *         empty).
+ */
+bool DiskController::GetDiskAccelerated(DriveId drive) const
+{
+    bool accelerated = false;
+
+    switch(drive)
+    {
+    case DRIVE_0:
+        accelerated = _drive0.GetAccelerated();
+        break;
+
+    case DRIVE_1:
+        accelerated = _drive1.GetAccelerated();
+        break;
+    }
+
+    return accelerated;
+}
+
+/**
+ * Get the disk telemetry, for reading its event log.
+ *
+ * @return The disk telemetry.
+ */
+const DiskTelemetry& DiskController::GetTelemetry() const
+{
+    return _telemetry;
+}
+
+/**
+ * Get the disk telemetry's counters, up to date as of now.
+ *
+ * @return The counters.
+ */
+DiskTelemetry::Stats DiskController::GetTelemetryStats() const
+{
+    return _telemetry.GetStats(_cpu.GetTotalCycles());
+}
+
+/**
+ * Reset the disk telemetry's counters and empty its event log.
+ */
+void DiskController::ClearTelemetry()
+{
+    _telemetry.Clear(_cpu.GetTotalCycles());
+}
+
 /**
  * Handle toggling disk controller soft switches.
  *
@@ -271,47 +570,45 @@ bool DiskController::GetDiskBusy()
  */
 void DiskController::toggle_switch(uint16_t addr)
 {
-    /**
-     * The row is the current phase, and the column is how far to move the
-     * stepper motor (which determines the track) if that phase is enabled.
-     */
-    int phase_delta[4][4] = { { 0, 1, 2, -1  },
-                              { -1, 0, 1, 2  },
-                              { -2, -1, 0, 1 },
-                              { 1, -2, -1, 0 } };
+    const uint32_t cycle = _cpu.GetTotalCycles();
+    const uint8_t old_phases = _phases;
+    const bool old_motor_on = _motor_on;
+    const bool old_drive_0_enabled = _drive_0_enabled;
 
     switch(addr)
     {
 
     /**
-     * I take a shortcut and just ignore turning off phases. I assume the
-     * program is disabling them correctly and only update the current track
-     * number when phases are enabled.
+     * Even addresses turn a phase off, and odd addresses turn it on.
      */
     case 0xC0E0:
+    case 0xC0E1:
     case 0xC0E2:
+    case 0xC0E3:
     case 0xC0E4:
+    case 0xC0E5:
     case 0xC0E6:
-        break;
-
-    case 0xC0E1:
-        _cur_track += phase_delta[static_cast<int>(_cur_phase)][0];
-        _cur_phase = PHASE_0;
-        break;
+    case 0xC0E7:
+        if(addr & 1)
+            _phases |= 1 << ((addr >> 1) & 3);
+        else
+            _phases &= ~(1 << ((addr >> 1) & 3));
 
-    case 0xC0E3:
-        _cur_track += phase_delta[static_cast<int>(_cur_phase)][1];
-        _cur_phase = PHASE_1;
-        break;
+        if(_phases != old_phases)
+        {
+            const int old_track = _cur_track;
 
-    case 0xC0E5:
-        _cur_track += phase_delta[static_cast<int>(_cur_phase)][2];
-        _cur_phase = PHASE_2;
-        break;
+            _telemetry.RecordPhaseChange();
+            step_head();
 
-    case 0xC0E7:
-        _cur_track += phase_delta[static_cast<int>(_cur_phase)][3];
-        _cur_phase = PHASE_3;
+            if(_cur_track != old_track)
+            {
+                _telemetry.RecordSeek(cycle,
+                                      (_drive_0_enabled) ? DRIVE_0 : DRIVE_1,
+                                      old_track,
+                                      _cur_track);
+            }
+        }
         break;
 
     case 0xC0E8:
@@ -347,116 +644,322 @@ void DiskController::toggle_switch(uint16_t addr)
         break;
     }
 
-    if(_cur_track > (DiskDrive::NUM_TRACKS * 2) - 1)
-        _cur_track = (DiskDrive::NUM_TRACKS * 2) - 1;
-    else if(_cur_track < 0)
-        _cur_track = 0;
+    if(_drive_0_enabled != old_drive_0_enabled)
+    {
+        _telemetry.RecordSelectDrive(cycle,
+                                     (_drive_0_enabled) ? DRIVE_0 : DRIVE_1);
+    }
+
+    if(_motor_on != old_motor_on)
+    {
+        _telemetry.RecordMotor(cycle,
+                               (_drive_0_enabled) ? DRIVE_0 : DRIVE_1,
+                               _motor_on);
+    }
+}
+
+/**
+ * Move the drive head towards whatever the phases that are turned on pull it
+ * to. The head takes the shortest way there, and can't be moved by phases
+ * directly opposite it.
+ */
+void DiskController::step_head()
+{
+    const int target = phase_positions[_phases];
+
+    if(target < 0)
+        return;
+
+    int delta = (target - (_cur_track % 8) + 8) % 8;
+
+    if(delta == 4)
+        return;
+    else if(delta > 4)
+        delta -= 8;
+
+    _cur_track = std::min(std::max(_cur_track + delta, 0),
+                          DiskDrive::NUM_QUARTER_TRACKS - 1);
 }
 
 /**
  * Handle moving the motor (current disk position), reading/writing bits, and
  * toggling soft switches.
  *
- * @param data_bus The data on the data bus (for reads this should be zero,
- *                 for write this should be the value to be written).
+ * The sequencer is run up until the access, and then the switch is toggled,
+ * so the new switch settings take effect from the access onwards.
+ *
+ * @param addr The address being accessed.
  */
-void DiskController::perform_read_write(uint16_t addr, uint8_t data_bus)
+void DiskController::perform_read_write(uint16_t addr)
 {
     DiskDrive &drive = (_drive_0_enabled) ? _drive0 : _drive1;
-    int cycle_delta = _cpu.GetTotalCycles() - _last_cycle_count;
-    bool switches_toggled = false;
+    const uint32_t cycle_delta = _cpu.GetTotalCycles() - _last_cycle_count;
 
     _disk_busy = true;
 
-    if(_motor_on)
+    run_sequencer(drive, cycle_delta * CLOCKS_PER_CYCLE);
+    toggle_switch(addr);
+
+    /**
+     * Reading a byte that isn't the start of a prologue while searching for
+     * one means the bytes up until the next prologue aren't going to be used.
+     */
+    if(drive.GetAccelerated() && _motor_on && !_read_write && !_shift_load &&
+       !(addr & 1) && (_data_reg & 0x80) && _data_reg != 0xD5 &&
+       is_prologue_search())
     {
-        cycle_delta -= _leftover_cycles;
+        skip_to_prologue(drive);
+    }
 
-        while(cycle_delta >= 0)
-        {
-            /**
-             * Run the motor and read bits up until the last bit before
-             * toggling any switches. This simulates the motor free-running
-             * until the current read takes place, in which any toggles are
-             * switched and the last bit is read with the new switches.
-             */
-            if(cycle_delta < 4)
-            {
-                toggle_switch(addr);
-                switches_toggled = true;
-            }
+    _last_cycle_count = _cpu.GetTotalCycles();
+}
 
-            update_data_reg(data_bus);
+/**
+ * Check whether the CPU is running the usual loop for finding the start of an
+ * address or data field. DOS 3.3, ProDOS and the boot ROM all wait for the
+ * first byte of a prologue with:
+ *
+ * LOOP: LDA $C08C,X
+ *       BPL LOOP
+ *       CMP #$D5 (or EOR #$D5)
+ *       BNE ...
+ *
+ * @note This is called while the LDA is reading the data register, so the
+ *       program counter already points at the BPL.
+ *
+ * @return True if the CPU is waiting for a prologue, false otherwise.
+ */
+bool DiskController::is_prologue_search()
+{
+    const uint16_t pc = _cpu.GetContext().pc;
+
+    return _bus.Read(pc - 3, true) == 0xBD &&
+           _bus.Read(pc - 2, true) == 0x8C &&
+           _bus.Read(pc - 1, true) == 0xC0 &&
+           _bus.Read(pc, true) == 0x10 &&
+           _bus.Read(pc + 1, true) == 0xFB &&
+           (_bus.Read(pc + 2, true) == 0xC9 ||
+            _bus.Read(pc + 2, true) == 0x49) &&
+           _bus.Read(pc + 3, true) == 0xD5;
+}
 
-            drive.SeekBit(_cur_track / 2);
+/**
+ * Spin the disk straight to just before the next prologue, and let the CPU
+ * time it would have taken pass without running the polling loop. The disk
+ * moves by whole bytes so tracks made of whole bytes stay in step with the
+ * data register.
+ *
+ * @param drive The drive being read.
+ */
+void DiskController::skip_to_prologue(DiskDrive &drive)
+{
+    const uint8_t track = drive.GetTrack(_cur_track);
+    const uint32_t distance = drive.FindPrologue(track,
+                                                 PROLOGUE_LOOK_BACK_BITS);
 
-            /**
-             * If a full byte has been loaded (the MSB is '1'), then wait
-             * more cycles than usual to give the CPU extra time to read
-             * the data.
-             */
-            if(!_read_write && !_shift_load && (_data_reg & 0x80))
-                cycle_delta -= VALID_BYTE_CYCLES;
-            else
-                cycle_delta -= CYCLES_PER_BIT;
-        }
+    if(distance < PROLOGUE_LOOK_BACK_BITS + PROLOGUE_LEAD_BITS + 8)
+        return;
+
+    const uint32_t num_bits = ((distance - PROLOGUE_LOOK_BACK_BITS -
+                                PROLOGUE_LEAD_BITS) / 8) * 8;
+
+    drive.SeekBits(track, num_bits);
+    _cpu.AddCycles(num_bits * CYCLES_PER_BIT);
+    _telemetry.RecordSkip(num_bits * CYCLES_PER_BIT);
+}
+
+/**
+ * Run the logic state sequencer for a number of clocks, spinning the disk
+ * underneath it if the motor is on.
+ *
+ * Nothing changes from one revolution of the disk to the next unless
+ * something is being written, so once the sequencer finishes a revolution in
+ * the same state it started in, the rest of the whole revolutions are skipped.
+ * This keeps long waits (e.g., a program leaving the motor on) from taking
+ * longer the longer the disk spins.
+ *
+ * @param drive The selected drive.
+ * @param num_clocks The number of sequencer clocks to run.
+ */
+void DiskController::run_sequencer(DiskDrive &drive, uint32_t num_clocks)
+{
+    const uint8_t track = (_motor_on) ? drive.GetTrack(_cur_track) :
+                                        DiskDrive::NO_TRACK;
 
-        _leftover_cycles = abs(cycle_delta);
+    /**
+     * Finish off the current bit cell.
+     */
+    while(num_clocks > 0 && _cell_clocks != 0)
+    {
+        clock_sequencer(drive, track);
+        num_clocks--;
     }
-    else
+
+    uint32_t num_cells = num_clocks / CLOCKS_PER_BIT;
+    num_clocks %= CLOCKS_PER_BIT;
+
+    const uint32_t track_bits = drive.GetTrackBits(track);
+    const uint32_t rev_cells = (track_bits != 0) ? track_bits : 1;
+    const bool writing = _read_write && track_bits != 0 &&
+                         !drive.GetWriteProtect();
+
+    while(num_cells > rev_cells)
     {
-        toggle_switch(addr);
-        switches_toggled = true;
+        const uint8_t start_state = _lss_state;
+        const uint8_t start_data_reg = _data_reg;
+
+        run_cells(drive, track, rev_cells);
+        num_cells -= rev_cells;
 
-        update_data_reg(data_bus);
+        if(!writing &&
+           _lss_state == start_state &&
+           _data_reg == start_data_reg)
+        {
+            num_cells %= rev_cells;
+        }
     }
 
-    if(!switches_toggled)
-        toggle_switch(addr);
+    run_cells(drive, track, num_cells);
 
-    _last_cycle_count = _cpu.GetTotalCycles();
+    while(num_clocks > 0)
+    {
+        clock_sequencer(drive, track);
+        num_clocks--;
+    }
 }
 
 /**
- * Update the data register based on the shift/load and read/write flags.
- *
- * The _read_write and _shift_load switches determine the action the disk
- * controller takes each cycle:
+ * Run the sequencer for a number of whole bit cells.
  *
- * !_read_write && !_shift_load = Read data (shift new data).
- * !_read_write && _shift_load = Read status of write-protect switch.
- * _read_write && !_shift_load = Shift out one bit and write it.
- * _read_write && _shift_load = Load data to write into the data register.
+ * @param drive The selected drive.
+ * @param track The track under the head (NO_TRACK if the disk isn't spinning).
+ * @param num_cells The number of bit cells to run.
  */
-void DiskController::update_data_reg(uint8_t data_bus)
+void DiskController::run_cells(DiskDrive &drive,
+                               uint8_t track,
+                               uint32_t num_cells)
 {
-    DiskDrive &drive = (_drive_0_enabled) ? _drive0 : _drive1;
-
     if(!_read_write && !_shift_load)
     {
-        /**
-         * If the last shift set the MSB, then clear the data register before
-         * shifting the next bit. It's assumed that the appropriate amount
-         * of time has been given to the CPU to read the data.
-         */
-        if(_data_reg & 0x80)
-            _data_reg = 0;
-
-        _data_reg = (_data_reg << 1) | drive.GetBit(_cur_track / 2);
+        shift_cells(drive, track, num_cells);
     }
-    else if(!_read_write && _shift_load)
+    else
     {
-        _data_reg = (drive.GetWriteProtect()) ? 0x80 : 0x0;
+        for(uint32_t i = 0; i < num_cells * CLOCKS_PER_BIT; ++i)
+            clock_sequencer(drive, track);
     }
-    else if(_read_write && !_shift_load)
+}
+
+/**
+ * Read a number of whole bit cells, looking up where the sequencer ends up
+ * after each one instead of running it every clock. The bits are fetched from
+ * the drive 32 at a time.
+ *
+ * @param drive The selected drive.
+ * @param track The track under the head (NO_TRACK if the disk isn't spinning).
+ * @param num_cells The number of bit cells to read.
+ */
+void DiskController::shift_cells(DiskDrive &drive,
+                                 uint8_t track,
+                                 uint32_t num_cells)
+{
+    while(num_cells > 0)
     {
-        _data_reg <<= 1;
-        drive.SetBit(_cur_track / 2, (_data_reg >> 7) & 1);
+        const uint32_t bits = drive.PeekBits(track);
+        const uint32_t num_bits = std::min<uint32_t>(num_cells, 32);
+
+        for(uint32_t i = 0; i < num_bits; ++i)
+        {
+            const uint16_t step = _read_steps[(_lss_state << 9) |
+                                              (_data_reg << 1) |
+                                              ((bits >> (31 - i)) & 1)];
+
+            _lss_state = step >> 8;
+            _data_reg = step & 0xFF;
+        }
+
+        drive.SeekBits(track, num_bits);
+        num_cells -= num_bits;
     }
-    else if(_read_write && _shift_load)
+}
+
+/**
+ * Run the sequencer for a single clock. At the end of each bit cell the disk
+ * moves on to the next bit, after writing a '1' to the cell if the write
+ * signal flipped during it (or a '0' if it didn't).
+ *
+ * @param drive The selected drive.
+ * @param track The track under the head (NO_TRACK if the disk isn't spinning).
+ */
+void DiskController::clock_sequencer(DiskDrive &drive, uint8_t track)
+{
+    const bool pulse = _cell_clocks < READ_PULSE_CLOCKS &&
+                       drive.GetBit(track);
+    const uint8_t entry = sequencer_entry(_lss_state,
+                                          _read_write,
+                                          _shift_load,
+                                          _data_reg,
+                                          pulse);
+
+    _data_reg = sequencer_action(entry & 0xF,
+                                 _data_reg,
+                                 _data_bus,
+                                 drive.GetWriteProtect());
+
+    /**
+     * The write signal follows the upper half of the states.
+     */
+    if(_read_write && ((_lss_state ^ (entry >> 4)) & 0x8))
+        _flux_changed = true;
+
+    _lss_state = entry >> 4;
+
+    if(++_cell_clocks == CLOCKS_PER_BIT)
+    {
+        if(_read_write && !drive.GetWriteProtect())
+            drive.SetBit(track, _flux_changed);
+
+        drive.SeekBit(track);
+
+        _cell_clocks = 0;
+        _flux_changed = false;
+    }
+}
+
+/**
+ * Build the table of where the sequencer ends up after reading a whole bit
+ * cell, for every state and data register value it could start in.
+ */
+void DiskController::build_read_steps()
+{
+    for(int state = 0; state < 16; ++state)
     {
-        _data_reg = data_bus;
-        drive.SeekPrevByte(_cur_track / 2);
-        drive.SetBit(_cur_track / 2, (_data_reg >> 7) & 1);
+        for(int data_reg = 0; data_reg < 256; ++data_reg)
+        {
+            for(int bit = 0; bit < 2; ++bit)
+            {
+                uint8_t cur_state = state;
+                uint8_t cur_data_reg = data_reg;
+
+                for(int clock = 0; clock < CLOCKS_PER_BIT; ++clock)
+                {
+                    const bool pulse = clock < READ_PULSE_CLOCKS && bit;
+                    const uint8_t entry = sequencer_entry(cur_state,
+                                                          false,
+                                                          false,
+                                                          cur_data_reg,
+                                                          pulse);
+
+                    cur_data_reg = sequencer_action(entry & 0xF,
+                                                    cur_data_reg,
+                                                    0,
+                                                    false);
+                    cur_state = entry >> 4;
+                }
+
+                _read_steps[(state << 9) | (data_reg << 1) | bit] =
+                        (cur_state << 8) | cur_data_reg;
+            }
+        }
     }
 }
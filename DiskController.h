@@ -3,10 +3,11 @@
 
 #include "Cpu.h"
 #include "DiskDrive.h"
+#include "DiskTelemetry.h"
 #include "IMemoryMapped.h"
 #include "IState.h"
+#include "SystemBus.h"
 
-#include <fstream>
 #include <string>
 
 class DiskController : public IMemoryMapped, public IState
@@ -25,29 +26,45 @@ public:
     static constexpr uint16_t DISK_ROM_END = 0xC6FF;
 
 public:
-    DiskController(Cpu &cpu);
+    DiskController(Cpu &cpu, SystemBus &bus);
 
     void Reset();
 
-    void LoadDisk(std::string filename,
-                  DriveId drive,
-                  uint8_t data[DiskDrive::DISK_SIZE]);
+    bool LoadDisk(std::string filename, DriveId drive);
     void UnloadDisk(DriveId drive);
+    bool FlushDisks();
+    bool ReloadDisks();
 
     uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
     void Write(uint16_t addr, uint8_t data) override;
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
     std::string GetDiskFilename(DriveId drive) const;
     bool GetDiskBusy();
+    bool GetMotorOn() const;
+
+    void SetDiskAccelerated(DriveId drive, bool accelerated);
+    bool GetDiskAccelerated(DriveId drive) const;
+
+    const DiskTelemetry& GetTelemetry() const;
+    DiskTelemetry::Stats GetTelemetryStats() const;
+    void ClearTelemetry();
 
 private:
     void toggle_switch(uint16_t addr);
+    void step_head();
+
+    void perform_read_write(uint16_t addr);
+    void run_sequencer(DiskDrive &drive, uint32_t num_clocks);
+    void run_cells(DiskDrive &drive, uint8_t track, uint32_t num_cells);
+    void shift_cells(DiskDrive &drive, uint8_t track, uint32_t num_cells);
+    void clock_sequencer(DiskDrive &drive, uint8_t track);
+    void build_read_steps();
 
-    void perform_read_write(uint16_t addr, uint8_t data_bus);
-    void update_data_reg(uint8_t data_bus);
+    bool is_prologue_search();
+    void skip_to_prologue(DiskDrive &drive);
 
 private:
     /**
@@ -57,20 +74,39 @@ private:
     static constexpr int DISK_END_ADDR = 0xC0EF;
 
     /**
-     * It takes the disk controller four CPU cycles to read/write a single bit.
+     * The logic state sequencer is clocked at twice the speed of the CPU, and
+     * it takes eight sequencer clocks (four CPU cycles) for a single bit to
+     * pass under the drive head.
+     */
+    static constexpr int CLOCKS_PER_CYCLE = 2;
+    static constexpr int CLOCKS_PER_BIT = 8;
+    static constexpr int CYCLES_PER_BIT = CLOCKS_PER_BIT / CLOCKS_PER_CYCLE;
+
+    /**
+     * How long (in sequencer clocks) the drive's read pulse lasts at the start
+     * of every bit cell holding a '1'.
+     */
+    static constexpr int READ_PULSE_CLOCKS = 2;
+
+    /**
+     * Number of entries in the table of whole bit cells read by the
+     * sequencer: one for each state, data register value and bit.
      */
-    static constexpr int CYCLES_PER_BIT = 4;
+    static constexpr int NUM_READ_STEPS = 16 * 256 * 2;
 
     /**
-     * The amount of cycles to hold a valid byte before clearing the data
-     * register and shifting in new data.
+     * When skipping ahead to a prologue, the disk is left this many bits short
+     * of it, so the sequencer has a few sync bytes to fall into step with
+     * before the prologue arrives.
      */
-    static constexpr int VALID_BYTE_CYCLES = 8;
+    static constexpr uint32_t PROLOGUE_LEAD_BITS = 64;
 
     /**
-     * Used to describe the phase of the motor that was last enabled.
+     * The data register can still be holding the last byte for a bit or two
+     * after the next byte starts passing under the head, so the search for the
+     * next prologue starts this many bits back.
      */
-    enum DiskPhase { PHASE_0 = 0, PHASE_1, PHASE_2, PHASE_3 };
+    static constexpr uint32_t PROLOGUE_LOOK_BACK_BITS = 8;
 
     /**
      * Used to retrieve cycle counts whenever a read/write is requested.
@@ -79,10 +115,45 @@ private:
      */
     Cpu &_cpu;
 
+    /**
+     * Used to look at the code that's reading the disk, to tell when it's
+     * only waiting for the next prologue.
+     */
+    SystemBus &_bus;
+
     /**
      * Holds the data to read/write.
      */
     uint8_t _data_reg;
+
+    /**
+     * The last value the CPU wrote to the controller. The sequencer loads
+     * this into the data register when it's time to write a new byte.
+     */
+    uint8_t _data_bus;
+
+    /**
+     * The current state of the logic state sequencer (0-15).
+     */
+    uint8_t _lss_state;
+
+    /**
+     * Number of sequencer clocks run since the start of the current bit cell.
+     */
+    uint32_t _cell_clocks;
+
+    /**
+     * True if the sequencer flipped the write signal (a '1' being written)
+     * during the current bit cell.
+     */
+    bool _flux_changed;
+
+    /**
+     * Where the sequencer ends up (state in the upper byte, data register in
+     * the lower byte) after reading a whole bit cell. Indexed by the state
+     * and data register at the start of the cell, and the bit in the cell.
+     */
+    uint16_t _read_steps[NUM_READ_STEPS];
     /**
      * False for shifting data from the disk image into the data register on
      * each cycle, true for loading data from the data bus into the data
@@ -106,28 +177,22 @@ private:
     bool _drive_0_enabled;
 
     /**
-     * The last phase that was enabled
+     * Which of the four stepper motor phases are turned on (bit N is set if
+     * phase N is on).
      */
-    DiskPhase _cur_phase;
+    uint8_t _phases;
 
     /**
-     * The current track to read/write to.
+     * The current position of the drive head, in quarter tracks.
      *
-     * @note There are only 35 tracks on a single disk and to move one track,
-     *       two phases have to be enabled. If you only enable a single phase
-     *       then the disk is on a "half-track". To support this correctly,
-     *       this variable goes from 0 to 69 (it keeps track of the half
-     *       tracks), and to find the current actual track for reading/writing
-     *       you need to divide this variable by two (shift right by one).
+     * @note Each phase is two quarter tracks (a half track) away from the
+     *       next, and turning on two neighbouring phases at once pulls the head
+     *       in between them, so the head can stop on any quarter track. This
+     *       goes from 0 to 159, and the drive works out which track (if any)
+     *       is under the head.
      */
     int _cur_track;
 
-    /**
-     * How many cycles need to be executed in the next read/write to cause
-     * the motor to move one bit.
-     */
-    uint32_t _leftover_cycles;
-
     /**
      * What the CPU's cycle count was the last time a read/write occurred.
      */
@@ -143,6 +208,12 @@ private:
      */
     bool _disk_busy;
 
+    /**
+     * Counters and event log describing how the disks are being used. This
+     * isn't part of the saved state.
+     */
+    DiskTelemetry _telemetry;
+
     /**
      * The disk inserted into drive 0.
      */
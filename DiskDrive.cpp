@@ -13,22 +13,112 @@
  * and synchronization bytes. This class handles "re-encoding" the disk image
  * to include this data.
  *
+ * Tracks aren't encoded when the disk is inserted, but the first time the
+ * drive head reads or writes them, straight out of the memory-mapped image
+ * file. Inserting (or swapping) a disk doesn't read anything, and a track
+ * that's never touched is never encoded.
+ *
+ * Images can hold 256-byte sectors in either DOS 3.3 (.dsk, .do) or ProDOS
+ * (.po) order, which only changes which physical sector each one ends up in.
+ * Pre-nibblized images (.nib) already hold the encoded disk bytes, so their
+ * tracks are copied into the drive as is.
+ *
+ * Bit-stream images (.woz) hold the bits on each track exactly as they were
+ * read off of an original disk, which is what copy protection schemes need.
+ * Tracks can be any length (not necessarily a whole number of bytes), and the
+ * image maps every quarter track position of the head to the track it would
+ * read there.
+ *
+ * Encoded tracks are shared (through the TrackCache) with every other drive
+ * that loads the same image data, and a drive only gets its own copy of a
+ * track the first time it changes it.
+ *
+ * Tracks that get written to are marked dirty. When the disk is flushed (or
+ * unloaded), only the dirty tracks are decoded back into 256-byte sectors (or
+ * copied back into the image, for .nib and .woz) and the image file is
+ * replaced with the updated image.
  */
 #include "DiskDrive.h"
+#include "GcrCodec.h"
+#include "TrackCache.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <iostream>
 
+/**
+ * Sector interleaving table. By not having all of the sectors located next to
+ * each other in ascending order, it gives DOS more time to process a sector
+ * before having to read the next one.
+ */
+static constexpr uint8_t dos_sector_trans[16] = {
+    0, 13, 11, 9, 7, 5, 3, 1, 14, 12, 10, 8, 6, 4, 2, 15
+};
+
+/**
+ * Sector interleaving table for ProDOS ordered images. Each pair of sectors in
+ * the image makes up one 512-byte ProDOS block.
+ */
+static constexpr uint8_t prodos_sector_trans[16] = {
+    0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15
+};
+
+/**
+ * The first two bytes of the prologue that starts every address and data
+ * field.
+ */
+static constexpr uint16_t field_prologue = 0xD5AA;
+
+/**
+ * Read a little-endian 16-bit value out of a disk image.
+ *
+ * @param data Where the value is.
+ *
+ * @return The value.
+ */
+static uint16_t read_le16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+/**
+ * Read a little-endian 32-bit value out of a disk image.
+ *
+ * @param data Where the value is.
+ *
+ * @return The value.
+ */
+static uint32_t read_le32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
 /**
  * Constructor.
  */
 DiskDrive::DiskDrive() :
     _cur_bit(0),
+    _cur_track_bits(0),
     _disk_loaded(false),
     _write_protected(false),
+    _accelerated(false),
     _filename(""),
-    _tracks()
-{ }
+    _image(),
+    _format(FORMAT_UNKNOWN),
+    _num_tracks(0),
+    _track_map(),
+    _track_offset(),
+    _track_bits(),
+    _tracks(),
+    _shared_tracks(),
+    _track_loaded(),
+    _track_dirty(),
+    _image_dirty(false)
+{
+    std::memset(_track_map, NO_TRACK, sizeof(_track_map));
+}
 
 /**
  * Reset the disk drive to its default state. This doesn't remove any disk data,
@@ -40,36 +130,168 @@ void DiskDrive::Reset()
 }
 
 /**
- * Encodes a disk image into the correct format for use by the Apple II
- * firmware.
+ * Insert a disk image. Each track gets encoded into the correct format for use
+ * by the Apple II firmware the first time it's accessed.
+ *
+ * @param filename Full path to the disk image (probably downloaded online).
  *
- * @param disk The raw non-encoded disk image (probably downloaded online).
+ * @return True if the disk was inserted, false if the image couldn't be opened
+ *         or isn't in a known format (the drive is left empty).
  */
-void DiskDrive::LoadDisk(std::string filename, uint8_t disk[DISK_SIZE])
+bool DiskDrive::LoadDisk(std::string filename)
 {
     if(_disk_loaded)
         UnloadDisk();
 
-    for(int i = 0; i < NUM_TRACKS; ++i)
-        encode_track(i, disk + (i * NUM_SECTORS * SECTOR_SIZE));
+    if(!_image.Open(filename))
+        return false;
+
+    _format = detect_format();
+
+    if(_format == FORMAT_UNKNOWN || !map_tracks())
+    {
+        _image.Close();
+        _format = FORMAT_UNKNOWN;
+        _write_protected = false;
+        return false;
+    }
 
     _disk_loaded = true;
     _filename = filename;
+
+    return true;
 }
 
 /**
- * Unload a disk from the drive.
+ * Unload a disk from the drive. Any changes made to the disk are written back
+ * to the image file first.
  */
 void DiskDrive::UnloadDisk()
 {
-    for(int i = 0; i < NUM_TRACKS; ++i)
-        _tracks[i].clear();
+    FlushWrites();
+
+    _image.Close();
+    _format = FORMAT_UNKNOWN;
+
+    for(int i = 0; i < MAX_TRACKS; ++i)
+    {
+        _shared_tracks[i].reset();
+        _track_loaded[i] = false;
+        _track_dirty[i] = false;
+    }
+
+    _num_tracks = 0;
+    std::memset(_track_map, NO_TRACK, sizeof(_track_map));
+
+    _image_dirty = false;
 
     _cur_bit = 0;
+    _cur_track_bits = 0;
     _disk_loaded = false;
+    _write_protected = false;
+    _accelerated = false;
     _filename = "";
 }
 
+/**
+ * Write any changes made to the disk back out to the image file. Only the
+ * tracks written to since the last flush get decoded, and the file is replaced
+ * atomically so a crash can't leave a half-written image behind.
+ *
+ * @return True if the image file is up to date, false if it couldn't be
+ *         written (the changes are kept so the next flush tries again).
+ */
+bool DiskDrive::FlushWrites()
+{
+    if(!_disk_loaded)
+        return true;
+
+    /**
+     * If the image file couldn't be found when a save state was loaded,
+     * there's nowhere to write changes to.
+     */
+    if(!_image.IsOpen())
+    {
+        for(int i = 0; i < _num_tracks; ++i)
+        {
+            if(_track_dirty[i])
+                return false;
+        }
+
+        return true;
+    }
+
+    for(int i = 0; i < _num_tracks; ++i)
+    {
+        if(_track_dirty[i])
+        {
+            decode_track(i);
+            _track_dirty[i] = false;
+            _image_dirty = true;
+        }
+    }
+
+    if(_image_dirty && _format == FORMAT_WOZ)
+        update_woz_crc();
+
+    if(_image_dirty && _image.Write())
+        _image_dirty = false;
+
+    return !_image_dirty;
+}
+
+/**
+ * Reload the disk if something else changed its image file. Whatever changed
+ * the file wins: changes made by the emulator that haven't been written yet
+ * are thrown away.
+ *
+ * @return True if the disk was reloaded (or removed, if the new file isn't a
+ *         valid image), false if the file hasn't changed.
+ */
+bool DiskDrive::ReloadIfChanged()
+{
+    if(!_disk_loaded || !_image.HasChanged())
+        return false;
+
+    for(int i = 0; i < _num_tracks; ++i)
+        _track_dirty[i] = false;
+
+    _image_dirty = false;
+
+    /**
+     * The disk keeps spinning from where it was.
+     */
+    const std::string filename = _filename;
+    const uint32_t cur_bit = _cur_bit;
+    const uint32_t cur_track_bits = _cur_track_bits;
+    const bool accelerated = _accelerated;
+
+    if(LoadDisk(filename))
+    {
+        _cur_bit = cur_bit;
+        _cur_track_bits = cur_track_bits;
+        _accelerated = accelerated;
+    }
+
+    return true;
+}
+
+/**
+ * Find the track under the head.
+ *
+ * @param quarter_track Where the head is, in quarter tracks.
+ *
+ * @return The track to pass to the other functions, or NO_TRACK if there's
+ *         nothing to read there.
+ */
+uint8_t DiskDrive::GetTrack(int quarter_track) const
+{
+    if(quarter_track < 0 || quarter_track >= NUM_QUARTER_TRACKS)
+        return NO_TRACK;
+
+    return _track_map[quarter_track];
+}
+
 /**
  * Move the drive one bit position forward.
  *
@@ -77,21 +299,42 @@ void DiskDrive::UnloadDisk()
  */
 void DiskDrive::SeekBit(uint8_t track_num)
 {
-    if(_disk_loaded && track_num < NUM_TRACKS)
-        _cur_bit = (_cur_bit + 1) % (_tracks[track_num].size() * 8);
+    if(select_track(track_num))
+    {
+        if(++_cur_bit >= _track_bits[track_num])
+            _cur_bit = 0;
+    }
 }
 
 /**
- * Seeks back to the beginning of the current byte. This is used to synchronize
- * any writes to the beginning of a byte. A real disk controller uses
- * "self-sync" bytes to keep this synchronization.
+ * Move the drive forward by any number of bits. This takes the same amount of
+ * time no matter how many times the disk spins around.
  *
  * @param track_num The track to seek on.
+ * @param num_bits The number of bits to move forward by.
+ */
+void DiskDrive::SeekBits(uint8_t track_num, uint32_t num_bits)
+{
+    if(select_track(track_num))
+    {
+        const uint32_t track_bits = _track_bits[track_num];
+        _cur_bit = (_cur_bit + (num_bits % track_bits)) % track_bits;
+    }
+}
+
+/**
+ * Get the length of a track.
+ *
+ * @param track_num The track to get the length of.
+ *
+ * @return The number of bits on the track (zero if there's nothing there).
  */
-void DiskDrive::SeekPrevByte(uint8_t track_num)
+uint32_t DiskDrive::GetTrackBits(uint8_t track_num)
 {
-    if(_disk_loaded && track_num < NUM_TRACKS)
-        _cur_bit = (_cur_bit / 8) * 8;
+    if(select_track(track_num))
+        return _track_bits[track_num];
+
+    return 0;
 }
 
 /**
@@ -102,14 +345,64 @@ void DiskDrive::SeekPrevByte(uint8_t track_num)
  */
 void DiskDrive::SetBit(uint8_t track_num, uint8_t data)
 {
-    if(_disk_loaded && track_num < NUM_TRACKS)
+    if(select_track(track_num))
     {
         int byte_index = _cur_bit / 8;
         int bit_index = 7 - (_cur_bit % 8);
 
-        _tracks[track_num][byte_index] &= ~(1 << bit_index);
-        _tracks[track_num][byte_index] |= (data & 1) << bit_index;
+        const uint8_t old_byte = get_track_data(track_num)[byte_index];
+        const uint8_t new_byte = (old_byte & ~(1 << bit_index)) |
+                                 ((data & 1) << bit_index);
+
+        /**
+         * Writing a bit that's already there doesn't change anything, so
+         * the track can stay shared.
+         */
+        if(new_byte == old_byte)
+            return;
+
+        unshare_track(track_num)[byte_index] = new_byte;
+        _track_dirty[track_num] = true;
+    }
+}
+
+/**
+ * Find the next field prologue (D5 AA) coming up on a track. The prologue is
+ * searched for bit by bit, so it's found no matter how it lines up with the
+ * bytes on the track. The search can start a little behind the head, so a
+ * prologue that's only just started passing under the head isn't mistaken
+ * for one that's still to come.
+ *
+ * @param track_num The track to search.
+ * @param num_bits_back How many bits behind the head to start searching.
+ *
+ * @return The number of bits from where the search started to the start of
+ *         the prologue, or zero if there isn't one on the track.
+ */
+uint32_t DiskDrive::FindPrologue(uint8_t track_num, uint32_t num_bits_back)
+{
+    if(!select_track(track_num))
+        return 0;
+
+    const uint8_t *data = get_track_data(track_num).data();
+    const uint32_t track_bits = _track_bits[track_num];
+
+    uint32_t bit = (_cur_bit + track_bits - (num_bits_back % track_bits)) %
+                   track_bits;
+    uint16_t window = 0;
+
+    for(uint32_t i = 0; i < track_bits + 16; ++i)
+    {
+        window = (window << 1) | ((data[bit / 8] >> (7 - (bit % 8))) & 1);
+
+        if(++bit >= track_bits)
+            bit = 0;
+
+        if(i >= 15 && window == field_prologue)
+            return i - 15;
     }
+
+    return 0;
 }
 
 /**
@@ -123,12 +416,65 @@ uint8_t DiskDrive::GetBit(uint8_t track_num)
 {
     uint8_t ret_val = 0;
 
-    if(_disk_loaded && track_num < NUM_TRACKS)
+    if(select_track(track_num))
     {
         int byte_index = _cur_bit / 8;
         int bit_index = 7 - (_cur_bit % 8);
 
-        ret_val = (_tracks[track_num][byte_index] >> bit_index) & 1;
+        ret_val = (get_track_data(track_num)[byte_index] >> bit_index) & 1;
+    }
+
+    return ret_val;
+}
+
+/**
+ * Get the next 32 bits on a track without moving past them, so the disk
+ * controller can shift in a run of bits without going through the drive for
+ * every one of them.
+ *
+ * @param track_num The track to read from.
+ *
+ * @return The bits, starting with the bit under the head in the most
+ *         significant bit (wrapping around to the start of the track).
+ */
+uint32_t DiskDrive::PeekBits(uint8_t track_num)
+{
+    uint32_t ret_val = 0;
+
+    if(select_track(track_num))
+    {
+        const std::vector<uint8_t> &track = get_track_data(track_num);
+        const uint8_t *data = track.data();
+        const uint32_t track_bits = _track_bits[track_num];
+        const uint32_t byte_index = _cur_bit / 8;
+
+        /**
+         * Away from the end of the track, the bits come out of the five bytes
+         * they're spread across in one go.
+         */
+        if(_cur_bit + 32 <= track_bits &&
+           byte_index + 5 <= track.size())
+        {
+            uint64_t window = 0;
+
+            for(int i = 0; i < 5; ++i)
+                window = (window << 8) | data[byte_index + i];
+
+            ret_val = static_cast<uint32_t>(window >> (8 - (_cur_bit % 8)));
+        }
+        else
+        {
+            uint32_t bit = _cur_bit;
+
+            for(int i = 0; i < 32; ++i)
+            {
+                ret_val = (ret_val << 1) |
+                          ((data[bit / 8] >> (7 - (bit % 8))) & 1);
+
+                if(++bit >= track_bits)
+                    bit = 0;
+            }
+        }
     }
 
     return ret_val;
@@ -144,6 +490,28 @@ bool DiskDrive::GetWriteProtect() const
     return _write_protected;
 }
 
+/**
+ * Allow (or stop) reads from this disk being sped up. Only software that
+ * reads the disk through the usual DOS/ProDOS routines should be sped up;
+ * anything that times the disk itself can be thrown off.
+ *
+ * @param accelerated True to speed up reads, false otherwise.
+ */
+void DiskDrive::SetAccelerated(bool accelerated)
+{
+    _accelerated = accelerated;
+}
+
+/**
+ * Check whether reads from this disk are being sped up.
+ *
+ * @return True if reads are sped up, false otherwise.
+ */
+bool DiskDrive::GetAccelerated() const
+{
+    return _disk_loaded && _accelerated;
+}
+
 /**
  * Returns back the filename.
  *
@@ -156,239 +524,801 @@ std::string DiskDrive::GetFilename() const
 }
 
 /**
- * Encodes a single track.
+ * Get the format of the inserted disk image.
  *
- * @param track_num The track to encode.
- * @param data A pointer to the data where the track begins.
+ * @return The image format (FORMAT_UNKNOWN if no disk is loaded).
+ */
+DiskDrive::ImageFormat DiskDrive::GetFormat() const
+{
+    return _format;
+}
+
+/**
+ * Work out the format of the opened image. Bit-stream images are recognized
+ * by their header, and the rest by their file extension and size. Images with
+ * 256-byte sectors are assumed to be in DOS 3.3 order unless they have a ".po"
+ * extension.
+ *
+ * @return The image format, or FORMAT_UNKNOWN if it isn't a valid image.
+ */
+DiskDrive::ImageFormat DiskDrive::detect_format() const
+{
+    static constexpr uint8_t woz_signature[4] = { 0xFF, 0x0A, 0x0D, 0x0A };
+
+    const uint8_t *data = _image.GetData();
+
+    if(_image.GetSize() >= WOZ_HEADER_SIZE &&
+       (std::memcmp(data, "WOZ1", 4) == 0 ||
+        std::memcmp(data, "WOZ2", 4) == 0) &&
+       std::memcmp(data + 4, woz_signature, 4) == 0)
+    {
+        return FORMAT_WOZ;
+    }
+
+    std::string filename = _image.GetFilename();
+    std::string extension = "";
+
+    const size_t dot = filename.find_last_of('.');
+    if(dot != std::string::npos)
+        extension = filename.substr(dot + 1);
+
+    for(char &c : extension)
+        c = std::tolower(static_cast<unsigned char>(c));
+
+    const size_t size = _image.GetSize();
+
+    if(extension == "nib")
+        return (size == NIB_DISK_SIZE) ? FORMAT_NIB : FORMAT_UNKNOWN;
+
+    if(size != DISK_SIZE)
+        return FORMAT_UNKNOWN;
+
+    return (extension == "po") ? FORMAT_PRODOS : FORMAT_DOS;
+}
+
+/**
+ * Work out where each track is in the image, how long it is, and which quarter
+ * track positions it can be read from.
+ *
+ * @return True if the image is valid, false otherwise.
  */
-void DiskDrive::encode_track(uint8_t track_num, uint8_t *data)
+bool DiskDrive::map_tracks()
 {
+    if(_format == FORMAT_WOZ)
+        return map_woz_tracks();
+
+    _num_tracks = NUM_TRACKS;
+
+    for(int i = 0; i < NUM_TRACKS; ++i)
+    {
+        if(_format == FORMAT_NIB)
+        {
+            _track_offset[i] = i * NIB_TRACK_SIZE;
+            _track_bits[i] = NIB_TRACK_SIZE * 8;
+        }
+        else
+        {
+            _track_offset[i] = i * NUM_SECTORS * SECTOR_SIZE;
+            _track_bits[i] = ENCODED_TRACK_SIZE * 8;
+        }
+    }
+
     /**
-     * Sector interleaving table. By not having all of the sectors located next
-     * to each other in ascending order, it gives DOS more time to process a
-     * sector before having to read the next one.
+     * Each track is four quarter tracks wide.
      */
-    constexpr uint8_t sector_trans[16] = { 0, 13, 11, 9, 7, 5, 3, 1,
-                                           14, 12, 10, 8, 6, 4, 2, 15 };
+    for(int i = 0; i < NUM_QUARTER_TRACKS; ++i)
+        _track_map[i] = (i / 4 < NUM_TRACKS) ? (i / 4) : NO_TRACK;
 
-    for(int i = 0; i < NUM_SECTORS; ++i)
-        encode_sector(track_num, sector_trans[i], data + (i * SECTOR_SIZE));
+    return true;
 }
 
 /**
- * Encode a single sector. This involves adding addressing information and sync
- * bytes as well as performing "6 and 2" encoding on the data.
+ * Read the track map and track list out of a bit-stream image. Version 1
+ * images store each track in a fixed size slot, while version 2 images point
+ * to where each track starts (in 512-byte blocks).
  *
- * This code is based off of the explodeSector() function from the apple2js
- * project located here:
- * https://github.com/whscullin/apple2js/blob/master/js/disk2.js
+ * The format is described here: https://applesaucefdc.com/woz/reference2/
  *
- * @param track_num The track this sector is on.
- * @param sector_num Which sector this is.
- * @param data A pointer to the data where the track begins.
+ * @return True if the image is valid, false otherwise.
  */
-void DiskDrive::encode_sector(uint8_t track_num,
-                              uint8_t sector_num,
-                              uint8_t *data)
+bool DiskDrive::map_woz_tracks()
 {
-    /**
-     * Translation table used to translate 8-bit data bytes into "6 and 2"
-     * disk bytes.
-     */
-    uint8_t trans62[64] = { 0x96, 0x97, 0x9a, 0x9b, 0x9d, 0x9e, 0x9f, 0xa6,
-                            0xa7, 0xab, 0xac, 0xad, 0xae, 0xaf, 0xb2, 0xb3,
-                            0xb4, 0xb5, 0xb6, 0xb7, 0xb9, 0xba, 0xbb, 0xbc,
-                            0xbd, 0xbe, 0xbf, 0xcb, 0xcd, 0xce, 0xcf, 0xd3,
-                            0xd6, 0xd7, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde,
-                            0xdf, 0xe5, 0xe6, 0xe7, 0xe9, 0xea, 0xeb, 0xec,
-                            0xed, 0xee, 0xef, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6,
-                            0xf7, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
-    /**
-     * Gap 1 appears before the first sector and is 128 bytes.
-     * Gap 3 appears before every other sector and is 40 bytes.
-     */
-    const int num_gap_bytes = (sector_num == 0) ? 128 : 40;
-    encode_gap(track_num, num_gap_bytes);
+    const uint8_t *data = _image.GetData();
+    const size_t size = _image.GetSize();
+    const bool version_2 = (data[3] == '2');
 
-    /**
-     * Encode the address field.
-     */
-    uint8_t checksum = DEFAULT_VOLUME ^ track_num ^ sector_num;
-    _tracks[track_num].push_back(0xD5);
-    _tracks[track_num].push_back(0xAA);
-    _tracks[track_num].push_back(0x96);
-    encode_44(track_num, DEFAULT_VOLUME);
-    encode_44(track_num, track_num);
-    encode_44(track_num, sector_num);
-    encode_44(track_num, checksum);
-    _tracks[track_num].push_back(0xDE);
-    _tracks[track_num].push_back(0xAA);
-    _tracks[track_num].push_back(0xEB);
+    const uint8_t *info = nullptr;
+    const uint8_t *tmap = nullptr;
+    const uint8_t *trks = nullptr;
+    uint32_t trks_size = 0;
 
-    /**
-     * Gap 2 appears between the address and data fields for 5 bytes.
-     */
-    encode_gap(track_num, 6);
+    size_t offset = WOZ_HEADER_SIZE;
+    while(offset + WOZ_CHUNK_HEADER_SIZE <= size)
+    {
+        const uint8_t *chunk = data + offset + WOZ_CHUNK_HEADER_SIZE;
+        const uint32_t chunk_size = read_le32(data + offset + 4);
+
+        /**
+         * The chunks needed are checked for below, so a damaged chunk at the
+         * end of the image (e.g. metadata) doesn't stop it from loading.
+         */
+        if(chunk_size > size - (offset + WOZ_CHUNK_HEADER_SIZE))
+            break;
+
+        if(std::memcmp(data + offset, "INFO", 4) == 0 &&
+           chunk_size >= WOZ_INFO_SIZE)
+        {
+            info = chunk;
+        }
+        else if(std::memcmp(data + offset, "TMAP", 4) == 0 &&
+                chunk_size >= NUM_QUARTER_TRACKS)
+        {
+            tmap = chunk;
+        }
+        else if(std::memcmp(data + offset, "TRKS", 4) == 0)
+        {
+            trks = chunk;
+            trks_size = chunk_size;
+        }
+
+        offset += WOZ_CHUNK_HEADER_SIZE + chunk_size;
+    }
 
     /**
-     * Encode the data field.
+     * Only 5.25" disks are supported.
      */
-    _tracks[track_num].push_back(0xD5);
-    _tracks[track_num].push_back(0xAA);
-    _tracks[track_num].push_back(0xAD);
+    if(info == nullptr || tmap == nullptr || trks == nullptr || info[1] != 1)
+        return false;
+
+    const int max_tracks = (version_2) ?
+                           std::min<uint32_t>(trks_size / WOZ2_TRACK_ENTRY_SIZE,
+                                              MAX_TRACKS) :
+                           std::min<uint32_t>(trks_size / WOZ1_TRACK_SIZE,
+                                              MAX_TRACKS);
+
+    _num_tracks = 0;
+
+    for(int i = 0; i < NUM_QUARTER_TRACKS; ++i)
+    {
+        if(tmap[i] != NO_TRACK && tmap[i] >= max_tracks)
+            return false;
+
+        _track_map[i] = tmap[i];
+
+        if(tmap[i] != NO_TRACK)
+            _num_tracks = std::max(_num_tracks, tmap[i] + 1);
+    }
+
+    for(int i = 0; i < _num_tracks; ++i)
+    {
+        uint32_t track_offset = 0;
+        uint32_t track_bits = 0;
+
+        if(version_2)
+        {
+            const uint8_t *entry = trks + (i * WOZ2_TRACK_ENTRY_SIZE);
+
+            track_offset = read_le16(entry) * WOZ2_BLOCK_SIZE;
+            track_bits = read_le32(entry + 4);
+        }
+        else
+        {
+            const uint8_t *entry = trks + (i * WOZ1_TRACK_SIZE);
+
+            track_offset = entry - data;
+            track_bits = read_le16(entry + WOZ1_BIT_COUNT_OFFSET);
+
+            if(track_bits > WOZ1_MAX_TRACK_BYTES * 8)
+                return false;
+        }
+
+        if(track_bits > MAX_TRACK_BITS)
+            return false;
+
+        const uint64_t track_size = (static_cast<uint64_t>(track_bits) + 7) / 8;
+        if(track_offset + track_size > size)
+            return false;
+
+        _track_offset[i] = track_offset;
+        _track_bits[i] = track_bits;
+    }
 
     /**
-     * The data is being encoded using the "6 and 2" encoding described in
-     * Beneath Apple DOS. This encoding takes 256 regular bytes, and encodes it
-     * into 342 "disk bytes".
-     *
-     * The following code converts the 8-bit bytes into 6-bit and 2-bit bytes.
-     * These new bytes have to be placed in a certain order so they can be
-     * translated correctly by DOS.
+     * Every track the head can land on needs some bits on it.
      */
-    uint8_t nibbles[342] = { 0 };
+    for(int i = 0; i < NUM_QUARTER_TRACKS; ++i)
+    {
+        if(_track_map[i] != NO_TRACK && _track_bits[_track_map[i]] == 0)
+            return false;
+    }
+
+    _write_protected = (info[2] != 0);
+
+    return true;
+}
+
+/**
+ * Update the CRC-32 in a bit-stream image's header after its tracks change.
+ */
+void DiskDrive::update_woz_crc()
+{
+    uint8_t *data = _image.GetData();
+    uint32_t crc = 0xFFFFFFFF;
 
-    constexpr int val6_offset = 86;
-    for(int idx2 = 85, idx6 = 257; idx6 >= 0; --idx6)
+    for(size_t i = WOZ_HEADER_SIZE; i < _image.GetSize(); ++i)
     {
-        uint8_t val6 = data[idx6 % 256];
-        uint8_t val2 = nibbles[idx2];
+        crc ^= data[i];
+
+        for(int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+
+    crc = ~crc;
+
+    for(int i = 0; i < 4; ++i)
+        data[WOZ_CRC_OFFSET + i] = (crc >> (i * 8)) & 0xFF;
+}
+
+/**
+ * Get the number of bytes a track takes up in the disk image.
+ *
+ * @param track_num The track.
+ *
+ * @return The size of the track in the image in bytes.
+ */
+uint32_t DiskDrive::get_image_track_size(uint8_t track_num) const
+{
+    return get_image_track_size(_format, _track_bits[track_num]);
+}
+
+/**
+ * Get the number of bytes a track takes up in a disk image of any format.
+ *
+ * @param format The format of the disk image.
+ * @param track_bits The number of bits on the track.
+ *
+ * @return The size of the track in the image in bytes.
+ */
+uint32_t DiskDrive::get_image_track_size(ImageFormat format,
+                                         uint32_t track_bits)
+{
+    switch(format)
+    {
+    case FORMAT_NIB:
+        return NIB_TRACK_SIZE;
+
+    case FORMAT_WOZ:
+        return (static_cast<uint64_t>(track_bits) + 7) / 8;
+
+    default:
+        return NUM_SECTORS * SECTOR_SIZE;
+    }
+}
+
+/**
+ * Find a track's data in the disk image.
+ *
+ * @param track_num The track.
+ *
+ * @return The start of the track's data, or nullptr if no image is open or the
+ *         track doesn't fit inside it.
+ */
+const uint8_t* DiskDrive::get_image_track(uint8_t track_num)
+{
+    if(!_image.IsOpen())
+        return nullptr;
+
+    const uint64_t track_end = static_cast<uint64_t>(_track_offset[track_num]) +
+                               get_image_track_size(track_num);
 
-        val2 = (val2 << 1) | (val6 & 1);
-        val6 >>= 1;
-        val2 = (val2 << 1) | (val6 & 1);
-        val6 >>= 1;
+    if(track_end > _image.GetSize())
+        return nullptr;
 
-        nibbles[val6_offset + idx6] = val6;
-        nibbles[idx2] = val2;
+    return _image.GetData() + _track_offset[track_num];
+}
+
+/**
+ * Get the sector interleaving table for the image's format.
+ *
+ * @return Maps each sector in the image to a physical sector on the track.
+ */
+const uint8_t* DiskDrive::get_sector_trans() const
+{
+    return (_format == FORMAT_PRODOS) ? prodos_sector_trans : dos_sector_trans;
+}
+
+/**
+ * Make sure a track has been encoded before the drive head accesses it.
+ *
+ * @param track_num The track being accessed.
+ *
+ * @return True if the track can be accessed, false if no disk is loaded or the
+ *         track doesn't exist.
+ */
+bool DiskDrive::load_track(uint8_t track_num)
+{
+    if(!_disk_loaded || track_num >= _num_tracks)
+        return false;
 
-        if (--idx2 < 0)
-            idx2 = 85;
+    if(!_track_loaded[track_num])
+    {
+        encode_track(track_num, _image.GetData() + _track_offset[track_num]);
+        _track_loaded[track_num] = true;
     }
 
-    uint8_t last = 0;
-    for(int i = 0; i < 342; ++i)
+    return true;
+}
+
+/**
+ * Get a track ready to be read or written by the drive head. If the head just
+ * moved over from a track of a different length, the current position gets
+ * scaled to the same point in the disk's rotation on the new track.
+ *
+ * @param track_num The track under the head.
+ *
+ * @return True if the track can be accessed, false if no disk is loaded or
+ *         there's nothing on the track.
+ */
+bool DiskDrive::select_track(uint8_t track_num)
+{
+    if(!load_track(track_num) || _track_bits[track_num] == 0)
+        return false;
+
+    const uint32_t track_bits = _track_bits[track_num];
+
+    if(track_bits != _cur_track_bits)
     {
-        uint8_t val = nibbles[i];
-        _tracks[track_num].push_back(trans62[last ^ val]);
-        last = val;
+        if(_cur_track_bits != 0)
+        {
+            _cur_bit = (static_cast<uint64_t>(_cur_bit) * track_bits) /
+                       _cur_track_bits;
+        }
+
+        if(_cur_bit >= track_bits)
+            _cur_bit %= track_bits;
+
+        _cur_track_bits = track_bits;
     }
 
-    _tracks[track_num].push_back(trans62[last]);
+    return true;
+}
 
-    _tracks[track_num].push_back(0xDE);
-    _tracks[track_num].push_back(0xAA);
-    _tracks[track_num].push_back(0xEB);
+/**
+ * Encodes a single track from the disk image. If any drive has already
+ * encoded the same image data, its track gets shared instead.
+ *
+ * @param track_num The track to encode.
+ * @param data The track's data in the disk image (or in a saved state).
+ */
+void DiskDrive::encode_track(uint8_t track_num, const uint8_t *data)
+{
+    const uint32_t size = get_image_track_size(track_num);
 
     /**
-     * Beginning of the next Gap 3.
+     * Sector images encode differently depending on their sector order and
+     * which track they're on (it's in every address field). Pre-nibblized
+     * and bit-stream tracks are the image data as is.
      */
-    encode_gap(track_num, 1);
+    const bool sectored = (_format != FORMAT_NIB && _format != FORMAT_WOZ);
+    const uint32_t variant = (sectored) ? ((_format << 8) | track_num) : 0;
+
+    TrackCache &cache = TrackCache::Shared();
+    const TrackCache::Key key = TrackCache::MakeKey(data, size, variant);
+
+    TrackCache::TrackPtr track = cache.Find(key, data);
+
+    if(!track)
+    {
+        TrackCache::Track *new_track = new TrackCache::Track();
+
+        if(sectored)
+            encode_sectors(track_num, data, new_track->data);
+        else
+            new_track->data.assign(data, data + size);
+
+        track = cache.Insert(key, data, new_track);
+    }
+
+    _shared_tracks[track_num] = track;
 }
 
 /**
- * Encodes a sequence of gap (self-sync) bytes. These are used to synchronize
- * disk controller so it knows where the start of a byte is. It also gives the
- * firmware time to decode the data and process it. Since this is an emulator,
- * we know exactly where the start of each byte is, so we can be more liberal
- * with how we encode these gap bytes.
- *
- * Usually these are 10-bit bytes (turns out "byte" doesn't imply 8-bits) where
- * the first 8-bits are 0xFF, and the last two bits are '0'. Since we know where
- * the beginning of every byte is, we don't encode those useless zero bits.
+ * Encode every sector on a track.
  *
- * @param track_num The track number to add the gap bytes to.
- * @param num_bytes Number of gap bytes to encode.
+ * @param track_num The track being encoded.
+ * @param data The track's sectors in the disk image.
+ * @param out Filled in with the encoded track.
  */
-void DiskDrive::encode_gap(uint8_t track_num, int num_bytes)
+void DiskDrive::encode_sectors(uint8_t track_num,
+                               const uint8_t *data,
+                               std::vector<uint8_t> &out)
 {
-    for(int i = 0; i < num_bytes; ++i)
-        _tracks[track_num].push_back(0xFF);
+    out.resize(ENCODED_TRACK_SIZE);
+
+    GcrCodec::EncodeTrack(&out[0],
+                          DEFAULT_VOLUME,
+                          track_num,
+                          data,
+                          get_sector_trans());
 }
 
 /**
- * Encode a byte into two separate bytes using the "4 and 4" encoding
- * system. Essentially, the data goes from:
- *
- * D7 D6 D5 D4 D3 D2 D1 D0
+ * Get a track's encoded data, whether it's shared or the drive's own copy.
  *
- * To:
+ * @param track_num The track to get.
  *
- * 1 D7 1 D5 1 D3 1 D1
- * 1 D6 1 D4 1 D2 1 D0
+ * @return The track's data.
+ */
+const std::vector<uint8_t>& DiskDrive::get_track_data(uint8_t track_num) const
+{
+    return (_shared_tracks[track_num]) ? _shared_tracks[track_num]->data :
+                                         _tracks[track_num];
+}
+
+/**
+ * Give the drive its own copy of a track (if it's shared) so it can be
+ * written to. The copy reuses the drive's storage for the track, so this only
+ * allocates the first time a track is ever written.
  *
- * This ensures that every byte starts with a '1' and that there's no
- * adjacent zeroes (which is a requirement of the original disk controller).
+ * @param track_num The track to write to.
  *
- * @param track_num The track to append the encoded data to.
- * @param data The byte to encode.
+ * @return The drive's own copy of the track.
  */
-void DiskDrive::encode_44(uint8_t track_num, uint8_t data)
+std::vector<uint8_t>& DiskDrive::unshare_track(uint8_t track_num)
 {
-    _tracks[track_num].push_back((data >> 1) | 0xAA);
-    _tracks[track_num].push_back(data | 0xAA);
+    if(_shared_tracks[track_num])
+    {
+        _tracks[track_num] = _shared_tracks[track_num]->data;
+        _shared_tracks[track_num].reset();
+    }
+
+    return _tracks[track_num];
 }
 
 /**
- * Save the Disk controller state out to a file.
+ * Read the disk bytes off of a track the same way the disk controller would.
+ * The track is read for two full revolutions so that a field that wraps around
+ * the end of the track can still be read in one piece.
  *
- * @param output The file to write to.
+ * @param track_num The track to read.
+ * @param nibbles Filled in with the disk bytes that were read.
  */
-void DiskDrive::SaveState(std::ofstream &output)
+void DiskDrive::read_nibbles(uint8_t track_num, std::vector<uint8_t> &nibbles)
 {
-    output.write(reinterpret_cast<char*>(&_cur_bit), sizeof(_cur_bit));
-    output.write(reinterpret_cast<char*>(&_disk_loaded), sizeof(_disk_loaded));
-    output.write(reinterpret_cast<char*>(&_write_protected),
-                 sizeof(_write_protected));
+    const std::vector<uint8_t> &track = get_track_data(track_num);
+    nibbles.clear();
 
-    if(_disk_loaded)
-    {
-        size_t size = _filename.size();
-        output.write(reinterpret_cast<char*>(&size), sizeof(size));
-        output.write(&_filename[0], size);
+    const uint32_t track_bits = _track_bits[track_num];
 
-        int track_size = _tracks[0].size();
-        output.write(reinterpret_cast<char*>(&track_size), sizeof(track_size));
+    /**
+     * If every byte starts with a '1' (and the track is a whole number of
+     * bytes), the controller reads them exactly as they're stored.
+     */
+    const bool byte_aligned = (track_bits % 8) == 0 &&
+        std::all_of(track.begin(), track.end(),
+                    [](uint8_t byte) { return (byte & 0x80) != 0; });
+
+    if(byte_aligned)
+    {
+        nibbles.insert(nibbles.end(), track.begin(), track.end());
+        nibbles.insert(nibbles.end(), track.begin(), track.end());
+        return;
+    }
 
-        for(int i = 0; i < NUM_TRACKS; ++i)
+    /**
+     * Otherwise shift the bits in one at a time and let the leading '1' of
+     * each byte resynchronize the reads.
+     */
+    uint8_t latch = 0;
+    for(int rev = 0; rev < 2; ++rev)
+    {
+        for(uint32_t i = 0; i < track_bits; ++i)
         {
-            output.write(reinterpret_cast<char*>(&_tracks[i][0]),
-                         track_size * sizeof(uint8_t));
+            latch = (latch << 1) | ((track[i / 8] >> (7 - (i % 8))) & 1);
+
+            if(latch & 0x80)
+            {
+                nibbles.push_back(latch);
+                latch = 0;
+            }
         }
     }
 }
 
 /**
- * Load the Disk controller state out of a file.
+ * Decode a track back into the disk image. Every sector with a valid address
+ * and data field is copied into the image; anything that can't be decoded
+ * (say, a sector that's in the middle of being written) is left alone.
+ *
+ * @param track_num The track to decode.
+ */
+void DiskDrive::decode_track(uint8_t track_num)
+{
+    const std::vector<uint8_t> &track = get_track_data(track_num);
+
+    if(track.empty())
+        return;
+
+    /**
+     * Bit-stream images hold the bits exactly as they are on the track.
+     */
+    if(_format == FORMAT_WOZ)
+    {
+        std::memcpy(_image.GetData() + _track_offset[track_num],
+                    &track[0],
+                    std::min<size_t>(track.size(),
+                                     get_image_track_size(track_num)));
+        return;
+    }
+
+    std::vector<uint8_t> nibbles;
+    read_nibbles(track_num, nibbles);
+
+    const size_t rev_size = nibbles.size() / 2;
+
+    /**
+     * Pre-nibblized images just hold the disk bytes. A track written out of
+     * sync can read back as fewer bytes than it started with, so fill the
+     * rest of the track with sync bytes.
+     */
+    if(_format == FORMAT_NIB)
+    {
+        uint8_t *image = _image.GetData() + _track_offset[track_num];
+        const size_t num_bytes = std::min<size_t>(rev_size, NIB_TRACK_SIZE);
+
+        std::memcpy(image, &nibbles[0], num_bytes);
+        std::memset(image + num_bytes, 0xFF, NIB_TRACK_SIZE - num_bytes);
+        return;
+    }
+
+    GcrCodec::DecodeTrack(&nibbles[0],
+                          nibbles.size(),
+                          track_num,
+                          get_sector_trans(),
+                          _image.GetData() + _track_offset[track_num]);
+}
+
+/**
+ * Save the Disk controller state. Saving never encodes a track: tracks that
+ * haven't been loaded yet are saved as they are in the disk image.
  *
- * @param input The file to read from.
+ * @param output Where to write the state.
  */
-void DiskDrive::LoadState(std::ifstream &input)
+void DiskDrive::SaveState(StateWriter &output)
 {
-    input.read(reinterpret_cast<char*>(&_cur_bit), sizeof(_cur_bit));
-    input.read(reinterpret_cast<char*>(&_disk_loaded), sizeof(_disk_loaded));
-    input.read(reinterpret_cast<char*>(&_write_protected),
-               sizeof(_write_protected));
+    output.Write(&_cur_bit, sizeof(_cur_bit));
+    output.Write(&_disk_loaded, sizeof(_disk_loaded));
+    output.Write(&_write_protected, sizeof(_write_protected));
 
     if(_disk_loaded)
     {
-        size_t size = _filename.size();
-        input.read(reinterpret_cast<char*>(&size), sizeof(size));
-        _filename.resize(size);
-        input.read(&_filename[0], size);
+        uint32_t size = _filename.size();
+        output.Write(&size, sizeof(size));
+        output.Write(&_filename[0], size);
 
-        int track_size = 0;
-        input.read(reinterpret_cast<char*>(&track_size), sizeof(track_size));
+        uint8_t format = _format;
+        output.Write(&format, sizeof(format));
+        output.Write(&_cur_track_bits, sizeof(_cur_track_bits));
+        output.Write(&_num_tracks, sizeof(_num_tracks));
+        output.Write(_track_map, sizeof(_track_map));
 
-        for(int i = 0; i < NUM_TRACKS; ++i)
+        for(int i = 0; i < _num_tracks; ++i)
         {
-            _tracks[i].resize(track_size);
-            input.read(reinterpret_cast<char*>(&_tracks[i][0]),
-                       track_size * sizeof(uint8_t));
+            output.Write(&_track_offset[i], sizeof(_track_offset[i]));
+            output.Write(&_track_bits[i], sizeof(_track_bits[i]));
+
+            /**
+             * Tracks the head hasn't been over yet are saved as they are in
+             * the image, rather than encoding them just to save them.
+             */
+            const uint8_t *image_track = (_track_loaded[i]) ?
+                                         nullptr : get_image_track(i);
+            const uint8_t encoded = (image_track == nullptr);
+            output.Write(&encoded, sizeof(encoded));
+
+            if(encoded)
+            {
+                load_track(i);
+
+                const std::vector<uint8_t> &track = get_track_data(i);
+                output.Write(track.data(), track.size() * sizeof(uint8_t));
+            }
+            else
+            {
+                output.Write(image_track, get_image_track_size(i));
+            }
         }
     }
-    else
+}
+
+/**
+ * Load the Disk controller state. If the same disk image is still in the
+ * drive, the tracks are restored in place: tracks that haven't changed since
+ * the state was saved are left alone (and stay shared), and tracks that differ
+ * from the image are marked as changed, to be written out the next time the
+ * disk gets flushed. The image file is only written if the state takes the
+ * disk out of the drive (or swaps it for another), in which case the changes
+ * made to it are flushed first, just like unloading it.
+ *
+ * @param input Where to read the state from.
+ */
+void DiskDrive::LoadState(StateReader &input)
+{
+    uint32_t cur_bit = 0;
+    bool disk_loaded = false;
+    bool write_protected = false;
+
+    input.Read(&cur_bit, sizeof(cur_bit));
+    input.Read(&disk_loaded, sizeof(disk_loaded));
+    input.Read(&write_protected, sizeof(write_protected));
+
+    if(input.Failed())
+        return;
+
+    /**
+     * Changes to the disk being taken out are written back first, the same
+     * as when a disk is unloaded.
+     */
+    if(!disk_loaded)
     {
         UnloadDisk();
+        return;
+    }
+
+    uint32_t size = 0;
+    input.Read(&size, sizeof(size));
+    if(size > MAX_FILENAME_SIZE)
+    {
+        input.SetFailed();
+        return;
+    }
+
+    const char *filename = reinterpret_cast<const char*>(input.ReadData(size));
+
+    uint8_t format = FORMAT_UNKNOWN;
+    uint32_t cur_track_bits = 0;
+    int num_tracks = 0;
+    uint8_t track_map[NUM_QUARTER_TRACKS];
+
+    input.Read(&format, sizeof(format));
+    input.Read(&cur_track_bits, sizeof(cur_track_bits));
+    input.Read(&num_tracks, sizeof(num_tracks));
+    input.Read(track_map, sizeof(track_map));
+
+    if(format > FORMAT_WOZ || num_tracks < 0 || num_tracks > MAX_TRACKS)
+        input.SetFailed();
+
+    /**
+     * The head has to be somewhere on the track it was last on (a length of
+     * zero means no track has been read yet).
+     */
+    if(cur_track_bits > MAX_TRACK_BITS ||
+       (cur_track_bits != 0 && cur_bit >= cur_track_bits))
+        input.SetFailed();
+
+    /**
+     * Check every track is there before changing anything, so a damaged state
+     * can't take out the disk that's in the drive.
+     */
+    StateReader tracks = input;
+
+    for(int i = 0; i < num_tracks && !tracks.Failed(); ++i)
+    {
+        uint32_t track_offset = 0;
+        uint32_t track_bits = 0;
+        uint8_t encoded = 0;
+
+        tracks.Read(&track_offset, sizeof(track_offset));
+        tracks.Read(&track_bits, sizeof(track_bits));
+        tracks.Read(&encoded, sizeof(encoded));
+
+        if(track_bits > MAX_TRACK_BITS)
+            tracks.SetFailed();
+
+        tracks.ReadData((encoded) ?
+                        (track_bits + 7) / 8 :
+                        get_image_track_size(static_cast<ImageFormat>(format),
+                                             track_bits));
+    }
+
+    if(tracks.Failed())
+        input.SetFailed();
+
+    if(input.Failed())
+        return;
+
+    /**
+     * A different disk was in the drive when the state was saved, so open
+     * its image again. If the file is gone (or has been replaced by a
+     * different kind of image) the disk can still be used, but changes can't
+     * be written back.
+     */
+    if(!_disk_loaded || !_image.IsOpen() || _format != format ||
+       _filename.compare(0, std::string::npos, filename, size) != 0)
+    {
+        const bool accelerated = _accelerated;
+
+        UnloadDisk();
+        _accelerated = accelerated;
+        _filename.assign(filename, size);
+        _format = static_cast<ImageFormat>(format);
+
+        if(!_image.Open(_filename) || detect_format() != _format)
+            _image.Close();
+    }
+
+    _cur_bit = cur_bit;
+    _cur_track_bits = cur_track_bits;
+    _disk_loaded = true;
+    _write_protected = write_protected;
+    _num_tracks = num_tracks;
+    std::memcpy(_track_map, track_map, sizeof(_track_map));
+
+    for(int i = _num_tracks; i < MAX_TRACKS; ++i)
+    {
+        _shared_tracks[i].reset();
+        _track_loaded[i] = false;
+        _track_dirty[i] = false;
+    }
+
+    for(int i = 0; i < _num_tracks; ++i)
+    {
+        uint8_t encoded = 0;
+
+        input.Read(&_track_offset[i], sizeof(_track_offset[i]));
+        input.Read(&_track_bits[i], sizeof(_track_bits[i]));
+        input.Read(&encoded, sizeof(encoded));
+
+        const uint8_t *image_track = get_image_track(i);
+        const bool in_image = (image_track != nullptr);
+
+        /**
+         * A track that was saved as it is in the image only needs encoding
+         * if the image has changed since.
+         */
+        if(!encoded)
+        {
+            const uint32_t image_size = get_image_track_size(i);
+            const uint8_t *track = input.ReadData(image_size);
+
+            if(in_image && std::memcmp(image_track, track, image_size) == 0)
+            {
+                _shared_tracks[i].reset();
+                _track_loaded[i] = false;
+                _track_dirty[i] = false;
+            }
+            else
+            {
+                encode_track(i, track);
+                _track_loaded[i] = true;
+                _track_dirty[i] = in_image;
+            }
+
+            continue;
+        }
+
+        const uint32_t track_size = (_track_bits[i] + 7) / 8;
+        const uint8_t *track = input.ReadData(track_size);
+
+        /**
+         * Compare against the track as it is now (encoding it from the image
+         * if it hasn't been yet, which is cheap if any drive already has).
+         */
+
+        if(in_image)
+            load_track(i);
+
+        const std::vector<uint8_t> &cur_track = get_track_data(i);
+
+        if(_track_loaded[i] && cur_track.size() == track_size &&
+           std::equal(cur_track.begin(), cur_track.end(), track))
+        {
+            continue;
+        }
+
+        _shared_tracks[i].reset();
+        _tracks[i].assign(track, track + track_size);
+        _track_loaded[i] = true;
+        _track_dirty[i] = in_image;
     }
 }
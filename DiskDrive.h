@@ -1,10 +1,12 @@
-#ifndef DISKIMAGE_H
-#define DISKIMAGE_H
+#ifndef DISKDRIVE_H
+#define DISKDRIVE_H
 
+#include "DiskImage.h"
+#include "GcrCodec.h"
 #include "IState.h"
+#include "TrackCache.h"
 
 #include <cstdint>
-#include <fstream>
 #include <string>
 #include <vector>
 
@@ -19,56 +21,152 @@ public:
     /**
      * Number of sectors on a DOS 3.3 disk.
      */
-    static constexpr int NUM_SECTORS = 16;
+    static constexpr int NUM_SECTORS = GcrCodec::NUM_SECTORS;
 
     /**
      * Size of each sector in bytes.
      */
-    static constexpr int SECTOR_SIZE = 256;
+    static constexpr int SECTOR_SIZE = GcrCodec::SECTOR_SIZE;
 
     /**
      * Size of a disk image in bytes (this only includes the data fields).
      */
     static constexpr int DISK_SIZE = NUM_TRACKS * NUM_SECTORS * SECTOR_SIZE;
 
+    /**
+     * Size of each track in a pre-nibblized (.nib) image, and of the whole
+     * image.
+     */
+    static constexpr int NIB_TRACK_SIZE = 6656;
+    static constexpr int NIB_DISK_SIZE = NUM_TRACKS * NIB_TRACK_SIZE;
+
+    /**
+     * Number of quarter tracks the head can be positioned over, which is also
+     * the most tracks a bit-stream (.woz) image can have.
+     */
+    static constexpr int NUM_QUARTER_TRACKS = 160;
+    static constexpr int MAX_TRACKS = NUM_QUARTER_TRACKS;
+
+    /**
+     * Returned by GetTrack() when there's no track under the head.
+     */
+    static constexpr uint8_t NO_TRACK = 0xFF;
+
+    /**
+     * The disk image formats that can be loaded.
+     */
+    enum ImageFormat {
+        FORMAT_UNKNOWN = 0,
+        FORMAT_DOS,     // 256-byte sectors in DOS 3.3 order (.dsk, .do).
+        FORMAT_PRODOS,  // 256-byte sectors in ProDOS order (.po).
+        FORMAT_NIB,     // Disk bytes exactly as they are on each track (.nib).
+        FORMAT_WOZ      // The bits on each track, including timing (.woz).
+    };
+
     /**
      * Default volume number.
      */
     static constexpr uint8_t DEFAULT_VOLUME = 254;
 
+    /**
+     * Size of an encoded track in bytes (see GcrCodec).
+     */
+    static constexpr int ENCODED_SECTOR_SIZE = GcrCodec::ENCODED_SECTOR_SIZE;
+    static constexpr int ENCODED_TRACK_SIZE = GcrCodec::ENCODED_TRACK_SIZE;
+
 public:
     DiskDrive();
 
     void Reset();
 
-    void LoadDisk(std::string filename, uint8_t disk[DISK_SIZE]);
+    bool LoadDisk(std::string filename);
     void UnloadDisk();
+    bool FlushWrites();
+    bool ReloadIfChanged();
+
+    uint8_t GetTrack(int quarter_track) const;
 
     void SeekBit(uint8_t track_num);
-    void SeekPrevByte(uint8_t track_num);
+    void SeekBits(uint8_t track_num, uint32_t num_bits);
+
+    uint32_t GetTrackBits(uint8_t track_num);
+    uint32_t FindPrologue(uint8_t track_num, uint32_t num_bits_back);
 
     void SetBit(uint8_t track_num, uint8_t data);
     uint8_t GetBit(uint8_t track_num);
+    uint32_t PeekBits(uint8_t track_num);
 
     bool GetWriteProtect() const;
+    void SetAccelerated(bool accelerated);
+    bool GetAccelerated() const;
     std::string GetFilename() const;
+    ImageFormat GetFormat() const;
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
 private:
-    void encode_track(uint8_t track_num, uint8_t *data);
-    void encode_sector(uint8_t track_num, uint8_t sector_num, uint8_t *data);
-    void encode_gap(uint8_t track_num, int num_bytes);
-    void encode_44(uint8_t track_num, uint8_t data);
+    ImageFormat detect_format() const;
+    bool map_tracks();
+    bool map_woz_tracks();
+    void update_woz_crc();
+    uint32_t get_image_track_size(uint8_t track_num) const;
+    static uint32_t get_image_track_size(ImageFormat format,
+                                         uint32_t track_bits);
+    const uint8_t* get_image_track(uint8_t track_num);
+    const uint8_t* get_sector_trans() const;
+
+    bool load_track(uint8_t track_num);
+    bool select_track(uint8_t track_num);
+
+    void encode_track(uint8_t track_num, const uint8_t *data);
+    void encode_sectors(uint8_t track_num,
+                        const uint8_t *data,
+                        std::vector<uint8_t> &out);
+
+    const std::vector<uint8_t>& get_track_data(uint8_t track_num) const;
+    std::vector<uint8_t>& unshare_track(uint8_t track_num);
+
+    void read_nibbles(uint8_t track_num, std::vector<uint8_t> &nibbles);
+    void decode_track(uint8_t track_num);
 
 private:
+    /**
+     * Layout of bit-stream (.woz) images: a header (holding a CRC-32 of the
+     * rest of the file) followed by chunks, each with an ID and a size.
+     * Version 1 images store every track in a fixed size slot.
+     */
+    static constexpr int WOZ_HEADER_SIZE = 12;
+    static constexpr int WOZ_CRC_OFFSET = 8;
+    static constexpr int WOZ_CHUNK_HEADER_SIZE = 8;
+    static constexpr int WOZ_INFO_SIZE = 60;
+    static constexpr int WOZ1_TRACK_SIZE = 6656;
+    static constexpr int WOZ1_MAX_TRACK_BYTES = 6646;
+    static constexpr int WOZ1_BIT_COUNT_OFFSET = 6648;
+    static constexpr int WOZ2_TRACK_ENTRY_SIZE = 8;
+    static constexpr int WOZ2_BLOCK_SIZE = 512;
+
+    /**
+     * Limits on what's read out of a disk image or a saved state, so a damaged
+     * one can't make the drive allocate a huge amount of memory (or overflow
+     * the size of a track). No real track comes anywhere close to this size.
+     */
+    static constexpr uint32_t MAX_FILENAME_SIZE = 4096;
+    static constexpr uint32_t MAX_TRACK_BITS = 65536 * 8;
+
     /**
      * The bit to read/write. This is the current position of the disk in its
      * rotation.
      */
     uint32_t _cur_bit;
 
+    /**
+     * Length (in bits) of the track that _cur_bit is a position on. When the
+     * head moves to a track of a different length, the position is scaled so
+     * the disk stays at the same point in its rotation.
+     */
+    uint32_t _cur_track_bits;
+
     /**
      * True if a disk has been loaded, otherwise false.
      */
@@ -79,15 +177,74 @@ private:
      */
     bool _write_protected;
 
+    /**
+     * True if the user has allowed reads from this disk to be sped up by
+     * skipping ahead to the next field the CPU is waiting for.
+     */
+    bool _accelerated;
+
     /**
      * Full path to the disk image if a disk is loaded.
      */
     std::string _filename;
 
     /**
-     * Encoded data for each track.
+     * The disk image file, mapped into memory. Tracks are only encoded from
+     * this the first time the drive head reads or writes them.
+     */
+    DiskImage _image;
+
+    /**
+     * The format of the disk image (changes are written back in the same
+     * format).
+     */
+    ImageFormat _format;
+
+    /**
+     * Number of tracks on the disk, and which of them is under the head at
+     * each quarter track position (NO_TRACK if there isn't one).
+     */
+    int _num_tracks;
+    uint8_t _track_map[NUM_QUARTER_TRACKS];
+
+    /**
+     * Where each track's data starts in the disk image, and how many bits
+     * long each track is.
+     */
+    uint32_t _track_offset[MAX_TRACKS];
+    uint32_t _track_bits[MAX_TRACKS];
+
+    /**
+     * The drive's own copy of each track it has written to (or loaded from a
+     * save state), with the bits packed eight to a byte (most significant bit
+     * first). The storage is kept between disks, so swapping disks doesn't
+     * allocate anything.
+     */
+    std::vector<uint8_t> _tracks[MAX_TRACKS];
+
+    /**
+     * Tracks that are shared with every other drive that loaded the same
+     * image data. These are used instead of _tracks until the track is
+     * written to.
+     */
+    TrackCache::TrackPtr _shared_tracks[MAX_TRACKS];
+
+    /**
+     * True for each track that has been encoded from the disk image.
+     */
+    bool _track_loaded[MAX_TRACKS];
+
+    /**
+     * True for each track that has been written to since it was last decoded
+     * back into the disk image.
+     */
+    bool _track_dirty[MAX_TRACKS];
+
+    /**
+     * True if the disk image has changed since it was last written out to the
+     * disk image file.
      */
-    std::vector<uint8_t> _tracks[NUM_TRACKS];
+    bool _image_dirty;
 };
 
-#endif // DISKIMAGE_H
+#endif // DISKDRIVE_H
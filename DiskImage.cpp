@@ -0,0 +1,326 @@
+/**
+ * Maps a disk image file into memory so it can be encoded straight out of the
+ * file without reading the whole thing in first. Only the parts of the image
+ * that actually get used are ever read off the disk.
+ *
+ * The mapping is private: changes made to the image stay in memory (the
+ * operating system copies each page the first time it's written to) until
+ * Write() replaces the file with the updated image.
+ *
+ * @note Like any mapped file, the image must not be truncated by another
+ *       program while it's open.
+ */
+#include "DiskImage.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Constructor.
+ */
+DiskImage::DiskImage() :
+    _filename(""),
+    _data(nullptr),
+    _size(0),
+#if defined(_WIN32)
+    _buffer(),
+#endif
+    _file_size(0),
+    _file_time(0),
+    _file_id(0)
+{ }
+
+/**
+ * Destructor.
+ */
+DiskImage::~DiskImage()
+{
+    Close();
+}
+
+/**
+ * Open a disk image file (closing whatever image was open before).
+ *
+ * @param filename Full path to the disk image.
+ *
+ * @return True if the image was opened, false otherwise.
+ */
+bool DiskImage::Open(const std::string &filename)
+{
+    Close();
+
+    size_t size = 0;
+    time_t time = 0;
+    uint64_t id = 0;
+
+    _filename = filename;
+
+    if(!get_file_info(size, time, id) || size == 0)
+    {
+        _filename = "";
+        return false;
+    }
+
+#if defined(_WIN32)
+    std::ifstream input(filename, std::ios::binary);
+
+    _buffer.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+
+    if(_buffer.size() != size)
+    {
+        _buffer.clear();
+        _filename = "";
+        return false;
+    }
+
+    _data = &_buffer[0];
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+
+    if(fd < 0)
+    {
+        _filename = "";
+        return false;
+    }
+
+    void *data = mmap(nullptr,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE,
+                      fd,
+                      0);
+
+    /**
+     * The mapping keeps the file open on its own.
+     */
+    close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        _filename = "";
+        return false;
+    }
+
+    _data = static_cast<uint8_t*>(data);
+#endif
+
+    _size = size;
+    _file_size = size;
+    _file_time = time;
+    _file_id = id;
+
+    return true;
+}
+
+/**
+ * Close the image. Any changes that haven't been written are thrown away.
+ */
+void DiskImage::Close()
+{
+#if defined(_WIN32)
+    _buffer.clear();
+#else
+    if(_data != nullptr)
+        munmap(_data, _size);
+#endif
+
+    _filename = "";
+    _data = nullptr;
+    _size = 0;
+    _file_size = 0;
+    _file_time = 0;
+    _file_id = 0;
+}
+
+/**
+ * Write the image out to its file. The image is written to a temporary file
+ * first, and then renamed over the original, so a crash can never leave a
+ * half-written image behind.
+ *
+ * @return True if the image was written, false otherwise.
+ */
+bool DiskImage::Write()
+{
+    if(_data == nullptr)
+        return false;
+
+    const std::string temp_filename = _filename + ".tmp";
+
+    std::ofstream output(temp_filename, std::ios::binary | std::ios::trunc);
+
+    if(!output.is_open())
+        return false;
+
+    output.write(reinterpret_cast<const char*>(_data), _size);
+    output.close();
+
+    if(!output)
+    {
+        std::remove(temp_filename.c_str());
+        return false;
+    }
+
+#if defined(_WIN32)
+    /**
+     * rename() won't replace an existing file on Windows.
+     */
+    std::remove(_filename.c_str());
+#endif
+
+    if(std::rename(temp_filename.c_str(), _filename.c_str()) != 0)
+    {
+        std::remove(temp_filename.c_str());
+        return false;
+    }
+
+    /**
+     * Remember what the new file looks like so this write isn't mistaken for
+     * something else changing it.
+     */
+    get_file_info(_file_size, _file_time, _file_id);
+
+    return true;
+}
+
+/**
+ * Write part of the image out to its file, in place. This is much quicker
+ * than Write() for large images where only a few blocks have changed, but a
+ * crash part way through can leave the file with only some of the changes.
+ *
+ * @param offset Where the part to write starts, in bytes.
+ * @param size Size of the part to write in bytes.
+ *
+ * @return True if the part was written, false otherwise.
+ */
+bool DiskImage::WriteRange(size_t offset, size_t size)
+{
+    if(_data == nullptr || offset > _size || size > _size - offset)
+        return false;
+
+    std::fstream output(_filename,
+                        std::ios::binary | std::ios::in | std::ios::out);
+
+    if(!output.is_open())
+        return false;
+
+    output.seekp(offset);
+    output.write(reinterpret_cast<const char*>(_data + offset), size);
+    output.close();
+
+    if(!output)
+        return false;
+
+    /**
+     * Remember what the file looks like now so this write isn't mistaken for
+     * something else changing it.
+     */
+    get_file_info(_file_size, _file_time, _file_id);
+
+    return true;
+}
+
+/**
+ * Check whether something else has changed (or replaced) the image file since
+ * it was opened or last written.
+ *
+ * @return True if the file has changed, false otherwise.
+ */
+bool DiskImage::HasChanged() const
+{
+    if(_data == nullptr)
+        return false;
+
+    size_t size = 0;
+    time_t time = 0;
+    uint64_t id = 0;
+
+    if(!get_file_info(size, time, id))
+        return false;
+
+    return size != _file_size || time != _file_time || id != _file_id;
+}
+
+/**
+ * Check whether an image is open.
+ *
+ * @return True if an image is open, false otherwise.
+ */
+bool DiskImage::IsOpen() const
+{
+    return _data != nullptr;
+}
+
+/**
+ * Get the image's data.
+ *
+ * @return A pointer to the image's data (nullptr if no image is open).
+ */
+uint8_t* DiskImage::GetData()
+{
+    return _data;
+}
+
+/**
+ * Get the image's data (read only).
+ *
+ * @return A pointer to the image's data (nullptr if no image is open).
+ */
+const uint8_t* DiskImage::GetData() const
+{
+    return _data;
+}
+
+/**
+ * Get the size of the image.
+ *
+ * @return The size of the image in bytes.
+ */
+size_t DiskImage::GetSize() const
+{
+    return _size;
+}
+
+/**
+ * Get the path to the image file.
+ *
+ * @return Full path to the image file, or an empty string if no image is
+ *         open.
+ */
+std::string DiskImage::GetFilename() const
+{
+    return _filename;
+}
+
+/**
+ * Look up the size, modification time and identity (inode) of the image file.
+ *
+ * @param size Set to the size of the file in bytes.
+ * @param time Set to the last time the file was modified.
+ * @param id Set to a number identifying the file (zero if the platform doesn't
+ *           have one).
+ *
+ * @return True if the file exists, false otherwise.
+ */
+bool DiskImage::get_file_info(size_t &size, time_t &time, uint64_t &id) const
+{
+    struct stat info;
+
+    if(stat(_filename.c_str(), &info) != 0)
+        return false;
+
+    size = info.st_size;
+    time = info.st_mtime;
+    id = info.st_ino;
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef DISKIMAGE_H
+#define DISKIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * A handle to a disk image file that's been mapped into memory. The image can
+ * be any size; it's up to the user to decide whether the size makes sense.
+ */
+class DiskImage
+{
+public:
+    DiskImage();
+    ~DiskImage();
+
+    DiskImage(const DiskImage &copy) = delete;
+    DiskImage& operator=(const DiskImage &rhs) = delete;
+
+    bool Open(const std::string &filename);
+    void Close();
+
+    bool Write();
+    bool WriteRange(size_t offset, size_t size);
+    bool HasChanged() const;
+
+    bool IsOpen() const;
+    uint8_t* GetData();
+    const uint8_t* GetData() const;
+    size_t GetSize() const;
+    std::string GetFilename() const;
+
+private:
+    bool get_file_info(size_t &size, time_t &time, uint64_t &id) const;
+
+private:
+    /**
+     * Full path to the image file.
+     */
+    std::string _filename;
+
+    /**
+     * The image's data and size in bytes. Changes made through this pointer
+     * stay in memory until Write() is called.
+     */
+    uint8_t *_data;
+    size_t _size;
+
+#if defined(_WIN32)
+    /**
+     * Windows doesn't have mmap(), so the image is read into here instead.
+     */
+    std::vector<uint8_t> _buffer;
+#endif
+
+    /**
+     * What the file looked like when it was opened or last written, used to
+     * tell when something else changes it.
+     */
+    size_t _file_size;
+    time_t _file_time;
+    uint64_t _file_id;
+};
+
+#endif // DISKIMAGE_H
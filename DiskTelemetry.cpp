@@ -0,0 +1,306 @@
+/**
+ * Keeps track of how the disk controller is being used, for tuning software
+ * that leans on the disk. Everything is counted as the CPU sees it (from the
+ * controller's soft switches and the bytes it reads out of the data register)
+ * rather than bit by bit, so it costs a handful of instructions per disk
+ * access and is always left on.
+ *
+ * The event log is a fixed size ring buffer, so nothing is allocated while the
+ * emulator runs.
+ */
+#include "DiskTelemetry.h"
+#include "GcrCodec.h"
+
+#include <cstring>
+
+/**
+ * The three disk bytes that start an address field.
+ */
+static constexpr uint32_t address_prologue = 0xD5AA96;
+
+/**
+ * Constructor.
+ */
+DiskTelemetry::DiskTelemetry() :
+    _stats(),
+    _events(),
+    _num_events(0),
+    _motor_on(false),
+    _motor_on_cycle(0),
+    _last_read(0),
+    _last_read_cycle(0),
+    _recent_nibbles(0),
+    _field(),
+    _field_size(-1),
+    _writing(false)
+{ }
+
+/**
+ * Reset every counter and empty the event log. Whether the motor is on is
+ * kept, so its running time starts counting again from now.
+ *
+ * @param cycle The current CPU cycle.
+ */
+void DiskTelemetry::Clear(uint32_t cycle)
+{
+    std::memset(&_stats, 0, sizeof(_stats));
+    _motor_on_cycle = cycle;
+    _num_events = 0;
+    _recent_nibbles = 0;
+    _field_size = -1;
+    _writing = false;
+}
+
+/**
+ * Record a stepper motor phase turning on or off.
+ */
+void DiskTelemetry::RecordPhaseChange()
+{
+    _stats.phase_changes++;
+}
+
+/**
+ * Record the head moving.
+ *
+ * @param cycle The CPU cycle the head moved on.
+ * @param drive The selected drive.
+ * @param from The quarter track the head moved from.
+ * @param to The quarter track the head moved to.
+ */
+void DiskTelemetry::RecordSeek(uint32_t cycle, uint8_t drive, int from, int to)
+{
+    _stats.seeks++;
+    _stats.quarter_tracks_stepped += (to > from) ? to - from : from - to;
+
+    log_event(cycle, EVENT_SEEK, drive, from, to);
+}
+
+/**
+ * Record the motor turning on or off.
+ *
+ * @param cycle The CPU cycle the motor changed on.
+ * @param drive The selected drive.
+ * @param on True if the motor turned on, false if it turned off.
+ */
+void DiskTelemetry::RecordMotor(uint32_t cycle, uint8_t drive, bool on)
+{
+    if(on == _motor_on)
+        return;
+
+    if(on)
+        _motor_on_cycle = cycle;
+    else
+        _stats.motor_on_cycles += cycle - _motor_on_cycle;
+
+    _motor_on = on;
+
+    log_event(cycle, (on) ? EVENT_MOTOR_ON : EVENT_MOTOR_OFF, drive, 0, 0);
+}
+
+/**
+ * Record a different drive being selected.
+ *
+ * @param cycle The CPU cycle the drive was selected on.
+ * @param drive The newly selected drive.
+ */
+void DiskTelemetry::RecordSelectDrive(uint32_t cycle, uint8_t drive)
+{
+    log_event(cycle, EVENT_SELECT_DRIVE, drive, drive, 0);
+}
+
+/**
+ * Record the CPU reading the data register while reading the disk. This
+ * counts the disk bytes read (and address fields seen), and how long the CPU
+ * spent polling for them.
+ *
+ * @param cycle The CPU cycle the read happened on.
+ * @param drive The selected drive.
+ * @param quarter_track Where the head is.
+ * @param data The value read.
+ */
+void DiskTelemetry::RecordRead(uint32_t cycle,
+                               uint8_t drive,
+                               int quarter_track,
+                               uint8_t data)
+{
+    const uint32_t delta = cycle - _last_read_cycle;
+    const bool last_valid = _last_read & 0x80;
+
+    /**
+     * Reading an incomplete byte means the CPU is waiting for the next one,
+     * until it shows up.
+     */
+    if(!last_valid && delta <= MAX_POLL_CYCLES)
+        _stats.poll_cycles += delta;
+
+    _writing = false;
+
+    const bool new_nibble = (data & 0x80) &&
+                            (!last_valid || data != _last_read ||
+                             delta >= MIN_NIBBLE_CYCLES);
+
+    _last_read = data;
+    _last_read_cycle = cycle;
+
+    if(!new_nibble)
+        return;
+
+    const int track = quarter_track / 4;
+
+    _stats.nibbles_read++;
+    _stats.tracks[track].nibbles_read++;
+
+    if(_field_size >= 0)
+    {
+        _field[_field_size++] = data;
+
+        if(_field_size == ADDRESS_FIELD_SIZE)
+            check_address_field(cycle, drive, track);
+    }
+
+    _recent_nibbles = ((_recent_nibbles << 8) | data) & 0xFFFFFF;
+
+    if(_recent_nibbles == address_prologue)
+        _field_size = 0;
+}
+
+/**
+ * Record the CPU handing the controller a byte to write to the disk.
+ *
+ * @param cycle The CPU cycle the write happened on.
+ * @param drive The selected drive.
+ * @param quarter_track Where the head is.
+ */
+void DiskTelemetry::RecordWrite(uint32_t cycle,
+                                uint8_t drive,
+                                int quarter_track)
+{
+    const int track = quarter_track / 4;
+
+    _stats.nibbles_written++;
+    _stats.tracks[track].nibbles_written++;
+
+    if(!_writing)
+        log_event(cycle, EVENT_WRITE, drive, quarter_track, 0);
+
+    _writing = true;
+    _field_size = -1;
+}
+
+/**
+ * Record cycles that passed without being run, because the disk was skipped
+ * ahead to the next prologue.
+ *
+ * @param num_cycles The number of cycles skipped.
+ */
+void DiskTelemetry::RecordSkip(uint32_t num_cycles)
+{
+    _stats.skipped_cycles += num_cycles;
+}
+
+/**
+ * Get the counters.
+ *
+ * @param cycle The current CPU cycle (so a motor that's still on counts up to
+ *              now).
+ *
+ * @return A copy of the counters.
+ */
+DiskTelemetry::Stats DiskTelemetry::GetStats(uint32_t cycle) const
+{
+    Stats stats = _stats;
+
+    if(_motor_on)
+        stats.motor_on_cycles += cycle - _motor_on_cycle;
+
+    return stats;
+}
+
+/**
+ * Get the number of events logged since the last time the telemetry was
+ * cleared (including any that have since been overwritten).
+ *
+ * @return The number of events.
+ */
+uint64_t DiskTelemetry::GetNumEvents() const
+{
+    return _num_events;
+}
+
+/**
+ * Get the events still in the log.
+ *
+ * @param events Filled with the events, oldest first.
+ */
+void DiskTelemetry::GetEvents(std::vector<Event> &events) const
+{
+    const uint64_t first = (_num_events > NUM_EVENTS) ?
+                           _num_events - NUM_EVENTS : 0;
+
+    events.clear();
+    events.reserve(_num_events - first);
+
+    for(uint64_t i = first; i < _num_events; ++i)
+        events.push_back(_events[i % NUM_EVENTS]);
+}
+
+/**
+ * Add an event to the log, overwriting the oldest one if the log is full.
+ *
+ * @param cycle The CPU cycle the event happened on.
+ * @param type The type of event.
+ * @param drive The selected drive.
+ * @param arg0 Depends on the type of event.
+ * @param arg1 Depends on the type of event.
+ */
+void DiskTelemetry::log_event(uint32_t cycle,
+                              uint8_t type,
+                              uint8_t drive,
+                              uint8_t arg0,
+                              uint8_t arg1)
+{
+    Event &event = _events[_num_events % NUM_EVENTS];
+
+    event.cycle = cycle;
+    event.type = type;
+    event.drive = drive;
+    event.arg0 = arg0;
+    event.arg1 = arg1;
+
+    _num_events++;
+}
+
+/**
+ * Decode a complete address field, and count it if it's made of valid 4-and-4
+ * bytes (every other bit set).
+ *
+ * @param cycle The CPU cycle the last byte of the field was read on.
+ * @param drive The selected drive.
+ * @param track The track the head is over.
+ */
+void DiskTelemetry::check_address_field(uint32_t cycle,
+                                        uint8_t drive,
+                                        int track)
+{
+    _field_size = -1;
+
+    for(int i = 0; i < ADDRESS_FIELD_SIZE; ++i)
+    {
+        if((_field[i] & 0xAA) != 0xAA)
+        {
+            _stats.bad_address_fields++;
+            return;
+        }
+    }
+
+    const uint8_t field_track = GcrCodec::Decode44(&_field[2]);
+    const uint8_t sector = GcrCodec::Decode44(&_field[4]);
+
+    _stats.address_fields++;
+    _stats.tracks[track].address_fields++;
+
+    if(sector < GcrCodec::NUM_SECTORS)
+        _stats.tracks[track].sectors_seen |= 1 << sector;
+
+    log_event(cycle, EVENT_ADDRESS_FIELD, drive, field_track, sector);
+}
@@ -0,0 +1,177 @@
+#ifndef DISKTELEMETRY_H
+#define DISKTELEMETRY_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Counters and a log of events describing how software is using the disk
+ * drives: head movement, the disk bytes read and written on each track, the
+ * address fields the CPU saw go by, and how long it spent waiting on the disk.
+ */
+class DiskTelemetry
+{
+public:
+    /**
+     * Number of whole tracks the head can be over (the counters for a quarter
+     * or half track go to the track it's part of).
+     */
+    static constexpr int NUM_TRACKS = 40;
+
+    /**
+     * Number of events kept in the log. Once it's full, the oldest events are
+     * overwritten.
+     */
+    static constexpr int NUM_EVENTS = 256;
+
+    /**
+     * Things that get logged.
+     */
+    enum EventType {
+        EVENT_MOTOR_ON = 0,
+        EVENT_MOTOR_OFF,
+        EVENT_SELECT_DRIVE,  // arg0 = the drive selected.
+        EVENT_SEEK,          // arg0/arg1 = from/to quarter track.
+        EVENT_ADDRESS_FIELD, // arg0/arg1 = track/sector in the field.
+        EVENT_WRITE          // arg0 = quarter track being written.
+    };
+
+    /**
+     * A logged event.
+     */
+    struct Event
+    {
+        uint32_t cycle;
+        uint8_t type;
+        uint8_t drive;
+        uint8_t arg0;
+        uint8_t arg1;
+    };
+
+    /**
+     * Counters for a single track.
+     */
+    struct TrackStats
+    {
+        uint32_t nibbles_read;
+        uint32_t nibbles_written;
+        uint32_t address_fields;
+
+        /**
+         * Bit N is set if an address field for sector N was seen.
+         */
+        uint16_t sectors_seen;
+    };
+
+    /**
+     * Counters for the whole controller.
+     */
+    struct Stats
+    {
+        uint32_t phase_changes;
+        uint32_t seeks;
+        uint32_t quarter_tracks_stepped;
+        uint32_t nibbles_read;
+        uint32_t nibbles_written;
+        uint32_t address_fields;
+        uint32_t bad_address_fields;
+        uint64_t motor_on_cycles;
+        uint64_t poll_cycles;
+        uint64_t skipped_cycles;
+        TrackStats tracks[NUM_TRACKS];
+    };
+
+public:
+    DiskTelemetry();
+
+    void Clear(uint32_t cycle);
+
+    void RecordPhaseChange();
+    void RecordSeek(uint32_t cycle, uint8_t drive, int from, int to);
+    void RecordMotor(uint32_t cycle, uint8_t drive, bool on);
+    void RecordSelectDrive(uint32_t cycle, uint8_t drive);
+    void RecordRead(uint32_t cycle,
+                    uint8_t drive,
+                    int quarter_track,
+                    uint8_t data);
+    void RecordWrite(uint32_t cycle, uint8_t drive, int quarter_track);
+    void RecordSkip(uint32_t num_cycles);
+
+    Stats GetStats(uint32_t cycle) const;
+    uint64_t GetNumEvents() const;
+    void GetEvents(std::vector<Event> &events) const;
+
+private:
+    void log_event(uint32_t cycle,
+                   uint8_t type,
+                   uint8_t drive,
+                   uint8_t arg0,
+                   uint8_t arg1);
+    void check_address_field(uint32_t cycle, uint8_t drive, int track);
+
+private:
+    /**
+     * Polling the data register takes about seven cycles a read. Gaps longer
+     * than this between reads are the CPU doing something else, not polling.
+     */
+    static constexpr uint32_t MAX_POLL_CYCLES = 32;
+
+    /**
+     * A disk byte stays in the data register for at most four bit cells (16
+     * cycles) before the next one starts shifting in, and the next one takes
+     * 32 cycles to arrive. So a valid byte read at least this long after the
+     * last one is a new byte, even if it has the same value.
+     */
+    static constexpr uint32_t MIN_NIBBLE_CYCLES = 16;
+
+    /**
+     * Number of disk bytes after an address prologue that hold the volume,
+     * track and sector (4-and-4 encoded). The checksum after them isn't used:
+     * DOS and the boot ROM are often too busy checking the sector number to
+     * read it.
+     */
+    static constexpr int ADDRESS_FIELD_SIZE = 6;
+
+    /**
+     * The counters.
+     */
+    Stats _stats;
+
+    /**
+     * The event log (a ring buffer), and the number of events ever logged.
+     */
+    Event _events[NUM_EVENTS];
+    uint64_t _num_events;
+
+    /**
+     * True if the motor is on, and the cycle it was turned on at.
+     */
+    bool _motor_on;
+    uint32_t _motor_on_cycle;
+
+    /**
+     * The last value read from the data register, and when.
+     */
+    uint8_t _last_read;
+    uint32_t _last_read_cycle;
+
+    /**
+     * The last three disk bytes read, used to spot an address prologue.
+     */
+    uint32_t _recent_nibbles;
+
+    /**
+     * The address field being read. The count is negative when no address
+     * field is being read.
+     */
+    uint8_t _field[ADDRESS_FIELD_SIZE];
+    int _field_size;
+
+    /**
+     * True while disk bytes are being written, so only the start of a write
+     * gets logged.
+     */
+    bool _writing;
+};
+
+#endif // DISKTELEMETRY_H
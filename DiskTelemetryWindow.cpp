@@ -0,0 +1,160 @@
+#include "DiskTelemetryWindow.h"
+#include "ui_DiskTelemetryWindow.h"
+
+#include <vector>
+
+/**
+ * Number of CPU cycles in a millisecond (the CPU runs at 1.023MHz).
+ */
+static constexpr uint64_t cycles_per_ms = 1023;
+
+/**
+ * Constructor.
+ *
+ * @param emu Reference to the main emulator core.
+ * @param parent Parent widget for this window.
+ */
+DiskTelemetryWindow::DiskTelemetryWindow(EmulatorCore &emu, QWidget *parent) :
+    QMainWindow(parent),
+    _ui(new Ui::DiskTelemetryWindow),
+    _refresh_timer(this),
+    _emu(emu)
+{
+    _ui->setupUi(this);
+
+    _ui->trackTable->setHorizontalHeaderLabels({"Track",
+                                                "Nibbles Read",
+                                                "Nibbles Written",
+                                                "Address Fields",
+                                                "Sectors Seen"});
+    _ui->trackTable->setRowCount(DiskTelemetry::NUM_TRACKS);
+
+    for(int track = 0; track < DiskTelemetry::NUM_TRACKS; ++track)
+    {
+        for(int column = 0; column < _ui->trackTable->columnCount(); ++column)
+            _ui->trackTable->setItem(track, column, new QTableWidgetItem());
+
+        _ui->trackTable->item(track, 0)->setText(QString::number(track));
+    }
+
+    connect(&_refresh_timer,
+            &QTimer::timeout,
+            this,
+            &DiskTelemetryWindow::refresh_timer_timeout);
+
+    _refresh_timer.start(REFRESH_TIMEOUT);
+
+    refresh_timer_timeout();
+}
+
+/**
+ * Update the GUI with the latest counters and events.
+ */
+void DiskTelemetryWindow::refresh_timer_timeout()
+{
+    const DiskTelemetry::Stats stats = _emu.GetDiskStats();
+
+    _ui->summaryLabel->setText(
+        tr("Motor on: %1 ms    Polling: %2 ms    Skipped: %3 ms\n"
+           "Phase changes: %4    Seeks: %5 (%6 quarter tracks)\n"
+           "Nibbles read: %7    Nibbles written: %8\n"
+           "Address fields: %9 (%10 bad)")
+            .arg(stats.motor_on_cycles / cycles_per_ms)
+            .arg(stats.poll_cycles / cycles_per_ms)
+            .arg(stats.skipped_cycles / cycles_per_ms)
+            .arg(stats.phase_changes)
+            .arg(stats.seeks)
+            .arg(stats.quarter_tracks_stepped)
+            .arg(stats.nibbles_read)
+            .arg(stats.nibbles_written)
+            .arg(stats.address_fields)
+            .arg(stats.bad_address_fields));
+
+    for(int track = 0; track < DiskTelemetry::NUM_TRACKS; ++track)
+    {
+        const DiskTelemetry::TrackStats &track_stats = stats.tracks[track];
+
+        _ui->trackTable->item(track, 1)->setText(
+            QString::number(track_stats.nibbles_read));
+        _ui->trackTable->item(track, 2)->setText(
+            QString::number(track_stats.nibbles_written));
+        _ui->trackTable->item(track, 3)->setText(
+            QString::number(track_stats.address_fields));
+        _ui->trackTable->item(track, 4)->setText(
+            tr("%1").arg(track_stats.sectors_seen, 4, 16, QChar('0'))
+                .toUpper());
+    }
+
+    std::vector<DiskTelemetry::Event> events;
+    _emu.GetDiskEvents(events);
+
+    QString log = "";
+    for(const DiskTelemetry::Event &event : events)
+        log += describe_event(event) + "\n";
+
+    if(log != _ui->eventLog->toPlainText())
+    {
+        _ui->eventLog->setPlainText(log);
+        _ui->eventLog->moveCursor(QTextCursor::End);
+    }
+}
+
+/**
+ * Reset the counters and empty the event log.
+ */
+void DiskTelemetryWindow::on_clearBtn_clicked()
+{
+    _emu.ClearDiskTelemetry();
+    refresh_timer_timeout();
+}
+
+/**
+ * Turn an event into a line of text for the event log.
+ *
+ * @param event The event.
+ *
+ * @return A description of the event.
+ */
+QString DiskTelemetryWindow::describe_event(const DiskTelemetry::Event &event)
+{
+    QString text = tr("%1  D%2  ").arg(event.cycle, 10).arg(event.drive);
+
+    switch(event.type)
+    {
+    case DiskTelemetry::EVENT_MOTOR_ON:
+        text += "Motor on";
+        break;
+
+    case DiskTelemetry::EVENT_MOTOR_OFF:
+        text += "Motor off";
+        break;
+
+    case DiskTelemetry::EVENT_SELECT_DRIVE:
+        text += tr("Select drive %1").arg(event.arg0);
+        break;
+
+    case DiskTelemetry::EVENT_SEEK:
+        text += tr("Seek %1 -> %2")
+                    .arg(event.arg0 / 4.0, 0, 'f', 2)
+                    .arg(event.arg1 / 4.0, 0, 'f', 2);
+        break;
+
+    case DiskTelemetry::EVENT_ADDRESS_FIELD:
+        text += tr("Address field T%1 S%2").arg(event.arg0).arg(event.arg1);
+        break;
+
+    case DiskTelemetry::EVENT_WRITE:
+        text += tr("Write at %1").arg(event.arg0 / 4.0, 0, 'f', 2);
+        break;
+    }
+
+    return text;
+}
+
+/**
+ * Destructor.
+ */
+DiskTelemetryWindow::~DiskTelemetryWindow()
+{
+    delete _ui;
+}
@@ -0,0 +1,52 @@
+#ifndef DISKTELEMETRYWINDOW_H
+#define DISKTELEMETRYWINDOW_H
+
+#include "EmulatorCore.h"
+
+#include <QMainWindow>
+#include <QTimer>
+
+namespace Ui {
+class DiskTelemetryWindow;
+}
+
+class DiskTelemetryWindow : public QMainWindow
+{
+    Q_OBJECT
+
+public:
+    explicit DiskTelemetryWindow(EmulatorCore &emu, QWidget *parent = 0);
+
+    ~DiskTelemetryWindow();
+
+private slots:
+    void refresh_timer_timeout();
+
+    void on_clearBtn_clicked();
+
+private:
+    static QString describe_event(const DiskTelemetry::Event &event);
+
+private:
+    /**
+     * The period at which to check the emulator's state and refresh the GUI.
+     */
+    static constexpr int REFRESH_TIMEOUT = 250;
+
+    /**
+     * Contains all of the UI elements generated in the Qt Forms Designer.
+     */
+    Ui::DiskTelemetryWindow *_ui;
+
+    /**
+     * Timer used to periodically refresh the counters and event log.
+     */
+    QTimer _refresh_timer;
+
+    /**
+     * A reference to the currently running emulator.
+     */
+    EmulatorCore &_emu;
+};
+
+#endif // DISKTELEMETRYWINDOW_H
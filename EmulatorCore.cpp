@@ -6,8 +6,18 @@
 #include "EmulatorCore.h"
 #include "instrs_6502.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
+#include <iterator>
+
+constexpr int EmulatorCore::WARP_FRAME_PERCENT;
+
+/**
+ * ID at the start of a saved state.
+ */
+static constexpr char state_id[4] = { 'S', 'I', 'I', 'S' };
 
 /**
  * Constructor.
@@ -20,10 +30,19 @@ EmulatorCore::EmulatorCore() :
     _video(new Video(_mem)),
     _keyboard(),
     _speaker(_cpu),
-    _disk_ctrl(_cpu),
+    _disk_ctrl(_cpu, _bus),
+    _mockingboard(_cpu),
+    _hard_disk(_cpu, _bus),
     _leftover_cycles(0),
     _paused(false),
-    _turbo(1)
+    _turbo(1),
+    _disk_warp(false),
+    _warp_time_saved(0),
+    _load_backup(),
+    _rewind(REWIND_BUFFER_SIZE, REWIND_MAX_STATES),
+    _rewind_state(),
+    _rewind_frames(0),
+    _rewinding(false)
 {
     _bus.Register(&_mem);
     _bus.Register(&_lang_card);
@@ -37,6 +56,13 @@ EmulatorCore::EmulatorCore() :
     _bus.Register(&_disk_ctrl,
                   DiskController::DISK_ROM_START,
                   DiskController::DISK_ROM_END);
+    _bus.Register(&_mockingboard);
+    _bus.Register(&_hard_disk);
+    _bus.Register(&_hard_disk,
+                  HardDiskCard::HARD_DISK_ROM_START,
+                  HardDiskCard::HARD_DISK_ROM_END);
+
+    _speaker.AddSource(&_mockingboard);
 
     /**
      * Reset the CPU so it grabs the correct reset vector now that the system
@@ -45,6 +71,14 @@ EmulatorCore::EmulatorCore() :
     _cpu.Reset();
 }
 
+/**
+ * Destructor.
+ */
+EmulatorCore::~EmulatorCore()
+{
+    delete _video;
+}
+
 /**
  * Pause the emulator.
  */
@@ -67,6 +101,13 @@ bool EmulatorCore::GetPaused() const
 void EmulatorCore::ResetCpu()
 {
     _cpu.Reset();
+
+    /**
+     * The reset line also goes to the slots, so the Mockingboard resets too
+     * (this also stops it from interrupting the freshly reset CPU).
+     */
+    _mockingboard.Reset();
+    _hard_disk.Reset();
 }
 
 /**
@@ -81,6 +122,8 @@ void EmulatorCore::PowerCycle()
     _keyboard.Reset();
     _speaker.Reset();
     _disk_ctrl.Reset();
+    _mockingboard.Reset();
+    _hard_disk.Reset();
 
     _leftover_cycles = 0;
 }
@@ -96,17 +139,18 @@ CpuContext EmulatorCore::GetCpuContext() const
 }
 
 /**
- * Load a disk image into memory.
+ * Load a disk image into one of the disk drives.
  *
  * @param filename The full path of the disk image.
  * @param drive The disk drive to "insert" the image into.
- * @param data The disk image data.
+ *
+ * @return True if the disk was loaded, false if the image couldn't be opened
+ *         or isn't valid.
  */
-void EmulatorCore::LoadDisk(std::string filename,
-                            DiskController::DriveId drive,
-                            uint8_t data[DiskDrive::DISK_SIZE])
+bool EmulatorCore::LoadDisk(std::string filename,
+                            DiskController::DriveId drive)
 {
-    _disk_ctrl.LoadDisk(filename, drive, data);
+    return _disk_ctrl.LoadDisk(filename, drive);
 }
 
 /**
@@ -119,6 +163,30 @@ void EmulatorCore::UnloadDisk(DiskController::DriveId drive)
     _disk_ctrl.UnloadDisk(drive);
 }
 
+/**
+ * Write any changes made to the inserted disks (and the hard disk) back to
+ * their image files.
+ *
+ * @return True if every image file is up to date, false otherwise.
+ */
+bool EmulatorCore::FlushDisks()
+{
+    const bool floppies_flushed = _disk_ctrl.FlushDisks();
+    const bool hard_disk_flushed = _hard_disk.FlushWrites();
+
+    return floppies_flushed && hard_disk_flushed;
+}
+
+/**
+ * Reload any inserted disks whose image files were changed by another program.
+ *
+ * @return True if either disk was reloaded, false otherwise.
+ */
+bool EmulatorCore::ReloadDisks()
+{
+    return _disk_ctrl.ReloadDisks();
+}
+
 /**
  * Return back the full path to a disk image loaded in one of the disk drives.
  *
@@ -132,6 +200,125 @@ std::string EmulatorCore::GetDiskFilename(DiskController::DriveId drive) const
     return _disk_ctrl.GetDiskFilename(drive);
 }
 
+/**
+ * Allow (or stop) reads from the disk in a drive being sped up.
+ *
+ * @param drive The drive containing the disk.
+ * @param accelerated True to speed up reads, false otherwise.
+ */
+void EmulatorCore::SetDiskAccelerated(DiskController::DriveId drive,
+                                      bool accelerated)
+{
+    _disk_ctrl.SetDiskAccelerated(drive, accelerated);
+}
+
+/**
+ * Check whether reads from the disk in a drive are being sped up.
+ *
+ * @param drive The drive containing the disk.
+ *
+ * @return True if reads are sped up, false otherwise.
+ */
+bool EmulatorCore::GetDiskAccelerated(DiskController::DriveId drive) const
+{
+    return _disk_ctrl.GetDiskAccelerated(drive);
+}
+
+/**
+ * Run the CPU as fast as possible (with the audio silenced) whenever a disk
+ * drive's motor is on. The normal speed comes back within a frame of the motor
+ * turning off.
+ *
+ * @param enabled True to enable disk warp, false otherwise.
+ */
+void EmulatorCore::SetDiskWarp(bool enabled)
+{
+    _disk_warp = enabled;
+}
+
+/**
+ * Check whether disk warp is enabled.
+ *
+ * @return True if disk warp is enabled, false otherwise.
+ */
+bool EmulatorCore::GetDiskWarp() const
+{
+    return _disk_warp;
+}
+
+/**
+ * Get how much host time disk warp has saved so far this session.
+ *
+ * @return The time saved in milliseconds.
+ */
+uint32_t EmulatorCore::GetDiskWarpTimeSaved() const
+{
+    return static_cast<uint32_t>(_warp_time_saved / 1000);
+}
+
+/**
+ * Get the disk telemetry counters: head movement, disk bytes read and written
+ * on each track, address fields seen, motor on time and time spent polling.
+ *
+ * @return The counters.
+ */
+DiskTelemetry::Stats EmulatorCore::GetDiskStats() const
+{
+    return _disk_ctrl.GetTelemetryStats();
+}
+
+/**
+ * Get the most recent disk events (motor, drive selection, seeks, address
+ * fields and writes).
+ *
+ * @param events Filled with the events, oldest first.
+ */
+void EmulatorCore::GetDiskEvents(
+    std::vector<DiskTelemetry::Event> &events) const
+{
+    _disk_ctrl.GetTelemetry().GetEvents(events);
+}
+
+/**
+ * Reset the disk telemetry counters and empty its event log.
+ */
+void EmulatorCore::ClearDiskTelemetry()
+{
+    _disk_ctrl.ClearTelemetry();
+}
+
+/**
+ * Load a hard disk image into the hard disk card.
+ *
+ * @param filename The full path of the hard disk image.
+ *
+ * @return True if the hard disk was loaded, false if the image couldn't be
+ *         opened or isn't valid.
+ */
+bool EmulatorCore::LoadHardDisk(std::string filename)
+{
+    return _hard_disk.LoadImage(filename);
+}
+
+/**
+ * Unload the hard disk, writing any changes back to its image file.
+ */
+void EmulatorCore::UnloadHardDisk()
+{
+    _hard_disk.UnloadImage();
+}
+
+/**
+ * Return back the full path to the hard disk image.
+ *
+ * @return The full path to the hard disk image, or "None" if no hard disk is
+ *         loaded.
+ */
+std::string EmulatorCore::GetHardDiskFilename() const
+{
+    return _hard_disk.GetFilename();
+}
+
 /**
  * Returns true if a disk is being accessed.
  *
@@ -146,15 +333,31 @@ bool EmulatorCore::GetDiskBusy()
 /**
  * Run for one video frame (for 60FPS this is 16.667ms).
  *
- * This involves checking SFML events to grab keyboard input, running for one
- * frame's worth of CPU cycles, and updating the video output.
+ * This involves running for one frame's worth of CPU cycles, and updating the
+ * video and audio output. If disk warp is enabled and the disk is spinning,
+ * the CPU keeps running for as much of the frame as can be spared.
+ *
+ * Every few frames, the state is saved to the rewind history. While rewinding,
+ * each frame steps back to the state before instead of running. Nothing
+ * happens while paused, rewinding included, so the debugger never sees the
+ * state change underneath it.
  *
  * @param FPS How many frames per second to run at.
  */
 void EmulatorCore::RunFrame(int FPS)
 {
-    if(!_paused)
+    if(_paused)
+        return;
+
+    if(_rewinding)
     {
+        rewind_frame();
+    }
+    else
+    {
+        const std::chrono::steady_clock::time_point frame_start =
+            std::chrono::steady_clock::now();
+
         /**
          * Calculate how many CPU cycles are to be executed in one frame.
          *
@@ -163,17 +366,83 @@ void EmulatorCore::RunFrame(int FPS)
         constexpr uint32_t CPU_FREQ = 1023000;
         const uint32_t CYCLES_PER_FRAME = (CPU_FREQ / FPS) * _turbo;
 
+        /**
+         * Decided up front, so the whole frame's audio is either played or
+         * silenced.
+         */
+        const bool warp = _disk_warp && _disk_ctrl.GetMotorOn();
+
         _leftover_cycles = _cpu.Execute(CYCLES_PER_FRAME - _leftover_cycles);
 
         if(_cpu.GetBpEnabled() && _cpu.GetContext().pc == _cpu.GetBpAddr())
             _paused = true;
 
-        _video->repaint();
+        _speaker.PlayAudio(warp);
+
+        if(warp && !_paused)
+            run_warp(CYCLES_PER_FRAME, FPS, frame_start);
+
+        _video->Render();
 
-        _speaker.PlayAudio(CYCLES_PER_FRAME - _leftover_cycles);
+        if(++_rewind_frames >= REWIND_INTERVAL)
+            save_rewind_state();
     }
 }
 
+/**
+ * Keep running the CPU, a frame's worth of cycles at a time, for as long as
+ * the disk is spinning and the frame has time to spare. The audio for these
+ * extra cycles is thrown away.
+ *
+ * Checking the motor after every frame's worth of cycles means the normal
+ * speed comes back within a frame of the motor turning off.
+ *
+ * @param cycles_per_frame CPU cycles in a frame at the normal speed.
+ * @param FPS How many frames per second the emulator runs at.
+ * @param frame_start When the current frame started running.
+ */
+void EmulatorCore::run_warp(uint32_t cycles_per_frame,
+                            int FPS,
+                            std::chrono::steady_clock::time_point frame_start)
+{
+    using namespace std::chrono;
+
+    const microseconds frame_time(1000000 / FPS);
+    const microseconds budget = (frame_time * WARP_FRAME_PERCENT) / 100;
+    const steady_clock::time_point warp_start = steady_clock::now();
+    const uint32_t start_cycles = _cpu.GetTotalCycles();
+
+    while(_disk_ctrl.GetMotorOn() &&
+          steady_clock::now() - frame_start < budget)
+    {
+        _leftover_cycles = _cpu.Execute(cycles_per_frame - _leftover_cycles);
+
+        /**
+         * Drop the audio a frame at a time, so the queued speaker toggles
+         * never pile up past a single frame's worth.
+         */
+        _speaker.SkipAudio();
+
+        if(_cpu.GetBpEnabled() && _cpu.GetContext().pc == _cpu.GetBpAddr())
+        {
+            _paused = true;
+            break;
+        }
+    }
+
+    /**
+     * The extra cycles would have taken this long at the normal speed.
+     */
+    const uint64_t num_cycles = _cpu.GetTotalCycles() - start_cycles;
+    const uint64_t normal_time = (num_cycles * frame_time.count()) /
+                                 cycles_per_frame;
+    const uint64_t host_time = duration_cast<microseconds>(
+        steady_clock::now() - warp_start).count();
+
+    if(normal_time > host_time)
+        _warp_time_saved += normal_time - host_time;
+}
+
 /**
  * Run one CPU instruction
  */
@@ -183,11 +452,72 @@ void EmulatorCore::SingleStep()
     {
         _cpu.SingleStep();
 
-        _video->repaint();
+        _video->Render();
         _speaker.ClearToggles();
     }
 }
 
+/**
+ * Start or stop rewinding. While rewinding, every frame goes back to the state
+ * saved before it (so the game runs backwards at several times its normal
+ * speed), until the oldest state in the history is reached.
+ *
+ * @param rewinding True to rewind, false to carry on from where the rewinding
+ *                  stopped.
+ */
+void EmulatorCore::SetRewinding(bool rewinding)
+{
+    _rewinding = rewinding;
+    _rewind_frames = 0;
+}
+
+/**
+ * Check whether the emulator is rewinding.
+ *
+ * @return True if rewinding, false otherwise.
+ */
+bool EmulatorCore::GetRewinding() const
+{
+    return _rewinding;
+}
+
+/**
+ * Get how far back the rewind history goes.
+ *
+ * @return The number of frames that can be rewound.
+ */
+uint32_t EmulatorCore::GetRewindFrames() const
+{
+    return _rewind.GetNumStates() * REWIND_INTERVAL;
+}
+
+/**
+ * Save the current state to the rewind history.
+ */
+void EmulatorCore::save_rewind_state()
+{
+    _rewind_frames = 0;
+
+    SaveState(_rewind_state);
+    _rewind.Push(_rewind_state.GetData(), _rewind_state.GetSize());
+}
+
+/**
+ * Go back to the newest state in the rewind history (taking it out of the
+ * history), and show it. Once the history runs out, the oldest state stays
+ * on the screen.
+ */
+void EmulatorCore::rewind_frame()
+{
+    if(_rewind.Pop(_rewind_state))
+    {
+        LoadState(_rewind_state.GetData(), _rewind_state.GetSize());
+        _speaker.ClearToggles();
+    }
+
+    _video->Render();
+}
+
 /**
  * Breakpoint getter.
  *
@@ -254,6 +584,79 @@ void EmulatorCore::SetVideoTextColor(QColor color)
     _video->SetTextColor(color.red(), color.green(), color.blue());
 }
 
+/**
+ * Gets whether the video module renders NTSC artifact colors.
+ *
+ * @return True if NTSC artifact colors are enabled.
+ */
+bool EmulatorCore::GetVideoNtsc() const
+{
+    return _video->GetNtsc();
+}
+
+/**
+ * Enable or disable NTSC artifact colors in the video module.
+ *
+ * @param enabled True to enable NTSC artifact colors.
+ */
+void EmulatorCore::SetVideoNtsc(bool enabled)
+{
+    _video->SetNtsc(enabled);
+}
+
+/**
+ * Gets the scaling and CRT effects applied to the video output.
+ *
+ * @return The post-processing settings.
+ */
+PostProcessSettings EmulatorCore::GetVideoPostProcess() const
+{
+    return _video->GetPostProcess();
+}
+
+/**
+ * Set the scaling and CRT effects applied to the video output. These are
+ * applied by the render thread, never the emulation thread.
+ *
+ * @param settings The new post-processing settings.
+ */
+void EmulatorCore::SetVideoPostProcess(const PostProcessSettings &settings)
+{
+    _video->SetPostProcess(settings);
+}
+
+/**
+ * Set where the video module displays its frames.
+ *
+ * @param presenter The display backend, or nullptr to stop displaying frames
+ *                  (this must be done before the presenter is destroyed).
+ */
+void EmulatorCore::SetVideoPresenter(IPresenter *presenter)
+{
+    _video->SetPresenter(presenter);
+}
+
+/**
+ * Get the average time the video module spends converting each frame.
+ *
+ * @return The average render time in microseconds.
+ */
+uint32_t EmulatorCore::GetVideoRenderTime() const
+{
+    return _video->GetRenderTime();
+}
+
+/**
+ * Get the average time between the end of an emulated frame and that frame
+ * being handed to the presenter.
+ *
+ * @return The average render latency in microseconds.
+ */
+uint32_t EmulatorCore::GetVideoRenderLatency() const
+{
+    return _video->GetRenderLatency();
+}
+
 /**
  * Get the speaker mute state.
  *
@@ -274,6 +677,79 @@ void EmulatorCore::SetSpeakerMute(bool mute)
     _speaker.SetMute(mute);
 }
 
+/**
+ * Get the sample rate audio is played at.
+ *
+ * @return The sample rate in Hz.
+ */
+int EmulatorCore::GetAudioSampleRate() const
+{
+    return _speaker.GetSampleRate();
+}
+
+/**
+ * Change the sample rate audio is played at.
+ *
+ * @param sample_rate The new sample rate in Hz.
+ */
+void EmulatorCore::SetAudioSampleRate(int sample_rate)
+{
+    if(sample_rate != _speaker.GetSampleRate())
+        _speaker.SetSampleRate(sample_rate);
+}
+
+/**
+ * Get the amount of audio kept buffered ahead of the audio device.
+ *
+ * @return The target latency in milliseconds.
+ */
+uint32_t EmulatorCore::GetAudioTargetLatency() const
+{
+    return _speaker.GetTargetLatency();
+}
+
+/**
+ * Change the amount of audio kept buffered ahead of the audio device.
+ *
+ * @param latency The new target latency in milliseconds.
+ */
+void EmulatorCore::SetAudioTargetLatency(uint32_t latency)
+{
+    if(latency != _speaker.GetTargetLatency())
+        _speaker.SetTargetLatency(latency);
+}
+
+/**
+ * Get how much audio is queued up waiting to be played.
+ *
+ * @return The amount of queued audio in milliseconds.
+ */
+uint32_t EmulatorCore::GetAudioBufferFill() const
+{
+    return _speaker.GetBufferFill();
+}
+
+/**
+ * Get the number of times the audio output ran out of samples to play.
+ *
+ * @return The number of underruns.
+ */
+uint32_t EmulatorCore::GetAudioUnderruns() const
+{
+    return _speaker.GetUnderruns();
+}
+
+/**
+ * Get how much the audio sample rate is being adjusted to absorb the drift
+ * between the emulated and host clocks.
+ *
+ * @return The adjustment in parts per million.
+ */
+int32_t EmulatorCore::GetAudioRateAdjust() const
+{
+    return _speaker.GetRateAdjust();
+}
+
 /**
  * Gets the keyboard mappings.
  *
@@ -317,6 +793,7 @@ void EmulatorCore::GetMemory(QByteArray &mem, uint16_t start, uint16_t end)
 void EmulatorCore::SetTurbo(uint8_t turbo)
 {
     _turbo = turbo;
+    _speaker.SetTurbo(turbo);
 }
 
 /**
@@ -330,89 +807,250 @@ uint8_t EmulatorCore::GetTurbo() const
 }
 
 /**
- * Save the emulator state out to a file.
+ * Save the emulator state into memory, replacing whatever the writer held.
  *
- * @param output The file to write to.
+ * The state starts with an ID and the version of the format, followed by a
+ * chunk for each device: an ID, the size of the chunk, and then the device's
+ * state. Every value is stored little-endian with a fixed size.
  *
- * @return True if writing was successful.
+ * Devices write straight into the writer, and the size of each chunk is
+ * filled in once it's done. Once the writer has grown to fit the state,
+ * nothing is allocated, so this is quick enough to run every frame.
+ *
+ * @param output Where to write the state.
  */
-bool EmulatorCore::SaveState(std::ofstream &output)
+void EmulatorCore::SaveState(StateWriter &output)
 {
-    uint32_t temp_magic = STATE_MAGIC;
-    output.write(reinterpret_cast<char*>(&temp_magic), sizeof(temp_magic));
+    output.Clear();
+    output.Write(state_id, sizeof(state_id));
 
-    _cpu.SaveState(output);
-    _mem.SaveState(output);
-    _lang_card.SaveState(output);
-    _video->SaveState(output);
-    _keyboard.SaveState(output);
-    _speaker.SaveState(output);
-    _disk_ctrl.SaveState(output);
+    uint32_t version = STATE_VERSION;
+    output.Write(&version, sizeof(version));
 
-    output.write(reinterpret_cast<char*>(&_leftover_cycles),
-                 sizeof(_leftover_cycles));
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    get_state_chunks(chunks);
 
-    return !(!output);
+    for(const StateChunk &chunk : chunks)
+    {
+        output.Write(chunk.id, STATE_CHUNK_HEADER_SIZE - sizeof(uint32_t));
+
+        const size_t size_offset = output.GetSize();
+        uint32_t size = 0;
+        output.Write(&size, sizeof(size));
+
+        if(chunk.device != nullptr)
+            chunk.device->SaveState(output);
+        else
+            output.Write(&_leftover_cycles, sizeof(_leftover_cycles));
+
+        size = static_cast<uint32_t>(output.GetSize() - size_offset -
+                                     sizeof(size));
+        output.Overwrite(size_offset, &size, sizeof(size));
+    }
 }
 
 /**
- * Load the emulator state out of a file.
+ * Load the emulator state out of memory.
  *
- * @param input The fiel to read from.
+ * The whole state is checked before anything is loaded: it has to be the
+ * current version, and hold a chunk for every device (chunks that aren't
+ * recognized are skipped). If a device then fails to load its chunk, every
+ * device is put back the way it was, so a load either works completely or
+ * doesn't change anything.
  *
- * @return  True if reading was successful.
+ * @param state The saved state.
+ * @param size Size of the saved state in bytes.
+ *
+ * @return True if the state was loaded, false if nothing was changed.
  */
-bool EmulatorCore::LoadState(std::ifstream &input)
+bool EmulatorCore::LoadState(const uint8_t *state, size_t size)
 {
-    uint32_t temp_magic = 0;
-    input.read(reinterpret_cast<char*>(&temp_magic), sizeof(temp_magic));
+    const uint8_t *data[NUM_STATE_CHUNKS];
+    uint32_t sizes[NUM_STATE_CHUNKS];
 
-    if(temp_magic != STATE_MAGIC)
+    if(!find_state_chunks(state, size, data, sizes))
         return false;
 
-    _cpu.LoadState(input);
-    if(!input || input.eof())
-        return false;
+    /**
+     * Keep a copy of the current state, in case it has to be put back.
+     */
+    SaveState(_load_backup);
 
-    _mem.LoadState(input);
-    if(!input || input.eof())
-        return false;
+    if(load_state_chunks(data, sizes))
+        return true;
 
-    _lang_card.LoadState(input);
-    if(!input || input.eof())
-        return false;
+    if(find_state_chunks(_load_backup.GetData(),
+                         _load_backup.GetSize(),
+                         data,
+                         sizes))
+    {
+        load_state_chunks(data, sizes);
+    }
 
-    _video->LoadState(input);
-    if(!input || input.eof())
-        return false;
+    return false;
+}
 
-    _keyboard.LoadState(input);
-    if(!input || input.eof())
-        return false;
+/**
+ * Save the emulator state to a file (or any other stream).
+ *
+ * @param output The stream to write to.
+ *
+ * @return True if writing was successful.
+ */
+bool EmulatorCore::SaveState(std::ostream &output)
+{
+    StateWriter state;
+    SaveState(state);
+
+    output.write(reinterpret_cast<const char*>(state.GetData()),
+                 state.GetSize());
+
+    return !(!output);
+}
+
+/**
+ * Load the emulator state from a file (or any other stream).
+ *
+ * @param input The stream to read from.
+ *
+ * @return True if the state was loaded, false if nothing was changed.
+ */
+bool EmulatorCore::LoadState(std::istream &input)
+{
+    const std::vector<uint8_t> state((std::istreambuf_iterator<char>(input)),
+                                     std::istreambuf_iterator<char>());
+
+    return LoadState(state.data(), state.size());
+}
+
+/**
+ * List the chunks in a saved state, in the order they're saved and loaded.
+ *
+ * @param chunks Filled in with the chunks.
+ */
+void EmulatorCore::get_state_chunks(StateChunk (&chunks)[NUM_STATE_CHUNKS])
+{
+    const StateChunk all_chunks[NUM_STATE_CHUNKS] = {
+        { "CPU ", &_cpu },
+        { "MEM ", &_mem },
+        { "LANG", &_lang_card },
+        { "VID ", _video },
+        { "KEYB", &_keyboard },
+        { "SPKR", &_speaker },
+        { "DISK", &_disk_ctrl },
+        { "MOCK", &_mockingboard },
+        { "HARD", &_hard_disk },
+        { "CORE", nullptr }
+    };
+
+    std::copy(std::begin(all_chunks), std::end(all_chunks), chunks);
+}
 
-    _speaker.LoadState(input);
-    if(!input || input.eof())
+/**
+ * Check that a saved state is valid, and find the chunk for each device.
+ *
+ * @param state The saved state.
+ * @param size Size of the saved state in bytes.
+ * @param data Filled in with where each device's chunk starts.
+ * @param sizes Filled in with the size of each device's chunk.
+ *
+ * @return True if the state is the current version and has one (complete)
+ *         chunk for every device, false otherwise.
+ */
+bool EmulatorCore::find_state_chunks(const uint8_t *state,
+                                     size_t size,
+                                     const uint8_t *(&data)[NUM_STATE_CHUNKS],
+                                     uint32_t (&sizes)[NUM_STATE_CHUNKS])
+{
+    if(size < STATE_HEADER_SIZE ||
+       std::memcmp(state, state_id, sizeof(state_id)) != 0)
+    {
         return false;
+    }
+
+    uint32_t version = 0;
+    std::memcpy(&version, state + sizeof(state_id), sizeof(version));
 
-    _disk_ctrl.LoadState(input);
-    if(!input || input.eof())
+    if(version != STATE_VERSION)
         return false;
 
-    input.read(reinterpret_cast<char*>(&_leftover_cycles),
-                 sizeof(_leftover_cycles));
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    get_state_chunks(chunks);
 
-    return !(!input);
+    std::fill(std::begin(data), std::end(data), nullptr);
+    std::fill(std::begin(sizes), std::end(sizes), 0);
+
+    size_t offset = STATE_HEADER_SIZE;
+    while(offset < size)
+    {
+        if(size - offset < STATE_CHUNK_HEADER_SIZE)
+            return false;
+
+        const uint8_t *chunk_id = state + offset;
+
+        uint32_t chunk_size = 0;
+        std::memcpy(&chunk_size,
+                    chunk_id + sizeof(uint32_t),
+                    sizeof(chunk_size));
+
+        if(chunk_size > size - (offset + STATE_CHUNK_HEADER_SIZE))
+            return false;
+
+        for(int i = 0; i < NUM_STATE_CHUNKS; ++i)
+        {
+            if(std::memcmp(chunk_id, chunks[i].id, sizeof(uint32_t)) != 0)
+                continue;
+
+            if(data[i] != nullptr)
+                return false;
+
+            data[i] = chunk_id + STATE_CHUNK_HEADER_SIZE;
+            sizes[i] = chunk_size;
+        }
+
+        offset += STATE_CHUNK_HEADER_SIZE + chunk_size;
+    }
+
+    for(int i = 0; i < NUM_STATE_CHUNKS; ++i)
+    {
+        if(data[i] == nullptr)
+            return false;
+    }
+
+    return true;
 }
 
 /**
- * Returns back the Video module. This is used by the MainWindow to render the
- * video module.
+ * Load every device's state out of its chunk. A chunk loads successfully if
+ * the device reads exactly the whole chunk.
+ *
+ * @param data Where each device's chunk starts.
+ * @param sizes The size of each device's chunk.
  *
- * @return The video module.
+ * @return True if every chunk was loaded, false if one of them failed (the
+ *         chunks after it aren't loaded).
  */
-Video* EmulatorCore::GetVideo() const
+bool EmulatorCore::load_state_chunks(
+    const uint8_t *const (&data)[NUM_STATE_CHUNKS],
+    const uint32_t (&sizes)[NUM_STATE_CHUNKS])
 {
-    return _video;
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    get_state_chunks(chunks);
+
+    for(int i = 0; i < NUM_STATE_CHUNKS; ++i)
+    {
+        StateReader input(data[i], sizes[i]);
+
+        if(chunks[i].device != nullptr)
+            chunks[i].device->LoadState(input);
+        else
+            input.Read(&_leftover_cycles, sizeof(_leftover_cycles));
+
+        if(input.Failed() || input.GetPosition() != sizes[i])
+            return false;
+    }
+
+    return true;
 }
 
 /**
@@ -3,10 +3,15 @@
 
 #include "Cpu.h"
 #include "DiskController.h"
+#include "HardDiskCard.h"
+#include "IPresenter.h"
 #include "IState.h"
 #include "Keyboard.h"
 #include "LanguageCard.h"
 #include "Memory.h"
+#include "Mockingboard.h"
+#include "PostProcessor.h"
+#include "RewindBuffer.h"
 #include "Speaker.h"
 #include "SystemBus.h"
 #include "Video.h"
@@ -14,13 +19,19 @@
 #include <QColor>
 #include <QKeyEvent>
 
-#include <fstream>
+#include <chrono>
+#include <iostream>
 #include <string>
+#include <vector>
 
 class EmulatorCore
 {
 public:
     EmulatorCore();
+    ~EmulatorCore();
+
+    EmulatorCore(const EmulatorCore &copy) = delete;
+    EmulatorCore& operator=(const EmulatorCore &rhs) = delete;
 
     void SetPaused(bool pause);
     bool GetPaused() const;
@@ -30,16 +41,32 @@ public:
 
     CpuContext GetCpuContext() const;
 
-    void LoadDisk(std::string filename,
-                  DiskController::DriveId drive,
-                  uint8_t data[DiskDrive::DISK_SIZE]);
+    bool LoadDisk(std::string filename, DiskController::DriveId drive);
     void UnloadDisk(DiskController::DriveId drive);
+    bool FlushDisks();
+    bool ReloadDisks();
     std::string GetDiskFilename(DiskController::DriveId drive) const;
     bool GetDiskBusy();
+    void SetDiskAccelerated(DiskController::DriveId drive, bool accelerated);
+    bool GetDiskAccelerated(DiskController::DriveId drive) const;
+    void SetDiskWarp(bool enabled);
+    bool GetDiskWarp() const;
+    uint32_t GetDiskWarpTimeSaved() const;
+    DiskTelemetry::Stats GetDiskStats() const;
+    void GetDiskEvents(std::vector<DiskTelemetry::Event> &events) const;
+    void ClearDiskTelemetry();
+
+    bool LoadHardDisk(std::string filename);
+    void UnloadHardDisk();
+    std::string GetHardDiskFilename() const;
 
     void RunFrame(int FPS);
     void SingleStep();
 
+    void SetRewinding(bool rewinding);
+    bool GetRewinding() const;
+    uint32_t GetRewindFrames() const;
+
     uint16_t GetBpAddr() const;
     void SetBpAddr(uint16_t addr);
 
@@ -49,8 +76,25 @@ public:
     QColor GetVideoTextColor() const;
     void SetVideoTextColor(QColor color);
 
+    bool GetVideoNtsc() const;
+    void SetVideoNtsc(bool enabled);
+
+    PostProcessSettings GetVideoPostProcess() const;
+    void SetVideoPostProcess(const PostProcessSettings &settings);
+
+    void SetVideoPresenter(IPresenter *presenter);
+    uint32_t GetVideoRenderTime() const;
+    uint32_t GetVideoRenderLatency() const;
+
     bool GetSpeakerMute() const;
     void SetSpeakerMute(bool mute);
+    int GetAudioSampleRate() const;
+    void SetAudioSampleRate(int sample_rate);
+    uint32_t GetAudioTargetLatency() const;
+    void SetAudioTargetLatency(uint32_t latency);
+    uint32_t GetAudioBufferFill() const;
+    uint32_t GetAudioUnderruns() const;
+    int32_t GetAudioRateAdjust() const;
 
     key_mappings GetMappings();
     void SetMappings(key_mappings key_map);
@@ -60,18 +104,88 @@ public:
     void SetTurbo(uint8_t turbo);
     uint8_t GetTurbo() const;
 
-    bool SaveState(std::ofstream &output);
-    bool LoadState(std::ifstream &input);
+    void SaveState(StateWriter &output);
+    bool LoadState(const uint8_t *state, size_t size);
 
-    Video* GetVideo() const;
+    bool SaveState(std::ostream &output);
+    bool LoadState(std::istream &input);
 
     void UpdateKeyboardStrobe(const QKeyEvent *key);
 
 private:
     /**
-     * Magic value placed at the beginning of a saved state.
+     * Number of chunks in a saved state: one for each device, plus one for the
+     * emulator core itself.
+     */
+    static constexpr int NUM_STATE_CHUNKS = 10;
+
+    /**
+     * A chunk of a saved state, holding the state of one device.
+     */
+    struct StateChunk
+    {
+        /**
+         * Identifies the chunk in the saved state.
+         */
+        const char *id;
+
+        /**
+         * The device whose state is in the chunk (nullptr for the emulator
+         * core's own state).
+         */
+        IState *device;
+    };
+
+private:
+    void run_warp(uint32_t cycles_per_frame,
+                  int FPS,
+                  std::chrono::steady_clock::time_point frame_start);
+
+    void save_rewind_state();
+    void rewind_frame();
+
+    void get_state_chunks(StateChunk (&chunks)[NUM_STATE_CHUNKS]);
+    bool find_state_chunks(const uint8_t *state,
+                           size_t size,
+                           const uint8_t *(&data)[NUM_STATE_CHUNKS],
+                           uint32_t (&sizes)[NUM_STATE_CHUNKS]);
+    bool load_state_chunks(const uint8_t *const (&data)[NUM_STATE_CHUNKS],
+                           const uint32_t (&sizes)[NUM_STATE_CHUNKS]);
+
+private:
+    /**
+     * Version of the saved state format. This goes up whenever the state
+     * saved by any of the devices changes, and states from other versions
+     * aren't loaded.
+     */
+    static constexpr uint32_t STATE_VERSION = 3;
+
+    /**
+     * Sizes of the header at the start of a saved state (an ID and the
+     * version), and of the header in front of each chunk (an ID and the size
+     * of the chunk).
+     */
+    static constexpr int STATE_HEADER_SIZE = 8;
+    static constexpr int STATE_CHUNK_HEADER_SIZE = 8;
+
+    /**
+     * How much of each frame (as a percentage) can be spent running the CPU
+     * while the disk is spinning at warp speed. The rest is left for the GUI.
+     */
+    static constexpr int WARP_FRAME_PERCENT = 75;
+
+    /**
+     * How many frames to run between saving each state for rewinding, and
+     * the most states to keep (ten minutes' worth at 60 frames a second).
+     */
+    static constexpr int REWIND_INTERVAL = 6;
+    static constexpr int REWIND_MAX_STATES = 6000;
+
+    /**
+     * Memory used to hold the rewind history. Along with the newest state
+     * (which is kept whole), this stays under 64MB.
      */
-    static constexpr uint32_t STATE_MAGIC = 0xDEADBEEF;
+    static constexpr size_t REWIND_BUFFER_SIZE = 60 * 1024 * 1024;
 
     /**
      * Provides the main access point between all of the components in the
@@ -96,8 +210,8 @@ private:
     LanguageCard _lang_card;
 
     /**
-     * Video module. This is both a QWidget (so QT can render it) and an SFML
-     * RenderWindow (so SFML can draw to it).
+     * Video module. This is allocated separately since it holds several
+     * frames worth of video data.
      */
     Video *_video;
 
@@ -116,6 +230,16 @@ private:
      */
     DiskController _disk_ctrl;
 
+    /**
+     * Mockingboard sound card.
+     */
+    Mockingboard _mockingboard;
+
+    /**
+     * ProDOS/SmartPort hard disk card.
+     */
+    HardDiskCard _hard_disk;
+
     /**
      * The number of extra cycles ran after each CPU execution. These will be
      * subtracted from the next amount of CPU cycles that are run.
@@ -132,6 +256,46 @@ private:
      * frame.
      */
     uint8_t _turbo;
+
+    /**
+     * True if the CPU runs as fast as it can (with the audio silenced) for as
+     * long as a disk drive's motor is on. This only lasts for the session.
+     */
+    bool _disk_warp;
+
+    /**
+     * Host time (in microseconds) saved by running at warp speed instead of
+     * at the normal speed.
+     */
+    uint64_t _warp_time_saved;
+
+    /**
+     * Copy of the state taken before loading a state, so it can be put back
+     * if the load fails. Kept around so loading doesn't have to allocate it
+     * every time.
+     */
+    StateWriter _load_backup;
+
+    /**
+     * States saved every few frames, to rewind through.
+     */
+    RewindBuffer _rewind;
+
+    /**
+     * Where states going in and out of the rewind history are kept.
+     */
+    StateWriter _rewind_state;
+
+    /**
+     * Number of frames run since the last state was saved for rewinding.
+     */
+    int _rewind_frames;
+
+    /**
+     * True while stepping back through the rewind history (one state a frame)
+     * instead of running.
+     */
+    bool _rewinding;
 };
 
 #endif // EMULATORCORE_H
@@ -0,0 +1,120 @@
+/**
+ * Headless presenter that captures finished frames into memory.
+ *
+ * The render thread draws into a private buffer and swaps it with the
+ * finished frame in EndFrame(), so retrieving a frame never blocks the render
+ * thread for longer than a swap.
+ */
+#include "FrameCapture.h"
+
+/**
+ * Constructor.
+ *
+ * @param target_width Width to report to the post-processing stage (zero if
+ *                     frames shouldn't be scaled to fit).
+ * @param target_height Height to report to the post-processing stage (zero if
+ *                      frames shouldn't be scaled to fit).
+ */
+FrameCapture::FrameCapture(int target_width, int target_height) :
+    _drawing(),
+    _drawing_width(0),
+    _drawing_height(0),
+    _finished(),
+    _finished_width(0),
+    _finished_height(0),
+    _frame_count(0),
+    _target_width(target_width),
+    _target_height(target_height),
+    _mutex()
+{ }
+
+/**
+ * Retrieve the buffer that the next frame should be drawn into.
+ *
+ * @note This is called from the render thread.
+ *
+ * @param width Width of the frame in pixels.
+ * @param height Height of the frame in pixels.
+ *
+ * @return Memory for (width * height) RGBA pixels.
+ */
+uint32_t* FrameCapture::BeginFrame(int width, int height)
+{
+    _drawing.resize(width * height);
+    _drawing_width = width;
+    _drawing_height = height;
+
+    return _drawing.data();
+}
+
+/**
+ * Make the frame drawn since the last BeginFrame() the finished frame.
+ *
+ * @note This is called from the render thread.
+ */
+void FrameCapture::EndFrame()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _drawing.swap(_finished);
+    _finished_width = _drawing_width;
+    _finished_height = _drawing_height;
+    _frame_count++;
+}
+
+/**
+ * Retrieve the size frames should be scaled to.
+ *
+ * @note This is called from the render thread.
+ *
+ * @param width Set to the target width in pixels.
+ * @param height Set to the target height in pixels.
+ */
+void FrameCapture::GetTargetSize(int &width, int &height) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    width = _target_width;
+    height = _target_height;
+}
+
+/**
+ * Change the size frames should be scaled to. This takes effect on the next
+ * frame.
+ *
+ * @param width The target width in pixels (zero if frames shouldn't be scaled
+ *              to fit).
+ * @param height The target height in pixels (zero if frames shouldn't be
+ *               scaled to fit).
+ */
+void FrameCapture::SetTargetSize(int width, int height)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _target_width = width;
+    _target_height = height;
+}
+
+/**
+ * Copy out the most recently finished frame.
+ *
+ * @param pixels Filled with the frame's RGBA pixels.
+ * @param width Set to the width of the frame (zero if no frame has finished).
+ * @param height Set to the height of the frame (zero if no frame has
+ *               finished).
+ *
+ * @return The number of frames finished so far, which can be used to tell
+ *         whether a new frame has arrived since the last call.
+ */
+uint32_t FrameCapture::GetFrame(std::vector<uint32_t> &pixels,
+                                int &width,
+                                int &height)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    pixels = _finished;
+    width = _finished_width;
+    height = _finished_height;
+
+    return _frame_count;
+}
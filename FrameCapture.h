@@ -0,0 +1,60 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "IPresenter.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * A presenter that doesn't display anything. Finished frames (after
+ * post-processing) are kept in memory so they can be retrieved, for instance
+ * to save screenshots or to run the emulator without a window.
+ */
+class FrameCapture : public IPresenter
+{
+public:
+    FrameCapture(int target_width = 0, int target_height = 0);
+
+    uint32_t* BeginFrame(int width, int height) override;
+    void EndFrame() override;
+    void GetTargetSize(int &width, int &height) const override;
+
+    void SetTargetSize(int width, int height);
+
+    uint32_t GetFrame(std::vector<uint32_t> &pixels, int &width, int &height);
+
+private:
+    /**
+     * The frame currently being drawn by the render thread.
+     */
+    std::vector<uint32_t> _drawing;
+    int _drawing_width;
+    int _drawing_height;
+
+    /**
+     * The most recently finished frame.
+     */
+    std::vector<uint32_t> _finished;
+    int _finished_width;
+    int _finished_height;
+
+    /**
+     * Number of frames finished so far.
+     */
+    uint32_t _frame_count;
+
+    /**
+     * The size frames get scaled to (if post-processing is scaling frames).
+     */
+    int _target_width;
+    int _target_height;
+
+    /**
+     * Protects everything except the frame currently being drawn.
+     */
+    mutable std::mutex _mutex;
+};
+
+#endif // FRAMECAPTURE_H
@@ -0,0 +1,433 @@
+/**
+ * Group coded recording (GCR) for 16-sector disks. The Disk II can't store
+ * arbitrary bytes: every disk byte has to start with a '1' and can't have two
+ * '0's in a row. DOS 3.3 and ProDOS get around this by storing the sector
+ * data "6 and 2" encoded (each 256-byte sector becomes 342 six-bit values,
+ * which are translated into valid disk bytes), and the address fields "4 and
+ * 4" encoded (each byte is split across two disk bytes). See "Beneath Apple
+ * DOS" for all of the details.
+ *
+ * Everything here is table driven, and whole tracks can be encoded or decoded
+ * in one call.
+ */
+#include "GcrCodec.h"
+
+#include <cstring>
+
+/**
+ * Translation table used to translate 6-bit values into "6 and 2" disk bytes.
+ */
+static constexpr uint8_t trans62[64] = {
+    0x96, 0x97, 0x9a, 0x9b, 0x9d, 0x9e, 0x9f, 0xa6,
+    0xa7, 0xab, 0xac, 0xad, 0xae, 0xaf, 0xb2, 0xb3,
+    0xb4, 0xb5, 0xb6, 0xb7, 0xb9, 0xba, 0xbb, 0xbc,
+    0xbd, 0xbe, 0xbf, 0xcb, 0xcd, 0xce, 0xcf, 0xd3,
+    0xd6, 0xd7, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde,
+    0xdf, 0xe5, 0xe6, 0xe7, 0xe9, 0xea, 0xeb, 0xec,
+    0xed, 0xee, 0xef, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6,
+    0xf7, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+/**
+ * Translation table used to translate "6 and 2" disk bytes back into 6-bit
+ * values. Indexed by the disk byte; invalid disk bytes map to 0xFF.
+ */
+static constexpr uint8_t detrans62[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00, 0x01,
+    0xff, 0xff, 0x02, 0x03, 0xff, 0x04, 0x05, 0x06,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x08,
+    0xff, 0xff, 0xff, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+    0xff, 0xff, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+    0xff, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x1b, 0xff, 0x1c, 0x1d, 0x1e,
+    0xff, 0xff, 0xff, 0x1f, 0xff, 0xff, 0x20, 0x21,
+    0xff, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0x29, 0x2a, 0x2b,
+    0xff, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32,
+    0xff, 0xff, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+    0xff, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f
+};
+
+/**
+ * The bottom two bits of a byte are stored swapped (bit 0 where bit 1 goes,
+ * and vice versa). Indexed by the two bits.
+ */
+static constexpr uint8_t swap_low_bits[4] = { 0, 2, 1, 3 };
+
+/**
+ * Number of 6-bit values holding the bottom two bits of every byte (three
+ * bytes' worth in each).
+ */
+static constexpr int num_low_values = 86;
+
+/**
+ * Number of 6-bit values in a data field (not including the checksum).
+ */
+static constexpr int num_values = num_low_values + GcrCodec::SECTOR_SIZE;
+
+/**
+ * How far past an address field to look for the data field when decoding.
+ */
+static constexpr size_t data_field_search = 32;
+
+/**
+ * Most disk bytes an address field through the end of its data field can take
+ * up.
+ */
+static constexpr size_t max_sector_nibbles = 3 + 8 + data_field_search + 3 +
+                                             GcrCodec::DATA_FIELD_SIZE;
+
+/**
+ * Encode a whole track.
+ *
+ * @param out Where to write the encoded track (ENCODED_TRACK_SIZE bytes).
+ * @param volume The volume number to put in the address fields.
+ * @param track_num The track being encoded.
+ * @param data The track's sectors, in the order they're stored in the disk
+ *             image.
+ * @param sector_trans Maps each sector in the image to a physical sector on
+ *                     the track.
+ *
+ * @return A pointer to just past the encoded track.
+ */
+uint8_t* GcrCodec::EncodeTrack(uint8_t *out,
+                               uint8_t volume,
+                               uint8_t track_num,
+                               const uint8_t *data,
+                               const uint8_t *sector_trans)
+{
+    for(int i = 0; i < NUM_SECTORS; ++i)
+    {
+        out = EncodeSector(out,
+                           volume,
+                           track_num,
+                           sector_trans[i],
+                           data + (i * SECTOR_SIZE));
+    }
+
+    return out;
+}
+
+/**
+ * Decode every sector on a track. Sectors are found by their address fields,
+ * so they can be anywhere on the track and in any order. A sector whose
+ * address or data field is damaged (say, one that was in the middle of being
+ * written) is skipped and its data is left alone.
+ *
+ * @param nibbles The disk bytes on the track, for two full revolutions (so a
+ *                sector that wraps around the end of the track is still read
+ *                in one piece).
+ * @param num_nibbles Number of disk bytes (two revolutions' worth).
+ * @param track_num The track being decoded. Sectors that claim to be on a
+ *                  different track are skipped.
+ * @param sector_trans Maps each sector in the image to a physical sector on
+ *                     the track.
+ * @param data Each sector that's decoded is written here, in the order
+ *             they're stored in the disk image.
+ *
+ * @return A bit for each sector in the image (bit 0 for the first) that was
+ *         decoded.
+ */
+uint16_t GcrCodec::DecodeTrack(const uint8_t *nibbles,
+                               size_t num_nibbles,
+                               uint8_t track_num,
+                               const uint8_t *sector_trans,
+                               uint8_t *data)
+{
+    uint8_t image_sector[NUM_SECTORS];
+
+    for(int i = 0; i < NUM_SECTORS; ++i)
+        image_sector[sector_trans[i]] = i;
+
+    const size_t rev_size = num_nibbles / 2;
+    uint16_t decoded = 0;
+
+    for(size_t i = 0; i < rev_size; ++i)
+    {
+        if(i + max_sector_nibbles > num_nibbles)
+            break;
+
+        if(nibbles[i] != 0xD5 || nibbles[i + 1] != 0xAA ||
+           nibbles[i + 2] != 0x96)
+        {
+            continue;
+        }
+
+        const uint8_t volume = Decode44(&nibbles[i + 3]);
+        const uint8_t track = Decode44(&nibbles[i + 5]);
+        const uint8_t sector = Decode44(&nibbles[i + 7]);
+        const uint8_t checksum = Decode44(&nibbles[i + 9]);
+
+        if((volume ^ track ^ sector) != checksum || track != track_num ||
+           sector >= NUM_SECTORS)
+        {
+            continue;
+        }
+
+        const int slot = image_sector[sector];
+
+        for(size_t j = i + 11; j < i + 11 + data_field_search; ++j)
+        {
+            if(nibbles[j] == 0xD5 && nibbles[j + 1] == 0xAA)
+            {
+                if(nibbles[j + 2] == 0xAD &&
+                   Decode62(&nibbles[j + 3], data + (slot * SECTOR_SIZE)))
+                {
+                    decoded |= 1 << slot;
+                }
+
+                break;
+            }
+        }
+    }
+
+    return decoded;
+}
+
+/**
+ * Encode a single sector: the gap before it, its address field and its data
+ * field.
+ *
+ * This code is based off of the explodeSector() function from the apple2js
+ * project located here:
+ * https://github.com/whscullin/apple2js/blob/master/js/disk2.js
+ *
+ * @param out Where to write the encoded sector.
+ * @param volume The volume number to put in the address field.
+ * @param track_num The track this sector is on.
+ * @param sector_num Which sector this is.
+ * @param data A pointer to the sector's data.
+ *
+ * @return A pointer to just past the encoded sector.
+ */
+uint8_t* GcrCodec::EncodeSector(uint8_t *out,
+                                uint8_t volume,
+                                uint8_t track_num,
+                                uint8_t sector_num,
+                                const uint8_t *data)
+{
+    /**
+     * Gap 1 appears before the first sector and is 128 bytes.
+     * Gap 3 appears before every other sector and is 40 bytes.
+     */
+    const int num_gap_bytes = (sector_num == 0) ? 128 : 40;
+    out = encode_gap(out, num_gap_bytes);
+
+    /**
+     * Encode the address field.
+     */
+    uint8_t checksum = volume ^ track_num ^ sector_num;
+    *out++ = 0xD5;
+    *out++ = 0xAA;
+    *out++ = 0x96;
+    out = Encode44(out, volume);
+    out = Encode44(out, track_num);
+    out = Encode44(out, sector_num);
+    out = Encode44(out, checksum);
+    *out++ = 0xDE;
+    *out++ = 0xAA;
+    *out++ = 0xEB;
+
+    /**
+     * Gap 2 appears between the address and data fields for 5 bytes.
+     */
+    out = encode_gap(out, 6);
+
+    /**
+     * Encode the data field.
+     */
+    *out++ = 0xD5;
+    *out++ = 0xAA;
+    *out++ = 0xAD;
+    out = Encode62(out, data);
+    *out++ = 0xDE;
+    *out++ = 0xAA;
+    *out++ = 0xEB;
+
+    /**
+     * Beginning of the next Gap 3.
+     */
+    return encode_gap(out, 1);
+}
+
+/**
+ * "6 and 2" encode a sector's data. The bottom two bits of every byte are
+ * gathered up (three bytes to a value) into the first 86 6-bit values, and
+ * the top six bits of each byte make up the other 256. Each value is XORed
+ * with the one before it, translated into a disk byte, and the final running
+ * value is added on the end as a checksum.
+ *
+ * @param out Where to write the DATA_FIELD_SIZE disk bytes.
+ * @param data The sector's 256 bytes of data.
+ *
+ * @return A pointer to just past the encoded data.
+ */
+uint8_t* GcrCodec::Encode62(uint8_t *out, const uint8_t *data)
+{
+    uint8_t values[num_values];
+
+    /**
+     * The last two low values only have room for two bytes' worth of bits.
+     * DOS fills in the rest with the bits of the first two bytes again (which
+     * get ignored when the sector is read back).
+     */
+    for(int i = 0; i < num_low_values; ++i)
+    {
+        values[i] = swap_low_bits[data[i] & 3] |
+                    (swap_low_bits[data[i + num_low_values] & 3] << 2) |
+                    (swap_low_bits[data[(i + 2 * num_low_values) & 0xFF] & 3]
+                     << 4);
+    }
+
+    for(int i = 0; i < SECTOR_SIZE; ++i)
+        values[num_low_values + i] = data[i] >> 2;
+
+    uint8_t last = 0;
+    for(int i = 0; i < num_values; ++i)
+    {
+        *out++ = trans62[last ^ values[i]];
+        last = values[i];
+    }
+
+    *out++ = trans62[last];
+
+    return out;
+}
+
+/**
+ * Decode the "6 and 2" encoded data field of a sector (the reverse of
+ * Encode62()).
+ *
+ * @param in The DATA_FIELD_SIZE disk bytes following the data field prologue.
+ * @param data Filled in with the sector's 256 bytes of data. Only written if
+ *             the data field is valid.
+ *
+ * @return True if the data field was valid and its checksum matched.
+ */
+bool GcrCodec::Decode62(const uint8_t *in, uint8_t *data)
+{
+    uint8_t values[num_values];
+
+    /**
+     * Each disk byte was XORed with the one before it, and the last disk byte
+     * is the checksum (the final running value). Invalid disk bytes all
+     * translate to 0xFF, which can't be hidden by the XORs.
+     */
+    uint8_t last = 0;
+    uint8_t invalid = 0;
+
+    for(int i = 0; i < num_values; ++i)
+    {
+        const uint8_t value = detrans62[in[i]];
+
+        invalid |= value;
+        last ^= value;
+        values[i] = last;
+    }
+
+    const uint8_t checksum = detrans62[in[num_values]];
+
+    if((invalid | checksum) & 0xC0 || checksum != last)
+        return false;
+
+    const uint8_t *high = values + num_low_values;
+
+    for(int i = 0; i < num_low_values; ++i)
+    {
+        const uint8_t low = values[i];
+
+        data[i] = (high[i] << 2) | swap_low_bits[low & 3];
+        data[i + num_low_values] = (high[i + num_low_values] << 2) |
+                                   swap_low_bits[(low >> 2) & 3];
+
+        if(i + 2 * num_low_values < SECTOR_SIZE)
+        {
+            data[i + 2 * num_low_values] =
+                (high[i + 2 * num_low_values] << 2) |
+                swap_low_bits[(low >> 4) & 3];
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Encode a byte into two separate bytes using the "4 and 4" encoding
+ * system. Essentially, the data goes from:
+ *
+ * D7 D6 D5 D4 D3 D2 D1 D0
+ *
+ * To:
+ *
+ * 1 D7 1 D5 1 D3 1 D1
+ * 1 D6 1 D4 1 D2 1 D0
+ *
+ * This ensures that every byte starts with a '1' and that there's no
+ * adjacent zeroes (which is a requirement of the original disk controller).
+ *
+ * @param out Where to write the encoded bytes.
+ * @param data The byte to encode.
+ *
+ * @return A pointer to just past the encoded bytes.
+ */
+uint8_t* GcrCodec::Encode44(uint8_t *out, uint8_t data)
+{
+    *out++ = (data >> 1) | 0xAA;
+    *out++ = data | 0xAA;
+
+    return out;
+}
+
+/**
+ * Decode a "4 and 4" encoded byte (see Encode44()).
+ *
+ * @param in The two encoded bytes.
+ *
+ * @return The decoded byte.
+ */
+uint8_t GcrCodec::Decode44(const uint8_t *in)
+{
+    return ((in[0] << 1) | 1) & in[1];
+}
+
+/**
+ * Encodes a sequence of gap (self-sync) bytes. These are used to synchronize
+ * disk controller so it knows where the start of a byte is. It also gives the
+ * firmware time to decode the data and process it. Since this is an emulator,
+ * we know exactly where the start of each byte is, so we can be more liberal
+ * with how we encode these gap bytes.
+ *
+ * Usually these are 10-bit bytes (turns out "byte" doesn't imply 8-bits) where
+ * the first 8-bits are 0xFF, and the last two bits are '0'. Since we know where
+ * the beginning of every byte is, we don't encode those useless zero bits.
+ *
+ * @param out Where to write the gap bytes.
+ * @param num_bytes Number of gap bytes to encode.
+ *
+ * @return A pointer to just past the gap bytes.
+ */
+uint8_t* GcrCodec::encode_gap(uint8_t *out, int num_bytes)
+{
+    std::memset(out, 0xFF, num_bytes);
+
+    return out + num_bytes;
+}
@@ -0,0 +1,65 @@
+#ifndef GCRCODEC_H
+#define GCRCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Converts sectors to and from the group coded (GCR) disk bytes that DOS 3.3
+ * and ProDOS store on a track: "6 and 2" for the data fields and "4 and 4"
+ * for the address fields.
+ */
+class GcrCodec
+{
+public:
+    /**
+     * Number of sectors on a track, and the size of each sector in bytes.
+     */
+    static constexpr int NUM_SECTORS = 16;
+    static constexpr int SECTOR_SIZE = 256;
+
+    /**
+     * Number of disk bytes a sector's data turns into: 342 "6 and 2" bytes
+     * plus a checksum byte.
+     */
+    static constexpr int DATA_FIELD_SIZE = 343;
+
+    /**
+     * Size of an encoded track in bytes. Every sector takes up 370 bytes
+     * (address field, data field and the gaps between them), plus the gap
+     * before it: 128 bytes before the first sector and 40 before the rest.
+     */
+    static constexpr int ENCODED_SECTOR_SIZE = 370;
+    static constexpr int ENCODED_TRACK_SIZE = 128 + (15 * 40) +
+                                              (NUM_SECTORS *
+                                               ENCODED_SECTOR_SIZE);
+
+public:
+    static uint8_t* EncodeTrack(uint8_t *out,
+                                uint8_t volume,
+                                uint8_t track_num,
+                                const uint8_t *data,
+                                const uint8_t *sector_trans);
+    static uint16_t DecodeTrack(const uint8_t *nibbles,
+                                size_t num_nibbles,
+                                uint8_t track_num,
+                                const uint8_t *sector_trans,
+                                uint8_t *data);
+
+    static uint8_t* EncodeSector(uint8_t *out,
+                                 uint8_t volume,
+                                 uint8_t track_num,
+                                 uint8_t sector_num,
+                                 const uint8_t *data);
+
+    static uint8_t* Encode62(uint8_t *out, const uint8_t *data);
+    static bool Decode62(const uint8_t *in, uint8_t *data);
+
+    static uint8_t* Encode44(uint8_t *out, uint8_t data);
+    static uint8_t Decode44(const uint8_t *in);
+
+private:
+    static uint8_t* encode_gap(uint8_t *out, int num_bytes);
+};
+
+#endif // GCRCODEC_H
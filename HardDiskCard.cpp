@@ -0,0 +1,601 @@
+/**
+ * A block device card for hard disk images (.po or .hdv, up to 32MB). Unlike
+ * the Disk II, there's no disk to spin: the card's ROM holds a ProDOS block
+ * driver and a SmartPort entry point, and each call is handed straight to the
+ * emulator, which copies the 512-byte block between the image and memory.
+ *
+ * The image is mapped into memory, so only the blocks that get used are ever
+ * read off of the host's disk. Writes go into the mapped image and mark their
+ * page dirty; flushing writes only the dirty pages back to the image file, in
+ * place.
+ *
+ * The ROM's driver is just enough 6502 code to start a command and return its
+ * result:
+ *
+ *   ProDOS:    JMP $C740           ($C730, pointed to by $C7FF)
+ *   SmartPort: STA $C0F1           ($C733, the ProDOS entry plus three)
+ *              JMP $C743
+ *              STA $C0F0           ($C740)
+ *              LDX $C0F1           ($C743)
+ *              LDY $C0F2
+ *              LDA $C0F0
+ *              CMP #$01            (carry set if there was an error)
+ *              RTS
+ *
+ * The Apple II+ autostart ROM doesn't boot from this card (only from cards
+ * that look like a Disk II controller), so the hard disk is booted with PR#7.
+ */
+#include "HardDiskCard.h"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * The card's ROM. The first eight bytes identify it as a ProDOS block device
+ * with a SmartPort interface, followed by code that boots from block 0.
+ */
+static constexpr uint8_t hard_disk_rom[256] = {
+    0xA2, 0x20, 0xA0, 0x00, 0xA2, 0x03, 0xA2, 0x00, // Signature.
+    0xA9, 0x01, 0x85, 0x42, 0xA9, 0x70, 0x85, 0x43, // Boot: read block
+    0xA9, 0x08, 0x85, 0x45, 0xA9, 0x00, 0x85, 0x44, // 0 into $0800 and
+    0x85, 0x46, 0x85, 0x47, 0x20, 0x30, 0xC7, 0xB0, // run it, or go
+    0x05, 0xA2, 0x70, 0x4C, 0x01, 0x08, 0x4C, 0x03, // back to BASIC.
+    0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x4C, 0x40, 0xC7, 0x8D, 0xF1, 0xC0, 0x4C, 0x43, // Entry points.
+    0xC7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x8D, 0xF0, 0xC0, 0xAE, 0xF1, 0xC0, 0xAC, 0xF2, // Driver.
+    0xC0, 0xAD, 0xF0, 0xC0, 0xC9, 0x01, 0x60, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x30
+};
+
+/**
+ * Name the hard disk reports to SmartPort callers (padded with spaces).
+ */
+static constexpr char device_name[] = "SUPERII HARDDISK";
+
+/**
+ * SmartPort status byte: a block device that can be read, written and
+ * formatted, plus whether a disk is online.
+ */
+static constexpr uint8_t smartport_block_device = 0xE8;
+static constexpr uint8_t smartport_online = 0x10;
+
+/**
+ * SmartPort device type and subtype for a hard disk.
+ */
+static constexpr uint8_t smartport_hard_disk = 0x02;
+static constexpr uint8_t smartport_not_removable = 0x00;
+
+/**
+ * Constructor.
+ *
+ * @param cpu Reference to the CPU, for finding SmartPort parameters.
+ * @param bus Reference to the system bus, for moving blocks in and out of
+ *            memory.
+ */
+HardDiskCard::HardDiskCard(Cpu &cpu, SystemBus &bus) :
+    IMemoryMapped(HARD_DISK_START_ADDR, HARD_DISK_END_ADDR),
+    _cpu(cpu),
+    _bus(bus),
+    _image(),
+    _filename(""),
+    _num_blocks(0),
+    _dirty_pages(),
+    _image_dirty(false),
+    _error(ERR_NONE),
+    _result_x(0),
+    _result_y(0)
+{ }
+
+/**
+ * Reset the card. The hard disk stays loaded.
+ */
+void HardDiskCard::Reset()
+{
+    _error = ERR_NONE;
+    _result_x = 0;
+    _result_y = 0;
+}
+
+/**
+ * Load a hard disk image. The image has to be a whole number of blocks, in
+ * ProDOS order (.po or .hdv).
+ *
+ * @param filename Full path to the image.
+ *
+ * @return True if the image was loaded, false if it couldn't be opened or
+ *         isn't valid (the card is left empty).
+ */
+bool HardDiskCard::LoadImage(std::string filename)
+{
+    UnloadImage();
+
+    if(!_image.Open(filename))
+        return false;
+
+    /**
+     * Images of exactly 32MB are common, even though ProDOS can't use the
+     * last block.
+     */
+    const size_t size = _image.GetSize();
+
+    if(size % BLOCK_SIZE != 0 ||
+       size > static_cast<size_t>(MAX_BLOCKS + 1) * BLOCK_SIZE)
+    {
+        _image.Close();
+        return false;
+    }
+
+    _num_blocks = std::min<size_t>(size / BLOCK_SIZE, MAX_BLOCKS);
+    _dirty_pages.assign((_num_blocks + BLOCKS_PER_PAGE - 1) / BLOCKS_PER_PAGE,
+                        false);
+    _filename = filename;
+
+    return true;
+}
+
+/**
+ * Unload the hard disk. Any changes are written back to the image file first.
+ */
+void HardDiskCard::UnloadImage()
+{
+    FlushWrites();
+
+    _image.Close();
+    _filename = "";
+    _num_blocks = 0;
+    _dirty_pages.clear();
+    _image_dirty = false;
+}
+
+/**
+ * Write the blocks that have changed back to the image file. Runs of dirty
+ * pages are written together, in place, so this costs the same no matter how
+ * big the image is.
+ *
+ * @return True if the image file is up to date, false if it couldn't be
+ *         written (the changes are kept so the next flush tries again).
+ */
+bool HardDiskCard::FlushWrites()
+{
+    if(!_image_dirty)
+        return true;
+
+    constexpr size_t PAGE_SIZE = BLOCKS_PER_PAGE * BLOCK_SIZE;
+    const size_t num_pages = _dirty_pages.size();
+
+    bool written = true;
+
+    for(size_t page = 0; page < num_pages;)
+    {
+        if(!_dirty_pages[page])
+        {
+            ++page;
+            continue;
+        }
+
+        size_t end = page;
+        while(end < num_pages && _dirty_pages[end])
+            ++end;
+
+        const size_t offset = page * PAGE_SIZE;
+        const size_t size = std::min(end * PAGE_SIZE, _image.GetSize()) -
+                            offset;
+
+        if(_image.WriteRange(offset, size))
+            std::fill(_dirty_pages.begin() + page,
+                      _dirty_pages.begin() + end,
+                      false);
+        else
+            written = false;
+
+        page = end;
+    }
+
+    _image_dirty = !written;
+
+    return written;
+}
+
+/**
+ * Returns back the filename.
+ *
+ * @return Filename of the loaded hard disk image or "None" if no image is
+ *         loaded.
+ */
+std::string HardDiskCard::GetFilename() const
+{
+    return (_image.IsOpen()) ? _filename : "None";
+}
+
+/**
+ * Read the card's ROM or the result of the last command.
+ *
+ * @param addr The address to read.
+ * @param no_side_fx Unused (reading the card has no side effects).
+ *
+ * @return The data at that address.
+ */
+uint8_t HardDiskCard::Read(uint16_t addr, bool no_side_fx)
+{
+    (void)no_side_fx;
+
+    if(addr >= HARD_DISK_ROM_START && addr <= HARD_DISK_ROM_END)
+        return hard_disk_rom[addr & 0xFF];
+
+    switch(addr)
+    {
+    case REG_ERROR:
+        return _error;
+
+    case REG_RESULT_X:
+        return _result_x;
+
+    case REG_RESULT_Y:
+        return _result_y;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Run a ProDOS or SmartPort command.
+ *
+ * @param addr The command register written to.
+ * @param data Unused.
+ */
+void HardDiskCard::Write(uint16_t addr, uint8_t data)
+{
+    (void)data;
+
+    _result_x = 0;
+    _result_y = 0;
+
+    switch(addr)
+    {
+    case REG_PRODOS_COMMAND:
+        prodos_command();
+        break;
+
+    case REG_SMARTPORT_COMMAND:
+        smartport_command();
+        break;
+    }
+}
+
+/**
+ * Save the card's state. The hard disk's contents aren't saved, only which
+ * image is loaded, so loading a state (or rewinding) never takes back what
+ * was written to the hard disk since. Blocks that haven't been flushed yet
+ * are left alone too; saving a state doesn't write to the image file.
+ *
+ * @param output Where to write the state.
+ */
+void HardDiskCard::SaveState(StateWriter &output)
+{
+    uint32_t size = (_image.IsOpen()) ? _filename.size() : 0;
+    output.Write(&size, sizeof(size));
+    output.Write(_filename.data(), size);
+
+    output.Write(&_error, sizeof(_error));
+    output.Write(&_result_x, sizeof(_result_x));
+    output.Write(&_result_y, sizeof(_result_y));
+}
+
+/**
+ * Load the card's state. If the same image is still loaded, it's kept as it
+ * is (along with any blocks written since the state was saved). Otherwise the
+ * image is opened again; if it can't be, the card is left empty.
+ *
+ * @param input Where to read the state from.
+ */
+void HardDiskCard::LoadState(StateReader &input)
+{
+    uint32_t size = 0;
+    input.Read(&size, sizeof(size));
+
+    if(size > MAX_FILENAME_SIZE)
+    {
+        input.SetFailed();
+        return;
+    }
+
+    char filename[MAX_FILENAME_SIZE];
+    input.Read(filename, size);
+
+    input.Read(&_error, sizeof(_error));
+    input.Read(&_result_x, sizeof(_result_x));
+    input.Read(&_result_y, sizeof(_result_y));
+
+    if(input.Failed())
+        return;
+
+    if(size == 0)
+    {
+        UnloadImage();
+    }
+    else if(!_image.IsOpen() ||
+            _filename.compare(0, std::string::npos, filename, size) != 0)
+    {
+        LoadImage(std::string(filename, size));
+    }
+}
+
+/**
+ * Run a ProDOS block device call. The parameters are in the zero page, and
+ * the unit number says which drive (only drive 1 exists).
+ */
+void HardDiskCard::prodos_command()
+{
+    const uint8_t command = _bus.Read(PRODOS_COMMAND, true);
+    const uint8_t unit = _bus.Read(PRODOS_UNIT, true);
+    const uint16_t buffer = read_word(PRODOS_BUFFER);
+    const uint16_t block = read_word(PRODOS_BLOCK);
+
+    if(!_image.IsOpen() || (unit & 0x80))
+    {
+        _error = ERR_NO_DEVICE;
+        return;
+    }
+
+    switch(command)
+    {
+    case CMD_STATUS:
+        _error = ERR_NONE;
+        _result_x = _num_blocks & 0xFF;
+        _result_y = _num_blocks >> 8;
+        break;
+
+    case CMD_READ_BLOCK:
+        _error = read_block(block, buffer);
+        break;
+
+    case CMD_WRITE_BLOCK:
+        _error = write_block(block, buffer);
+        break;
+
+    case CMD_FORMAT:
+        _error = ERR_NONE;
+        break;
+
+    default:
+        _error = ERR_IO;
+        break;
+    }
+
+    /**
+     * ProDOS only knows about I/O errors for bad blocks.
+     */
+    if(_error == ERR_BAD_BLOCK)
+        _error = ERR_IO;
+}
+
+/**
+ * Run a SmartPort call. The command number and a pointer to the parameter
+ * list follow the JSR to the SmartPort entry point, so they're found through
+ * the return address on the stack, which is moved past them.
+ */
+void HardDiskCard::smartport_command()
+{
+    const uint8_t sp = _cpu.GetContext().sp;
+    const uint16_t ret_lo = 0x100 | static_cast<uint8_t>(sp + 1);
+    const uint16_t ret_hi = 0x100 | static_cast<uint8_t>(sp + 2);
+
+    const uint16_t ret = _bus.Read(ret_lo, true) |
+                         (_bus.Read(ret_hi, true) << 8);
+
+    const uint8_t command = _bus.Read(ret + 1, true);
+    const uint16_t params = read_word(ret + 2);
+
+    _bus.Write(ret_lo, (ret + 3) & 0xFF);
+    _bus.Write(ret_hi, (ret + 3) >> 8);
+
+    const uint8_t num_params = _bus.Read(params, true);
+    const uint8_t unit = _bus.Read(params + 1, true);
+
+    static constexpr uint8_t expected_params[] = { 3, 3, 3, 1, 3, 1 };
+
+    if(command > CMD_INIT)
+    {
+        _error = ERR_BAD_COMMAND;
+        return;
+    }
+
+    if(num_params != expected_params[command])
+    {
+        _error = ERR_BAD_PARAM_COUNT;
+        return;
+    }
+
+    /**
+     * Unit 0 is the SmartPort interface itself, and the hard disk is unit 1.
+     */
+    if(unit > 1 || (unit == 0 && command != CMD_STATUS))
+    {
+        _error = ERR_BAD_UNIT;
+        return;
+    }
+
+    const uint16_t buffer = read_word(params + 2);
+    const uint32_t block = read_word(params + 4) |
+                           (_bus.Read(params + 6, true) << 16);
+
+    switch(command)
+    {
+    case CMD_STATUS:
+        smartport_status(unit, buffer, _bus.Read(params + 4, true));
+        break;
+
+    case CMD_READ_BLOCK:
+        _error = read_block(block, buffer);
+        break;
+
+    case CMD_WRITE_BLOCK:
+        _error = write_block(block, buffer);
+        break;
+
+    default:
+        _error = (_image.IsOpen()) ? ERR_NONE : ERR_NO_DEVICE;
+        break;
+    }
+}
+
+/**
+ * Handle a SmartPort status call.
+ *
+ * @param unit Unit 0 (the interface) or unit 1 (the hard disk).
+ * @param list Where to write the status.
+ * @param code Which status to return.
+ */
+void HardDiskCard::smartport_status(uint8_t unit, uint16_t list, uint8_t code)
+{
+    uint8_t status[25] = { 0 };
+    int size = 0;
+
+    const uint8_t device_status = smartport_block_device |
+                                  ((_image.IsOpen()) ? smartport_online : 0);
+
+    if(unit == 0 && code == 0)
+    {
+        /**
+         * The number of devices, followed by reserved bytes.
+         */
+        status[0] = 1;
+        size = 8;
+    }
+    else if(unit == 1 && code == 0)
+    {
+        status[0] = device_status;
+        status[1] = _num_blocks & 0xFF;
+        status[2] = (_num_blocks >> 8) & 0xFF;
+        status[3] = (_num_blocks >> 16) & 0xFF;
+        size = 4;
+    }
+    else if(unit == 1 && code == 3)
+    {
+        /**
+         * Device information block: the general status followed by the
+         * device's name, type and firmware version.
+         */
+        status[0] = device_status;
+        status[1] = _num_blocks & 0xFF;
+        status[2] = (_num_blocks >> 8) & 0xFF;
+        status[3] = (_num_blocks >> 16) & 0xFF;
+        status[4] = sizeof(device_name) - 1;
+        std::memcpy(&status[5], device_name, sizeof(device_name) - 1);
+        status[21] = smartport_hard_disk;
+        status[22] = smartport_not_removable;
+        status[23] = 0x00;
+        status[24] = 0x01;
+        size = 25;
+    }
+    else
+    {
+        _error = ERR_BAD_CONTROL;
+        return;
+    }
+
+    write_bytes(list, status, size);
+
+    _error = ERR_NONE;
+    _result_x = size & 0xFF;
+    _result_y = size >> 8;
+}
+
+/**
+ * Copy a block from the hard disk into memory.
+ *
+ * @param block The block to read.
+ * @param buffer Where in memory to copy it to.
+ *
+ * @return An error code (ERR_NONE if the block was read).
+ */
+uint8_t HardDiskCard::read_block(uint32_t block, uint16_t buffer)
+{
+    if(!_image.IsOpen())
+        return ERR_NO_DEVICE;
+
+    if(block >= _num_blocks)
+        return ERR_BAD_BLOCK;
+
+    write_bytes(buffer, _image.GetData() + (block * BLOCK_SIZE), BLOCK_SIZE);
+
+    return ERR_NONE;
+}
+
+/**
+ * Copy a block from memory onto the hard disk.
+ *
+ * @param block The block to write.
+ * @param buffer Where in memory to copy it from.
+ *
+ * @return An error code (ERR_NONE if the block was written).
+ */
+uint8_t HardDiskCard::write_block(uint32_t block, uint16_t buffer)
+{
+    if(!_image.IsOpen())
+        return ERR_NO_DEVICE;
+
+    if(block >= _num_blocks)
+        return ERR_BAD_BLOCK;
+
+    uint8_t *data = _image.GetData() + (block * BLOCK_SIZE);
+
+    for(int i = 0; i < BLOCK_SIZE; ++i)
+        data[i] = _bus.Read(static_cast<uint16_t>(buffer + i), true);
+
+    _dirty_pages[block / BLOCKS_PER_PAGE] = true;
+    _image_dirty = true;
+
+    return ERR_NONE;
+}
+
+/**
+ * Read a little-endian 16-bit value out of memory.
+ *
+ * @param addr Where the value is.
+ *
+ * @return The value.
+ */
+uint16_t HardDiskCard::read_word(uint16_t addr)
+{
+    return _bus.Read(addr, true) |
+           (_bus.Read(static_cast<uint16_t>(addr + 1), true) << 8);
+}
+
+/**
+ * Copy bytes into memory.
+ *
+ * @param addr Where to copy the bytes to (wrapping around the end of memory).
+ * @param data The bytes to copy.
+ * @param num_bytes Number of bytes to copy.
+ */
+void HardDiskCard::write_bytes(uint16_t addr,
+                               const uint8_t *data,
+                               int num_bytes)
+{
+    for(int i = 0; i < num_bytes; ++i)
+        _bus.Write(static_cast<uint16_t>(addr + i), data[i]);
+}
@@ -0,0 +1,175 @@
+#ifndef HARDDISKCARD_H
+#define HARDDISKCARD_H
+
+#include "Cpu.h"
+#include "DiskImage.h"
+#include "IMemoryMapped.h"
+#include "IState.h"
+#include "SystemBus.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * ProDOS/SmartPort block device card (installed in slot 7), which serves
+ * 512-byte blocks straight out of a hard disk image.
+ */
+class HardDiskCard : public IMemoryMapped, public IState
+{
+public:
+    /**
+     * Start and end addresses (inclusive) for the card's ROM.
+     */
+    static constexpr uint16_t HARD_DISK_ROM_START = 0xC700;
+    static constexpr uint16_t HARD_DISK_ROM_END = 0xC7FF;
+
+    /**
+     * Size of a block in bytes, and the most blocks a ProDOS volume can have
+     * (just under 32MB).
+     */
+    static constexpr int BLOCK_SIZE = 512;
+    static constexpr int MAX_BLOCKS = 65535;
+
+public:
+    HardDiskCard(Cpu &cpu, SystemBus &bus);
+
+    HardDiskCard(const HardDiskCard &copy) = delete;
+    HardDiskCard& operator=(const HardDiskCard &rhs) = delete;
+
+    void Reset();
+
+    bool LoadImage(std::string filename);
+    void UnloadImage();
+    bool FlushWrites();
+
+    std::string GetFilename() const;
+
+    uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
+    void Write(uint16_t addr, uint8_t data) override;
+
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
+
+private:
+    void prodos_command();
+    void smartport_command();
+    void smartport_status(uint8_t unit, uint16_t list, uint8_t code);
+
+    uint8_t read_block(uint32_t block, uint16_t buffer);
+    uint8_t write_block(uint32_t block, uint16_t buffer);
+
+    uint16_t read_word(uint16_t addr);
+    void write_bytes(uint16_t addr, const uint8_t *data, int num_bytes);
+
+private:
+    /**
+     * Start and end addresses (inclusive) for the card's registers (slot 7's
+     * I/O space).
+     */
+    static constexpr uint16_t HARD_DISK_START_ADDR = 0xC0F0;
+    static constexpr uint16_t HARD_DISK_END_ADDR = 0xC0FF;
+
+    /**
+     * Registers. Writing to the command registers runs a ProDOS or SmartPort
+     * command; the result is then read out of the other three.
+     */
+    static constexpr uint16_t REG_PRODOS_COMMAND = 0xC0F0;
+    static constexpr uint16_t REG_SMARTPORT_COMMAND = 0xC0F1;
+    static constexpr uint16_t REG_ERROR = 0xC0F0;
+    static constexpr uint16_t REG_RESULT_X = 0xC0F1;
+    static constexpr uint16_t REG_RESULT_Y = 0xC0F2;
+
+    /**
+     * Where ProDOS puts the parameters of a block device call (in the zero
+     * page).
+     */
+    static constexpr uint16_t PRODOS_COMMAND = 0x42;
+    static constexpr uint16_t PRODOS_UNIT = 0x43;
+    static constexpr uint16_t PRODOS_BUFFER = 0x44;
+    static constexpr uint16_t PRODOS_BLOCK = 0x46;
+
+    /**
+     * Block device commands (the same numbers are used by ProDOS and
+     * SmartPort).
+     */
+    enum Command {
+        CMD_STATUS = 0,
+        CMD_READ_BLOCK,
+        CMD_WRITE_BLOCK,
+        CMD_FORMAT,
+        CMD_CONTROL,
+        CMD_INIT
+    };
+
+    /**
+     * Error codes returned to ProDOS and SmartPort callers.
+     */
+    enum Error {
+        ERR_NONE = 0x00,
+        ERR_BAD_COMMAND = 0x01,
+        ERR_BAD_PARAM_COUNT = 0x04,
+        ERR_BAD_UNIT = 0x11,
+        ERR_BAD_CONTROL = 0x21,
+        ERR_IO = 0x27,
+        ERR_NO_DEVICE = 0x28,
+        ERR_BAD_BLOCK = 0x2D
+    };
+
+    /**
+     * Longest filename read back from a saved state.
+     */
+    static constexpr uint32_t MAX_FILENAME_SIZE = 4096;
+
+    /**
+     * Dirty blocks are tracked (and written back) a page at a time.
+     */
+    static constexpr int BLOCKS_PER_PAGE = 8;
+
+    /**
+     * Reference to the CPU, for finding a SmartPort call's parameters on the
+     * stack.
+     */
+    Cpu &_cpu;
+
+    /**
+     * Reference to the system bus, used to move blocks in and out of memory.
+     */
+    SystemBus &_bus;
+
+    /**
+     * The hard disk image, mapped into memory.
+     */
+    DiskImage _image;
+
+    /**
+     * Full path to the image if one is loaded.
+     */
+    std::string _filename;
+
+    /**
+     * Number of blocks on the hard disk (zero if no image is loaded).
+     */
+    uint32_t _num_blocks;
+
+    /**
+     * True for each page of blocks written to since the image file was last
+     * updated.
+     */
+    std::vector<bool> _dirty_pages;
+
+    /**
+     * True if any page is dirty.
+     */
+    bool _image_dirty;
+
+    /**
+     * Result of the last command: the error code, and the values to return
+     * in the X and Y registers.
+     */
+    uint8_t _error;
+    uint8_t _result_x;
+    uint8_t _result_y;
+};
+
+#endif // HARDDISKCARD_H
@@ -0,0 +1,49 @@
+/**
+ * Any classes that inherit from this class can display finished video frames.
+ */
+#ifndef IPRESENTER_H
+#define IPRESENTER_H
+
+#include <cstdint>
+
+/**
+ * Standard interface for the display backends that video frames get presented
+ * to. All of these methods are called from the Video module's render thread.
+ */
+class IPresenter
+{
+public:
+    /**
+     * Retrieve the surface that the next frame should be drawn into. The frame
+     * is written directly into the presenter's memory, so no extra copy is
+     * needed to hand it over.
+     *
+     * @param width Width of the frame in pixels.
+     * @param height Height of the frame in pixels.
+     *
+     * @return Memory for (width * height) pixels in RGBA byte order.
+     */
+    virtual uint32_t* BeginFrame(int width, int height) = 0;
+
+    /**
+     * Display the frame that was drawn into the surface returned by the last
+     * call to BeginFrame().
+     */
+    virtual void EndFrame() = 0;
+
+    /**
+     * Retrieve the size of the area the frames are being displayed in. This is
+     * used to pick the output size when post-processing scales the frames.
+     *
+     * @param width Set to the width in pixels (zero if unknown).
+     * @param height Set to the height in pixels (zero if unknown).
+     */
+    virtual void GetTargetSize(int &width, int &height) const = 0;
+
+    /**
+     * Required for polymorphism.
+     */
+    virtual ~IPresenter() {}
+};
+
+#endif // IPRESENTER_H
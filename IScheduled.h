@@ -0,0 +1,32 @@
+/**
+ * Any classes that inherit from this class can ask the CPU to call them back
+ * at a specific cycle.
+ */
+#ifndef ISCHEDULED_H
+#define ISCHEDULED_H
+
+#include <cstdint>
+
+/**
+ * Standard interface for devices that need to act at an exact CPU cycle (e.g.,
+ * a timer raising an interrupt) without being polled on every instruction.
+ */
+class IScheduled
+{
+public:
+    /**
+     * Called by the CPU at the end of the first instruction that reaches the
+     * cycle this device was scheduled for. The device should reschedule itself
+     * if it needs to be called again.
+     *
+     * @param cycle The current CPU cycle count.
+     */
+    virtual void OnScheduled(uint32_t cycle) = 0;
+
+    /**
+     * Required for polymorphism.
+     */
+    virtual ~IScheduled() {}
+};
+
+#endif // ISCHEDULED_H
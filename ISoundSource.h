@@ -0,0 +1,55 @@
+/**
+ * Any classes that inherit from this class produce audio that gets mixed into
+ * the speaker's output.
+ */
+#ifndef ISOUNDSOURCE_H
+#define ISOUNDSOURCE_H
+
+#include <cstdint>
+
+/**
+ * Standard interface for sound generating devices. The Speaker drives every
+ * source with the same frame timing, so all of them produce the same number of
+ * samples per frame.
+ */
+class ISoundSource
+{
+public:
+    /**
+     * Set the rate of the clock that the source is timed with and the rate
+     * samples are mixed at.
+     *
+     * @param clock_rate Clock cycles per second.
+     * @param sample_rate Output samples per second.
+     */
+    virtual void SetRates(double clock_rate, int sample_rate) = 0;
+
+    /**
+     * Throw away any generated sound.
+     */
+    virtual void ClearAudio() = 0;
+
+    /**
+     * Generate the sound for a frame.
+     *
+     * @param frame_start CPU cycle count at the start of the frame.
+     * @param num_cycles Length of the frame in CPU cycles.
+     */
+    virtual void EndFrame(uint32_t frame_start, uint32_t num_cycles) = 0;
+
+    /**
+     * Add the next samples of generated sound to a mix.
+     *
+     * @param mix The samples to add to.
+     * @param count Number of samples to add. If fewer samples are available,
+     *              the rest are left as is.
+     */
+    virtual void MixSamples(int32_t *mix, int count) = 0;
+
+    /**
+     * Required for polymorphism.
+     */
+    virtual ~ISoundSource() {}
+};
+
+#endif // ISOUNDSOURCE_H
@@ -5,7 +5,8 @@
 #ifndef ISTATE_H
 #define ISTATE_H
 
-#include <fstream>
+#include "StateReader.h"
+#include "StateWriter.h"
 
 /**
  * Standard interface for modules that provide a way to read/write memory mapped
@@ -15,18 +16,23 @@ class IState
 {
 public:
     /**
-     * Write any state out to a file.
+     * Write any state out to memory (which may then get saved to a file).
      *
-     * @param output The file to write to.
+     * Everything written has to have a fixed size (no size_t, enums or
+     * structs with padding), so the state is the same on every build.
+     *
+     * @param output Where to write the state.
      */
-    virtual void SaveState(std::ofstream &output) = 0;
+    virtual void SaveState(StateWriter &output) = 0;
 
     /**
-     * Load any state from a file.
+     * Load any state back out of memory. If the state runs out or the reader
+     * fails, the whole load is undone, so this doesn't need to check for
+     * errors.
      *
-     * @param input The file to read from.
+     * @param input Where to read the state from.
      */
-    virtual void LoadState(std::ifstream &input) = 0;
+    virtual void LoadState(StateReader &input) = 0;
 
     /**
      * Required for polymorphism.
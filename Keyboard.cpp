@@ -123,21 +123,21 @@ void Keyboard::Write(uint16_t addr, uint8_t)
 }
 
 /**
- * Save the Keyboard state out to a file.
+ * Save the Keyboard state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void Keyboard::SaveState(std::ofstream &output)
+void Keyboard::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(&_data), sizeof(_data));
+    output.Write(&_data, sizeof(_data));
 }
 
 /**
- * Load the Keyboard state out of a file.
+ * Load the Keyboard state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void Keyboard::LoadState(std::ifstream &input)
+void Keyboard::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(&_data), sizeof(_data));
+    input.Read(&_data, sizeof(_data));
 }
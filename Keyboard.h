@@ -5,7 +5,6 @@
 #include "IState.h"
 
 #include <cstddef>
-#include <fstream>
 #include <functional>
 #include <unordered_map>
 
@@ -62,8 +61,8 @@ public:
     uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
     void Write(uint16_t addr, uint8_t) override;
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
 private:
     /**
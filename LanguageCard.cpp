@@ -160,27 +160,27 @@ uint8_t LanguageCard::handle_control(uint16_t addr)
 }
 
 /**
- * Save the Language Card state out to a file.
+ * Save the Language Card state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void LanguageCard::SaveState(std::ofstream &output)
+void LanguageCard::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(_ram_static), sizeof(_ram_static));
-    output.write(reinterpret_cast<char*>(_ram_bank1), sizeof(_ram_bank1));
-    output.write(reinterpret_cast<char*>(_ram_bank2), sizeof(_ram_bank2));
-    output.write(reinterpret_cast<char*>(&_status), sizeof(_status));
+    output.Write(_ram_static, sizeof(_ram_static));
+    output.Write(_ram_bank1, sizeof(_ram_bank1));
+    output.Write(_ram_bank2, sizeof(_ram_bank2));
+    output.Write(&_status, sizeof(_status));
 }
 
 /**
- * Load the Language Card state out of a file.
+ * Load the Language Card state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void LanguageCard::LoadState(std::ifstream &input)
+void LanguageCard::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(_ram_static), sizeof(_ram_static));
-    input.read(reinterpret_cast<char*>(_ram_bank1), sizeof(_ram_bank1));
-    input.read(reinterpret_cast<char*>(_ram_bank2), sizeof(_ram_bank2));
-    input.read(reinterpret_cast<char*>(&_status), sizeof(_status));
+    input.Read(_ram_static, sizeof(_ram_static));
+    input.Read(_ram_bank1, sizeof(_ram_bank1));
+    input.Read(_ram_bank2, sizeof(_ram_bank2));
+    input.Read(&_status, sizeof(_status));
 }
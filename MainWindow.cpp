@@ -1,6 +1,7 @@
 #include "CpuRegistersWindow.h"
 #include "DisassemblyWindow.h"
 #include "DiskController.h"
+#include "DiskTelemetryWindow.h"
 #include "EmulatorCore.h"
 #include "MainWindow.h"
 #include "SettingsDialog.h"
@@ -19,23 +20,28 @@
 /**
  * Constructor.
  *
- * @param emulator_video Pointer to the emulator's video object. This is used
- *        to render the emulator video output.
+ * @param emu The emulator to display and control.
  * @param parent Parent for this widget.
  */
 MainWindow::MainWindow(EmulatorCore &emu, QWidget *parent) :
     QMainWindow(parent),
     _ui(new Ui::MainWindow),
+    _screen(nullptr),
     _turbo_text(nullptr),
     _status_text(nullptr),
     _disk_busy(nullptr),
     _check_disk_busy(nullptr),
+    _flush_disks(nullptr),
+    _disk_watcher(nullptr),
     _emu(emu)
 {
     _ui->setupUi(this);
 
+    _screen = new Screen();
+    _emu.SetVideoPresenter(_screen);
+
     QVBoxLayout *main_layout = new QVBoxLayout;
-    main_layout->addWidget(emu.GetVideo());
+    main_layout->addWidget(_screen);
 
     QWidget *window = new QWidget();
     window->setLayout(main_layout);
@@ -62,6 +68,23 @@ MainWindow::MainWindow(EmulatorCore &emu, QWidget *parent) :
             &MainWindow::disk_busy_timeout);
 
     _check_disk_busy->start();
+
+    _flush_disks = new QTimer(this);
+    _flush_disks->setInterval(DISK_FLUSH_TIMEOUT);
+
+    connect(_flush_disks,
+            &QTimer::timeout,
+            this,
+            &MainWindow::flush_disks_timeout);
+
+    _flush_disks->start();
+
+    _disk_watcher = new QFileSystemWatcher(this);
+
+    connect(_disk_watcher,
+            &QFileSystemWatcher::fileChanged,
+            this,
+            &MainWindow::disk_file_changed);
 }
 
 /**
@@ -74,6 +97,16 @@ void MainWindow::SetStatusText(const QString &string)
     _status_text->setText(string);
 }
 
+/**
+ * Get the average time between a frame being rendered and it being painted.
+ *
+ * @return The average present latency in microseconds.
+ */
+uint32_t MainWindow::GetPresentLatency() const
+{
+    return _screen->GetPresentLatency();
+}
+
 /**
  * Pass a KeyPressEvent down to the EmulatorCore.
  *
@@ -81,6 +114,12 @@ void MainWindow::SetStatusText(const QString &string)
  */
 void MainWindow::keyPressEvent(QKeyEvent *event)
 {
+    if(event->key() == REWIND_KEY)
+    {
+        _emu.SetRewinding(true);
+        return;
+    }
+
     /**
      * Don't handle "auto-repeat keys" caused by holding the key down. Only
      * check actual key presses.
@@ -89,6 +128,21 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
         _emu.UpdateKeyboardStrobe(event);
 }
 
+/**
+ * Stop rewinding when the rewind key is let go.
+ *
+ * @param event An event describing the key that was released.
+ */
+void MainWindow::keyReleaseEvent(QKeyEvent *event)
+{
+    /**
+     * Holding a key down also sends "auto-repeat" releases, which don't mean
+     * the key was actually let go.
+     */
+    if(event->key() == REWIND_KEY && !event->isAutoRepeat())
+        _emu.SetRewinding(false);
+}
+
 /**
  * Check to see if the disk is busy, and update the status bar if so.
  */
@@ -100,11 +154,62 @@ void MainWindow::disk_busy_timeout()
         _disk_busy->setChecked(false);
 }
 
+/**
+ * Write any changes made to the disks back to their image files.
+ */
+void MainWindow::flush_disks_timeout()
+{
+    /**
+     * Catch any changes the file watcher missed (for instance, if the file
+     * was briefly gone while another program replaced it).
+     */
+    if(_emu.ReloadDisks())
+        update_disks();
+
+    if(!_emu.FlushDisks())
+    {
+        _ui->statusbar->showMessage("Unable to write changes to the disk "
+                                        "image.",
+                                    STATUS_TEXT_TIMEOUT);
+    }
+}
+
+/**
+ * Reload a disk if another program changed its image file. Writing disk
+ * changes back to a file also triggers this, but the disk is only reloaded
+ * if the file is different from what was written.
+ *
+ * @param path The image file that changed.
+ */
+void MainWindow::disk_file_changed(const QString &path)
+{
+    Q_UNUSED(path);
+
+    if(_emu.ReloadDisks())
+    {
+        _ui->statusbar->showMessage("Disk image changed, reloaded.",
+                                    STATUS_TEXT_TIMEOUT);
+    }
+
+    /**
+     * Replacing a file stops it from being watched, so watch it again.
+     */
+    update_disks();
+}
+
 /**
  * Destructor.
  */
 MainWindow::~MainWindow()
 {
+    _emu.FlushDisks();
+
+    /**
+     * Make sure the render thread is done with the screen before Qt deletes
+     * it.
+     */
+    _emu.SetVideoPresenter(nullptr);
+
     delete _ui;
 }
 
@@ -226,13 +331,7 @@ void MainWindow::load_state(QString filename)
     {
         if(_emu.LoadState(input))
         {
-            QString drive0_filename = QString::fromStdString(
-                        _emu.GetDiskFilename(DiskController::DRIVE_0));
-            _ui->actionDrive_0->setText("Drive 0: " + drive0_filename + "...");
-
-            QString drive1_filename = QString::fromStdString(
-                        _emu.GetDiskFilename(DiskController::DRIVE_1));
-            _ui->actionDrive_1->setText("Drive 1: " + drive1_filename + "...");
+            update_disks();
 
             _ui->statusbar->showMessage("State loaded.", STATUS_TEXT_TIMEOUT);
         }
@@ -241,11 +340,10 @@ void MainWindow::load_state(QString filename)
             QMessageBox::warning(this,
                                  "Can't Load Emulator State",
                                  "There was an error while trying to load the "
-                                    "emulator state. This could be caused by "
-                                    "a corrupted state file.\n\nThe system "
-                                    " is in an invalid state and will reset.");
-
-            _emu.PowerCycle();
+                                    "emulator state. The state file is "
+                                    "either damaged or from a different "
+                                    "version of the emulator.\n\nThe "
+                                    "emulator was left as it was.");
         }
 
         input.close();
@@ -287,6 +385,15 @@ void MainWindow::on_actionCPU_Registers_triggered()
     reg->show();
 }
 
+/**
+ * Opens up the Disk Telemetry window.
+ */
+void MainWindow::on_actionDisk_Telemetry_triggered()
+{
+    DiskTelemetryWindow *telemetry = new DiskTelemetryWindow(_emu, this);
+    telemetry->show();
+}
+
 /**
  * Opens up the View Memory window.
  */
@@ -307,59 +414,63 @@ void MainWindow::load_disk(DiskController::DriveId drive)
                 this,
                 "Load Disk",
                 "",
-                "Disk Image (*.dsk)");
+                "Disk Image (*.dsk *.do *.po *.nib *.woz)");
 
     if(filename.size() != 0)
     {
-        std::ifstream input(filename.toStdString(),
-                            std::ios::ate | std::ios::binary);
-
-        if(input.is_open())
+        if(_emu.LoadDisk(filename.toStdString(), drive))
         {
-            uint32_t filesize = input.tellg();
-
-            if(filesize == DiskDrive::DISK_SIZE)
-            {
-                uint8_t file_data[DiskDrive::DISK_SIZE];
-                input.seekg(0, std::ios::beg);
-                input.read(reinterpret_cast<char*>(file_data), filesize);
-
-                _emu.LoadDisk(filename.toStdString(), drive, file_data);
-
-                if(drive == DiskController::DRIVE_0)
-                    _ui->actionDrive_0->setText("Drive 0: " + filename + "...");
-                else
-                    _ui->actionDrive_1->setText("Drive 1: " + filename + "...");
-
-                _ui->statusbar->showMessage("Disk loaded.", STATUS_TEXT_TIMEOUT);
-            }
-            else
-            {
-                QMessageBox::warning(this,
-                                     "Can't Load Disk Image",
-                                     "There was an error while trying to load "
-                                        "the disk image. Ensure the image you "
-                                        "selected is a valid image (should be "
-                                        "exactly 140KB in size).");
-
-                _emu.UnloadDisk(drive);
-
-                if(drive == DiskController::DRIVE_0)
-                    _ui->actionDrive_0->setText("Drive 0: None...");
-                else
-                    _ui->actionDrive_1->setText("Drive 1: None...");
-            }
-
-            input.close();
+            _ui->statusbar->showMessage("Disk loaded.", STATUS_TEXT_TIMEOUT);
         }
         else
         {
-
             QMessageBox::warning(this,
                                  "Can't Load Disk Image",
-                                 "Unable to open the disk image as a readable "
-                                    "file.");
+                                 "There was an error while trying to load "
+                                    "the disk image. Ensure the image you "
+                                    "selected is a readable, valid image "
+                                    "(.dsk, .do and .po images should be "
+                                    "exactly 140KB in size, .nib images "
+                                    "exactly 227.5KB, and .woz images must "
+                                    "be 5.25\" disks).");
         }
+
+        update_disks();
+    }
+}
+
+/**
+ * Show which disks are inserted, and watch their image files for changes.
+ */
+void MainWindow::update_disks()
+{
+    QString drive0_filename = QString::fromStdString(
+                _emu.GetDiskFilename(DiskController::DRIVE_0));
+    _ui->actionDrive_0->setText("Drive 0: " + drive0_filename + "...");
+
+    QString drive1_filename = QString::fromStdString(
+                _emu.GetDiskFilename(DiskController::DRIVE_1));
+    _ui->actionDrive_1->setText("Drive 1: " + drive1_filename + "...");
+
+    QString hard_disk_filename = QString::fromStdString(
+                _emu.GetHardDiskFilename());
+    _ui->actionHard_Disk->setText("Hard Disk: " + hard_disk_filename + "...");
+
+    _ui->actionAccelerate_Drive_0->setEnabled(drive0_filename != "None");
+    _ui->actionAccelerate_Drive_0->setChecked(
+                _emu.GetDiskAccelerated(DiskController::DRIVE_0));
+
+    _ui->actionAccelerate_Drive_1->setEnabled(drive1_filename != "None");
+    _ui->actionAccelerate_Drive_1->setChecked(
+                _emu.GetDiskAccelerated(DiskController::DRIVE_1));
+
+    if(!_disk_watcher->files().isEmpty())
+        _disk_watcher->removePaths(_disk_watcher->files());
+
+    for(const QString &filename : { drive0_filename, drive1_filename })
+    {
+        if(filename != "None" && !_disk_watcher->files().contains(filename))
+            _disk_watcher->addPath(filename);
     }
 }
 
@@ -379,6 +490,59 @@ void MainWindow::on_actionDrive_1_triggered()
     load_disk(DiskController::DRIVE_1);
 }
 
+/**
+ * Loads a hard disk into the hard disk card.
+ */
+void MainWindow::on_actionHard_Disk_triggered()
+{
+    QString filename = QFileDialog::getOpenFileName(
+                this,
+                "Load Hard Disk",
+                "",
+                "Hard Disk Image (*.po *.hdv)");
+
+    if(filename.size() != 0)
+    {
+        if(_emu.LoadHardDisk(filename.toStdString()))
+        {
+            _ui->statusbar->showMessage("Hard disk loaded.",
+                                        STATUS_TEXT_TIMEOUT);
+        }
+        else
+        {
+            QMessageBox::warning(this,
+                                 "Can't Load Hard Disk Image",
+                                 "There was an error while trying to load "
+                                    "the hard disk image. Ensure the image "
+                                    "you selected is a readable ProDOS "
+                                    "order image, a whole number of 512 "
+                                    "byte blocks and no bigger than 32MB.");
+        }
+
+        update_disks();
+    }
+}
+
+/**
+ * Speed up (or stop speeding up) reads from the disk in Drive 0.
+ *
+ * @param checked True to speed up reads, false otherwise.
+ */
+void MainWindow::on_actionAccelerate_Drive_0_triggered(bool checked)
+{
+    _emu.SetDiskAccelerated(DiskController::DRIVE_0, checked);
+}
+
+/**
+ * Speed up (or stop speeding up) reads from the disk in Drive 1.
+ *
+ * @param checked True to speed up reads, false otherwise.
+ */
+void MainWindow::on_actionAccelerate_Drive_1_triggered(bool checked)
+{
+    _emu.SetDiskAccelerated(DiskController::DRIVE_1, checked);
+}
+
 /**
  * Increase the CPU turbo.
  */
@@ -404,3 +568,13 @@ void MainWindow::on_actionSpeed_Down_triggered()
         _turbo_text->setText(QString::asprintf("Turbo: %dx", _turbo));
     }
 }
+
+/**
+ * Run as fast as possible (or stop doing so) while a disk drive's motor is on.
+ *
+ * @param checked True to enable disk warp, false otherwise.
+ */
+void MainWindow::on_actionDisk_Warp_triggered(bool checked)
+{
+    _emu.SetDiskWarp(checked);
+}
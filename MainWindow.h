@@ -3,7 +3,9 @@
 
 #include "DiskController.h"
 #include "EmulatorCore.h"
+#include "Screen.h"
 
+#include <QFileSystemWatcher>
 #include <QKeyEvent>
 #include <QLabel>
 #include <QMainWindow>
@@ -23,6 +25,8 @@ public:
 
     void SetStatusText(const QString &string);
 
+    uint32_t GetPresentLatency() const;
+
     ~MainWindow();
 
 private slots:
@@ -46,23 +50,37 @@ private slots:
 
     void on_actionCPU_Registers_triggered();
 
+    void on_actionDisk_Telemetry_triggered();
+
     void on_actionDrive_0_triggered();
     
     void on_actionDrive_1_triggered();
 
+    void on_actionHard_Disk_triggered();
+
+    void on_actionAccelerate_Drive_0_triggered(bool checked);
+
+    void on_actionAccelerate_Drive_1_triggered(bool checked);
+
     void disk_busy_timeout();
+    void flush_disks_timeout();
+    void disk_file_changed(const QString &path);
     
     void on_actionSpeed_Up_triggered();
 
     void on_actionSpeed_Down_triggered();
 
+    void on_actionDisk_Warp_triggered(bool checked);
+
 private:
     void keyPressEvent(QKeyEvent *event);
+    void keyReleaseEvent(QKeyEvent *event);
 
     void save_state(QString filename);
     void load_state(QString filename);
 
     void load_disk(DiskController::DriveId drive);
+    void update_disks();
 
 private:
     /**
@@ -75,11 +93,26 @@ private:
      */
      static constexpr int DISK_BUSY_TIMEOUT = 100;
 
+    /**
+     * How often to write disk changes back to the disk image files (in ms).
+     */
+    static constexpr int DISK_FLUSH_TIMEOUT = 5000;
+
+    /**
+     * Key that rewinds the emulator for as long as it's held down.
+     */
+    static constexpr int REWIND_KEY = Qt::Key_F8;
+
     /**
      * Contains all of the UI elements generated in the Qt Forms Designer.
      */
     Ui::MainWindow *_ui;
 
+    /**
+     * The widget the emulator's video output gets displayed in.
+     */
+    Screen *_screen;
+
     /**
      * Label used to show what the current CPU turbo is.
      */
@@ -100,6 +133,17 @@ private:
      */
     QTimer *_check_disk_busy;
 
+    /**
+     * Used to periodically write disk changes back to the disk image files.
+     */
+    QTimer *_flush_disks;
+
+    /**
+     * Watches the inserted disk image files so they can be reloaded when
+     * another program changes them.
+     */
+    QFileSystemWatcher *_disk_watcher;
+
     /**
      * A reference to the currently running emulator.
      */
@@ -79,23 +79,23 @@ void Memory::Write(uint16_t addr, uint8_t data)
 }
 
 /**
- * Save the Memory state out to a file.
+ * Save the Memory state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void Memory::SaveState(std::ofstream &output)
+void Memory::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(_memory), _size);
+    output.Write(_memory, _size);
 }
 
 /**
- * Load the Memory state out of a file.
+ * Load the Memory state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void Memory::LoadState(std::ifstream &input)
+void Memory::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(_memory), _size);
+    input.Read(_memory, _size);
 }
 
 
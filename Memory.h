@@ -6,7 +6,6 @@
 
 #include <cstdint>
 
-#include <fstream>
 
 class Memory : public IMemoryMapped, public IState
 {
@@ -24,8 +23,8 @@ public:
     uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
     void Write(uint16_t addr, uint8_t data) override;
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
 private:
     /**
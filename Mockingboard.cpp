@@ -0,0 +1,289 @@
+/**
+ * Emulates a Mockingboard sound card.
+ *
+ * The card has two 6522 VIAs ($C400-$C47F and $C480-$C4FF), each wired to an
+ * AY-3-8910 sound chip. Programs talk to a sound chip by putting a value on
+ * the VIA's port A and then pulsing the chip's bus control lines through port
+ * B. The VIA timers are usually set up to interrupt the CPU at a regular rate
+ * to drive the music.
+ *
+ * Sound chip output is synthesized lazily. A write to a sound chip first
+ * catches the chip up to the current cycle, and the rest of each frame is
+ * synthesized when the Speaker asks for it. Timer interrupts are scheduled
+ * with the CPU at their exact cycle, so nothing is polled per instruction.
+ */
+#include "Mockingboard.h"
+
+#include <algorithm>
+
+constexpr int Mockingboard::MIX_CHUNK;
+
+/**
+ * Constructor.
+ *
+ * @param cpu The CPU that the card interrupts.
+ */
+Mockingboard::Mockingboard(Cpu &cpu) :
+    IMemoryMapped(MOCKINGBOARD_START, MOCKINGBOARD_END),
+    _cpu(cpu),
+    _via(),
+    _psg(),
+    _blip(),
+    _frame_start(0),
+    _samples()
+{ }
+
+/**
+ * Reset the card (the reset line on the slot resets both VIAs and both sound
+ * chips).
+ */
+void Mockingboard::Reset()
+{
+    for(int i = 0; i < NUM_CHIPS; ++i)
+    {
+        _via[i].Reset(_cpu.GetTotalCycles());
+        _psg[i].Reset();
+    }
+
+    ClearAudio();
+    update_irq();
+}
+
+/**
+ * Read one of the VIA registers.
+ *
+ * @param addr The address to read from.
+ * @param no_side_fx True if this read shouldn't cause any side effects
+ *                   (used by the memory view and disassembly).
+ *
+ * @return The register's value.
+ */
+uint8_t Mockingboard::Read(uint16_t addr, bool no_side_fx)
+{
+    const int chip = (addr & VIA_SELECT) ? 1 : 0;
+    const uint8_t data = _via[chip].Read(addr & 0xF,
+                                         _cpu.GetTotalCycles(),
+                                         no_side_fx);
+
+    /**
+     * Reading a timer's counter acknowledges its interrupt.
+     */
+    if(!no_side_fx)
+        update_irq();
+
+    return data;
+}
+
+/**
+ * Write one of the VIA registers.
+ *
+ * @param addr The address to write to.
+ * @param data The value to write.
+ */
+void Mockingboard::Write(uint16_t addr, uint8_t data)
+{
+    const int chip = (addr & VIA_SELECT) ? 1 : 0;
+    const uint8_t reg = addr & 0xF;
+
+    _via[chip].Write(reg, data, _cpu.GetTotalCycles());
+
+    if(reg == Via6522::REG_ORB || reg == Via6522::REG_ORA ||
+       reg == Via6522::REG_DDRB || reg == Via6522::REG_DDRA ||
+       reg == Via6522::REG_ORA_NH)
+    {
+        update_bus(chip);
+    }
+
+    update_irq();
+}
+
+/**
+ * Called by the CPU when a VIA timer interrupt is due.
+ *
+ * @param cycle The current CPU cycle count.
+ */
+void Mockingboard::OnScheduled(uint32_t cycle)
+{
+    for(int i = 0; i < NUM_CHIPS; ++i)
+        _via[i].Update(cycle);
+
+    update_irq();
+}
+
+/**
+ * Set the rate of the CPU clock (which the sound chips run at) and the rate
+ * samples are mixed at.
+ *
+ * @param clock_rate CPU cycles per second.
+ * @param sample_rate Output samples per second.
+ */
+void Mockingboard::SetRates(double clock_rate, int sample_rate)
+{
+    _blip.SetRates(clock_rate, sample_rate);
+}
+
+/**
+ * Throw away any synthesized sound and start a new frame at the current cycle.
+ */
+void Mockingboard::ClearAudio()
+{
+    _blip.Clear();
+
+    for(int i = 0; i < NUM_CHIPS; ++i)
+        _psg[i].ClearAudio();
+
+    _frame_start = _cpu.GetTotalCycles();
+}
+
+/**
+ * Synthesize the rest of the frame.
+ *
+ * @param frame_start CPU cycle count at the start of the frame.
+ * @param num_cycles Length of the frame in CPU cycles.
+ */
+void Mockingboard::EndFrame(uint32_t frame_start, uint32_t num_cycles)
+{
+    for(int i = 0; i < NUM_CHIPS; ++i)
+        _psg[i].EndFrame(num_cycles, _blip);
+
+    _blip.EndFrame(num_cycles);
+    _frame_start = frame_start + num_cycles;
+}
+
+/**
+ * Add the synthesized samples to a mix.
+ *
+ * @param mix The samples to add to.
+ * @param count Number of samples to add.
+ */
+void Mockingboard::MixSamples(int32_t *mix, int count)
+{
+    int mixed = 0;
+
+    while(mixed < count)
+    {
+        const int read = _blip.ReadSamples(_samples,
+                                           std::min(count - mixed, MIX_CHUNK));
+
+        if(read == 0)
+            break;
+
+        for(int i = 0; i < read; ++i)
+            mix[mixed + i] += _samples[i];
+
+        mixed += read;
+    }
+}
+
+/**
+ * Save the card state.
+ *
+ * @param output Where to write the state.
+ */
+void Mockingboard::SaveState(StateWriter &output)
+{
+    for(int i = 0; i < NUM_CHIPS; ++i)
+    {
+        _via[i].SaveState(output);
+        _psg[i].SaveState(output);
+    }
+}
+
+/**
+ * Load the card state.
+ *
+ * @param input Where to read the state from.
+ */
+void Mockingboard::LoadState(StateReader &input)
+{
+    for(int i = 0; i < NUM_CHIPS; ++i)
+    {
+        _via[i].LoadState(input);
+        _psg[i].LoadState(input);
+    }
+
+    /**
+     * The CPU doesn't save which devices are interrupting it or waiting to be
+     * called back, so re-establish both.
+     */
+    ClearAudio();
+    update_irq();
+}
+
+/**
+ * Get the current cycle relative to the start of the audio frame.
+ *
+ * @return The frame-relative cycle (clamped to what the BlipBuffer can hold).
+ */
+uint32_t Mockingboard::get_frame_time() const
+{
+    return std::min(_cpu.GetTotalCycles() - _frame_start,
+                    _blip.GetMaxFrameCycles());
+}
+
+/**
+ * Perform whatever the VIA's port B is asking the sound chip to do.
+ *
+ * @param chip Which VIA and sound chip pair changed.
+ */
+void Mockingboard::update_bus(int chip)
+{
+    const uint8_t control = _via[chip].GetPortB();
+    const uint8_t data = _via[chip].GetPortA();
+    Ay38910 &psg = _psg[chip];
+
+    _via[chip].SetPortAInput(0xFF);
+
+    if(!(control & PORT_B_RESET))
+    {
+        psg.RunUntil(get_frame_time(), _blip);
+        psg.Reset();
+        return;
+    }
+
+    switch(control & (PORT_B_BDIR | PORT_B_BC1))
+    {
+    case BUS_READ:
+        _via[chip].SetPortAInput(psg.Read());
+        break;
+
+    case BUS_WRITE:
+        psg.RunUntil(get_frame_time(), _blip);
+        psg.Write(data);
+        break;
+
+    case BUS_LATCH:
+        psg.LatchAddress(data);
+        break;
+    }
+}
+
+/**
+ * Update the IRQ line and schedule a callback for the next timer interrupt.
+ */
+void Mockingboard::update_irq()
+{
+    bool irq = false;
+    bool scheduled = false;
+    uint32_t next_cycle = 0;
+
+    for(int i = 0; i < NUM_CHIPS; ++i)
+    {
+        irq = irq || _via[i].GetIrq();
+
+        uint32_t cycle = 0;
+        if(_via[i].GetNextInterrupt(cycle) &&
+           (!scheduled || static_cast<int32_t>(cycle - next_cycle) < 0))
+        {
+            next_cycle = cycle;
+            scheduled = true;
+        }
+    }
+
+    _cpu.SetIrq(IRQ_MOCKINGBOARD, irq);
+
+    if(scheduled)
+        _cpu.Schedule(this, next_cycle);
+    else
+        _cpu.Unschedule(this);
+}
@@ -0,0 +1,119 @@
+#ifndef MOCKINGBOARD_H
+#define MOCKINGBOARD_H
+
+#include "Ay38910.h"
+#include "BlipBuffer.h"
+#include "Cpu.h"
+#include "IMemoryMapped.h"
+#include "IScheduled.h"
+#include "ISoundSource.h"
+#include "IState.h"
+#include "Via6522.h"
+
+#include <cstdint>
+
+/**
+ * Sweet Micro Systems Mockingboard sound card (installed in slot 4).
+ */
+class Mockingboard : public IMemoryMapped,
+                     public IState,
+                     public IScheduled,
+                     public ISoundSource
+{
+public:
+    /**
+     * Start and end addresses (inclusive) for the card's registers.
+     */
+    static constexpr uint16_t MOCKINGBOARD_START = 0xC400;
+    static constexpr uint16_t MOCKINGBOARD_END = 0xC4FF;
+
+public:
+    Mockingboard(Cpu &cpu);
+
+    Mockingboard(const Mockingboard &copy) = delete;
+    Mockingboard& operator=(const Mockingboard &rhs) = delete;
+
+    void Reset();
+
+    uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
+    void Write(uint16_t addr, uint8_t data) override;
+
+    void OnScheduled(uint32_t cycle) override;
+
+    void SetRates(double clock_rate, int sample_rate) override;
+    void ClearAudio() override;
+    void EndFrame(uint32_t frame_start, uint32_t num_cycles) override;
+    void MixSamples(int32_t *mix, int count) override;
+
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
+
+private:
+    uint32_t get_frame_time() const;
+
+    void update_bus(int chip);
+    void update_irq();
+
+private:
+    /**
+     * Number of VIA and sound chip pairs on the card.
+     */
+    static constexpr int NUM_CHIPS = 2;
+
+    /**
+     * Address bit that selects the second VIA.
+     */
+    static constexpr uint16_t VIA_SELECT = 0x80;
+
+    /**
+     * Port B bits wired to the sound chip's bus control and reset lines.
+     */
+    static constexpr uint8_t PORT_B_BC1 = 0x1;
+    static constexpr uint8_t PORT_B_BDIR = 0x2;
+    static constexpr uint8_t PORT_B_RESET = 0x4;
+
+    /**
+     * Sound chip bus functions (BDIR and BC1 combined).
+     */
+    enum BusFunction {
+        BUS_INACTIVE = 0,
+        BUS_READ = PORT_B_BC1,
+        BUS_WRITE = PORT_B_BDIR,
+        BUS_LATCH = PORT_B_BDIR | PORT_B_BC1
+    };
+
+    /**
+     * Number of samples read out of the BlipBuffer at a time when mixing.
+     */
+    static constexpr int MIX_CHUNK = 1024;
+
+    /**
+     * Used to get the current cycle count, raise interrupts and schedule timer
+     * interrupts.
+     */
+    Cpu &_cpu;
+
+    /**
+     * Each VIA drives the sound chip next to it; port A is the data bus and
+     * port B drives the control lines.
+     */
+    Via6522 _via[NUM_CHIPS];
+    Ay38910 _psg[NUM_CHIPS];
+
+    /**
+     * Both sound chips are synthesized into here.
+     */
+    BlipBuffer _blip;
+
+    /**
+     * The CPU cycle count at the start of the current audio frame.
+     */
+    uint32_t _frame_start;
+
+    /**
+     * Samples are read out of the BlipBuffer into here before being mixed.
+     */
+    int16_t _samples[MIX_CHUNK];
+};
+
+#endif // MOCKINGBOARD_H
@@ -0,0 +1,172 @@
+/**
+ * Converts the raw Apple II video signal into NTSC "artifact" colors.
+ *
+ * The Apple II doesn't generate color directly. It outputs a stream of on/off
+ * dots at four times the NTSC color subcarrier frequency, and a TV interprets
+ * any pattern that repeats every four dots as a color. Which color you get
+ * depends on the pattern and on where it lines up against the subcarrier,
+ * which is why the color of a hi-res pixel depends on its neighbors, its column
+ * and the high bit of its byte.
+ *
+ * Every four consecutive dots of the signal form a lo-res color value (rotated
+ * by their position relative to the subcarrier), so a solid run of a single
+ * pattern always comes out as exactly one of the sixteen palette colors. Each
+ * output pixel covers two dots; its color is a weighted blend of the colors
+ * centered on the four nearest dots, which softens edges the same way the
+ * limited bandwidth of a TV does.
+ *
+ * Since the output only depends on a small window of dots and on the pixel's
+ * phase, every possible output is precomputed into a lookup table at startup
+ * and the per-frame work is a single table lookup per pixel.
+ */
+#include "NtscFilter.h"
+
+#include <cstdint>
+
+/**
+ * Constructor. Precomputes the lookup table.
+ *
+ * @param palette The palette providing the sixteen lo-res colors.
+ */
+NtscFilter::NtscFilter(const Palette &palette) :
+    _lut()
+{
+    /**
+     * Weights of the four dot colors that get blended into one pixel (the
+     * middle two are the dots that belong to the pixel itself).
+     */
+    constexpr int weights[4] = { 1, 3, 3, 1 };
+    constexpr int weight_total = 8;
+
+    for(int phase = 0; phase < 2; ++phase)
+    {
+        /**
+         * Position (relative to the subcarrier) of the first dot in the
+         * window. Even pixels start on a multiple of four dots.
+         */
+        const int first_dot = (phase * 2) + WINDOW_OFFSET + 4;
+
+        for(int window = 0; window < (1 << WINDOW_SIZE); ++window)
+        {
+            int channels[4] = { 0, 0, 0, 0 };
+
+            for(int center = 0; center < 4; ++center)
+            {
+                /**
+                 * The four dots around the center dot (one before, two after)
+                 * make up the color at that dot.
+                 */
+                uint8_t color = 0;
+                for(int dot = center + 1; dot < center + 5; ++dot)
+                {
+                    const int bit = (window >> dot) & 1;
+                    color |= bit << ((first_dot + dot) % 4);
+                }
+
+                const uint32_t rgba =
+                        palette.GetColor(static_cast<VideoColor>(color));
+
+                for(int channel = 0; channel < 4; ++channel)
+                {
+                    channels[channel] += weights[center] *
+                                         ((rgba >> (channel * 8)) & 0xFF);
+                }
+            }
+
+            uint32_t result = 0;
+            for(int channel = 0; channel < 4; ++channel)
+            {
+                const uint32_t value = (channels[channel] + (weight_total / 2)) /
+                                       weight_total;
+                result |= (value & 0xFF) << (channel * 8);
+            }
+
+            _lut[phase][window] = result;
+        }
+    }
+}
+
+/**
+ * Convert a frame's worth of signal into RGBA pixels. The lines are split into
+ * bands that are processed in parallel.
+ *
+ * @param signal The video signal (num_lines * LINE_STRIDE bytes).
+ * @param pixels Where to write the pixels (num_lines * LINE_WIDTH pixels).
+ * @param num_lines Number of lines to convert.
+ * @param pool The worker threads to split the work across.
+ */
+void NtscFilter::Apply(const uint8_t *signal,
+                       uint32_t *pixels,
+                       int num_lines,
+                       WorkerPool &pool) const
+{
+    pool.Run([&](int band, int num_bands)
+    {
+        int first_line = 0;
+        int end_line = 0;
+        WorkerPool::GetBand(band, num_bands, num_lines, first_line, end_line);
+
+        apply_lines(signal, pixels, first_line, end_line);
+    });
+}
+
+/**
+ * Set a single dot in a line of signal.
+ *
+ * @param line The start of the line.
+ * @param dot The dot to set (0 to DOTS_PER_LINE - 1).
+ * @param value True if the signal is on at this dot.
+ */
+void NtscFilter::SetDot(uint8_t *line, int dot, bool value)
+{
+    const int bit = dot + LINE_PADDING;
+    const uint8_t mask = 1 << (bit & 7);
+
+    if(value)
+        line[bit >> 3] |= mask;
+    else
+        line[bit >> 3] &= ~mask;
+}
+
+/**
+ * Convert a range of lines.
+ *
+ * The window for pixel 'x' starts at padded bit (2x + 5), so every group of
+ * four pixels starts at the same bit offset within a byte. That lets each group
+ * pull all four windows out of a single 24-bit load.
+ *
+ * @param signal The video signal for the whole frame.
+ * @param pixels The output pixels for the whole frame.
+ * @param first_line The first line to convert.
+ * @param end_line One past the last line to convert.
+ */
+void NtscFilter::apply_lines(const uint8_t *signal,
+                             uint32_t *pixels,
+                             int first_line,
+                             int end_line) const
+{
+    constexpr int first_bit = WINDOW_OFFSET + LINE_PADDING;
+    constexpr uint32_t window_mask = (1 << WINDOW_SIZE) - 1;
+
+    const uint32_t *even_lut = _lut[0];
+    const uint32_t *odd_lut = _lut[1];
+
+    for(int line = first_line; line < end_line; ++line)
+    {
+        const uint8_t *in = signal + (line * LINE_STRIDE);
+        uint32_t *out = pixels + (line * LINE_WIDTH);
+
+        for(int x = 0; x < LINE_WIDTH; x += 4, out += 4)
+        {
+            const uint8_t *bytes = in + (x / 4);
+            const uint32_t bits = bytes[0] |
+                                  (bytes[1] << 8) |
+                                  (bytes[2] << 16);
+
+            out[0] = even_lut[(bits >> (first_bit + 0)) & window_mask];
+            out[1] = odd_lut[(bits >> (first_bit + 2)) & window_mask];
+            out[2] = even_lut[(bits >> (first_bit + 4)) & window_mask];
+            out[3] = odd_lut[(bits >> (first_bit + 6)) & window_mask];
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef NTSCFILTER_H
+#define NTSCFILTER_H
+
+#include "Palette.h"
+#include "WorkerPool.h"
+
+#include <cstdint>
+
+class NtscFilter
+{
+public:
+    /**
+     * Number of output pixels per line.
+     */
+    static constexpr int LINE_WIDTH = 280;
+
+    /**
+     * The video signal runs at four times the color subcarrier frequency, so
+     * every output pixel covers two "dots" of the signal.
+     */
+    static constexpr int DOTS_PER_LINE = LINE_WIDTH * 2;
+
+    /**
+     * Number of blank dots stored before the first dot of each line so that
+     * the filter never has to special-case the left edge.
+     */
+    static constexpr int LINE_PADDING = 8;
+
+    /**
+     * Number of bytes used to store one line of the signal. Dot 'd' of a line
+     * is stored at bit ((d + LINE_PADDING) % 8) of byte
+     * ((d + LINE_PADDING) / 8). Everything outside of the line's dots must be
+     * zero.
+     */
+    static constexpr int LINE_STRIDE = 72;
+
+public:
+    explicit NtscFilter(const Palette &palette);
+
+    void Apply(const uint8_t *signal,
+               uint32_t *pixels,
+               int num_lines,
+               WorkerPool &pool) const;
+
+    static void SetDot(uint8_t *line, int dot, bool value);
+
+private:
+    void apply_lines(const uint8_t *signal,
+                     uint32_t *pixels,
+                     int first_line,
+                     int end_line) const;
+
+private:
+    /**
+     * Number of dots looked at to produce a single output pixel.
+     */
+    static constexpr int WINDOW_SIZE = 8;
+
+    /**
+     * Offset of the first dot in the window relative to the first dot of the
+     * output pixel.
+     */
+    static constexpr int WINDOW_OFFSET = -3;
+
+    /**
+     * The output color for every possible window of dots. The first index is
+     * the phase of the output pixel relative to the color subcarrier (even or
+     * odd pixel), the second is the window of dots (oldest dot in the LSB).
+     */
+    uint32_t _lut[2][1 << WINDOW_SIZE];
+};
+
+#endif // NTSCFILTER_H
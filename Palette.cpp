@@ -0,0 +1,145 @@
+/**
+ * Converts palette-indexed video frames into RGBA pixels.
+ *
+ * The video generator only ever produces a handful of colors, so it writes a
+ * single byte per pixel and the conversion to 32-bit color happens once per
+ * presented frame. Since only the conversion looks at the actual colors,
+ * changing a palette entry (like the text color) costs nothing.
+ */
+#include "Palette.h"
+
+#include <cstdint>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+/**
+ * Constructor. Fills in the standard Apple II colors.
+ */
+Palette::Palette() :
+    _colors {
+        0xFF000000, /* Black */
+        0xFF601EE3, /* Red */
+        0xFFCB2525, /* Dark Blue */
+        0xFFFD44FF, /* Purple */
+        0xFF60A300, /* Dark Green */
+        0xFF9C9C9C, /* Gray */
+        0xFFFDCF14, /* Medium Blue */
+        0xFFFFC3D0, /* Light Blue */
+        0xFF037260, /* Brown */
+        0xFF3C6AFF, /* Orange */
+        0xFF9C9C9C, /* Gray */
+        0xFFD0A0FF, /* Pink */
+        0xFF3CF514, /* Light Green */
+        0xFF8DDDD0, /* Yellow */
+        0xFFD0FF72, /* Aqua */
+        0xFFFFFFFF, /* White */
+        0xFF60A300  /* Text */
+    }
+{ }
+
+/**
+ * Get a color out of the palette.
+ *
+ * @param index The palette entry to retrieve.
+ *
+ * @return The color in 32-bit ABGR format.
+ */
+uint32_t Palette::GetColor(VideoColor index) const
+{
+    return _colors[index];
+}
+
+/**
+ * Change a color in the palette.
+ *
+ * @param index The palette entry to change.
+ * @param color The new color in 32-bit ABGR format.
+ */
+void Palette::SetColor(VideoColor index, uint32_t color)
+{
+    _colors[index] = color;
+}
+
+/**
+ * Convert a run of palette indices into RGBA pixels.
+ *
+ * When SSSE3 is available, sixteen pixels are converted at a time by using
+ * each index as a shuffle control into per-channel lookup tables of the first
+ * sixteen colors. The text color (the only index above fifteen) is blended in
+ * afterwards with a compare mask.
+ *
+ * @note Every index is assumed to be a valid VideoColor.
+ *
+ * @param indices The palette indices to convert.
+ * @param pixels Where to write the RGBA pixels (same number of entries as
+ *               indices).
+ * @param count Number of pixels to convert.
+ */
+void Palette::Convert(const uint8_t *indices,
+                      uint32_t *pixels,
+                      size_t count) const
+{
+    size_t i = 0;
+
+#if defined(__SSSE3__)
+    uint8_t channels[4][16];
+    for(int color = 0; color < 16; ++color)
+    {
+        for(int channel = 0; channel < 4; ++channel)
+            channels[channel][color] = (_colors[color] >> (channel * 8)) & 0xFF;
+    }
+
+    const __m128i red_lut = _mm_loadu_si128((const __m128i*)channels[0]);
+    const __m128i green_lut = _mm_loadu_si128((const __m128i*)channels[1]);
+    const __m128i blue_lut = _mm_loadu_si128((const __m128i*)channels[2]);
+    const __m128i alpha_lut = _mm_loadu_si128((const __m128i*)channels[3]);
+
+    const uint32_t text = _colors[COLOR_TEXT];
+    const __m128i text_index = _mm_set1_epi8(COLOR_TEXT);
+    const __m128i text_red = _mm_set1_epi8(text & 0xFF);
+    const __m128i text_green = _mm_set1_epi8((text >> 8) & 0xFF);
+    const __m128i text_blue = _mm_set1_epi8((text >> 16) & 0xFF);
+    const __m128i text_alpha = _mm_set1_epi8((text >> 24) & 0xFF);
+    const __m128i low_nybble = _mm_set1_epi8(0xF);
+
+    for(; i + 16 <= count; i += 16)
+    {
+        const __m128i index = _mm_loadu_si128((const __m128i*)(indices + i));
+        const __m128i lut_index = _mm_and_si128(index, low_nybble);
+        const __m128i is_text = _mm_cmpeq_epi8(index, text_index);
+
+        __m128i red = _mm_shuffle_epi8(red_lut, lut_index);
+        __m128i green = _mm_shuffle_epi8(green_lut, lut_index);
+        __m128i blue = _mm_shuffle_epi8(blue_lut, lut_index);
+        __m128i alpha = _mm_shuffle_epi8(alpha_lut, lut_index);
+
+        red = _mm_or_si128(_mm_andnot_si128(is_text, red),
+                           _mm_and_si128(is_text, text_red));
+        green = _mm_or_si128(_mm_andnot_si128(is_text, green),
+                             _mm_and_si128(is_text, text_green));
+        blue = _mm_or_si128(_mm_andnot_si128(is_text, blue),
+                            _mm_and_si128(is_text, text_blue));
+        alpha = _mm_or_si128(_mm_andnot_si128(is_text, alpha),
+                             _mm_and_si128(is_text, text_alpha));
+
+        /**
+         * Interleave the four channel vectors into sixteen RGBA pixels.
+         */
+        const __m128i rg_lo = _mm_unpacklo_epi8(red, green);
+        const __m128i rg_hi = _mm_unpackhi_epi8(red, green);
+        const __m128i ba_lo = _mm_unpacklo_epi8(blue, alpha);
+        const __m128i ba_hi = _mm_unpackhi_epi8(blue, alpha);
+
+        __m128i *out = (__m128i*)(pixels + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+#endif
+
+    for(; i < count; ++i)
+        pixels[i] = _colors[indices[i]];
+}
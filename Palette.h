@@ -0,0 +1,56 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Indices of every color the video generator can produce. The first sixteen
+ * are the lo-res colors (in the same order as the lo-res nybble values), and
+ * the hi-res colors are a subset of those. The text color is the only color
+ * that can be changed by the user.
+ */
+enum VideoColor {
+    COLOR_BLACK = 0,
+    COLOR_RED,
+    COLOR_DARK_BLUE,
+    COLOR_PURPLE,
+    COLOR_DARK_GREEN,
+    COLOR_GRAY1,
+    COLOR_MEDIUM_BLUE,
+    COLOR_LIGHT_BLUE,
+    COLOR_BROWN,
+    COLOR_ORANGE,
+    COLOR_GRAY2,
+    COLOR_PINK,
+    COLOR_LIGHT_GREEN,
+    COLOR_YELLOW,
+    COLOR_AQUA,
+    COLOR_WHITE,
+    COLOR_TEXT
+};
+
+class Palette
+{
+public:
+    /**
+     * Number of entries in the palette.
+     */
+    static constexpr int NUM_COLORS = COLOR_TEXT + 1;
+
+public:
+    Palette();
+
+    uint32_t GetColor(VideoColor index) const;
+    void SetColor(VideoColor index, uint32_t color);
+
+    void Convert(const uint8_t *indices, uint32_t *pixels, size_t count) const;
+
+private:
+    /**
+     * Every color in the palette in 32-bit ABGR format (RGBA byte order).
+     */
+    uint32_t _colors[NUM_COLORS];
+};
+
+#endif // PALETTE_H
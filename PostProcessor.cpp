@@ -0,0 +1,562 @@
+/**
+ * Post-processing stage that sits between the converted RGBA frame and the
+ * presenter. It handles scaling the 280x192 image up to the display size (with
+ * either plain integer scaling or "sharp bilinear" filtering), darkening the
+ * gaps between scanlines, and blending in the fading glow of previous frames
+ * (phosphor persistence).
+ *
+ * All of the scaling work is driven by per-row and per-column tables that are
+ * only rebuilt when the sizes or settings change. Each frame is processed in
+ * two passes that are both split into horizontal bands across the worker pool:
+ *
+ * 1. Every source row gets persistence applied and is scaled horizontally to
+ *    the output width.
+ * 2. Every output row is blended from the two nearest horizontally scaled
+ *    rows and then shaded for the scanline effect.
+ *
+ * This runs on the render thread, so none of this costs the emulation thread
+ * anything.
+ */
+#include "PostProcessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Constructor.
+ */
+PostProcessor::PostProcessor() :
+    _history(),
+    _last_persistence(0),
+    _scaled_rows(),
+    _x_index(),
+    _x_weight(),
+    _y_index(),
+    _y_weight(),
+    _y_shade(),
+    _src_width(0),
+    _src_height(0),
+    _dst_width(0),
+    _dst_height(0),
+    _sharp_bilinear(false),
+    _scanlines(0)
+{ }
+
+/**
+ * Get the settings that leave the image untouched.
+ *
+ * @return The default settings.
+ */
+PostProcessSettings PostProcessor::GetDefaultSettings()
+{
+    return { 1, false, 0, 0 };
+}
+
+/**
+ * Calculate how big the processed image will be.
+ *
+ * @param settings The post-processing settings.
+ * @param src_width Width of the source image.
+ * @param src_height Height of the source image.
+ * @param target_width Width of the area the image will be displayed in (zero
+ *                     if unknown).
+ * @param target_height Height of the area the image will be displayed in (zero
+ *                      if unknown).
+ * @param out_width Set to the width of the processed image.
+ * @param out_height Set to the height of the processed image.
+ */
+void PostProcessor::GetOutputSize(const PostProcessSettings &settings,
+                                  int src_width,
+                                  int src_height,
+                                  int target_width,
+                                  int target_height,
+                                  int &out_width,
+                                  int &out_height)
+{
+    const bool have_target = (target_width > 0 && target_height > 0);
+
+    if(settings.sharp_bilinear && have_target)
+    {
+        out_width = target_width;
+        out_height = target_height;
+        return;
+    }
+
+    int scale = settings.scale;
+
+    if(scale <= 0)
+    {
+        scale = 1;
+
+        if(have_target)
+        {
+            scale = std::max(1, std::min(target_width / src_width,
+                                         target_height / src_height));
+        }
+    }
+
+    out_width = src_width * scale;
+    out_height = src_height * scale;
+}
+
+/**
+ * Check whether processing would leave the image unchanged (so it can be
+ * skipped entirely).
+ *
+ * @param settings The post-processing settings.
+ * @param src_width Width of the source image.
+ * @param src_height Height of the source image.
+ * @param out_width Width of the processed image.
+ * @param out_height Height of the processed image.
+ *
+ * @return True if the image doesn't need any processing.
+ */
+bool PostProcessor::IsPassThrough(const PostProcessSettings &settings,
+                                  int src_width,
+                                  int src_height,
+                                  int out_width,
+                                  int out_height)
+{
+    return (src_width == out_width) &&
+           (src_height == out_height) &&
+           (settings.persistence == 0);
+}
+
+/**
+ * Run every enabled filter over a frame.
+ *
+ * @param settings The post-processing settings.
+ * @param src The source image. If persistence is enabled, this is modified in
+ *            place.
+ * @param src_width Width of the source image.
+ * @param src_height Height of the source image.
+ * @param dst Where to write the processed image.
+ * @param dst_width Width of the processed image (see GetOutputSize()).
+ * @param dst_height Height of the processed image (see GetOutputSize()).
+ * @param pool The worker threads to split the work across.
+ */
+void PostProcessor::Process(const PostProcessSettings &settings,
+                            uint32_t *src,
+                            int src_width,
+                            int src_height,
+                            uint32_t *dst,
+                            int dst_width,
+                            int dst_height,
+                            WorkerPool &pool)
+{
+    const int src_count = src_width * src_height;
+    const int persistence = std::max(0, std::min(settings.persistence, 100));
+    const uint16_t decay = (persistence * WEIGHT_ONE) / 100;
+
+    if(persistence > 0 && (_last_persistence == 0 ||
+                           static_cast<int>(_history.size()) != src_count))
+    {
+        _history.assign(src, src + src_count);
+    }
+
+    _last_persistence = persistence;
+
+    if(src_width != _src_width ||
+       src_height != _src_height ||
+       dst_width != _dst_width ||
+       dst_height != _dst_height ||
+       settings.sharp_bilinear != _sharp_bilinear ||
+       settings.scanlines != _scanlines)
+    {
+        build_tables(settings, src_width, src_height, dst_width, dst_height);
+    }
+
+    /**
+     * Pass 1: persistence and horizontal scaling of every source row.
+     */
+    pool.Run([&](int band, int num_bands)
+    {
+        int first_row = 0;
+        int end_row = 0;
+        WorkerPool::GetBand(band, num_bands, src_height, first_row, end_row);
+
+        for(int row = first_row; row < end_row; ++row)
+        {
+            uint32_t *src_row = src + (row * src_width);
+
+            if(persistence > 0)
+            {
+                apply_persistence(src_row,
+                                  _history.data() + (row * src_width),
+                                  src_width,
+                                  decay);
+            }
+
+            scale_row(src_row,
+                      _scaled_rows.data() + (row * dst_width),
+                      _x_index.data(),
+                      _x_weight.data(),
+                      dst_width);
+        }
+    });
+
+    /**
+     * Pass 2: vertical scaling and scanlines for every output row.
+     */
+    pool.Run([&](int band, int num_bands)
+    {
+        int first_row = 0;
+        int end_row = 0;
+        WorkerPool::GetBand(band, num_bands, dst_height, first_row, end_row);
+
+        for(int row = first_row; row < end_row; ++row)
+        {
+            const uint32_t *top =
+                    _scaled_rows.data() + (_y_index[row] * dst_width);
+
+            blend_rows(top,
+                       top + dst_width,
+                       dst + (row * dst_width),
+                       dst_width,
+                       _y_weight[row],
+                       _y_shade[row]);
+        }
+    });
+}
+
+/**
+ * Forget the previous frames used for phosphor persistence. This should be
+ * called whenever frames are displayed without going through Process(), so
+ * that a stale image doesn't reappear once persistence is turned back on.
+ */
+void PostProcessor::ResetHistory()
+{
+    _last_persistence = 0;
+}
+
+/**
+ * Rebuild the scaling and scanline tables.
+ *
+ * @param settings The post-processing settings.
+ * @param src_width Width of the source image.
+ * @param src_height Height of the source image.
+ * @param dst_width Width of the processed image.
+ * @param dst_height Height of the processed image.
+ */
+void PostProcessor::build_tables(const PostProcessSettings &settings,
+                                 int src_width,
+                                 int src_height,
+                                 int dst_width,
+                                 int dst_height)
+{
+    build_axis(settings.sharp_bilinear,
+               src_width,
+               dst_width,
+               _x_index,
+               _x_weight);
+
+    build_axis(settings.sharp_bilinear,
+               src_height,
+               dst_height,
+               _y_index,
+               _y_weight);
+
+    /**
+     * Darken the bottom half of every source line, but only if there are at
+     * least two output lines per source line (otherwise every line would just
+     * get darker).
+     */
+    const int scanlines = std::max(0, std::min(settings.scanlines, 100));
+    const bool use_scanlines = (scanlines > 0) &&
+                               (dst_height >= (src_height * 2));
+
+    _y_shade.resize(dst_height);
+    for(int row = 0; row < dst_height; ++row)
+    {
+        const double pos = ((row + 0.5) * src_height) / dst_height;
+        const bool gap = (pos - std::floor(pos)) >= 0.5;
+
+        _y_shade[row] = (use_scanlines && gap) ?
+                        WEIGHT_ONE - ((scanlines * WEIGHT_ONE) / 100) :
+                        WEIGHT_ONE;
+    }
+
+    _scaled_rows.resize(src_height * dst_width);
+
+    _src_width = src_width;
+    _src_height = src_height;
+    _dst_width = dst_width;
+    _dst_height = dst_height;
+    _sharp_bilinear = settings.sharp_bilinear;
+    _scanlines = settings.scanlines;
+}
+
+/**
+ * Build the sampling table for one axis.
+ *
+ * Every output pixel is blended from source pixel "index" and "index + 1"
+ * (the weight is how much of the second one to use), so the index is always
+ * kept at least one away from the last source pixel.
+ *
+ * With sharp bilinear filtering, the blend only happens within one output
+ * pixel of the boundary between source pixels; everywhere else a source pixel
+ * is reproduced as is. Otherwise, plain nearest-neighbor sampling is used.
+ *
+ * @param sharp_bilinear True to use sharp bilinear filtering.
+ * @param src_size Number of source pixels along this axis.
+ * @param dst_size Number of output pixels along this axis.
+ * @param index Filled in with the first source pixel for every output pixel.
+ * @param weight Filled in with the weight of the second source pixel.
+ */
+void PostProcessor::build_axis(bool sharp_bilinear,
+                               int src_size,
+                               int dst_size,
+                               std::vector<int> &index,
+                               std::vector<uint16_t> &weight)
+{
+    const double scale = static_cast<double>(dst_size) / src_size;
+    const double region = (scale > 1.0) ? (0.5 - (0.5 / scale)) : 0.0;
+
+    index.resize(dst_size);
+    weight.resize(dst_size);
+
+    for(int i = 0; i < dst_size; ++i)
+    {
+        const double texel = (i + 0.5) / scale;
+        double pos = 0.0;
+
+        if(sharp_bilinear)
+        {
+            const double texel_floor = std::floor(texel);
+            const double center_dist = (texel - texel_floor) - 0.5;
+            const double clamped = std::max(-region,
+                                            std::min(center_dist, region));
+            pos = texel_floor + ((center_dist - clamped) * scale);
+        }
+        else
+        {
+            pos = std::floor(texel);
+        }
+
+        int first = static_cast<int>(std::floor(pos));
+        uint16_t second_weight = static_cast<uint16_t>(
+                std::lround((pos - first) * WEIGHT_ONE));
+
+        if(first < 0)
+        {
+            first = 0;
+            second_weight = 0;
+        }
+        else if(first >= src_size - 1)
+        {
+            first = src_size - 2;
+            second_weight = WEIGHT_ONE;
+        }
+
+        index[i] = first;
+        weight[i] = second_weight;
+    }
+}
+
+/**
+ * Blend the fading glow of previous frames into the current frame.
+ *
+ * Each channel keeps whichever is brighter: the new pixel, or the previous
+ * pixel dimmed by the decay factor. The result becomes the new history.
+ *
+ * @param pixels The current frame's pixels (modified in place).
+ * @param history The previous result for the same pixels.
+ * @param count Number of pixels.
+ * @param decay How much of the previous brightness to keep (out of
+ *              WEIGHT_ONE).
+ */
+void PostProcessor::apply_persistence(uint32_t *pixels,
+                                      uint32_t *history,
+                                      int count,
+                                      uint16_t decay)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16(decay);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128i cur = _mm_loadu_si128((const __m128i*)(pixels + i));
+        const __m128i prev = _mm_loadu_si128((const __m128i*)(history + i));
+
+        const __m128i lo = _mm_srli_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(prev, zero), factor), 8);
+        const __m128i hi = _mm_srli_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(prev, zero), factor), 8);
+
+        const __m128i result = _mm_max_epu8(cur, _mm_packus_epi16(lo, hi));
+
+        _mm_storeu_si128((__m128i*)(pixels + i), result);
+        _mm_storeu_si128((__m128i*)(history + i), result);
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        uint32_t result = 0;
+
+        for(int shift = 0; shift < 32; shift += 8)
+        {
+            const uint32_t cur = (pixels[i] >> shift) & 0xFF;
+            const uint32_t prev = (((history[i] >> shift) & 0xFF) * decay) >> 8;
+            result |= std::max(cur, prev) << shift;
+        }
+
+        pixels[i] = result;
+        history[i] = result;
+    }
+}
+
+/**
+ * Scale a single row horizontally.
+ *
+ * @param src The source row.
+ * @param dst The output row.
+ * @param index The first source pixel for every output pixel.
+ * @param weight The weight of the second source pixel for every output pixel.
+ * @param count Number of output pixels.
+ */
+void PostProcessor::scale_row(const uint32_t *src,
+                              uint32_t *dst,
+                              const int *index,
+                              const uint16_t *weight,
+                              int count)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE / 2);
+
+    /**
+     * Two output pixels at a time, one per 64-bit half of the register.
+     */
+    for(; i + 2 <= count; i += 2)
+    {
+        const __m128i left = _mm_unpacklo_epi32(
+                _mm_cvtsi32_si128(src[index[i]]),
+                _mm_cvtsi32_si128(src[index[i + 1]]));
+        const __m128i right = _mm_unpacklo_epi32(
+                _mm_cvtsi32_si128(src[index[i] + 1]),
+                _mm_cvtsi32_si128(src[index[i + 1] + 1]));
+
+        const __m128i w = _mm_set_epi16(weight[i + 1], weight[i + 1],
+                                        weight[i + 1], weight[i + 1],
+                                        weight[i], weight[i],
+                                        weight[i], weight[i]);
+
+        __m128i result = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(left, zero),
+                                _mm_sub_epi16(one, w)),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(right, zero), w));
+        result = _mm_srli_epi16(_mm_add_epi16(result, round), 8);
+
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(result, zero));
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        const uint32_t left = src[index[i]];
+        const uint32_t right = src[index[i] + 1];
+        uint32_t result = 0;
+
+        for(int shift = 0; shift < 32; shift += 8)
+        {
+            const uint32_t a = (left >> shift) & 0xFF;
+            const uint32_t b = (right >> shift) & 0xFF;
+            const uint32_t value = ((a * (WEIGHT_ONE - weight[i])) +
+                                    (b * weight[i]) + (WEIGHT_ONE / 2)) >> 8;
+            result |= value << shift;
+        }
+
+        dst[i] = result;
+    }
+}
+
+/**
+ * Blend two horizontally scaled rows together into an output row and apply
+ * the scanline shading.
+ *
+ * @param top The row above the sample point.
+ * @param bottom The row below the sample point.
+ * @param dst The output row.
+ * @param count Number of pixels in each row.
+ * @param weight How much of the bottom row to use (out of WEIGHT_ONE).
+ * @param shade The brightness of this row (out of WEIGHT_ONE).
+ */
+void PostProcessor::blend_rows(const uint32_t *top,
+                               const uint32_t *bottom,
+                               uint32_t *dst,
+                               int count,
+                               uint16_t weight,
+                               uint16_t shade)
+{
+    if(weight == 0 && shade == WEIGHT_ONE)
+    {
+        std::memcpy(dst, top, count * sizeof(uint32_t));
+        return;
+    }
+
+    /**
+     * Alpha is forced back to opaque after shading.
+     */
+    constexpr uint32_t ALPHA = 0xFF000000;
+
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(WEIGHT_ONE / 2);
+    const __m128i w_top = _mm_set1_epi16(WEIGHT_ONE - weight);
+    const __m128i w_bottom = _mm_set1_epi16(weight);
+    const __m128i w_shade = _mm_set1_epi16(shade);
+    const __m128i alpha = _mm_set1_epi32(ALPHA);
+
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+
+        __m128i lo = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w_top),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w_bottom));
+        __m128i hi = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w_top),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w_bottom));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, w_shade), round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, w_shade), round), 8);
+
+        const __m128i result = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+        _mm_storeu_si128((__m128i*)(dst + i), result);
+    }
+#endif
+
+    for(; i < count; ++i)
+    {
+        uint32_t result = 0;
+
+        for(int shift = 0; shift < 32; shift += 8)
+        {
+            const uint32_t a = (top[i] >> shift) & 0xFF;
+            const uint32_t b = (bottom[i] >> shift) & 0xFF;
+            uint32_t value = ((a * (WEIGHT_ONE - weight)) + (b * weight) +
+                              (WEIGHT_ONE / 2)) >> 8;
+            value = ((value * shade) + (WEIGHT_ONE / 2)) >> 8;
+            result |= value << shift;
+        }
+
+        dst[i] = result | ALPHA;
+    }
+}
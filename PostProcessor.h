@@ -0,0 +1,150 @@
+#ifndef POSTPROCESSOR_H
+#define POSTPROCESSOR_H
+
+#include "WorkerPool.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * User-selectable post-processing options.
+ */
+struct PostProcessSettings
+{
+    /**
+     * Integer scale factor to apply. Zero picks the largest factor that fits
+     * in the presenter's target size. Ignored if sharp_bilinear is set.
+     */
+    int scale;
+
+    /**
+     * Scale to exactly the presenter's target size using "sharp bilinear"
+     * filtering (pixels stay crisp, only their edges get blended).
+     */
+    bool sharp_bilinear;
+
+    /**
+     * How much to darken the gap between source lines (0 to 100 percent).
+     * Only applied when each source line covers at least two output lines.
+     */
+    int scanlines;
+
+    /**
+     * How much of the previous frame's brightness remains visible (0 to 100
+     * percent). This emulates the slow decay of a CRT's phosphors.
+     */
+    int persistence;
+};
+
+class PostProcessor
+{
+public:
+    PostProcessor();
+
+    static PostProcessSettings GetDefaultSettings();
+
+    static void GetOutputSize(const PostProcessSettings &settings,
+                              int src_width,
+                              int src_height,
+                              int target_width,
+                              int target_height,
+                              int &out_width,
+                              int &out_height);
+
+    static bool IsPassThrough(const PostProcessSettings &settings,
+                              int src_width,
+                              int src_height,
+                              int out_width,
+                              int out_height);
+
+    void Process(const PostProcessSettings &settings,
+                 uint32_t *src,
+                 int src_width,
+                 int src_height,
+                 uint32_t *dst,
+                 int dst_width,
+                 int dst_height,
+                 WorkerPool &pool);
+
+    void ResetHistory();
+
+private:
+    void build_tables(const PostProcessSettings &settings,
+                      int src_width,
+                      int src_height,
+                      int dst_width,
+                      int dst_height);
+
+    static void build_axis(bool sharp_bilinear,
+                           int src_size,
+                           int dst_size,
+                           std::vector<int> &index,
+                           std::vector<uint16_t> &weight);
+
+    static void apply_persistence(uint32_t *pixels,
+                                  uint32_t *history,
+                                  int count,
+                                  uint16_t decay);
+
+    static void scale_row(const uint32_t *src,
+                          uint32_t *dst,
+                          const int *index,
+                          const uint16_t *weight,
+                          int count);
+
+    static void blend_rows(const uint32_t *top,
+                           const uint32_t *bottom,
+                           uint32_t *dst,
+                           int count,
+                           uint16_t weight,
+                           uint16_t shade);
+
+private:
+    /**
+     * Weights are fixed point values where this represents 1.0.
+     */
+    static constexpr uint16_t WEIGHT_ONE = 256;
+
+    /**
+     * The source image from previous frames, used for phosphor persistence.
+     */
+    std::vector<uint32_t> _history;
+
+    /**
+     * The persistence setting the last time a frame was processed. The
+     * history gets reset whenever persistence is turned on.
+     */
+    int _last_persistence;
+
+    /**
+     * Every source row scaled horizontally to the output width.
+     */
+    std::vector<uint32_t> _scaled_rows;
+
+    /**
+     * For every output column: the source column to the left of the sample
+     * point, and how much of the next column to blend in.
+     */
+    std::vector<int> _x_index;
+    std::vector<uint16_t> _x_weight;
+
+    /**
+     * For every output row: the source row above the sample point, how much of
+     * the next row to blend in, and the scanline brightness.
+     */
+    std::vector<int> _y_index;
+    std::vector<uint16_t> _y_weight;
+    std::vector<uint16_t> _y_shade;
+
+    /**
+     * The configuration the tables were last built for.
+     */
+    int _src_width;
+    int _src_height;
+    int _dst_width;
+    int _dst_height;
+    bool _sharp_bilinear;
+    int _scanlines;
+};
+
+#endif // POSTPROCESSOR_H
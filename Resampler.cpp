@@ -0,0 +1,113 @@
+/**
+ * Small-ratio sample rate converter using cubic Hermite interpolation.
+ *
+ * Every input sample is shifted into a four sample history, and output
+ * samples are interpolated between the middle two samples until the output
+ * position moves past the newest one. The fractional position carries over
+ * between calls, so the stream is seamless no matter how it's chunked.
+ */
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Constructor.
+ */
+Resampler::Resampler() :
+    _ratio(1.0),
+    _step(1.0),
+    _position(0.0),
+    _history()
+{ }
+
+/**
+ * Forget any previous input.
+ */
+void Resampler::Reset()
+{
+    _position = 0.0;
+
+    for(float &sample : _history)
+        sample = 0.0f;
+}
+
+/**
+ * Set the conversion ratio. This takes effect on the next sample.
+ *
+ * @param ratio Output samples to generate per input sample.
+ */
+void Resampler::SetRatio(double ratio)
+{
+    _ratio = ratio;
+    _step = 1.0 / ratio;
+}
+
+/**
+ * Get the conversion ratio.
+ *
+ * @return Output samples generated per input sample.
+ */
+double Resampler::GetRatio() const
+{
+    return _ratio;
+}
+
+/**
+ * Convert a block of samples.
+ *
+ * @param input The samples to convert.
+ * @param input_count Number of input samples.
+ * @param output Where to write the converted samples.
+ * @param max_output Room in the output. This should be at least
+ *                   (input_count * ratio) + 2; anything past it is dropped.
+ *
+ * @return The number of samples written to the output.
+ */
+int Resampler::Process(const int16_t *input,
+                       int input_count,
+                       int16_t *output,
+                       int max_output)
+{
+    int count = 0;
+
+    for(int i = 0; i < input_count; ++i)
+    {
+        _history[0] = _history[1];
+        _history[1] = _history[2];
+        _history[2] = _history[3];
+        _history[3] = input[i];
+
+        const float y0 = _history[0];
+        const float y1 = _history[1];
+        const float y2 = _history[2];
+        const float y3 = _history[3];
+
+        /**
+         * Catmull-Rom coefficients for the segment between y1 and y2.
+         */
+        const float a = (-0.5f * y0) + (1.5f * y1) - (1.5f * y2) + (0.5f * y3);
+        const float b = y0 - (2.5f * y1) + (2.0f * y2) - (0.5f * y3);
+        const float c = (-0.5f * y0) + (0.5f * y2);
+        const float d = y1;
+
+        while(_position < 1.0)
+        {
+            const float t = static_cast<float>(_position);
+            const float value = (((((a * t) + b) * t) + c) * t) + d;
+
+            if(count < max_output)
+            {
+                const float clamped = std::max(-32768.0f,
+                                               std::min(value, 32767.0f));
+                output[count++] = static_cast<int16_t>(std::lrint(clamped));
+            }
+
+            _position += _step;
+        }
+
+        _position -= 1.0;
+    }
+
+    return count;
+}
@@ -0,0 +1,51 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstdint>
+
+/**
+ * Converts a stream of 16-bit samples to a slightly different sample rate.
+ *
+ * This is only meant for small ratio adjustments (fractions of a percent) used
+ * to keep the audio buffer at a steady fill level, so a cubic interpolator is
+ * more than good enough and costs only a handful of operations per sample.
+ */
+class Resampler
+{
+public:
+    Resampler();
+
+    void Reset();
+
+    void SetRatio(double ratio);
+    double GetRatio() const;
+
+    int Process(const int16_t *input,
+                int input_count,
+                int16_t *output,
+                int max_output);
+
+private:
+    /**
+     * Output samples generated per input sample.
+     */
+    double _ratio;
+
+    /**
+     * Input samples consumed per output sample.
+     */
+    double _step;
+
+    /**
+     * Position of the next output sample between _history[1] and
+     * _history[2] (0.0 to 1.0).
+     */
+    double _position;
+
+    /**
+     * The last four input samples (oldest first).
+     */
+    float _history[4];
+};
+
+#endif // RESAMPLER_H
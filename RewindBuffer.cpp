@@ -0,0 +1,296 @@
+/**
+ * A whole saved state is over half a megabyte with two disks inserted, so
+ * keeping minutes of them isn't possible. From one state to the next, though,
+ * only a handful of pages usually change (the screen, the zero page and stack,
+ * maybe a disk track being written), so that's all that gets kept.
+ *
+ * The changed pages are found by comparing each new state to the newest one a
+ * page at a time, rather than having every device track which of its pages
+ * were written. That costs about as much as copying the state once, catches
+ * changes to any device, and keeps the memory write path untouched.
+ *
+ * The undo data is stored backwards: the newest state is kept whole, and each
+ * undo turns a state back into the one before it. Stepping back is then just
+ * a matter of copying the pages in the newest undo, and the oldest states can
+ * be thrown away without rebuilding anything.
+ */
+#include "RewindBuffer.h"
+
+#include <cstring>
+
+/**
+ * Constructor.
+ *
+ * @param capacity Bytes of memory to keep undo data in. This is only
+ *                 allocated once the second state is pushed.
+ * @param max_states The most states to keep (at least two).
+ */
+RewindBuffer::RewindBuffer(size_t capacity, int max_states) :
+    _capacity(capacity),
+    _max_states(max_states),
+    _buffer(),
+    _undos(),
+    _first_undo(0),
+    _num_undos(0),
+    _latest(),
+    _has_latest(false),
+    _changed_pages()
+{ }
+
+/**
+ * Throw away every state, keeping the memory for next time.
+ */
+void RewindBuffer::Clear()
+{
+    _first_undo = 0;
+    _num_undos = 0;
+    _has_latest = false;
+}
+
+/**
+ * Add a state to the history, throwing away the oldest states if there isn't
+ * room for it.
+ *
+ * @param state The state to add.
+ * @param size Size of the state in bytes.
+ */
+void RewindBuffer::Push(const uint8_t *state, size_t size)
+{
+    if(!_has_latest || size != _latest.size())
+    {
+        if(_has_latest && push_undo(_latest.size(), true))
+        {
+            std::memcpy(&_buffer[get_undo(_num_undos - 1).offset],
+                        _latest.data(),
+                        _latest.size());
+        }
+
+        _latest.assign(state, state + size);
+        _has_latest = true;
+        return;
+    }
+
+    _changed_pages.clear();
+
+    for(size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        size_t page_size = size - offset;
+        if(page_size > PAGE_SIZE)
+            page_size = PAGE_SIZE;
+
+        if(std::memcmp(&_latest[offset], state + offset, page_size) != 0)
+            _changed_pages.push_back(offset / PAGE_SIZE);
+    }
+
+    /**
+     * The undo is the number of pages, followed by the page numbers and then
+     * what each page held before.
+     */
+    const uint32_t num_pages = _changed_pages.size();
+    const size_t undo_size = sizeof(num_pages) +
+                             (num_pages * (sizeof(uint32_t) + PAGE_SIZE));
+
+    if(!push_undo(undo_size, false))
+    {
+        _latest.assign(state, state + size);
+        return;
+    }
+
+    uint8_t *undo = &_buffer[get_undo(_num_undos - 1).offset];
+
+    std::memcpy(undo, &num_pages, sizeof(num_pages));
+    undo += sizeof(num_pages);
+
+    if(num_pages > 0)
+    {
+        std::memcpy(undo,
+                    _changed_pages.data(),
+                    num_pages * sizeof(uint32_t));
+        undo += num_pages * sizeof(uint32_t);
+    }
+
+    for(uint32_t page : _changed_pages)
+    {
+        const size_t offset = page * PAGE_SIZE;
+
+        size_t page_size = size - offset;
+        if(page_size > PAGE_SIZE)
+            page_size = PAGE_SIZE;
+
+        std::memcpy(undo, &_latest[offset], page_size);
+        std::memcpy(&_latest[offset], state + offset, page_size);
+        undo += PAGE_SIZE;
+    }
+}
+
+/**
+ * Take the newest state out of the history.
+ *
+ * @param state Filled in with the newest state.
+ *
+ * @return True if there was a state, false if the history is empty.
+ */
+bool RewindBuffer::Pop(StateWriter &state)
+{
+    if(!_has_latest)
+        return false;
+
+    state.Clear();
+    state.Write(_latest.data(), _latest.size());
+
+    if(_num_undos > 0)
+    {
+        apply_undo(get_undo(_num_undos - 1));
+        _num_undos--;
+    }
+    else
+    {
+        _has_latest = false;
+    }
+
+    return true;
+}
+
+/**
+ * Get the number of states in the history.
+ *
+ * @return The number of states.
+ */
+int RewindBuffer::GetNumStates() const
+{
+    return (_has_latest) ? _num_undos + 1 : 0;
+}
+
+/**
+ * Make room for a new undo after the newest one, throwing away the oldest
+ * undos that are in the way.
+ *
+ * @param size Size of the undo data in bytes.
+ * @param whole_state True if the undo data is a whole state.
+ *
+ * @return True if the undo was added, false if it's too big to ever fit (in
+ *         which case every undo is thrown away, since the history can't go
+ *         back past the new state).
+ */
+bool RewindBuffer::push_undo(size_t size, bool whole_state)
+{
+    if(size > _capacity || _max_states < 2)
+    {
+        while(_num_undos > 0)
+            drop_oldest();
+
+        return false;
+    }
+
+    if(_buffer.empty())
+    {
+        _buffer.resize(_capacity);
+        _undos.resize(_max_states - 1);
+    }
+
+    if(_num_undos == static_cast<int>(_undos.size()))
+        drop_oldest();
+
+    size_t offset = get_write_offset();
+
+    /**
+     * If the undo doesn't fit before the end of the buffer, it goes at the
+     * start instead. The undos left at the end are older than the ones at
+     * the start, so they have to go first.
+     */
+    if(size > _capacity - offset)
+    {
+        while(_num_undos > 0 && get_undo(0).offset >= offset)
+            drop_oldest();
+
+        offset = 0;
+    }
+
+    while(_num_undos > 0 &&
+          get_undo(0).offset < offset + size &&
+          get_undo(0).offset + get_undo(0).size > offset)
+    {
+        drop_oldest();
+    }
+
+    Undo &undo = get_undo(_num_undos);
+    undo.offset = offset;
+    undo.size = size;
+    undo.whole_state = whole_state;
+
+    _num_undos++;
+
+    return true;
+}
+
+/**
+ * Turn the newest state back into the state before it.
+ *
+ * @param undo The undo for the newest state.
+ */
+void RewindBuffer::apply_undo(const Undo &undo)
+{
+    const uint8_t *data = &_buffer[undo.offset];
+
+    if(undo.whole_state)
+    {
+        _latest.assign(data, data + undo.size);
+        return;
+    }
+
+    uint32_t num_pages = 0;
+    std::memcpy(&num_pages, data, sizeof(num_pages));
+
+    const uint8_t *pages = data + sizeof(num_pages);
+    const uint8_t *page_data = pages + (num_pages * sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < num_pages; ++i)
+    {
+        uint32_t page = 0;
+        std::memcpy(&page, pages + (i * sizeof(uint32_t)), sizeof(page));
+
+        const size_t offset = page * PAGE_SIZE;
+
+        size_t page_size = _latest.size() - offset;
+        if(page_size > PAGE_SIZE)
+            page_size = PAGE_SIZE;
+
+        std::memcpy(&_latest[offset], page_data + (i * PAGE_SIZE), page_size);
+    }
+}
+
+/**
+ * Throw away the oldest undo (and with it, the oldest state).
+ */
+void RewindBuffer::drop_oldest()
+{
+    _first_undo = (_first_undo + 1) % _undos.size();
+    _num_undos--;
+}
+
+/**
+ * Get an undo out of the ring.
+ *
+ * @param index Which undo to get (zero is the oldest).
+ *
+ * @return The undo.
+ */
+RewindBuffer::Undo& RewindBuffer::get_undo(int index)
+{
+    return _undos[(_first_undo + index) % _undos.size()];
+}
+
+/**
+ * Get where the next undo would go: right after the newest one.
+ *
+ * @return The offset into the buffer.
+ */
+size_t RewindBuffer::get_write_offset()
+{
+    if(_num_undos == 0)
+        return 0;
+
+    const Undo &newest = get_undo(_num_undos - 1);
+
+    return newest.offset + newest.size;
+}
@@ -0,0 +1,96 @@
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include "StateWriter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Keeps a history of saved states that can be stepped back through, newest
+ * first. Only the newest state is kept whole; for every other state, only the
+ * pages that differ from the state after it are kept. Once the history fills
+ * its memory, the oldest states are thrown away.
+ */
+class RewindBuffer
+{
+public:
+    RewindBuffer(size_t capacity, int max_states);
+
+    RewindBuffer(const RewindBuffer &copy) = delete;
+    RewindBuffer& operator=(const RewindBuffer &rhs) = delete;
+
+    void Clear();
+
+    void Push(const uint8_t *state, size_t size);
+    bool Pop(StateWriter &state);
+
+    int GetNumStates() const;
+
+private:
+    /**
+     * What it takes to get from a state back to the state before it: either
+     * the pages that changed (as they were before), or the whole state before
+     * it if the size of the state changed (e.g., a disk was inserted).
+     */
+    struct Undo
+    {
+        /**
+         * Where the undo data is in the buffer, and its size in bytes.
+         */
+        size_t offset;
+        size_t size;
+
+        /**
+         * True if the undo data is a whole state, false if it's pages.
+         */
+        bool whole_state;
+    };
+
+    bool push_undo(size_t size, bool whole_state);
+    void apply_undo(const Undo &undo);
+
+    void drop_oldest();
+    Undo& get_undo(int index);
+    size_t get_write_offset();
+
+private:
+    /**
+     * States are compared (and kept) a page at a time.
+     */
+    static constexpr size_t PAGE_SIZE = 256;
+
+    /**
+     * Size of the memory holding the undo data, and the most states kept.
+     */
+    size_t _capacity;
+    int _max_states;
+
+    /**
+     * Holds the undo data, oldest first (wrapping around to the start once
+     * it reaches the end). Allocated the first time it's needed.
+     */
+    std::vector<uint8_t> _buffer;
+
+    /**
+     * A ring of undos, one for every state but the oldest.
+     */
+    std::vector<Undo> _undos;
+    int _first_undo;
+    int _num_undos;
+
+    /**
+     * The newest state, and whether there is one.
+     */
+    std::vector<uint8_t> _latest;
+    bool _has_latest;
+
+    /**
+     * The pages that changed in the state being pushed. Kept around so it
+     * doesn't have to be allocated on every push.
+     */
+    std::vector<uint32_t> _changed_pages;
+};
+
+#endif // REWINDBUFFER_H
@@ -0,0 +1,193 @@
+/**
+ * Lock-free ring buffer used to stream data from a single producer thread to a
+ * single consumer thread.
+ *
+ * The storage is a fixed-size array inside the object, so nothing is ever
+ * allocated after construction. The producer only ever writes the tail index
+ * and the consumer only ever writes the head index, so neither side has to
+ * wait on the other. If the buffer is full, the producer's data is dropped.
+ */
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY>
+class RingBuffer
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                  "RingBuffer capacity must be a power of two");
+
+public:
+    /**
+     * Constructor.
+     */
+    RingBuffer() :
+        _buffer(),
+        _head(0),
+        _tail(0)
+    { }
+
+    RingBuffer(const RingBuffer &copy) = delete;
+    RingBuffer& operator=(const RingBuffer &rhs) = delete;
+
+    /**
+     * Producer side: add a single element to the buffer.
+     *
+     * @param value The element to add.
+     *
+     * @return True if the element was added, false if the buffer was full.
+     */
+    bool Push(const T &value)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if(tail - _head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+
+        _buffer[tail & INDEX_MASK] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Producer side: add as many elements as will fit into the buffer.
+     *
+     * @param values The elements to add.
+     * @param count Number of elements to add.
+     *
+     * @return The number of elements actually added.
+     */
+    size_t Push(const T *values, size_t count)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t space = CAPACITY - (tail - _head.load(std::memory_order_acquire));
+
+        if(count > space)
+            count = space;
+
+        for(size_t i = 0; i < count; ++i)
+            _buffer[(tail + i) & INDEX_MASK] = values[i];
+
+        _tail.store(tail + count, std::memory_order_release);
+
+        return count;
+    }
+
+    /**
+     * Consumer side: look at the oldest element without removing it.
+     *
+     * @param value Set to the oldest element.
+     *
+     * @return True if there was an element, false if the buffer was empty.
+     */
+    bool Peek(T &value) const
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+
+        if(head == _tail.load(std::memory_order_acquire))
+            return false;
+
+        value = _buffer[head & INDEX_MASK];
+
+        return true;
+    }
+
+    /**
+     * Consumer side: remove the oldest element.
+     *
+     * @param value Set to the removed element.
+     *
+     * @return True if an element was removed, false if the buffer was empty.
+     */
+    bool Pop(T &value)
+    {
+        if(!Peek(value))
+            return false;
+
+        _head.store(_head.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Consumer side: remove up to "count" of the oldest elements.
+     *
+     * @param values Where to copy the removed elements.
+     * @param count Maximum number of elements to remove.
+     *
+     * @return The number of elements actually removed.
+     */
+    size_t Pop(T *values, size_t count)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        const size_t available = _tail.load(std::memory_order_acquire) - head;
+
+        if(count > available)
+            count = available;
+
+        for(size_t i = 0; i < count; ++i)
+            values[i] = _buffer[(head + i) & INDEX_MASK];
+
+        _head.store(head + count, std::memory_order_release);
+
+        return count;
+    }
+
+    /**
+     * Consumer side: remove every element currently in the buffer.
+     */
+    void Clear()
+    {
+        _head.store(_tail.load(std::memory_order_acquire),
+                    std::memory_order_release);
+    }
+
+    /**
+     * Get the number of elements currently in the buffer. This is safe to call
+     * from any thread, but the value may be out of date by the time it's used.
+     *
+     * @return The number of elements in the buffer.
+     */
+    size_t GetSize() const
+    {
+        const size_t head = _head.load(std::memory_order_acquire);
+        return _tail.load(std::memory_order_acquire) - head;
+    }
+
+    /**
+     * Get the maximum number of elements the buffer can hold.
+     *
+     * @return The capacity of the buffer.
+     */
+    static constexpr size_t GetCapacity()
+    {
+        return CAPACITY;
+    }
+
+private:
+    /**
+     * Masks a free-running index down to a position in the buffer.
+     */
+    static constexpr size_t INDEX_MASK = CAPACITY - 1;
+
+    /**
+     * The elements in the buffer.
+     */
+    T _buffer[CAPACITY];
+
+    /**
+     * Free-running count of elements removed (only written by the consumer).
+     */
+    std::atomic<size_t> _head;
+
+    /**
+     * Free-running count of elements added (only written by the producer).
+     */
+    std::atomic<size_t> _tail;
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,161 @@
+/**
+ * The widget that the emulator's video output gets displayed in.
+ *
+ * This is a plain software presenter: the render thread draws each finished
+ * frame straight into one of three persistent surfaces, and the GUI thread
+ * paints the newest one with QPainter, scaling it to whatever size the widget
+ * currently is. Resizing the widget only changes the destination rectangle
+ * (and the target size reported to the post-processing stage), nothing gets
+ * reinitialized.
+ */
+#include "Screen.h"
+
+#include <QImage>
+#include <QMetaObject>
+#include <QPainter>
+
+/**
+ * Constructor.
+ *
+ * @param parent Parent of this widget.
+ */
+Screen::Screen(QWidget *parent) :
+    QWidget(parent),
+    _surfaces(),
+    _target_width(0),
+    _target_height(0),
+    _present_latency(0)
+{
+    /**
+     * Every pixel of the widget gets painted over on each frame.
+     */
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_NoSystemBackground);
+
+    /**
+     * This widget doesn't get focus (keyboard events are handled by the
+     * MainWindow).
+     */
+    setFocusPolicy(Qt::NoFocus);
+}
+
+/**
+ * Retrieve the surface that the next frame should be drawn into.
+ *
+ * @note This is called from the render thread.
+ *
+ * @param width Width of the frame in pixels.
+ * @param height Height of the frame in pixels.
+ *
+ * @return Memory for (width * height) RGBA pixels.
+ */
+uint32_t* Screen::BeginFrame(int width, int height)
+{
+    Surface &surface = _surfaces.GetBackBuffer();
+
+    if(surface.width != width || surface.height != height)
+    {
+        surface.pixels.resize(width * height);
+        surface.width = width;
+        surface.height = height;
+    }
+
+    return surface.pixels.data();
+}
+
+/**
+ * Hand the frame drawn since the last BeginFrame() over to the GUI thread and
+ * schedule a repaint.
+ *
+ * @note This is called from the render thread.
+ */
+void Screen::EndFrame()
+{
+    _surfaces.GetBackBuffer().finished = std::chrono::steady_clock::now();
+    _surfaces.Publish();
+
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+}
+
+/**
+ * Retrieve the current size of the widget.
+ *
+ * @note This is called from the render thread.
+ *
+ * @param width Set to the width of the widget in pixels.
+ * @param height Set to the height of the widget in pixels.
+ */
+void Screen::GetTargetSize(int &width, int &height) const
+{
+    width = _target_width;
+    height = _target_height;
+}
+
+/**
+ * Get the average time between a frame being finished by the render thread and
+ * it being painted on the screen.
+ *
+ * @return The average present latency in microseconds.
+ */
+uint32_t Screen::GetPresentLatency() const
+{
+    return _present_latency;
+}
+
+/**
+ * Paint the most recent frame, scaled to fill the widget.
+ */
+void Screen::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+
+    if(_surfaces.Acquire())
+    {
+        using namespace std::chrono;
+
+        const Surface &surface = _surfaces.GetFrontBuffer();
+        const int64_t sample = duration_cast<microseconds>(
+                steady_clock::now() - surface.finished).count();
+
+        /**
+         * Keep a running average so the reported value doesn't jump around
+         * from frame to frame.
+         */
+        const int64_t average = _present_latency;
+        _present_latency = static_cast<uint32_t>(average +
+                                                 ((sample - average) / 8));
+    }
+
+    const Surface &surface = _surfaces.GetFrontBuffer();
+
+    if(surface.width == 0 || surface.height == 0)
+    {
+        painter.fillRect(rect(), Qt::black);
+        return;
+    }
+
+    /**
+     * Wrap the surface without copying it.
+     */
+    const QImage image(reinterpret_cast<const uchar*>(surface.pixels.data()),
+                       surface.width,
+                       surface.height,
+                       surface.width * sizeof(uint32_t),
+                       QImage::Format_RGBA8888);
+
+    painter.drawImage(rect(), image);
+}
+
+/**
+ * Keep track of the widget's size so the render thread can scale frames to
+ * fit it.
+ *
+ * @param event The resize event.
+ */
+void Screen::resizeEvent(QResizeEvent *event)
+{
+    _target_width = event->size().width();
+    _target_height = event->size().height();
+
+    QWidget::resizeEvent(event);
+}
@@ -0,0 +1,77 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include "IPresenter.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QWidget>
+
+class Screen : public QWidget, public IPresenter
+{
+    Q_OBJECT
+
+public:
+    explicit Screen(QWidget *parent = 0);
+
+    uint32_t* BeginFrame(int width, int height) override;
+    void EndFrame() override;
+    void GetTargetSize(int &width, int &height) const override;
+
+    uint32_t GetPresentLatency() const;
+
+private:
+    void paintEvent(QPaintEvent *) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    /**
+     * A single frame waiting to be painted.
+     */
+    struct Surface
+    {
+        /**
+         * The pixels in RGBA byte order.
+         */
+        std::vector<uint32_t> pixels;
+
+        /**
+         * Dimensions of the frame.
+         */
+        int width;
+        int height;
+
+        /**
+         * When the render thread finished drawing this frame.
+         */
+        std::chrono::steady_clock::time_point finished;
+    };
+
+    /**
+     * Frames being passed from the render thread to the GUI thread. The
+     * surfaces are only reallocated when the frame size changes. Resizing the
+     * widget only changes the frame size if post-processing is scaling frames
+     * to fit; otherwise the frame is scaled when it's painted.
+     */
+    TripleBuffer<Surface> _surfaces;
+
+    /**
+     * Size of the widget, readable from the render thread.
+     */
+    std::atomic<int> _target_width;
+    std::atomic<int> _target_height;
+
+    /**
+     * Running average of the time between the render thread finishing a frame
+     * and that frame being painted (in microseconds).
+     */
+    std::atomic<uint32_t> _present_latency;
+};
+
+#endif // SCREEN_H
@@ -4,6 +4,8 @@
 #include <QColorDialog>
 #include <QMessageBox>
 
+constexpr int SettingsDialog::SAMPLE_RATES[];
+
 /**
  * Constructor.
  *
@@ -15,7 +17,11 @@ SettingsDialog::SettingsDialog(EmulatorCore &emu, QWidget *parent) :
     _emu(emu),
     _key_map(_emu.GetMappings()),
     _text_color(),
+    _video_ntsc(false),
+    _video_post(PostProcessor::GetDefaultSettings()),
     _speaker_mute(false),
+    _sample_rate(0),
+    _audio_latency(0),
     _selected_keyevent({ QEvent::KeyPress, Qt::Key_unknown, Qt::NoModifier }),
     _selected_scancode({0, ""}),
     _selected_row(0),
@@ -58,12 +64,42 @@ SettingsDialog::SettingsDialog(EmulatorCore &emu, QWidget *parent) :
     _ui->blueEdit->setText("0x" +
             tr("%1").arg(_text_color.blue(), 2, 16, QChar('0')));
 
+    /**
+     * Initialize the video color mode.
+     */
+    _video_ntsc = _emu.GetVideoNtsc();
+    _ui->colorNtsc->setChecked(_video_ntsc);
+    _ui->colorStandard->setChecked(!_video_ntsc);
+
+    /**
+     * Initialize the display filters.
+     */
+    _video_post = _emu.GetVideoPostProcess();
+    _ui->scaleSpin->setValue(_video_post.scale);
+    _ui->sharpBilinearCheck->setChecked(_video_post.sharp_bilinear);
+    _ui->scanlinesSpin->setValue(_video_post.scanlines);
+    _ui->persistenceSpin->setValue(_video_post.persistence);
+
     /**
      * Initialize speaker mute.
      */
     _speaker_mute = _emu.GetSpeakerMute();
     _ui->speakerEnable->setChecked(_speaker_mute);
     _ui->speakerDisable->setChecked(!_speaker_mute);
+
+    /**
+     * Initialize the audio output settings.
+     */
+    _sample_rate = _emu.GetAudioSampleRate();
+    for(int i = 0; i < NUM_SAMPLE_RATES; ++i)
+    {
+        if(SAMPLE_RATES[i] == _sample_rate)
+            _ui->sampleRateCombo->setCurrentIndex(i);
+    }
+
+    _audio_latency = _emu.GetAudioTargetLatency();
+    _ui->latencySpin->setMaximum(AudioOutput::MAX_TARGET_LATENCY);
+    _ui->latencySpin->setValue(_audio_latency);
 }
 
 /**
@@ -170,7 +206,20 @@ void SettingsDialog::on_buttonBox_accepted()
 {
     _emu.SetMappings(_key_map);
     _emu.SetVideoTextColor(_text_color);
+    _emu.SetVideoNtsc(_video_ntsc);
+
+    _video_post.scale = _ui->scaleSpin->value();
+    _video_post.sharp_bilinear = _ui->sharpBilinearCheck->isChecked();
+    _video_post.scanlines = _ui->scanlinesSpin->value();
+    _video_post.persistence = _ui->persistenceSpin->value();
+    _emu.SetVideoPostProcess(_video_post);
     _emu.SetSpeakerMute(_speaker_mute);
+
+    _sample_rate = SAMPLE_RATES[_ui->sampleRateCombo->currentIndex()];
+    _emu.SetAudioSampleRate(_sample_rate);
+
+    _audio_latency = _ui->latencySpin->value();
+    _emu.SetAudioTargetLatency(_audio_latency);
 }
 
 /**
@@ -205,6 +254,16 @@ void SettingsDialog::on_speakerEnable_toggled(bool checked)
     _speaker_mute = checked;
 }
 
+/**
+ * Triggered when the NTSC color mode radio button is triggered.
+ *
+ * @param checked True if NTSC artifact colors are selected.
+ */
+void SettingsDialog::on_colorNtsc_toggled(bool checked)
+{
+    _video_ntsc = checked;
+}
+
 /**
  * Destructor.
  */
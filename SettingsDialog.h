@@ -31,12 +31,25 @@ private slots:
 
     void on_speakerEnable_toggled(bool checked);
 
+    void on_colorNtsc_toggled(bool checked);
+
 private:
     QString key_tostring(QKeyEvent key);
 
     void keyPressEvent(QKeyEvent *key) override;
 
 private:
+    /**
+     * The sample rates that can be picked, in the same order as the entries in
+     * the sample rate combo box.
+     */
+    static constexpr int NUM_SAMPLE_RATES = 3;
+    static constexpr int SAMPLE_RATES[NUM_SAMPLE_RATES] = { 44100, 48000, 96000 };
+
+    static_assert(SAMPLE_RATES[NUM_SAMPLE_RATES - 1] <=
+                  AudioOutput::MAX_SAMPLE_RATE,
+                  "AudioOutput can't buffer the highest sample rate");
+
     /**
      * Contains all of the UI elements generated in the Qt Forms Designer.
      */
@@ -57,11 +70,31 @@ private:
      */
     QColor _text_color;
 
+    /**
+     * True if NTSC artifact colors are enabled, false otherwise.
+     */
+    bool _video_ntsc;
+
+    /**
+     * Scaling and CRT effects applied to the video output.
+     */
+    PostProcessSettings _video_post;
+
     /**
      * True if speaker is muted, false otherwise.
      */
     bool _speaker_mute;
 
+    /**
+     * The sample rate audio is played at (in Hz).
+     */
+    int _sample_rate;
+
+    /**
+     * How much audio is kept buffered (in ms).
+     */
+    uint32_t _audio_latency;
+
     /**
      * QKeyEvent for the selected key mapping.
      */
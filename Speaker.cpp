@@ -12,15 +12,16 @@
  *
  * To make up for this, the number of clicks wanting to be emitted in a single
  * frame is recorded and at the end of every frame, are played back at the
- * correct speed.
+ * correct speed. Each click is inserted into a BlipBuffer at its exact cycle,
+ * which produces a band-limited (alias-free) square wave at any sample rate.
+ *
+ * The generated samples are handed to an AudioOutput, which plays them on its
+ * own thread. Everything the speaker needs is allocated up front, so nothing
+ * gets allocated per frame.
  */
 #include "Speaker.h"
 
-#include <QAudioDeviceInfo>
-#include <QAudioFormat>
-#include <QAudioOutput>
-
-#include <queue>
+#include <algorithm>
 
 /**
  * Constructor.
@@ -31,22 +32,17 @@ Speaker::Speaker(Cpu &cpu) :
     _prev_cycle_count(0),
     _toggle_cycles(),
     _speaker_state(false),
-    _format(),
+    _blip(),
+    _clock_rate(CPU_FREQ),
+    _sources(),
     _output(nullptr),
-    _audio_io(nullptr),
-    _mute_counter(0),
+    _samples(),
+    _mix(),
+    _target_latency(DEFAULT_TARGET_LATENCY),
     _muted(false)
 {
-    _format.setSampleRate(SAMPLE_RATE);
-    _format.setChannelCount(1);
-    _format.setSampleSize(16);
-    _format.setCodec("audio/pcm");
-    _format.setByteOrder(QAudioFormat::LittleEndian);
-    _format.setSampleType(QAudioFormat::SignedInt);
-
-    _output = new QAudioOutput(_format);
-    _output->setBufferSize(10000);
-    _audio_io = _output->start();
+    SetSampleRate(DEFAULT_SAMPLE_RATE);
+    SetTurbo(1);
 }
 
 /**
@@ -56,10 +52,27 @@ void Speaker::Reset()
 {
     _prev_cycle_count = 0;
     _speaker_state = false;
+    _blip.Clear();
+
+    for(ISoundSource *source : _sources)
+        source->ClearAudio();
 
     ClearToggles();
 }
 
+/**
+ * Mix another device's sound in with the speaker's.
+ *
+ * @param source The device to mix in. It must outlive the speaker.
+ */
+void Speaker::AddSource(ISoundSource *source)
+{
+    source->SetRates(_clock_rate, _output->GetSampleRate());
+    source->ClearAudio();
+
+    _sources.push_back(source);
+}
+
 /**
  * Clears out any pending speaker toggles.
  *
@@ -67,54 +80,120 @@ void Speaker::Reset()
  */
 void Speaker::ClearToggles()
 {
-    while(!_toggle_cycles.empty())
-        _toggle_cycles.pop();
+    _toggle_cycles.clear();
 }
 
 /**
- * Play "num_cycles" worth of audio data.
+ * Play all of the audio generated since the last call.
+ *
+ * @param silent True to play silence instead (keeping the output fed without
+ *               making any noise), false otherwise.
  *
  * @note It is critical that this function be called at the same rate as the CPU
  *       (aka, every frame). If not, the audio will become out of sync with the
  *       CPU.
- *
- * @param num_cycles How much audio to play. This should be identical to how
- *                   many cycles the CPU ran within the last frame.
  */
-void Speaker::PlayAudio(uint32_t num_cycles)
+void Speaker::PlayAudio(bool silent)
 {
-    constexpr float CYCLES_PER_SAMPLE = 1023000.0f / SAMPLE_RATE;
-    const unsigned int num_samples =
-            static_cast<unsigned int>(num_cycles / CYCLES_PER_SAMPLE);
+    const uint32_t cur_cycle_count = _cpu.GetTotalCycles();
+    const uint32_t num_cycles = cur_cycle_count - _prev_cycle_count;
 
-    if(num_samples > 0)
+    /**
+     * If more time passed than the synthesizer can hold (e.g., after the CPU
+     * was reset), there's nothing sensible to play; just resynchronize.
+     */
+    if(num_cycles > _blip.GetMaxFrameCycles())
     {
-        int16_t *samples = new int16_t[num_samples];
+        ClearToggles();
+
+        for(ISoundSource *source : _sources)
+            source->ClearAudio();
+
+        _prev_cycle_count = cur_cycle_count;
+        return;
+    }
 
-        if(_toggle_cycles.empty())
-            _mute_counter++;
+    /**
+     * Only the toggles cost anything here, not the number of samples.
+     */
+    for(uint32_t toggle_cycle : _toggle_cycles)
+    {
+        const uint32_t time = std::min(toggle_cycle - _prev_cycle_count,
+                                       num_cycles);
+
+        _speaker_state = !_speaker_state;
+        _blip.AddDelta(time, (_speaker_state) ? TOGGLE_AMPLITUDE :
+                                                -TOGGLE_AMPLITUDE);
+    }
+
+    _toggle_cycles.clear();
+    _blip.EndFrame(num_cycles);
+
+    /**
+     * Every source is timed off the same frame, so they all produce the same
+     * number of samples as the speaker.
+     */
+    for(ISoundSource *source : _sources)
+        source->EndFrame(_prev_cycle_count, num_cycles);
 
-        for(unsigned int i = 0; i < num_samples; ++i)
+    /**
+     * Read the samples out (and mix in the other sources) a chunk at a time.
+     */
+    while(_blip.GetSamplesAvailable() > 0)
+    {
+        const int count = _blip.ReadSamples(_samples, SAMPLE_CHUNK);
+
+        if(!_sources.empty())
         {
-            if(!_toggle_cycles.empty()  &&
-               ((i * CYCLES_PER_SAMPLE + _prev_cycle_count) >=
-               _toggle_cycles.front()))
-            {
-                _mute_counter = 0;
-                _toggle_cycles.pop();
-                _speaker_state = !_speaker_state;
-            }
-
-
-            samples[i] = (_speaker_state) ? 16000 : 0;
-            samples[i] = (_muted || (_mute_counter > 10)) ? 0 : samples[i];
+            std::copy(_samples, _samples + count, _mix);
+
+            for(ISoundSource *source : _sources)
+                source->MixSamples(_mix, count);
+
+            for(int i = 0; i < count; ++i)
+                _samples[i] = static_cast<int16_t>(
+                        std::max(-32768, std::min(_mix[i], 32767)));
         }
 
-        _audio_io->write(reinterpret_cast<char*>(samples), num_samples * 2);
+        if(_muted || silent)
+            std::fill(_samples, _samples + count, 0);
+
+        _output->Write(_samples, count);
+    }
+
+    _prev_cycle_count = cur_cycle_count;
+}
+
+/**
+ * Throw away all of the audio generated since the last call without playing
+ * anything. Used when the CPU runs far ahead of real time, where there's no
+ * sensible way to play what it generated.
+ */
+void Speaker::SkipAudio()
+{
+    /**
+     * The toggles are still applied, so the speaker ends up in the right
+     * position once audio starts playing again. The synthesizer has to move
+     * with it, or every toggle after this would swing the wrong way; the
+     * skipped span is never played, so the whole move goes at the end of it
+     * (the start of the next frame).
+     */
+    const bool prev_speaker_state = _speaker_state;
+
+    if(_toggle_cycles.size() % 2 != 0)
+        _speaker_state = !_speaker_state;
 
-        delete [] samples;
+    _toggle_cycles.clear();
+
+    if(_speaker_state != prev_speaker_state)
+    {
+        _blip.AddDelta(0, (_speaker_state) ? TOGGLE_AMPLITUDE :
+                                             -TOGGLE_AMPLITUDE);
     }
 
+    for(ISoundSource *source : _sources)
+        source->ClearAudio();
+
     _prev_cycle_count = _cpu.GetTotalCycles();
 }
 
@@ -138,6 +217,110 @@ void Speaker::SetMute(bool mute)
     _muted = mute;
 }
 
+/**
+ * Get the sample rate audio is being played at.
+ *
+ * @return The sample rate in Hz.
+ */
+int Speaker::GetSampleRate() const
+{
+    return _output->GetSampleRate();
+}
+
+/**
+ * Change the sample rate audio is played at. This restarts the audio output.
+ *
+ * @param sample_rate The new sample rate in Hz (e.g., 44100, 48000 or 96000).
+ */
+void Speaker::SetSampleRate(int sample_rate)
+{
+    delete _output;
+    _output = new AudioOutput(sample_rate, _target_latency);
+
+    _blip.SetRates(_clock_rate, sample_rate);
+    _blip.Clear();
+
+    for(ISoundSource *source : _sources)
+    {
+        source->SetRates(_clock_rate, sample_rate);
+        source->ClearAudio();
+    }
+}
+
+/**
+ * Get the amount of audio the output keeps buffered.
+ *
+ * @return The target latency in milliseconds.
+ */
+uint32_t Speaker::GetTargetLatency() const
+{
+    return _target_latency;
+}
+
+/**
+ * Change the amount of audio the output keeps buffered. This restarts the
+ * audio output.
+ *
+ * @param latency The new target latency in milliseconds.
+ */
+void Speaker::SetTargetLatency(uint32_t latency)
+{
+    _target_latency = latency;
+    SetSampleRate(_output->GetSampleRate());
+}
+
+/**
+ * Let the speaker know how fast the CPU is running, so that audio still plays
+ * in real time (just at a higher pitch) when turbo is enabled.
+ *
+ * @param turbo The CPU speed multiplier.
+ */
+void Speaker::SetTurbo(uint8_t turbo)
+{
+    _clock_rate = CPU_FREQ * std::max<uint8_t>(turbo, 1);
+    _blip.SetRates(_clock_rate, _output->GetSampleRate());
+
+    /**
+     * Each frame runs this many times as many cycles, so it can also queue up
+     * this many times as many toggles.
+     */
+    _toggle_cycles.reserve(TOGGLES_PER_FRAME * std::max<uint8_t>(turbo, 1));
+
+    for(ISoundSource *source : _sources)
+        source->SetRates(_clock_rate, _output->GetSampleRate());
+}
+
+/**
+ * Get how much audio is queued up waiting to be played.
+ *
+ * @return The amount of queued audio in milliseconds.
+ */
+uint32_t Speaker::GetBufferFill() const
+{
+    return (_output->GetBufferFill() * 1000) / _output->GetSampleRate();
+}
+
+/**
+ * Get the number of times the audio output ran out of samples to play.
+ *
+ * @return The number of underruns.
+ */
+uint32_t Speaker::GetUnderruns() const
+{
+    return _output->GetUnderruns();
+}
+
+/**
+ * Get how much the output's sample rate is currently being adjusted to absorb
+ * the drift between the emulated and host clocks.
+ *
+ * @return The adjustment in parts per million.
+ */
+int32_t Speaker::GetRateAdjust() const
+{
+    return _output->GetRateAdjust();
+}
+
 /**
  * Emit a click when the speaker's address is referenced.
  *
@@ -150,7 +333,7 @@ void Speaker::SetMute(bool mute)
 uint8_t Speaker::Read(uint16_t addr, bool no_side_fx)
 {
     if(addr == SPEAKER_START_ADDR && !no_side_fx)
-        _toggle_cycles.push(_cpu.GetTotalCycles());
+        _toggle_cycles.push_back(_cpu.GetTotalCycles());
 
     return 0;
 }
@@ -163,41 +346,40 @@ uint8_t Speaker::Read(uint16_t addr, bool no_side_fx)
 void Speaker::Write(uint16_t addr, uint8_t)
 {
     if(addr == SPEAKER_START_ADDR)
-        _toggle_cycles.push(_cpu.GetTotalCycles());
+        _toggle_cycles.push_back(_cpu.GetTotalCycles());
 }
 
 /**
- * Save the Speaker state out to a file.
+ * Save the Speaker state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void Speaker::SaveState(std::ofstream &output)
+void Speaker::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(&_prev_cycle_count),
-                 sizeof(_prev_cycle_count));
+    output.Write(&_prev_cycle_count, sizeof(_prev_cycle_count));
 
-    output.write(reinterpret_cast<char*>(&_speaker_state),
-                 sizeof(_speaker_state));
+    output.Write(&_speaker_state, sizeof(_speaker_state));
 }
 
 /**
- * Load the Speaker state out of a file.
+ * Load the Speaker state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void Speaker::LoadState(std::ifstream &input)
+void Speaker::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(&_prev_cycle_count),
-                 sizeof(_prev_cycle_count));
+    input.Read(&_prev_cycle_count, sizeof(_prev_cycle_count));
 
-    input.read(reinterpret_cast<char*>(&_speaker_state),
-                 sizeof(_speaker_state));
+    input.Read(&_speaker_state, sizeof(_speaker_state));
 
     /**
      * Ensure any sound data from before the LoadState doesn't play.
      */
-    while(!_toggle_cycles.empty())
-        _toggle_cycles.pop();
+    _toggle_cycles.clear();
+    _blip.Clear();
+
+    for(ISoundSource *source : _sources)
+        source->ClearAudio();
 }
 
 /**
@@ -205,8 +387,5 @@ void Speaker::LoadState(std::ifstream &input)
  */
 Speaker::~Speaker()
 {
-    if(_output->state() == QAudio::ActiveState)
-        _output->stop();
-
     delete _output;
 }
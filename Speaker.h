@@ -1,35 +1,52 @@
 #ifndef SPEAKER_H
 #define SPEAKER_H
 
+#include "AudioOutput.h"
+#include "BlipBuffer.h"
 #include "Cpu.h"
 #include "IMemoryMapped.h"
+#include "ISoundSource.h"
 #include "IState.h"
 
-#include <QAudioOutput>
-#include <QAudioFormat>
-#include <QIODevice>
-
-#include <fstream>
-#include <queue>
+#include <cstdint>
+#include <vector>
 
 class Speaker : public IMemoryMapped, public IState
 {
 public:
     Speaker(Cpu &cpu);
 
+    Speaker(const Speaker &copy) = delete;
+    Speaker& operator=(const Speaker &rhs) = delete;
+
     void Reset();
     void ClearToggles();
 
-    void PlayAudio(uint32_t num_cycles);
+    void AddSource(ISoundSource *source);
+
+    void PlayAudio(bool silent = false);
+    void SkipAudio();
 
     bool GetMute() const;
     void SetMute(bool mute);
 
+    int GetSampleRate() const;
+    void SetSampleRate(int sample_rate);
+
+    uint32_t GetTargetLatency() const;
+    void SetTargetLatency(uint32_t latency);
+
+    void SetTurbo(uint8_t turbo);
+
+    uint32_t GetBufferFill() const;
+    uint32_t GetUnderruns() const;
+    int32_t GetRateAdjust() const;
+
     uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
     void Write(uint16_t addr, uint8_t) override;
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
     ~Speaker();
 
@@ -42,9 +59,37 @@ private:
 
 
     /**
-     * The sample rate to output at.
+     * The default sample rate to output at.
+     */
+    static constexpr int DEFAULT_SAMPLE_RATE = 48000;
+
+    /**
+     * The default amount of audio to keep buffered (in ms).
+     */
+    static constexpr uint32_t DEFAULT_TARGET_LATENCY = 50;
+
+    /**
+     * The standard Apple II CPU frequency.
+     */
+    static constexpr uint32_t CPU_FREQ = 1023000;
+
+    /**
+     * The change in amplitude each time the speaker is toggled.
      */
-    static constexpr int SAMPLE_RATE = 44100;
+    static constexpr int TOGGLE_AMPLITUDE = 20000;
+
+    /**
+     * Number of speaker toggles room is made for up front, per frame at the
+     * normal CPU speed. A frame is about 17,000 cycles, and even the tightest
+     * loop can't toggle the speaker every other cycle.
+     */
+    static constexpr size_t TOGGLES_PER_FRAME = 8192;
+
+    /**
+     * Number of samples generated at a time before being handed to the audio
+     * output.
+     */
+    static constexpr int SAMPLE_CHUNK = 1024;
 
     /**
      * Used to retrieve cycle counts whenever a speaker toggle is requested.
@@ -59,9 +104,12 @@ private:
     uint32_t _prev_cycle_count;
 
     /**
-     * A list of CPU cycle counts at which the speaker should be toggled.
+     * A list of CPU cycle counts at which the speaker should be toggled. It's
+     * only ever touched by the emulation thread, and room for a whole frame
+     * of toggles is reserved ahead of time (it still grows rather than drop
+     * any, if a frame somehow has more).
      */
-    std::queue<uint32_t> _toggle_cycles;
+    std::vector<uint32_t> _toggle_cycles;
 
     /**
      * True if the speaker is in a logic high state, false if in a logic low
@@ -70,27 +118,42 @@ private:
     bool _speaker_state;
 
     /**
-     * Data structure to describe the audio output. This will be standard
-     * 44.1KHz, 16-bit audio.
+     * Converts the speaker toggles into band-limited samples.
+     */
+    BlipBuffer _blip;
+
+    /**
+     * Emulated CPU cycles per second (scaled up with the turbo setting so that
+     * audio keeps playing in real time, at a higher pitch).
+     */
+    uint32_t _clock_rate;
+
+    /**
+     * Other devices whose sound gets mixed in with the speaker's.
+     */
+    std::vector<ISoundSource*> _sources;
+
+    /**
+     * Plays the generated samples on its own thread.
      */
-    QAudioFormat _format;
+    AudioOutput *_output;
 
     /**
-     * The Audio output device that will be playing the audio.
+     * Samples are generated into here before being handed to the audio output
+     * (so nothing gets allocated per frame).
      */
-    QAudioOutput *_output;
+    int16_t _samples[SAMPLE_CHUNK];
 
     /**
-     * Samples are written to this I/O device before they get played.
+     * The speaker and every sound source are summed in here before being
+     * clamped back down to 16 bits.
      */
-    QIODevice *_audio_io;
+    int32_t _mix[SAMPLE_CHUNK];
 
     /**
-     * If the application doesn't toggle the speaker within a certain number of
-     * frames, then the application is muted. This is used to prevent some
-     * strange audio glitches.
+     * How much audio the output keeps buffered (in ms).
      */
-    int _mute_counter;
+    uint32_t _target_latency;
 
     /**
      * True if the speaker is muted, false otherwise.
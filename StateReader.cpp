@@ -0,0 +1,88 @@
+#include "StateReader.h"
+
+#include <cstring>
+
+/**
+ * Constructor.
+ *
+ * @param data The state to read.
+ * @param size Size of the state in bytes.
+ */
+StateReader::StateReader(const uint8_t *data, size_t size) :
+    _data(data),
+    _size(size),
+    _position(0),
+    _failed(false)
+{ }
+
+/**
+ * Read the next piece of the state. If there isn't enough state left, the
+ * reader fails and the data is left alone.
+ *
+ * @param data Filled in with the state.
+ * @param size Number of bytes to read.
+ */
+void StateReader::Read(void *data, size_t size)
+{
+    if(_failed || size > _size - _position)
+    {
+        _failed = true;
+        return;
+    }
+
+    if(size > 0)
+        std::memcpy(data, _data + _position, size);
+
+    _position += size;
+}
+
+/**
+ * Read the next piece of the state in place, for data that only needs to be
+ * looked at (or is too big to be worth copying twice).
+ *
+ * @param size Number of bytes to read.
+ *
+ * @return Where the data is in the state, or nullptr if there isn't enough
+ *         state left (the reader fails).
+ */
+const uint8_t* StateReader::ReadData(size_t size)
+{
+    if(_failed || size > _size - _position)
+    {
+        _failed = true;
+        return nullptr;
+    }
+
+    const uint8_t *data = _data + _position;
+    _position += size;
+
+    return data;
+}
+
+/**
+ * Fail the reader, for when a device reads a value that doesn't make sense.
+ */
+void StateReader::SetFailed()
+{
+    _failed = true;
+}
+
+/**
+ * Check whether a read has failed.
+ *
+ * @return True if a read has failed, false otherwise.
+ */
+bool StateReader::Failed() const
+{
+    return _failed;
+}
+
+/**
+ * Get the number of bytes read so far.
+ *
+ * @return Where the next read starts.
+ */
+size_t StateReader::GetPosition() const
+{
+    return _position;
+}
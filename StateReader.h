@@ -0,0 +1,44 @@
+#ifndef STATEREADER_H
+#define STATEREADER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Reads saved state back out of a block of memory (which it doesn't own).
+ * Reading past the end fails the reader, and every read after that does
+ * nothing, so a device can read its whole state and leave checking for
+ * errors to whoever is loading it.
+ */
+class StateReader
+{
+public:
+    StateReader(const uint8_t *data, size_t size);
+
+    void Read(void *data, size_t size);
+    const uint8_t* ReadData(size_t size);
+
+    void SetFailed();
+    bool Failed() const;
+
+    size_t GetPosition() const;
+
+private:
+    /**
+     * The state being read.
+     */
+    const uint8_t *_data;
+    size_t _size;
+
+    /**
+     * Number of bytes read so far.
+     */
+    size_t _position;
+
+    /**
+     * True once a read has failed.
+     */
+    bool _failed;
+};
+
+#endif // STATEREADER_H
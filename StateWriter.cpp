@@ -0,0 +1,108 @@
+/**
+ * Saving state used to go through a file stream, so every snapshot of the
+ * emulator had to touch the file system. Writing into memory instead lets
+ * the whole machine be snapshotted in microseconds (for rewinding, or
+ * resetting to a known state over and over), with a file being just one place
+ * the memory can be copied to afterwards.
+ */
+#include "StateWriter.h"
+
+#include <cstring>
+
+/**
+ * Constructor.
+ *
+ * @param capacity Number of bytes to allocate up front.
+ */
+StateWriter::StateWriter(size_t capacity) :
+    _buffer(capacity),
+    _size(0)
+{ }
+
+/**
+ * Throw away everything written so far, keeping the memory for next time.
+ */
+void StateWriter::Clear()
+{
+    _size = 0;
+}
+
+/**
+ * Make sure there's room for a certain amount of state without having to
+ * allocate any more memory.
+ *
+ * @param capacity Number of bytes needed.
+ */
+void StateWriter::Reserve(size_t capacity)
+{
+    if(capacity > _buffer.size())
+        _buffer.resize(capacity);
+}
+
+/**
+ * Add data to the end of the state. The memory only grows (by at least double)
+ * if the data doesn't fit.
+ *
+ * @param data The data to write.
+ * @param size Number of bytes to write.
+ */
+void StateWriter::Write(const void *data, size_t size)
+{
+    if(_size + size > _buffer.size())
+    {
+        const size_t doubled = _buffer.size() * 2;
+        Reserve((doubled > _size + size) ? doubled : _size + size);
+    }
+
+    if(size > 0)
+        std::memcpy(&_buffer[_size], data, size);
+
+    _size += size;
+}
+
+/**
+ * Replace data that was already written (e.g., to fill in a size once it's
+ * known). Data past the end of what's been written is ignored.
+ *
+ * @param offset Where to write the data.
+ * @param data The data to write.
+ * @param size Number of bytes to write.
+ */
+void StateWriter::Overwrite(size_t offset, const void *data, size_t size)
+{
+    if(offset > _size || size > _size - offset)
+        return;
+
+    if(size > 0)
+        std::memcpy(&_buffer[offset], data, size);
+}
+
+/**
+ * Get the state written so far.
+ *
+ * @return The start of the state.
+ */
+const uint8_t* StateWriter::GetData() const
+{
+    return _buffer.data();
+}
+
+/**
+ * Get the number of bytes written so far.
+ *
+ * @return The size of the state.
+ */
+size_t StateWriter::GetSize() const
+{
+    return _size;
+}
+
+/**
+ * Get the number of bytes that can be written without allocating.
+ *
+ * @return The size of the memory.
+ */
+size_t StateWriter::GetCapacity() const
+{
+    return _buffer.size();
+}
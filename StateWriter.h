@@ -0,0 +1,40 @@
+#ifndef STATEWRITER_H
+#define STATEWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A contiguous block of memory that saved state gets written into. The memory
+ * is kept when the writer is cleared, so once it's big enough to hold the
+ * state, saving again never allocates anything.
+ */
+class StateWriter
+{
+public:
+    explicit StateWriter(size_t capacity = 0);
+
+    void Clear();
+    void Reserve(size_t capacity);
+
+    void Write(const void *data, size_t size);
+    void Overwrite(size_t offset, const void *data, size_t size);
+
+    const uint8_t* GetData() const;
+    size_t GetSize() const;
+    size_t GetCapacity() const;
+
+private:
+    /**
+     * The memory being written into. Only the first _size bytes hold state.
+     */
+    std::vector<uint8_t> _buffer;
+
+    /**
+     * Number of bytes written so far.
+     */
+    size_t _size;
+};
+
+#endif // STATEWRITER_H
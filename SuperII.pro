@@ -14,7 +14,11 @@ win32 {
     INCLUDEPATH += C:\Developer\SFML\include
 }
 
-LIBS += -lsfml-graphics -lsfml-network -lsfml-window -lsfml-system -lsfml-audio
+contains(QT_ARCH, x86_64)|contains(QT_ARCH, i386) {
+    !msvc: QMAKE_CXXFLAGS += -mssse3
+}
+
+LIBS += -lsfml-system
 
 SOURCES += main.cpp \
     instrs_6502.cpp \
@@ -31,10 +35,31 @@ SOURCES += main.cpp \
     DisassemblyWindow.cpp \
     CpuRegistersWindow.cpp \
     ViewMemoryWindow.cpp \
+    DiskTelemetryWindow.cpp \
     DiskController.cpp \
     DiskDrive.cpp \
+    DiskImage.cpp \
+    DiskTelemetry.cpp \
+    GcrCodec.cpp \
+    TrackCache.cpp \
+    RewindBuffer.cpp \
+    StateReader.cpp \
+    StateWriter.cpp \
     applesoft_rom.cpp \
-    LanguageCard.cpp
+    LanguageCard.cpp \
+    Palette.cpp \
+    NtscFilter.cpp \
+    WorkerPool.cpp \
+    Screen.cpp \
+    PostProcessor.cpp \
+    FrameCapture.cpp \
+    AudioOutput.cpp \
+    BlipBuffer.cpp \
+    Resampler.cpp \
+    Via6522.cpp \
+    Ay38910.cpp \
+    Mockingboard.cpp \
+    HardDiskCard.cpp
 
 
 OTHER_FILES += \
@@ -58,14 +83,41 @@ HEADERS += \
     DisassemblyWindow.h \
     CpuRegistersWindow.h \
     ViewMemoryWindow.h \
+    DiskTelemetryWindow.h \
     DiskController.h \
     DiskDrive.h \
+    DiskImage.h \
+    DiskTelemetry.h \
+    GcrCodec.h \
+    TrackCache.h \
+    RewindBuffer.h \
+    StateReader.h \
+    StateWriter.h \
     applesoft_rom.h \
-    LanguageCard.h
+    LanguageCard.h \
+    TripleBuffer.h \
+    Palette.h \
+    NtscFilter.h \
+    WorkerPool.h \
+    IPresenter.h \
+    Screen.h \
+    PostProcessor.h \
+    FrameCapture.h \
+    RingBuffer.h \
+    AudioOutput.h \
+    BlipBuffer.h \
+    Resampler.h \
+    IScheduled.h \
+    ISoundSource.h \
+    Via6522.h \
+    Ay38910.h \
+    Mockingboard.h \
+    HardDiskCard.h
 
 FORMS += \
     MainWindow.ui \
     SettingsDialog.ui \
     DisassemblyWindow.ui \
     CpuRegistersWindow.ui \
-    ViewMemoryWindow.ui
+    ViewMemoryWindow.ui \
+    DiskTelemetryWindow.ui
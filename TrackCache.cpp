@@ -0,0 +1,251 @@
+/**
+ * Encoding a track of a disk image takes a few kilobytes per track, and every
+ * drive used to keep its own copy of every track it touched. When lots of
+ * emulators (say, a farm of them running tests) load the same images, they
+ * all end up encoding and storing the exact same tracks.
+ *
+ * This cache lets them share the work: tracks are looked up by a hash of the
+ * image data they're encoded from, so a track only gets encoded once no matter
+ * how many drives (or which image files) it's loaded from. A hit is checked
+ * against the image data byte for byte, so a hash collision can never hand a
+ * drive the wrong track.
+ *
+ * Cached tracks are read only and reference counted. A drive that writes to a
+ * track makes its own copy the first time the write actually changes anything
+ * (copy-on-write), and a track is freed once no drive is using it.
+ */
+#include "TrackCache.h"
+
+#include <cstring>
+
+/**
+ * Multiplier used to mix the image data into the hash (2^64 divided by the
+ * golden ratio, which spreads the bits well).
+ */
+static constexpr uint64_t hash_multiplier = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * Check whether two keys are the same.
+ *
+ * @param rhs The key to compare against.
+ *
+ * @return True if the keys are the same, false otherwise.
+ */
+bool TrackCache::Key::operator==(const Key &rhs) const
+{
+    return hash == rhs.hash && size == rhs.size && variant == rhs.variant;
+}
+
+/**
+ * Hash a key.
+ *
+ * @param key The key to hash.
+ *
+ * @return The hash.
+ */
+size_t TrackCache::KeyHash::operator()(const Key &key) const
+{
+    return static_cast<size_t>(key.hash ^ (key.variant * hash_multiplier));
+}
+
+/**
+ * Get the cache shared by every drive in the process.
+ *
+ * @return The shared cache.
+ */
+TrackCache& TrackCache::Shared()
+{
+    static TrackCache cache;
+
+    return cache;
+}
+
+/**
+ * Constructor.
+ */
+TrackCache::TrackCache() :
+    _tracks(),
+    _cleanup_size(MIN_CLEANUP_SIZE),
+    _mutex()
+{ }
+
+/**
+ * Make the key a track is cached under. The image data is hashed eight bytes
+ * at a time, which is much quicker than encoding it.
+ *
+ * @param source The image data the track is encoded from.
+ * @param size Size of the image data in bytes.
+ * @param variant Anything besides the image data that changes how the track
+ *                gets encoded.
+ *
+ * @return The key.
+ */
+TrackCache::Key TrackCache::MakeKey(const uint8_t *source,
+                                    uint32_t size,
+                                    uint32_t variant)
+{
+    uint64_t hash = size * hash_multiplier;
+    uint32_t i = 0;
+
+    for(; i + 8 <= size; i += 8)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, source + i, sizeof(word));
+
+        hash = (hash ^ word) * hash_multiplier;
+        hash ^= hash >> 32;
+    }
+
+    for(; i < size; ++i)
+    {
+        hash = (hash ^ source[i]) * hash_multiplier;
+        hash ^= hash >> 32;
+    }
+
+    Key key;
+    key.hash = hash;
+    key.size = size;
+    key.variant = variant;
+
+    return key;
+}
+
+/**
+ * Look up a track.
+ *
+ * @param key The key made from the image data.
+ * @param source The image data the track is encoded from.
+ *
+ * @return The track, or an empty pointer if it isn't in the cache.
+ */
+TrackCache::TrackPtr TrackCache::Find(const Key &key, const uint8_t *source)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const auto entry = _tracks.find(key);
+
+    if(entry == _tracks.end())
+        return TrackPtr();
+
+    TrackPtr track = entry->second.lock();
+
+    if(track && !matches(*track, source, key.size))
+        return TrackPtr();
+
+    return track;
+}
+
+/**
+ * Add a newly encoded track to the cache. If another drive added the same
+ * track in the meantime, that one is used instead.
+ *
+ * @param key The key made from the image data.
+ * @param source The image data the track was encoded from.
+ * @param track The encoded track. The cache takes ownership of it (it's freed
+ *              straight away if the cache already has the track).
+ *
+ * @return The cached track.
+ */
+TrackCache::TrackPtr TrackCache::Insert(const Key &key,
+                                        const uint8_t *source,
+                                        Track *track)
+{
+    /**
+     * Only keep a copy of the image data if the track doesn't already hold
+     * the exact same bytes.
+     */
+    track->source.clear();
+
+    if(track->data.size() != key.size ||
+       std::memcmp(track->data.data(), source, key.size) != 0)
+    {
+        track->source.assign(source, source + key.size);
+    }
+
+    /**
+     * The track is allocated separately from its reference count, so its
+     * memory is given back as soon as the last drive lets go of it (even
+     * though the cache still points at it).
+     */
+    TrackPtr new_track(track);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::weak_ptr<const Track> &entry = _tracks[key];
+    TrackPtr cached = entry.lock();
+
+    if(cached)
+    {
+        /**
+         * Two different pieces of image data with the same hash. Keep the
+         * cached one, and let the new track belong to the drive alone.
+         */
+        if(!matches(*cached, source, key.size))
+            return new_track;
+
+        return cached;
+    }
+
+    entry = new_track;
+
+    if(_tracks.size() >= _cleanup_size)
+        remove_unused();
+
+    return new_track;
+}
+
+/**
+ * Get the number of tracks in the cache (including any that are no longer
+ * used, but haven't been cleaned out yet).
+ *
+ * @return The number of tracks.
+ */
+size_t TrackCache::GetNumTracks()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _tracks.size();
+}
+
+/**
+ * Check that a cached track was encoded from the given image data.
+ *
+ * @param track The cached track.
+ * @param source The image data.
+ * @param size Size of the image data in bytes.
+ *
+ * @return True if the track was encoded from the image data, false otherwise.
+ */
+bool TrackCache::matches(const Track &track,
+                         const uint8_t *source,
+                         uint32_t size)
+{
+    const std::vector<uint8_t> &expected = (track.source.empty()) ?
+                                           track.data : track.source;
+
+    return expected.size() == size &&
+           std::memcmp(expected.data(), source, size) == 0;
+}
+
+/**
+ * Remove every track that no drive is using anymore. The cache is allowed to
+ * grow to twice its size before this happens again, so cleaning up costs a
+ * constant amount per track added.
+ *
+ * @note The mutex must already be locked.
+ */
+void TrackCache::remove_unused()
+{
+    for(auto entry = _tracks.begin(); entry != _tracks.end();)
+    {
+        if(entry->second.expired())
+            entry = _tracks.erase(entry);
+        else
+            ++entry;
+    }
+
+    _cleanup_size = _tracks.size() * 2;
+
+    if(_cleanup_size < MIN_CLEANUP_SIZE)
+        _cleanup_size = MIN_CLEANUP_SIZE;
+}
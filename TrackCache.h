@@ -0,0 +1,106 @@
+#ifndef TRACKCACHE_H
+#define TRACKCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A process-wide cache of encoded disk tracks, looked up by the contents of
+ * the image data they were encoded from. Every drive that loads the same
+ * image shares one (read only) copy of each track.
+ */
+class TrackCache
+{
+public:
+    /**
+     * An encoded track. Tracks in the cache are never modified; a drive that
+     * writes to one makes its own copy first.
+     */
+    struct Track
+    {
+        /**
+         * The bits on the track, packed eight to a byte.
+         */
+        std::vector<uint8_t> data;
+
+        /**
+         * The image data the track was encoded from. Left empty when the
+         * image data is the same as the track (nothing had to be encoded).
+         */
+        std::vector<uint8_t> source;
+    };
+
+    using TrackPtr = std::shared_ptr<const Track>;
+
+    /**
+     * Identifies the image data a track is encoded from, and how it was
+     * encoded (the same data can encode differently, e.g., on another track).
+     */
+    struct Key
+    {
+        uint64_t hash;
+        uint32_t size;
+        uint32_t variant;
+
+        bool operator==(const Key &rhs) const;
+    };
+
+public:
+    static TrackCache& Shared();
+
+    TrackCache();
+
+    TrackCache(const TrackCache &copy) = delete;
+    TrackCache& operator=(const TrackCache &rhs) = delete;
+
+    static Key MakeKey(const uint8_t *source, uint32_t size, uint32_t variant);
+
+    TrackPtr Find(const Key &key, const uint8_t *source);
+    TrackPtr Insert(const Key &key, const uint8_t *source, Track *track);
+
+    size_t GetNumTracks();
+
+private:
+    static bool matches(const Track &track,
+                        const uint8_t *source,
+                        uint32_t size);
+
+    void remove_unused();
+
+private:
+    /**
+     * Hashes a key (the key already holds a hash of the image data).
+     */
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    /**
+     * The fewest entries the cache holds before unused ones get cleaned out.
+     */
+    static constexpr size_t MIN_CLEANUP_SIZE = 64;
+
+    /**
+     * Every cached track. The cache doesn't keep tracks alive on its own: a
+     * track is freed as soon as the last drive using it lets go of it.
+     */
+    std::unordered_map<Key, std::weak_ptr<const Track>, KeyHash> _tracks;
+
+    /**
+     * The number of entries that triggers the next cleanup of tracks that are
+     * no longer in use.
+     */
+    size_t _cleanup_size;
+
+    /**
+     * Protects all of the above, since emulators can run on any thread.
+     */
+    std::mutex _mutex;
+};
+
+#endif // TRACKCACHE_H
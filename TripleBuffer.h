@@ -0,0 +1,116 @@
+/**
+ * Lock-free triple buffer used to hand data from a single producer thread to a
+ * single consumer thread without either side ever waiting on the other.
+ *
+ * Three copies of the data exist at all times. The producer owns the "back"
+ * buffer, the consumer owns the "front" buffer, and the "middle" buffer holds
+ * the most recently published data. Publishing and acquiring are both a single
+ * atomic exchange with the middle buffer, so the producer can keep publishing
+ * at full speed even if the consumer falls behind (older data is simply
+ * dropped).
+ */
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    /**
+     * Constructor.
+     */
+    TripleBuffer() :
+        _buffers(),
+        _back(0),
+        _middle(1),
+        _front(2)
+    { }
+
+    TripleBuffer(const TripleBuffer &copy) = delete;
+    TripleBuffer& operator=(const TripleBuffer &rhs) = delete;
+
+    /**
+     * Producer side: the buffer that should be filled in before the next call
+     * to Publish().
+     *
+     * @return The producer's buffer.
+     */
+    T& GetBackBuffer()
+    {
+        return _buffers[_back];
+    }
+
+    /**
+     * Producer side: make the back buffer available to the consumer and take
+     * ownership of a new back buffer.
+     */
+    void Publish()
+    {
+        _back = _middle.exchange(_back | NEW_DATA, std::memory_order_acq_rel) &
+                INDEX_MASK;
+    }
+
+    /**
+     * Consumer side: swap in the most recently published buffer (if one was
+     * published since the last call).
+     *
+     * @return True if the front buffer now contains new data.
+     */
+    bool Acquire()
+    {
+        if(!(_middle.load(std::memory_order_relaxed) & NEW_DATA))
+            return false;
+
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) &
+                 INDEX_MASK;
+
+        return true;
+    }
+
+    /**
+     * Consumer side: the buffer last swapped in by Acquire().
+     *
+     * @return The consumer's buffer.
+     */
+    const T& GetFrontBuffer() const
+    {
+        return _buffers[_front];
+    }
+
+private:
+    /**
+     * Set on the middle index whenever the producer has published a buffer
+     * that the consumer hasn't picked up yet.
+     */
+    static constexpr uint8_t NEW_DATA = 0x4;
+
+    /**
+     * Masks off the buffer index from the middle index.
+     */
+    static constexpr uint8_t INDEX_MASK = 0x3;
+
+    /**
+     * The three buffers being rotated between the producer and consumer.
+     */
+    T _buffers[3];
+
+    /**
+     * Index of the buffer owned by the producer.
+     */
+    uint8_t _back;
+
+    /**
+     * Index of the most recently published buffer (plus the NEW_DATA flag).
+     */
+    std::atomic<uint8_t> _middle;
+
+    /**
+     * Index of the buffer owned by the consumer.
+     */
+    uint8_t _front;
+};
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,425 @@
+/**
+ * Emulates the ports and timers of a MOS 6522 VIA.
+ *
+ * Both timers count down once per CPU cycle. Timer 1 raises an interrupt when
+ * it underflows and, in free-running mode, reloads itself from its latch
+ * (giving a period of latch + 2 cycles). Timer 2 is always one-shot.
+ *
+ * Rather than stepping the counters on every cycle, they're advanced by the
+ * number of cycles that passed whenever the VIA is touched, and
+ * GetNextInterrupt() tells the owner exactly which cycle the next timer
+ * interrupt will happen on so it can be scheduled with the CPU.
+ */
+#include "Via6522.h"
+
+/**
+ * Constructor.
+ */
+Via6522::Via6522() :
+    _orb(0),
+    _ora(0),
+    _ddrb(0),
+    _ddra(0),
+    _port_a_input(0xFF),
+    _t1_latch(0xFFFF),
+    _t1_counter(0xFFFF),
+    _t1_armed(false),
+    _t1_reloading(false),
+    _t2_latch_low(0xFF),
+    _t2_counter(0xFFFF),
+    _t2_armed(false),
+    _sr(0),
+    _acr(0),
+    _pcr(0),
+    _ifr(0),
+    _ier(0),
+    _last_cycle(0)
+{ }
+
+/**
+ * Reset the VIA. The timers stop interrupting and every register that a reset
+ * affects is cleared.
+ *
+ * @param cycle The current CPU cycle (the CPU's cycle count may have been
+ *              reset as well, so the timers restart counting from here).
+ */
+void Via6522::Reset(uint32_t cycle)
+{
+    _last_cycle = cycle;
+
+    _orb = 0;
+    _ora = 0;
+    _ddrb = 0;
+    _ddra = 0;
+    _port_a_input = 0xFF;
+    _t1_armed = false;
+    _t1_reloading = false;
+    _t2_armed = false;
+    _sr = 0;
+    _acr = 0;
+    _pcr = 0;
+    _ifr = 0;
+    _ier = 0;
+}
+
+/**
+ * Advance the timers to the given cycle.
+ *
+ * @param cycle The current CPU cycle.
+ */
+void Via6522::Update(uint32_t cycle)
+{
+    const uint32_t elapsed = cycle - _last_cycle;
+    _last_cycle = cycle;
+
+    if(elapsed == 0)
+        return;
+
+    /**
+     * Timer 1.
+     */
+    if(_acr & ACR_T1_CONTINUOUS)
+    {
+        /**
+         * After underflowing, the counter shows 0xFFFF for one cycle and then
+         * counts down from the latch again.
+         */
+        const uint32_t period = _t1_latch + 2;
+        const uint32_t until = (_t1_reloading) ? period : _t1_counter + 1;
+
+        if(elapsed < until)
+        {
+            if(_t1_reloading)
+                _t1_counter = static_cast<uint16_t>(_t1_latch - (elapsed - 1));
+            else
+                _t1_counter -= elapsed;
+
+            _t1_reloading = false;
+        }
+        else
+        {
+            const uint32_t phase = (elapsed - until) % period;
+
+            _t1_reloading = (phase == 0);
+            _t1_counter = (_t1_reloading) ? 0xFFFF :
+                    static_cast<uint16_t>(_t1_latch - (phase - 1));
+
+            _ifr |= IRQ_T1;
+        }
+    }
+    else
+    {
+        /**
+         * A one-shot timer keeps counting down past zero, but only
+         * interrupts the first time.
+         */
+        if(elapsed > _t1_counter && _t1_armed)
+        {
+            _ifr |= IRQ_T1;
+            _t1_armed = false;
+        }
+
+        _t1_counter = static_cast<uint16_t>(_t1_counter - elapsed);
+        _t1_reloading = false;
+    }
+
+    /**
+     * Timer 2 (one-shot mode only).
+     */
+    if(elapsed > _t2_counter && _t2_armed)
+    {
+        _ifr |= IRQ_T2;
+        _t2_armed = false;
+    }
+
+    _t2_counter = static_cast<uint16_t>(_t2_counter - elapsed);
+}
+
+/**
+ * Read a register.
+ *
+ * @param reg The register to read (0x0 to 0xF).
+ * @param cycle The current CPU cycle.
+ * @param no_side_fx True if this read shouldn't clear any interrupt flags
+ *                   (used by the memory view and disassembly).
+ *
+ * @return The register's value.
+ */
+uint8_t Via6522::Read(uint8_t reg, uint32_t cycle, bool no_side_fx)
+{
+    if(!no_side_fx)
+        Update(cycle);
+
+    switch(reg & 0xF)
+    {
+    case REG_ORB:
+        return (_orb & _ddrb) | ~_ddrb;
+
+    case REG_ORA:
+    case REG_ORA_NH:
+        return (_ora & _ddra) | (_port_a_input & ~_ddra);
+
+    case REG_DDRB:
+        return _ddrb;
+
+    case REG_DDRA:
+        return _ddra;
+
+    case REG_T1C_L:
+        if(!no_side_fx)
+            _ifr &= ~IRQ_T1;
+
+        return _t1_counter & 0xFF;
+
+    case REG_T1C_H:
+        return _t1_counter >> 8;
+
+    case REG_T1L_L:
+        return _t1_latch & 0xFF;
+
+    case REG_T1L_H:
+        return _t1_latch >> 8;
+
+    case REG_T2C_L:
+        if(!no_side_fx)
+            _ifr &= ~IRQ_T2;
+
+        return _t2_counter & 0xFF;
+
+    case REG_T2C_H:
+        return _t2_counter >> 8;
+
+    case REG_SR:
+        return _sr;
+
+    case REG_ACR:
+        return _acr;
+
+    case REG_PCR:
+        return _pcr;
+
+    case REG_IFR:
+        return _ifr | ((GetIrq()) ? IRQ_ANY : 0);
+
+    case REG_IER:
+        return _ier | IRQ_ANY;
+    }
+
+    return 0;
+}
+
+/**
+ * Write a register.
+ *
+ * @param reg The register to write (0x0 to 0xF).
+ * @param data The value to write.
+ * @param cycle The current CPU cycle.
+ */
+void Via6522::Write(uint8_t reg, uint8_t data, uint32_t cycle)
+{
+    Update(cycle);
+
+    switch(reg & 0xF)
+    {
+    case REG_ORB:
+        _orb = data;
+        break;
+
+    case REG_ORA:
+    case REG_ORA_NH:
+        _ora = data;
+        break;
+
+    case REG_DDRB:
+        _ddrb = data;
+        break;
+
+    case REG_DDRA:
+        _ddra = data;
+        break;
+
+    case REG_T1C_L:
+    case REG_T1L_L:
+        _t1_latch = (_t1_latch & 0xFF00) | data;
+        break;
+
+    case REG_T1C_H:
+        _t1_latch = (_t1_latch & 0x00FF) | (data << 8);
+        _t1_counter = _t1_latch;
+        _t1_armed = true;
+        _t1_reloading = false;
+        _ifr &= ~IRQ_T1;
+        break;
+
+    case REG_T1L_H:
+        _t1_latch = (_t1_latch & 0x00FF) | (data << 8);
+        _ifr &= ~IRQ_T1;
+        break;
+
+    case REG_T2C_L:
+        _t2_latch_low = data;
+        break;
+
+    case REG_T2C_H:
+        _t2_counter = (data << 8) | _t2_latch_low;
+        _t2_armed = true;
+        _ifr &= ~IRQ_T2;
+        break;
+
+    case REG_SR:
+        _sr = data;
+        break;
+
+    case REG_ACR:
+        _acr = data;
+        break;
+
+    case REG_PCR:
+        _pcr = data;
+        break;
+
+    case REG_IFR:
+        _ifr &= ~(data & 0x7F);
+        break;
+
+    case REG_IER:
+        if(data & 0x80)
+            _ier |= data & 0x7F;
+        else
+            _ier &= ~(data & 0x7F);
+        break;
+    }
+}
+
+/**
+ * Check whether the VIA is asserting its IRQ output.
+ *
+ * @return True if an enabled interrupt is pending.
+ */
+bool Via6522::GetIrq() const
+{
+    return (_ifr & _ier & 0x7F) != 0;
+}
+
+/**
+ * Get the cycle that the next enabled timer interrupt will happen on, based on
+ * the state as of the last update.
+ *
+ * @param cycle Set to the cycle of the next interrupt.
+ *
+ * @return True if a timer interrupt is coming, false if none will happen.
+ */
+bool Via6522::GetNextInterrupt(uint32_t &cycle) const
+{
+    bool found = false;
+    uint32_t cycles_left = 0;
+
+    if((_ier & IRQ_T1) && (_acr & ACR_T1_CONTINUOUS))
+    {
+        cycles_left = (_t1_reloading) ? _t1_latch + 2 : _t1_counter + 1;
+        found = true;
+    }
+    else if((_ier & IRQ_T1) && _t1_armed)
+    {
+        cycles_left = _t1_counter + 1;
+        found = true;
+    }
+
+    if((_ier & IRQ_T2) && _t2_armed)
+    {
+        const uint32_t t2_left = _t2_counter + 1;
+
+        if(!found || t2_left < cycles_left)
+            cycles_left = t2_left;
+
+        found = true;
+    }
+
+    cycle = _last_cycle + cycles_left;
+
+    return found;
+}
+
+/**
+ * Get the value on port A's pins (inputs read as high).
+ *
+ * @return The port A output.
+ */
+uint8_t Via6522::GetPortA() const
+{
+    return (_ora & _ddra) | ~_ddra;
+}
+
+/**
+ * Get the value on port B's pins (inputs read as high).
+ *
+ * @return The port B output.
+ */
+uint8_t Via6522::GetPortB() const
+{
+    return (_orb & _ddrb) | ~_ddrb;
+}
+
+/**
+ * Set the value the attached device is driving onto port A.
+ *
+ * @param data The value on port A's input pins.
+ */
+void Via6522::SetPortAInput(uint8_t data)
+{
+    _port_a_input = data;
+}
+
+/**
+ * Save the VIA state.
+ *
+ * @param output Where to write the state.
+ */
+void Via6522::SaveState(StateWriter &output)
+{
+    output.Write(&_orb, sizeof(_orb));
+    output.Write(&_ora, sizeof(_ora));
+    output.Write(&_ddrb, sizeof(_ddrb));
+    output.Write(&_ddra, sizeof(_ddra));
+    output.Write(&_port_a_input, sizeof(_port_a_input));
+    output.Write(&_t1_latch, sizeof(_t1_latch));
+    output.Write(&_t1_counter, sizeof(_t1_counter));
+    output.Write(&_t1_armed, sizeof(_t1_armed));
+    output.Write(&_t1_reloading, sizeof(_t1_reloading));
+    output.Write(&_t2_latch_low, sizeof(_t2_latch_low));
+    output.Write(&_t2_counter, sizeof(_t2_counter));
+    output.Write(&_t2_armed, sizeof(_t2_armed));
+    output.Write(&_sr, sizeof(_sr));
+    output.Write(&_acr, sizeof(_acr));
+    output.Write(&_pcr, sizeof(_pcr));
+    output.Write(&_ifr, sizeof(_ifr));
+    output.Write(&_ier, sizeof(_ier));
+    output.Write(&_last_cycle, sizeof(_last_cycle));
+}
+
+/**
+ * Load the VIA state.
+ *
+ * @param input Where to read the state from.
+ */
+void Via6522::LoadState(StateReader &input)
+{
+    input.Read(&_orb, sizeof(_orb));
+    input.Read(&_ora, sizeof(_ora));
+    input.Read(&_ddrb, sizeof(_ddrb));
+    input.Read(&_ddra, sizeof(_ddra));
+    input.Read(&_port_a_input, sizeof(_port_a_input));
+    input.Read(&_t1_latch, sizeof(_t1_latch));
+    input.Read(&_t1_counter, sizeof(_t1_counter));
+    input.Read(&_t1_armed, sizeof(_t1_armed));
+    input.Read(&_t1_reloading, sizeof(_t1_reloading));
+    input.Read(&_t2_latch_low, sizeof(_t2_latch_low));
+    input.Read(&_t2_counter, sizeof(_t2_counter));
+    input.Read(&_t2_armed, sizeof(_t2_armed));
+    input.Read(&_sr, sizeof(_sr));
+    input.Read(&_acr, sizeof(_acr));
+    input.Read(&_pcr, sizeof(_pcr));
+    input.Read(&_ifr, sizeof(_ifr));
+    input.Read(&_ier, sizeof(_ier));
+    input.Read(&_last_cycle, sizeof(_last_cycle));
+}
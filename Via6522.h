@@ -0,0 +1,135 @@
+#ifndef VIA6522_H
+#define VIA6522_H
+
+#include "IState.h"
+
+#include <cstdint>
+
+/**
+ * MOS 6522 Versatile Interface Adapter.
+ *
+ * Only the parts used by sound cards are emulated: the two 8-bit ports and the
+ * two interval timers (along with their interrupt flags). The timers aren't
+ * stepped every cycle; their state is calculated from the number of cycles
+ * that passed whenever the VIA is accessed.
+ */
+class Via6522 : public IState
+{
+public:
+    /**
+     * Register offsets.
+     */
+    enum Register {
+        REG_ORB = 0x0,
+        REG_ORA = 0x1,
+        REG_DDRB = 0x2,
+        REG_DDRA = 0x3,
+        REG_T1C_L = 0x4,
+        REG_T1C_H = 0x5,
+        REG_T1L_L = 0x6,
+        REG_T1L_H = 0x7,
+        REG_T2C_L = 0x8,
+        REG_T2C_H = 0x9,
+        REG_SR = 0xA,
+        REG_ACR = 0xB,
+        REG_PCR = 0xC,
+        REG_IFR = 0xD,
+        REG_IER = 0xE,
+        REG_ORA_NH = 0xF
+    };
+
+public:
+    Via6522();
+
+    void Reset(uint32_t cycle);
+
+    void Update(uint32_t cycle);
+
+    uint8_t Read(uint8_t reg, uint32_t cycle, bool no_side_fx = false);
+    void Write(uint8_t reg, uint8_t data, uint32_t cycle);
+
+    bool GetIrq() const;
+    bool GetNextInterrupt(uint32_t &cycle) const;
+
+    uint8_t GetPortA() const;
+    uint8_t GetPortB() const;
+    void SetPortAInput(uint8_t data);
+
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
+
+private:
+    /**
+     * Interrupt flag bits.
+     */
+    static constexpr uint8_t IRQ_T2 = 0x20;
+    static constexpr uint8_t IRQ_T1 = 0x40;
+    static constexpr uint8_t IRQ_ANY = 0x80;
+
+    /**
+     * Auxiliary control register bit that puts timer 1 in free-running mode.
+     */
+    static constexpr uint8_t ACR_T1_CONTINUOUS = 0x40;
+
+    /**
+     * Output registers and data direction registers (a set bit is an output).
+     */
+    uint8_t _orb;
+    uint8_t _ora;
+    uint8_t _ddrb;
+    uint8_t _ddra;
+
+    /**
+     * The value driven onto port A's input pins by the attached device.
+     */
+    uint8_t _port_a_input;
+
+    /**
+     * Timer 1 latch and counter.
+     */
+    uint16_t _t1_latch;
+    uint16_t _t1_counter;
+
+    /**
+     * True if timer 1 will raise an interrupt when it next underflows (a
+     * one-shot timer only interrupts once per write).
+     */
+    bool _t1_armed;
+
+    /**
+     * True during the cycle after a free-running timer 1 underflows, when the
+     * counter reads 0xFFFF but reloads from the latch on the next cycle.
+     */
+    bool _t1_reloading;
+
+    /**
+     * Timer 2 low-order latch and counter.
+     */
+    uint8_t _t2_latch_low;
+    uint16_t _t2_counter;
+
+    /**
+     * True if timer 2 will raise an interrupt when it next underflows.
+     */
+    bool _t2_armed;
+
+    /**
+     * Shift, auxiliary control and peripheral control registers.
+     */
+    uint8_t _sr;
+    uint8_t _acr;
+    uint8_t _pcr;
+
+    /**
+     * Interrupt flag and interrupt enable registers (bit 7 isn't stored).
+     */
+    uint8_t _ifr;
+    uint8_t _ier;
+
+    /**
+     * The CPU cycle that the timer counters were last updated at.
+     */
+    uint32_t _last_cycle;
+};
+
+#endif // VIA6522_H
@@ -1,22 +1,34 @@
 /**
  * Represents the Video generator module in the Apple II.
+ *
+ * The emulation thread only renders video memory into a framebuffer at the end
+ * of every frame (see Render()). Each pixel in the framebuffer is a single
+ * byte index into the palette. When NTSC artifact colors are enabled, the
+ * framebuffer holds the raw video signal instead.
+ *
+ * Finished frames are handed over through a lock-free triple buffer to a
+ * separate render thread, which converts them to RGBA directly into the
+ * presenter's surface and tells the presenter to display them. That way a slow
+ * display can never stall the emulation; at worst, frames get dropped.
  */
 #include "character_rom.h"
 #include "Video.h"
 
+#include <chrono>
+#include <cstring>
+
 #include <SFML/System/Clock.hpp>
-#include <SFML/Graphics.hpp>
 #include <SFML/System/Time.hpp>
-#include <SFML/Window.hpp>
+
+constexpr int Video::RENDER_WAIT_TIMEOUT;
 
 /**
  * Constructor.
  *
  * @param mem A reference to main memory where the graphics data is stored.
  *            This memory is assumed to be 48K in size.
- * @param parent Parent of this widget.
  */
-Video::Video(Memory &mem, QWidget*) :
+Video::Video(Memory &mem) :
     IMemoryMapped(VIDEO_START_ADDR, VIDEO_END_ADDR),
     _main_mem(mem),
     _use_graphics(false),
@@ -25,31 +37,40 @@ Video::Video(Memory &mem, QWidget*) :
     _use_lo_res(true),
     _flash_timer(),
     _flash_invert(false),
-    _initialized(false),
-    _pixels(),
-    _texture(),
-    _sprite(_texture)
+    _frames(),
+    _pixels(nullptr),
+    _signal(nullptr),
+    _ntsc_frame(false),
+    _ntsc_enabled(false),
+    _palette(),
+    _ntsc(_palette),
+    _workers(),
+    _presenter(nullptr),
+    _presenter_mutex(),
+    _post(),
+    _post_settings(PostProcessor::GetDefaultSettings()),
+    _rgba(),
+    _render_time(0),
+    _render_latency(0),
+    _running(true),
+    _render_mutex(),
+    _render_wakeup(),
+    _render_thread(),
+    _text_color(_palette.GetColor(COLOR_TEXT))
 {
-    /**
-     * Setup some states to allow direct rendering into the widget.
-     */
-    setAttribute(Qt::WA_PaintOnScreen);
-    setAttribute(Qt::WA_OpaquePaintEvent);
-    setAttribute(Qt::WA_NoSystemBackground);
+    _render_thread = std::thread(&Video::render_thread, this);
+}
 
-    /**
-     * This widget doesn't get focus (keyboard events are handled by the
-     * MainWindow).
-     */
-    setFocusPolicy(Qt::NoFocus);
+/**
+ * Destructor. Stops the render thread.
+ */
+Video::~Video()
+{
+    _running = false;
+    _render_wakeup.notify_one();
 
-    /**
-      * Setup the texture/sprite to draw the framebuffer on. The texture
-      * contains the raw pixel array while the sprite is an SFML drawable
-      * entity that gets rendered to the screen.
-      */
-    _texture.create(VIDEO_WIDTH, VIDEO_HEIGHT);
-    _sprite.setTexture(_texture, true);
+    if(_render_thread.joinable())
+        _render_thread.join();
 }
 
 /**
@@ -63,6 +84,92 @@ void Video::Reset()
     _use_lo_res = true;
 }
 
+/**
+ * Render the current contents of video memory into a new frame and hand it off
+ * to the render thread. This should be called by the emulation thread at the
+ * end of every frame.
+ *
+ * This never waits on the render thread. If the render thread hasn't picked
+ * up the previous frame yet, that frame gets replaced with this one.
+ */
+void Video::Render()
+{
+    VideoFrame &frame = _frames.GetBackBuffer();
+
+    frame.ntsc = _ntsc_enabled && _use_graphics;
+
+    _pixels = frame.pixels;
+    _signal = frame.signal;
+    _ntsc_frame = frame.ntsc;
+
+    if(_ntsc_frame)
+        std::memset(frame.signal, 0, sizeof(frame.signal));
+
+    render();
+
+    frame.published = std::chrono::steady_clock::now();
+    _frames.Publish();
+
+    _render_wakeup.notify_one();
+}
+
+/**
+ * Set where finished frames get displayed.
+ *
+ * This waits for the render thread to finish with the old presenter, so once
+ * this returns the old presenter can safely be destroyed.
+ *
+ * @param presenter The new presenter, or nullptr to stop displaying frames.
+ */
+void Video::SetPresenter(IPresenter *presenter)
+{
+    std::lock_guard<std::mutex> lock(_presenter_mutex);
+    _presenter = presenter;
+}
+
+/**
+ * Get the current post-processing settings.
+ *
+ * @return The post-processing settings.
+ */
+PostProcessSettings Video::GetPostProcess()
+{
+    std::lock_guard<std::mutex> lock(_presenter_mutex);
+    return _post_settings;
+}
+
+/**
+ * Change the post-processing settings. These take effect on the next frame.
+ *
+ * @param settings The new post-processing settings.
+ */
+void Video::SetPostProcess(const PostProcessSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(_presenter_mutex);
+    _post_settings = settings;
+}
+
+/**
+ * Get the average time it takes the render thread to convert a frame.
+ *
+ * @return The average render time in microseconds.
+ */
+uint32_t Video::GetRenderTime() const
+{
+    return _render_time;
+}
+
+/**
+ * Get the average time between a frame being finished by the emulation thread
+ * and it being handed to the presenter.
+ *
+ * @return The average render latency in microseconds.
+ */
+uint32_t Video::GetRenderLatency() const
+{
+    return _render_latency;
+}
+
 /**
  * Get the text color.
  *
@@ -88,6 +195,27 @@ void Video::SetTextColor(int red, int green, int blue)
                   (red & 0xFF);
 }
 
+/**
+ * Get whether NTSC artifact colors are enabled.
+ *
+ * @return True if NTSC artifact colors are enabled.
+ */
+bool Video::GetNtsc() const
+{
+    return _ntsc_enabled;
+}
+
+/**
+ * Enable or disable NTSC artifact colors. This takes effect on the next frame.
+ *
+ * @param enabled True to enable NTSC artifact colors, false to use the
+ *                standard palette.
+ */
+void Video::SetNtsc(bool enabled)
+{
+    _ntsc_enabled = enabled;
+}
+
 /**
  * Toggle a soft-switch through a read operation.
  *
@@ -130,103 +258,148 @@ void Video::Write(uint16_t addr, uint8_t)
 }
 
 /**
- * Save the Video state out to a file.
+ * Save the Video state.
  *
- * @param output The file to write to.
+ * @param output Where to write the state.
  */
-void Video::SaveState(std::ofstream &output)
+void Video::SaveState(StateWriter &output)
 {
-    output.write(reinterpret_cast<char*>(&_use_graphics),
-                 sizeof(_use_graphics));
+    output.Write(&_use_graphics, sizeof(_use_graphics));
 
-    output.write(reinterpret_cast<char*>(&_use_full_screen),
-                 sizeof(_use_full_screen));
+    output.Write(&_use_full_screen, sizeof(_use_full_screen));
 
-    output.write(reinterpret_cast<char*>(&_use_page1), sizeof(_use_page1));
+    output.Write(&_use_page1, sizeof(_use_page1));
 
-    output.write(reinterpret_cast<char*>(&_use_lo_res), sizeof(_use_lo_res));
+    output.Write(&_use_lo_res, sizeof(_use_lo_res));
 }
 
 /**
- * Load the Video state out of a file.
+ * Load the Video state.
  *
- * @param input The file to read from.
+ * @param input Where to read the state from.
  */
-void Video::LoadState(std::ifstream &input)
+void Video::LoadState(StateReader &input)
 {
-    input.read(reinterpret_cast<char*>(&_use_graphics),
-                 sizeof(_use_graphics));
+    input.Read(&_use_graphics, sizeof(_use_graphics));
 
-    input.read(reinterpret_cast<char*>(&_use_full_screen),
-                 sizeof(_use_full_screen));
+    input.Read(&_use_full_screen, sizeof(_use_full_screen));
 
-    input.read(reinterpret_cast<char*>(&_use_page1), sizeof(_use_page1));
+    input.Read(&_use_page1, sizeof(_use_page1));
 
-    input.read(reinterpret_cast<char*>(&_use_lo_res), sizeof(_use_lo_res));
+    input.Read(&_use_lo_res, sizeof(_use_lo_res));
 }
 
 
 /**
- * A showEvent is triggered just display a QWidget is displayed.
+ * Main loop of the render thread. Waits for the emulation thread to publish a
+ * frame and then presents it.
+ *
+ * The emulation thread wakes this thread up without taking the mutex (so it
+ * can never block on it). A wake-up that races with this thread going to sleep
+ * could be missed, so the wait is bounded by RENDER_WAIT_TIMEOUT.
  */
-void Video::showEvent(QShowEvent*)
+void Video::render_thread()
 {
-    if (!_initialized)
+    std::unique_lock<std::mutex> lock(_render_mutex);
+
+    while(_running)
     {
-        /**
-         * Create the SFML window with the widget handle and set it render at
-         * the correct Apple II resolution (280 by 192).
-         */
-        sf::RenderWindow::create((sf::WindowHandle) winId());
-        setView(sf::View(sf::FloatRect(0, 0, VIDEO_WIDTH, VIDEO_HEIGHT)));
+        _render_wakeup.wait_for(lock,
+                                std::chrono::milliseconds(RENDER_WAIT_TIMEOUT));
 
-        _initialized = true;
+        if(_frames.Acquire())
+            present();
     }
 }
 
 /**
- * Returns null since SFML handles drawing to the screen.
+ * Convert the most recent frame to RGBA and display it.
  *
- * @return Null since no paint engine is implemented.
+ * Without post-processing the frame is converted straight into the presenter's
+ * surface. Otherwise it's converted into a staging buffer first, and the
+ * post-processed image is written into the presenter's surface.
  */
-QPaintEngine* Video::paintEngine() const
+void Video::present()
 {
-    return 0;
-}
+    using namespace std::chrono;
 
-/**
- * Gets called every time the screen needs to be redrawn or whenever repaint()
- * is called.
- */
-void Video::paintEvent(QPaintEvent*)
-{
-    clear();
+    std::lock_guard<std::mutex> lock(_presenter_mutex);
 
-    render();
+    if(_presenter == nullptr)
+        return;
 
-    _texture.update(_pixels);
+    const VideoFrame &frame = _frames.GetFrontBuffer();
+    const steady_clock::time_point start = steady_clock::now();
 
-    draw(_sprite);
+    int target_width = 0;
+    int target_height = 0;
+    _presenter->GetTargetSize(target_width, target_height);
 
-    display();
-}
+    int out_width = 0;
+    int out_height = 0;
+    PostProcessor::GetOutputSize(_post_settings,
+                                 VIDEO_WIDTH,
+                                 VIDEO_HEIGHT,
+                                 target_width,
+                                 target_height,
+                                 out_width,
+                                 out_height);
 
-/**
- * Re-create the SFML RenderWindow every time the widget's size changes. This
- * ensures that SFML is drawing everything at the correct dimensions.
- *
- * Since the RenderWindow was just regenerated, it's also necessary to reset
- * the view to display the correct resolution (by default the view is the same
- * size as the window).
- */
-void Video::resizeEvent(QResizeEvent*)
-{
-    sf::RenderWindow::create((sf::WindowHandle) winId());
-    setView(sf::View(sf::FloatRect(0, 0, VIDEO_WIDTH, VIDEO_HEIGHT)));
+    const bool pass_through = PostProcessor::IsPassThrough(_post_settings,
+                                                           VIDEO_WIDTH,
+                                                           VIDEO_HEIGHT,
+                                                           out_width,
+                                                           out_height);
+
+    uint32_t *surface = _presenter->BeginFrame(out_width, out_height);
+    uint32_t *pixels = (pass_through) ? surface : _rgba;
+
+    if(frame.ntsc)
+    {
+        _ntsc.Apply(frame.signal, pixels, VIDEO_HEIGHT, _workers);
+    }
+    else
+    {
+        _palette.SetColor(COLOR_TEXT, _text_color);
+        _palette.Convert(frame.pixels, pixels, VIDEO_WIDTH * VIDEO_HEIGHT);
+    }
+
+    if(pass_through)
+    {
+        _post.ResetHistory();
+    }
+    else
+    {
+        _post.Process(_post_settings,
+                      _rgba,
+                      VIDEO_WIDTH,
+                      VIDEO_HEIGHT,
+                      surface,
+                      out_width,
+                      out_height,
+                      _workers);
+    }
+
+    const steady_clock::time_point end = steady_clock::now();
+
+    _presenter->EndFrame();
+
+    /**
+     * Keep running averages so the reported values don't jump around from
+     * frame to frame.
+     */
+    const int64_t time = duration_cast<microseconds>(end - start).count();
+    const int64_t latency =
+            duration_cast<microseconds>(end - frame.published).count();
+
+    const int64_t average_time = _render_time;
+    const int64_t average_latency = _render_latency;
+    _render_time = average_time + ((time - average_time) / 8);
+    _render_latency = average_latency + ((latency - average_latency) / 8);
 }
 
 /**
- * Redraw the screen.
+ * Render video memory into the current back buffer.
  */
 void Video::render()
 {
@@ -346,10 +519,7 @@ void Video::render_char(uint8_t char_index, int x, int y)
  */
 void Video::set_text_pixel(bool pixel, bool invert, int x, int y)
 {
-    constexpr uint32_t BG_COLOR = 0xFF000000;
-    const uint32_t color = (pixel ^ invert) ? _text_color : BG_COLOR;
-
-    *(uint32_t *)(_pixels + (y * VIDEO_WIDTH * 4) + (x * 4)) = color;
+    set_pixel((pixel ^ invert) ? COLOR_TEXT : COLOR_BLACK, x, y);
 }
 
 /**
@@ -408,39 +578,19 @@ void Video::render_lores()
  */
 void Video::render_lores_block(uint8_t block, int x, int y)
 {
-    static constexpr uint32_t colors[16] = {
-        0xFF000000, /* Black */
-        0xFF601EE3, /* Red */
-        0xFFCB2525, /* Dark Blue */
-        0xFFFD44FF, /* Purple */
-        0xFF60A300, /* Dark Green */
-        0xFF9C9C9C, /* Gray */
-        0xFFFDCF14, /* Medium Blue */
-        0xFFFFC3D0, /* Light Blue */
-        0xFF037260, /* Brown */
-        0xFF3C6AFF, /* Orange */
-        0xFF9C9C9C, /* Gray */
-        0xFFD0A0FF, /* Pink */
-        0xFF3CF514, /* Light Green */
-        0xFF8DDDD0, /* Yellow */
-        0xFFD0FF72, /* Aqua */
-        0xFFFFFFFF  /* White */
-    };
-
-    const int pixel_x = x * 28;
-    const int pixel_y = y * VIDEO_WIDTH * 32;
+    const int pixel_x = x * 7;
+    const int pixel_y = y * 8;
 
     for(int row = 0; row < 8; ++row)
     {
-        const uint32_t color = (row < 4) ? colors[block & 0xF] :
-                                           colors[(block & 0xF0) >> 4];
+        /**
+         * The lo-res nybble values line up with the palette indices.
+         */
+        const VideoColor color = static_cast<VideoColor>(
+                (row < 4) ? (block & 0xF) : ((block & 0xF0) >> 4));
 
         for(int col = 0; col < 7; ++col)
-        {
-            const int row_offset = pixel_y + (row * VIDEO_WIDTH * 4);
-            const int col_offset = pixel_x + (col * 4);
-            *(uint32_t *)(_pixels + row_offset + col_offset) = color;
-        }
+            set_pixel(color, pixel_x + col, pixel_y + row);
     }
 }
 
@@ -492,6 +642,12 @@ void Video::render_hires()
  */
 void Video::render_hires_row(int row_num, uint16_t row_addr)
 {
+    if(_ntsc_frame)
+    {
+        render_hires_signal(row_num, row_addr);
+        return;
+    }
+
     for(int col = 0; col < 40; ++col)
     {
         uint8_t prev_data = (col > 0) ? _main_mem.Read(row_addr + col - 1) : 0;
@@ -527,6 +683,40 @@ void Video::render_hires_row(int row_num, uint16_t row_addr)
     }
 }
 
+/**
+ * Render an entire row of hi-res pixels as a video signal.
+ *
+ * Every bit in a hi-res byte is output as two dots. If the high bit of the byte
+ * is set, the whole byte is delayed by one dot, and the last dot of the
+ * previous byte is held for that extra dot. This delay is what shifts the
+ * artifact colors from purple/green to blue/orange.
+ *
+ * @param row_num Index of the row to render.
+ * @param row_addr Address where this row's contents are in memory.
+ */
+void Video::render_hires_signal(int row_num, uint16_t row_addr)
+{
+    uint8_t *line = _signal + (row_num * NtscFilter::LINE_STRIDE);
+    bool last_dot = false;
+
+    for(int col = 0; col < 40; ++col)
+    {
+        const uint8_t data = _main_mem.Read(row_addr + col);
+        int dot = col * 14;
+
+        if(data & 0x80)
+            NtscFilter::SetDot(line, dot++, last_dot);
+
+        for(int pixel = 0; pixel < 7; ++pixel)
+        {
+            last_dot = (data >> pixel) & 1;
+
+            for(int i = 0; i < 2 && dot < NtscFilter::DOTS_PER_LINE; ++i)
+                NtscFilter::SetDot(line, dot++, last_dot);
+        }
+    }
+}
+
 /**
  * Render a single hi-res pixel.
  *
@@ -543,24 +733,52 @@ void Video::render_hires_pixel(uint8_t color_group,
                         int x,
                         int y)
 {
-    uint32_t color = 0;
+    VideoColor color = COLOR_BLACK;
 
     if(pixel == 0)
-        color = 0xFF000000; /* Black */
+        color = COLOR_BLACK;
     else if(pixel != 0 && adjacent_pixels != 0)
-        color = 0xFFFFFFFF; /* White */
+        color = COLOR_WHITE;
     else if(pixel != 0 && color_group == 0 && (x & 1) == 0)
-        color = 0xFFFD44FF; /* Purple */
+        color = COLOR_PURPLE;
     else if(pixel != 0 && color_group == 0 && (x & 1) == 1)
-        color = 0xFF3CF514; /* Green */
+        color = COLOR_LIGHT_GREEN;
     else if(pixel != 0 && color_group == 1 && (x & 1) == 0)
-        color = 0xFFFDCF14; /* Blue */
+        color = COLOR_MEDIUM_BLUE;
     else if(pixel != 0 && color_group == 1 && (x & 1) == 1)
-        color = 0xFF3C6AFF; /* Orange */
+        color = COLOR_ORANGE;
 
-    const int row_offset = y * VIDEO_WIDTH * 4;
-    const int col_offset = x * 4;
-    *(uint32_t *)(_pixels + row_offset + col_offset) = color;
+    set_pixel(color, x, y);
+}
+
+/**
+ * Sets a single pixel in the framebuffer.
+ *
+ * @param color The palette index of the pixel's color.
+ * @param x X-position of the pixel.
+ * @param y Y-position of the pixel.
+ */
+void Video::set_pixel(VideoColor color, int x, int y)
+{
+    if(_ntsc_frame)
+    {
+        /**
+         * Every pixel is two dots of the video signal. Lo-res colors are
+         * output as their four-bit pattern repeating across the line, and
+         * text is simply on or off.
+         */
+        uint8_t *line = _signal + (y * NtscFilter::LINE_STRIDE);
+
+        for(int dot = x * 2; dot < (x * 2) + 2; ++dot)
+        {
+            const bool on = (color == COLOR_TEXT) || ((color >> (dot & 3)) & 1);
+            NtscFilter::SetDot(line, dot, on);
+        }
+    }
+    else
+    {
+        _pixels[(y * VIDEO_WIDTH) + x] = color;
+    }
 }
 
 /**
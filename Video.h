@@ -2,52 +2,61 @@
 #define VIDEO_H
 
 #include "IMemoryMapped.h"
+#include "IPresenter.h"
 #include "IState.h"
 #include "Memory.h"
-
+#include "NtscFilter.h"
+#include "Palette.h"
+#include "PostProcessor.h"
+#include "TripleBuffer.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <mutex>
+#include <thread>
 
 #include <SFML/System/Clock.hpp>
-#include <SFML/Graphics.hpp>
-
-#include <QPaintEngine>
-#include <QPaintEvent>
-#include <QResizeEvent>
-#include <QShowEvent>
-#include <QTimer>
-#include <QWidget>
-
-class Video :
-        public QWidget,
-        public sf::RenderWindow,
-        public IMemoryMapped,
-        public IState
-{
-    Q_OBJECT
 
+class Video : public IMemoryMapped, public IState
+{
 public:
-    Video(Memory &mem, QWidget *parent = 0);
+    explicit Video(Memory &mem);
+
+    Video(const Video &copy) = delete;
+    Video& operator=(const Video &rhs) = delete;
 
     void Reset();
 
+    void Render();
+
+    void SetPresenter(IPresenter *presenter);
+
+    uint32_t GetRenderTime() const;
+    uint32_t GetRenderLatency() const;
+
     uint32_t GetTextColor() const;
     void SetTextColor(int red, int green, int blue);
 
-    uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
-    void Write(uint16_t addr, uint8_t) override;
+    bool GetNtsc() const;
+    void SetNtsc(bool enabled);
 
-    void SaveState(std::ofstream &output) override;
-    void LoadState(std::ifstream &input) override;
+    PostProcessSettings GetPostProcess();
+    void SetPostProcess(const PostProcessSettings &settings);
 
-private:
-    virtual void showEvent(QShowEvent*);
+    uint8_t Read(uint16_t addr, bool no_side_fx = false) override;
+    void Write(uint16_t addr, uint8_t) override;
 
-    virtual QPaintEngine* paintEngine() const;
+    void SaveState(StateWriter &output) override;
+    void LoadState(StateReader &input) override;
 
-    virtual void paintEvent(QPaintEvent*);
+    ~Video();
 
-    virtual void resizeEvent(QResizeEvent *);
+private:
+    void render_thread();
+    void present();
 
     void render();
 
@@ -60,12 +69,15 @@ private:
 
     void render_hires();
     void render_hires_row(int row_num, uint16_t row_addr);
+    void render_hires_signal(int row_num, uint16_t row_addr);
     void render_hires_pixel(uint8_t color_group,
                             uint8_t pixel,
                             uint8_t adjacent_pixels,
                             int x,
                             int y);
 
+    void set_pixel(VideoColor color, int x, int y);
+
     void toggle_switch(uint16_t addr);
 
 private:
@@ -81,6 +93,43 @@ private:
     static constexpr int VIDEO_START_ADDR = 0xC050;
     static constexpr int VIDEO_END_ADDR = 0xC057;
 
+    /**
+     * How long the render thread will sleep waiting for a new frame before
+     * checking for work again (in ms). This only bounds how late a frame can
+     * be shown if a wake-up is missed; frames are normally presented as soon
+     * as they're published.
+     */
+    static constexpr int RENDER_WAIT_TIMEOUT = 16;
+
+    /**
+     * A single frame of video output. These get passed from the emulation
+     * thread to the render thread through a triple buffer.
+     */
+    struct VideoFrame
+    {
+        /**
+         * Every byte represents a pixel as an index into the palette (see
+         * VideoColor). Only valid if "ntsc" is false.
+         */
+        uint8_t pixels[VIDEO_HEIGHT * VIDEO_WIDTH];
+
+        /**
+         * The raw video signal for every line (see NtscFilter). Only valid if
+         * "ntsc" is true.
+         */
+        uint8_t signal[VIDEO_HEIGHT * NtscFilter::LINE_STRIDE];
+
+        /**
+         * True if this frame should be displayed with NTSC artifact colors.
+         */
+        bool ntsc;
+
+        /**
+         * When the emulation thread finished rendering this frame.
+         */
+        std::chrono::steady_clock::time_point published;
+    };
+
     /**
      * A reference to main memory where the graphics data is stored.
      */
@@ -119,31 +168,109 @@ private:
     bool _flash_invert;
 
     /**
-     * True if the RenderWindow has been initialized already.
+     * Frames being passed from the emulation thread to the render thread.
+     */
+    TripleBuffer<VideoFrame> _frames;
+
+    /**
+     * The pixels currently being rendered by the emulation thread. This
+     * points into the back buffer of _frames.
+     */
+    uint8_t *_pixels;
+
+    /**
+     * The video signal currently being rendered by the emulation thread. This
+     * points into the back buffer of _frames.
+     */
+    uint8_t *_signal;
+
+    /**
+     * True if the frame currently being rendered is being rendered as a video
+     * signal instead of palette indices.
+     */
+    bool _ntsc_frame;
+
+    /**
+     * True if NTSC artifact colors are enabled.
+     *
+     * Like a real Apple II+, color is turned off completely in full text mode
+     * (the "color killer"), so text-only frames are always rendered with the
+     * palette.
+     */
+    std::atomic<bool> _ntsc_enabled;
+
+    /**
+     * Converts frames into RGBA pixels. This is only touched by the render
+     * thread.
+     */
+    Palette _palette;
+
+    /**
+     * Converts video signal frames into RGBA pixels. This is only touched by
+     * the render thread.
+     */
+    NtscFilter _ntsc;
+
+    /**
+     * Threads used by the render thread to split up frame conversion.
+     */
+    WorkerPool _workers;
+
+    /**
+     * Where finished frames get displayed. The render thread holds
+     * _presenter_mutex for as long as it's using the presenter.
+     */
+    IPresenter *_presenter;
+    std::mutex _presenter_mutex;
+
+    /**
+     * Scaling and CRT effects applied after frames are converted to RGBA.
+     * The settings are protected by _presenter_mutex; the post-processor
+     * itself is only touched by the render thread.
+     */
+    PostProcessor _post;
+    PostProcessSettings _post_settings;
+
+    /**
+     * Converted frames are staged here when post-processing is enabled (the
+     * processed image is what gets written into the presenter's surface).
      */
-    bool _initialized;
+    uint32_t _rgba[VIDEO_HEIGHT * VIDEO_WIDTH];
 
     /**
-     * The pixels that will get drawn to the screen. Every four bytes represents
-     * a pixel in the RGBA format.
+     * Running average of the time the render thread spends converting each
+     * frame (in microseconds).
      */
-    uint8_t _pixels[VIDEO_HEIGHT * VIDEO_WIDTH * 4];
+    std::atomic<uint32_t> _render_time;
 
     /**
-     * The texture that contains the pixels. This cannot be drawn by itself;
-     * this texture needs to be wrapped into a sprite to be drawn.
+     * Running average of the time between the emulation thread publishing a
+     * frame and that frame being handed to the presenter (in microseconds).
      */
-     sf::Texture _texture;
+    std::atomic<uint32_t> _render_latency;
 
-     /**
-      * The drawable entity that will display the array of pixels.
-      */
-     sf::Sprite _sprite;
+    /**
+     * False when the render thread should exit.
+     */
+    std::atomic<bool> _running;
 
-     /**
-      * Color of the text in 32-bit ABGR format;
-      */
-     uint32_t _text_color = 0xFF60A300;
+    /**
+     * Used to wake the render thread up when there's work to do.
+     */
+    std::mutex _render_mutex;
+    std::condition_variable _render_wakeup;
+
+    /**
+     * Converts frames into RGBA pixels and presents them so that the emulation
+     * thread never has to wait on the display.
+     */
+    std::thread _render_thread;
+
+    /**
+     * Color of the text in 32-bit ABGR format. This gets copied into the
+     * palette by the render thread before converting each frame.
+     */
+    std::atomic<uint32_t> _text_color;
 };
 
 #endif // VIDEO_H
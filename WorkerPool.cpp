@@ -0,0 +1,144 @@
+/**
+ * Runs a job across a fixed number of threads, one horizontal band of an image
+ * per thread. The calling thread always runs the first band itself and then
+ * waits for the rest to finish, so Run() only returns once the whole image has
+ * been processed.
+ */
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+constexpr int WorkerPool::MAX_DEFAULT_THREADS;
+
+/**
+ * Constructor.
+ *
+ * @param num_threads Total number of bands to split jobs into (including the
+ *                    calling thread). Zero picks a default based on the
+ *                    number of cores on the host.
+ */
+WorkerPool::WorkerPool(int num_threads) :
+    _job(nullptr),
+    _generation(0),
+    _pending(0),
+    _running(true),
+    _mutex(),
+    _job_ready(),
+    _job_done(),
+    _threads()
+{
+    if(num_threads <= 0)
+    {
+        const int cores = static_cast<int>(std::thread::hardware_concurrency());
+        num_threads = std::max(1, std::min(cores, MAX_DEFAULT_THREADS));
+    }
+
+    for(int band = 1; band < num_threads; ++band)
+        _threads.emplace_back(&WorkerPool::worker, this, band);
+}
+
+/**
+ * Destructor. Stops all of the worker threads.
+ */
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+
+    _job_ready.notify_all();
+
+    for(std::thread &thread : _threads)
+        thread.join();
+}
+
+/**
+ * Get the number of bands that jobs get split into.
+ *
+ * @return The number of bands.
+ */
+int WorkerPool::GetNumBands() const
+{
+    return static_cast<int>(_threads.size()) + 1;
+}
+
+/**
+ * Run a job on every band and wait for all of them to finish.
+ *
+ * @param job The job to run.
+ */
+void WorkerPool::Run(const Job &job)
+{
+    const int num_bands = GetNumBands();
+
+    if(num_bands > 1)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &job;
+        _pending = num_bands - 1;
+        _generation++;
+    }
+
+    _job_ready.notify_all();
+
+    job(0, num_bands);
+
+    if(num_bands > 1)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _job_done.wait(lock, [this] { return _pending == 0; });
+        _job = nullptr;
+    }
+}
+
+/**
+ * Split an image into evenly sized bands of rows.
+ *
+ * @param band The band to retrieve.
+ * @param num_bands Total number of bands.
+ * @param num_rows Number of rows in the image.
+ * @param first_row Set to the first row in the band.
+ * @param end_row Set to one past the last row in the band.
+ */
+void WorkerPool::GetBand(int band,
+                         int num_bands,
+                         int num_rows,
+                         int &first_row,
+                         int &end_row)
+{
+    first_row = (num_rows * band) / num_bands;
+    end_row = (num_rows * (band + 1)) / num_bands;
+}
+
+/**
+ * Main loop of each worker thread.
+ *
+ * @param band The band this worker is responsible for.
+ */
+void WorkerPool::worker(int band)
+{
+    uint32_t last_generation = 0;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while(true)
+    {
+        _job_ready.wait(lock, [&] {
+            return !_running || _generation != last_generation;
+        });
+
+        if(!_running)
+            break;
+
+        last_generation = _generation;
+        const Job *job = _job;
+
+        lock.unlock();
+        (*job)(band, GetNumBands());
+        lock.lock();
+
+        if(--_pending == 0)
+            _job_done.notify_one();
+    }
+}
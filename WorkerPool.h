@@ -0,0 +1,95 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A small fixed pool of threads used to split image processing kernels into
+ * horizontal bands.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * A job gets called once per band with the band index and the total number
+     * of bands.
+     */
+    using Job = std::function<void(int band, int num_bands)>;
+
+public:
+    explicit WorkerPool(int num_threads = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &copy) = delete;
+    WorkerPool& operator=(const WorkerPool &rhs) = delete;
+
+    int GetNumBands() const;
+
+    void Run(const Job &job);
+
+    static void GetBand(int band,
+                        int num_bands,
+                        int num_rows,
+                        int &first_row,
+                        int &end_row);
+
+private:
+    void worker(int band);
+
+private:
+    /**
+     * The maximum number of worker threads to spawn by default. The images
+     * being processed are small, so more threads than this just adds
+     * synchronization overhead.
+     */
+    static constexpr int MAX_DEFAULT_THREADS = 4;
+
+    /**
+     * The job currently being run.
+     */
+    const Job *_job;
+
+    /**
+     * Incremented every time a new job is started so the workers can tell
+     * when they have something to do.
+     */
+    uint32_t _generation;
+
+    /**
+     * Number of workers still running the current job.
+     */
+    int _pending;
+
+    /**
+     * False when the workers should exit.
+     */
+    bool _running;
+
+    /**
+     * Protects all of the above.
+     */
+    std::mutex _mutex;
+
+    /**
+     * Signalled when a new job is started.
+     */
+    std::condition_variable _job_ready;
+
+    /**
+     * Signalled when a worker finishes its band.
+     */
+    std::condition_variable _job_done;
+
+    /**
+     * The worker threads. The thread calling Run() always processes band zero
+     * itself, so there is one less thread than there are bands.
+     */
+    std::vector<std::thread> _threads;
+};
+
+#endif // WORKERPOOL_H
@@ -33,8 +33,18 @@ int main(int argc, char *argv[])
     sf::Clock clock;
     while(window.isVisible())
     {
-        window.SetStatusText(QString("FPS: %1").arg(
-            static_cast<int>(1.0f / clock.getElapsedTime().asSeconds())));
+        window.SetStatusText(QString("FPS: %1  Render: %2us  Latency: %3us  "
+                                     "Audio: %4/%5ms (%6ppm)  Underruns: %7  "
+                                     "Warp Saved: %8s  Rewind (F8): %9s").arg(
+            static_cast<int>(1.0f / clock.getElapsedTime().asSeconds())).arg(
+            emulator.GetVideoRenderTime()).arg(
+            emulator.GetVideoRenderLatency() + window.GetPresentLatency()).arg(
+            emulator.GetAudioBufferFill()).arg(
+            emulator.GetAudioTargetLatency()).arg(
+            emulator.GetAudioRateAdjust()).arg(
+            emulator.GetAudioUnderruns()).arg(
+            emulator.GetDiskWarpTimeSaved() / 1000).arg(
+            emulator.GetRewindFrames() / FPS));
 
         clock.restart();
 
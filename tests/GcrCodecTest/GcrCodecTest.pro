@@ -0,0 +1,18 @@
+QT -= core gui
+
+CONFIG += c++11 warn_on console
+CONFIG -= app_bundle
+OBJECTS_DIR = build
+DESTDIR = build
+
+TARGET = GcrCodecTest
+
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../GcrCodec.cpp
+
+HEADERS += \
+    ../../GcrCodec.h
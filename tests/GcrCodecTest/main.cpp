@@ -0,0 +1,346 @@
+/**
+ * Round trip tests and a microbenchmark for GcrCodec.
+ *
+ * Every value that "4 and 4" can encode, every byte value in a "6 and 2" data
+ * field, and whole tracks in both sector orders are encoded and decoded
+ * again, and damaged data fields have to be rejected. The benchmark then
+ * times encoding and decoding a sector and a whole track.
+ *
+ * Exits with the number of failed tests (zero if everything passed).
+ */
+#include "GcrCodec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+/**
+ * Sector interleaving tables for DOS 3.3 and ProDOS ordered images (the same
+ * as the ones DiskDrive uses).
+ */
+static constexpr uint8_t dos_sector_trans[GcrCodec::NUM_SECTORS] = {
+    0, 13, 11, 9, 7, 5, 3, 1, 14, 12, 10, 8, 6, 4, 2, 15
+};
+
+static constexpr uint8_t prodos_sector_trans[GcrCodec::NUM_SECTORS] = {
+    0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15
+};
+
+/**
+ * Size of a track's worth of sectors.
+ */
+static constexpr int TRACK_SIZE = GcrCodec::NUM_SECTORS *
+                                  GcrCodec::SECTOR_SIZE;
+
+/**
+ * Number of times each operation is run by the benchmark.
+ */
+static constexpr int BENCH_SECTOR_RUNS = 200000;
+static constexpr int BENCH_TRACK_RUNS = 10000;
+
+/**
+ * Number of tests that have failed so far.
+ */
+static int num_failed = 0;
+
+/**
+ * Report the result of a test.
+ *
+ * @param name What was tested.
+ * @param passed True if the test passed.
+ */
+static void check(const char *name, bool passed)
+{
+    std::printf("%-48s %s\n", name, (passed) ? "ok" : "FAILED");
+
+    if(!passed)
+        num_failed++;
+}
+
+/**
+ * Check that a disk byte can be stored on a disk: it has to start with a '1'
+ * and can't have more than two '0's in a row.
+ *
+ * @param byte The disk byte.
+ *
+ * @return True if the disk byte is valid.
+ */
+static bool is_valid_disk_byte(uint8_t byte)
+{
+    if(!(byte & 0x80))
+        return false;
+
+    for(int i = 0; i < 6; ++i)
+    {
+        if(((byte >> i) & 7) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Every byte "4 and 4" encodes into two valid disk bytes and back.
+ */
+static void test_44()
+{
+    bool passed = true;
+
+    for(int value = 0; value < 256; ++value)
+    {
+        uint8_t encoded[2];
+        GcrCodec::Encode44(encoded, value);
+
+        passed = passed && (encoded[0] & 0xAA) == 0xAA &&
+                 (encoded[1] & 0xAA) == 0xAA &&
+                 GcrCodec::Decode44(encoded) == value;
+    }
+
+    check("4 and 4 round trip, every byte value", passed);
+}
+
+/**
+ * A sector filled with each byte value (and a sector holding every byte value
+ * in every position) "6 and 2" encodes into valid disk bytes and back.
+ */
+static void test_62_byte_values()
+{
+    bool passed = true;
+    uint8_t sector[GcrCodec::SECTOR_SIZE];
+    uint8_t decoded[GcrCodec::SECTOR_SIZE];
+    uint8_t encoded[GcrCodec::DATA_FIELD_SIZE];
+
+    for(int value = 0; value < 256; ++value)
+    {
+        std::memset(sector, value, sizeof(sector));
+        GcrCodec::Encode62(encoded, sector);
+
+        for(uint8_t byte : encoded)
+            passed = passed && is_valid_disk_byte(byte);
+
+        passed = passed && GcrCodec::Decode62(encoded, decoded) &&
+                 std::memcmp(sector, decoded, sizeof(sector)) == 0;
+    }
+
+    check("6 and 2 round trip, sector of each byte value", passed);
+
+    passed = true;
+
+    for(int shift = 0; shift < 256; ++shift)
+    {
+        for(int i = 0; i < GcrCodec::SECTOR_SIZE; ++i)
+            sector[i] = (i + shift) & 0xFF;
+
+        GcrCodec::Encode62(encoded, sector);
+
+        passed = passed && GcrCodec::Decode62(encoded, decoded) &&
+                 std::memcmp(sector, decoded, sizeof(sector)) == 0;
+    }
+
+    check("6 and 2 round trip, every byte in every position", passed);
+}
+
+/**
+ * Random sectors round trip, and changing any one disk byte of a data field to
+ * any other value is caught (either as an invalid disk byte or by the
+ * checksum).
+ */
+static void test_62_random()
+{
+    std::mt19937 rng(1);
+    bool passed = true;
+    uint8_t sector[GcrCodec::SECTOR_SIZE];
+    uint8_t decoded[GcrCodec::SECTOR_SIZE];
+    uint8_t encoded[GcrCodec::DATA_FIELD_SIZE];
+
+    for(int run = 0; run < 20000; ++run)
+    {
+        for(uint8_t &byte : sector)
+            byte = rng() & 0xFF;
+
+        GcrCodec::Encode62(encoded, sector);
+
+        passed = passed && GcrCodec::Decode62(encoded, decoded) &&
+                 std::memcmp(sector, decoded, sizeof(sector)) == 0;
+    }
+
+    check("6 and 2 round trip, 20000 random sectors", passed);
+
+    passed = true;
+
+    for(int i = 0; i < GcrCodec::DATA_FIELD_SIZE; ++i)
+    {
+        for(int value = 0; value < 256; ++value)
+        {
+            uint8_t damaged[GcrCodec::DATA_FIELD_SIZE];
+            std::memcpy(damaged, encoded, sizeof(damaged));
+
+            if(damaged[i] == value)
+                continue;
+
+            damaged[i] = value;
+            passed = passed && !GcrCodec::Decode62(damaged, decoded);
+        }
+    }
+
+    check("6 and 2 rejects every single byte corruption", passed);
+}
+
+/**
+ * Whole tracks round trip in both sector orders, on every track number, and
+ * only sectors on the right track are decoded.
+ *
+ * @param name What's being tested.
+ * @param sector_trans The sector order.
+ */
+static void test_track(const char *name, const uint8_t *sector_trans)
+{
+    std::mt19937 rng(2);
+    bool passed = true;
+
+    static uint8_t data[TRACK_SIZE];
+    static uint8_t decoded[TRACK_SIZE];
+    static uint8_t nibbles[GcrCodec::ENCODED_TRACK_SIZE * 2];
+
+    for(int track_num = 0; track_num < 35; ++track_num)
+    {
+        for(uint8_t &byte : data)
+            byte = rng() & 0xFF;
+
+        uint8_t *end = GcrCodec::EncodeTrack(nibbles,
+                                             254,
+                                             track_num,
+                                             data,
+                                             sector_trans);
+
+        passed = passed && (end - nibbles) == GcrCodec::ENCODED_TRACK_SIZE;
+
+        for(int i = 0; i < GcrCodec::ENCODED_TRACK_SIZE; ++i)
+            passed = passed && is_valid_disk_byte(nibbles[i]);
+
+        /**
+         * The decoder reads two revolutions of the track.
+         */
+        std::memcpy(nibbles + GcrCodec::ENCODED_TRACK_SIZE,
+                    nibbles,
+                    GcrCodec::ENCODED_TRACK_SIZE);
+
+        std::memset(decoded, 0, sizeof(decoded));
+        const uint16_t sectors = GcrCodec::DecodeTrack(nibbles,
+                                                       sizeof(nibbles),
+                                                       track_num,
+                                                       sector_trans,
+                                                       decoded);
+
+        passed = passed && sectors == 0xFFFF &&
+                 std::memcmp(data, decoded, sizeof(data)) == 0;
+
+        passed = passed && GcrCodec::DecodeTrack(nibbles,
+                                                 sizeof(nibbles),
+                                                 track_num + 1,
+                                                 sector_trans,
+                                                 decoded) == 0;
+    }
+
+    check(name, passed);
+}
+
+/**
+ * Print how long an operation takes on average.
+ *
+ * @param name The operation.
+ * @param start When the runs started.
+ * @param runs Number of times the operation ran.
+ */
+static void report(const char *name,
+                   std::chrono::steady_clock::time_point start,
+                   int runs)
+{
+    using namespace std::chrono;
+
+    const double total = duration<double, std::micro>(steady_clock::now() -
+                                                      start).count();
+
+    std::printf("%-48s %8.3f us\n", name, total / runs);
+}
+
+/**
+ * Time encoding and decoding sectors and tracks.
+ */
+static void benchmark()
+{
+    using namespace std::chrono;
+
+    std::mt19937 rng(3);
+
+    static uint8_t data[TRACK_SIZE];
+    static uint8_t decoded[TRACK_SIZE];
+    static uint8_t nibbles[GcrCodec::ENCODED_TRACK_SIZE * 2];
+
+    for(uint8_t &byte : data)
+        byte = rng() & 0xFF;
+
+    /**
+     * Summed into the output so the work can't be optimized away.
+     */
+    uint32_t sink = 0;
+
+    steady_clock::time_point start = steady_clock::now();
+    for(int i = 0; i < BENCH_SECTOR_RUNS; ++i)
+    {
+        GcrCodec::Encode62(nibbles, data + ((i & 15) * GcrCodec::SECTOR_SIZE));
+        sink += nibbles[i % GcrCodec::DATA_FIELD_SIZE];
+    }
+    report("Encode62 (per sector)", start, BENCH_SECTOR_RUNS);
+
+    start = steady_clock::now();
+    for(int i = 0; i < BENCH_SECTOR_RUNS; ++i)
+        sink += GcrCodec::Decode62(nibbles, decoded);
+    report("Decode62 (per sector)", start, BENCH_SECTOR_RUNS);
+
+    start = steady_clock::now();
+    for(int i = 0; i < BENCH_TRACK_RUNS; ++i)
+    {
+        GcrCodec::EncodeTrack(nibbles, 254, i % 35, data, dos_sector_trans);
+        sink += nibbles[i % GcrCodec::ENCODED_TRACK_SIZE];
+    }
+    report("EncodeTrack (per track)", start, BENCH_TRACK_RUNS);
+
+    GcrCodec::EncodeTrack(nibbles, 254, 0, data, dos_sector_trans);
+    std::memcpy(nibbles + GcrCodec::ENCODED_TRACK_SIZE,
+                nibbles,
+                GcrCodec::ENCODED_TRACK_SIZE);
+
+    start = steady_clock::now();
+    for(int i = 0; i < BENCH_TRACK_RUNS; ++i)
+    {
+        sink += GcrCodec::DecodeTrack(nibbles,
+                                      sizeof(nibbles),
+                                      0,
+                                      dos_sector_trans,
+                                      decoded);
+    }
+    report("DecodeTrack (per track)", start, BENCH_TRACK_RUNS);
+
+    std::printf("(checksum %u)\n", sink);
+}
+
+/**
+ * Run every test, then the benchmark.
+ *
+ * @return The number of tests that failed.
+ */
+int main()
+{
+    test_44();
+    test_62_byte_values();
+    test_62_random();
+    test_track("Track round trip, DOS 3.3 order", dos_sector_trans);
+    test_track("Track round trip, ProDOS order", prodos_sector_trans);
+
+    std::printf("\n");
+    benchmark();
+
+    return num_failed;
+}
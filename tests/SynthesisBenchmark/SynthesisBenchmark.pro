@@ -0,0 +1,25 @@
+QT -= core gui
+
+CONFIG += c++11 warn_on console
+CONFIG -= app_bundle
+OBJECTS_DIR = build
+DESTDIR = build
+
+TARGET = SynthesisBenchmark
+
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../Ay38910.cpp \
+    ../../BlipBuffer.cpp \
+    ../../StateReader.cpp \
+    ../../StateWriter.cpp
+
+HEADERS += \
+    ../../Ay38910.h \
+    ../../BlipBuffer.h \
+    ../../IState.h \
+    ../../StateReader.h \
+    ../../StateWriter.h
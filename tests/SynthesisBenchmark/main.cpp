@@ -0,0 +1,179 @@
+/**
+ * Benchmark for the Mockingboard's sound synthesis: how much host time it
+ * takes to synthesize one emulated second of audio from the card's two
+ * AY-3-8910s, the same way the card does every frame (register writes, the
+ * rest of the frame, then reading the samples out).
+ *
+ * Each scenario is timed separately, since the synthesis cost depends on how
+ * many edges the audible generators produce rather than on the sample rate.
+ */
+#include "Ay38910.h"
+#include "BlipBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+
+/**
+ * The emulated CPU clock (which also clocks the sound chips), the frame rate
+ * and the sample rate the audio is synthesized at.
+ */
+static constexpr uint32_t CPU_FREQ = 1023000;
+static constexpr int FPS = 60;
+static constexpr int SAMPLE_RATE = 48000;
+static constexpr uint32_t CYCLES_PER_FRAME = CPU_FREQ / FPS;
+
+/**
+ * Number of sound chips on the card, and emulated seconds per scenario.
+ */
+static constexpr int NUM_CHIPS = 2;
+static constexpr int NUM_SECONDS = 60;
+
+/**
+ * Register writes made by a scenario every frame. Spread evenly over the
+ * frame, alternating between the chips.
+ */
+struct RegisterWrite
+{
+    uint8_t reg;
+    uint8_t data;
+};
+
+/**
+ * A scenario: the registers every chip starts with, and what gets written
+ * every frame (the data is offset by the frame number, so tones and
+ * envelopes keep changing).
+ */
+struct Scenario
+{
+    const char *name;
+    uint8_t regs[Ay38910::REG_PORT_A];
+    int num_writes;
+    RegisterWrite writes[16];
+};
+
+static const Scenario scenarios[] = {
+    {
+        "Silent (all channels off)",
+        { 0, 0, 0, 0, 0, 0, 0, 0x3F, 0, 0, 0, 0, 0, 0 },
+        0,
+        { }
+    },
+    {
+        "Three tones per chip",
+        { 0x40, 0x01, 0xC0, 0x00, 0x80, 0x00, 0, 0x38, 15, 15, 15, 0, 0, 0 },
+        0,
+        { }
+    },
+    {
+        "Tone, noise and envelope, 16 writes per frame",
+        { 0x40, 0x01, 0xC0, 0x00, 0x80, 0x00, 0x08, 0x00, 0x10, 0x10, 15,
+          0x00, 0x02, 0x0E },
+        16,
+        {
+            { Ay38910::REG_TONE_A_FINE, 0x40 },
+            { Ay38910::REG_TONE_B_FINE, 0xC0 },
+            { Ay38910::REG_TONE_C_FINE, 0x80 },
+            { Ay38910::REG_AMPLITUDE_C, 12 },
+            { Ay38910::REG_NOISE_PERIOD, 0x04 },
+            { Ay38910::REG_TONE_A_COARSE, 0x01 },
+            { Ay38910::REG_AMPLITUDE_C, 15 },
+            { Ay38910::REG_ENV_FINE, 0x80 },
+            { Ay38910::REG_TONE_A_FINE, 0x48 },
+            { Ay38910::REG_TONE_B_FINE, 0xB0 },
+            { Ay38910::REG_TONE_C_FINE, 0x70 },
+            { Ay38910::REG_AMPLITUDE_C, 10 },
+            { Ay38910::REG_NOISE_PERIOD, 0x08 },
+            { Ay38910::REG_TONE_B_COARSE, 0x00 },
+            { Ay38910::REG_AMPLITUDE_C, 15 },
+            { Ay38910::REG_ENV_SHAPE, 0x0E }
+        }
+    }
+};
+
+/**
+ * Write a register the way the card does: latch the address, then write.
+ *
+ * @param psg The sound chip.
+ * @param reg The register.
+ * @param data The value to write.
+ */
+static void write_register(Ay38910 &psg, uint8_t reg, uint8_t data)
+{
+    psg.LatchAddress(reg);
+    psg.Write(data);
+}
+
+/**
+ * Synthesize a scenario and report how long it took per emulated second.
+ *
+ * @param scenario The scenario to run.
+ */
+static void run_scenario(const Scenario &scenario)
+{
+    using namespace std::chrono;
+
+    Ay38910 psg[NUM_CHIPS];
+    BlipBuffer blip;
+    blip.SetRates(CPU_FREQ, SAMPLE_RATE);
+
+    for(int chip = 0; chip < NUM_CHIPS; ++chip)
+    {
+        for(int reg = 0; reg < Ay38910::REG_PORT_A; ++reg)
+            write_register(psg[chip], reg, scenario.regs[reg]);
+    }
+
+    static int16_t samples[BlipBuffer::MAX_SAMPLES];
+
+    /**
+     * Summed into the output so the work can't be optimized away.
+     */
+    int64_t sink = 0;
+    int64_t num_samples = 0;
+
+    const steady_clock::time_point start = steady_clock::now();
+
+    for(int frame = 0; frame < NUM_SECONDS * FPS; ++frame)
+    {
+        for(int i = 0; i < scenario.num_writes; ++i)
+        {
+            const RegisterWrite &write = scenario.writes[i];
+            Ay38910 &chip = psg[i % NUM_CHIPS];
+
+            chip.RunUntil((CYCLES_PER_FRAME * i) / scenario.num_writes, blip);
+            write_register(chip, write.reg, write.data + (frame & 7));
+        }
+
+        for(int chip = 0; chip < NUM_CHIPS; ++chip)
+            psg[chip].EndFrame(CYCLES_PER_FRAME, blip);
+
+        blip.EndFrame(CYCLES_PER_FRAME);
+
+        const int count = blip.ReadSamples(samples, BlipBuffer::MAX_SAMPLES);
+        sink += samples[count / 2];
+        num_samples += count;
+    }
+
+    const double total = duration<double, std::milli>(steady_clock::now() -
+                                                      start).count();
+
+    std::printf("%-48s %7.3f ms per emulated second (%.3f%% of real time, "
+                "%lld samples, checksum %lld)\n",
+                scenario.name,
+                total / NUM_SECONDS,
+                (total / NUM_SECONDS) / 10.0,
+                static_cast<long long>(num_samples),
+                static_cast<long long>(sink));
+}
+
+/**
+ * Run every scenario.
+ *
+ * @return Always zero (this only measures, it doesn't check anything).
+ */
+int main()
+{
+    for(const Scenario &scenario : scenarios)
+        run_scenario(scenario);
+
+    return 0;
+}